@@ -0,0 +1,240 @@
+// Host shim for the parts of the ESP32 Arduino core the firmware uses.
+// millis()/micros() run on the virtual clock in host.h; Serial goes to
+// stdout and reads from a queue the host feeds; FreeRTOS tasks are threads.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+#define SERIAL_8N1 0x800001c
+#define PGM_P const char *
+#define PROGMEM
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::isfinite;
+using std::isnan;
+using std::max;
+using std::min;
+
+class String {
+ public:
+  String() {}
+  String(const char *c) : s_(c ? c : "") {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+  String(double v, unsigned int decimals = 2) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s_ = buf;
+  }
+
+  size_t length() const { return s_.size(); }
+  const char *c_str() const { return s_.c_str(); }
+  char operator[](size_t i) const { return i < s_.size() ? s_[i] : '\0'; }
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  String &operator+=(const char *o) { s_ += o; return *this; }
+  String &operator+=(char o) { s_ += o; return *this; }
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  bool operator!=(const String &o) const { return s_ != o.s_; }
+  bool operator==(const char *o) const { return s_ == o; }
+  bool equals(const char *o) const { return s_ == o; }
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(s_.c_str(), nullptr); }
+  bool startsWith(const char *p) const { return s_.rfind(p, 0) == 0; }
+  int indexOf(char c) const {
+    const size_t p = s_.find(c);
+    return p == std::string::npos ? -1 : static_cast<int>(p);
+  }
+  String substring(size_t from, size_t to = std::string::npos) const {
+    if (from > s_.size()) {
+      return String();
+    }
+    return String(s_.substr(from, to == std::string::npos ? to : to - from));
+  }
+  void trim() {
+    const size_t a = s_.find_first_not_of(" \t\r\n");
+    const size_t b = s_.find_last_not_of(" \t\r\n");
+    s_ = (a == std::string::npos) ? std::string() : s_.substr(a, b - a + 1);
+  }
+  bool reserve(size_t n) { s_.reserve(n); return true; }
+  const std::string &str() const { return s_; }
+
+ private:
+  std::string s_;
+};
+
+inline String operator+(const String &a, const String &b) { return String(a.str() + b.str()); }
+inline String operator+(const char *a, const String &b) { return String(std::string(a) + b.str()); }
+inline String operator+(const String &a, const char *b) { return String(a.str() + b); }
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *data, size_t n) {
+    size_t k = 0;
+    while (n--) {
+      k += write(*data++);
+    }
+    return k;
+  }
+  size_t write(const char *s) { return write(reinterpret_cast<const uint8_t *>(s), strlen(s)); }
+  size_t write(const char *s, size_t n) { return write(reinterpret_cast<const uint8_t *>(s), n); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int v, int = 10) { return printf("%d", v); }
+  size_t print(unsigned v, int = 10) { return printf("%u", v); }
+  size_t print(long v, int = 10) { return printf("%ld", v); }
+  size_t print(unsigned long v, int = 10) { return printf("%lu", v); }
+  size_t print(unsigned char v, int = 10) { return printf("%u", v); }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+  template <typename T>
+  size_t println(T v) { return print(v) + write("\r\n"); }
+  template <typename T>
+  size_t println(T v, int digits) { return print(v, digits) + write("\r\n"); }
+  size_t println() { return write("\r\n"); }
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  virtual void flush() {}
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  void setTimeout(unsigned long) {}
+  size_t readBytes(uint8_t *buf, size_t n) {
+    size_t k = 0;
+    while (k < n && available() > 0) {
+      buf[k++] = static_cast<uint8_t>(read());
+    }
+    return k;
+  }
+  size_t readBytes(char *buf, size_t n) { return readBytes(reinterpret_cast<uint8_t *>(buf), n); }
+};
+
+// UART 0 is the console (stdout); other ports record what the firmware
+// writes. Received bytes are queued by the host and, when a baud rate is
+// set, arrive at that rate on the virtual clock into an RX buffer of
+// setRxBufferSize() bytes; bytes that do not fit are dropped as the
+// hardware FIFO would.
+class HardwareSerial : public Stream {
+ public:
+  explicit HardwareSerial(int port = 0) : port_(port) {}
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx = -1, int8_t tx = -1);
+  void end() {}
+  size_t setRxBufferSize(size_t n) { rx_cap_ = n; return n; }
+  operator bool() const { return true; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t n) override;
+  using Print::write;
+
+  // Host side.
+  void host_feed(const uint8_t *data, size_t n);
+  void host_feed(const char *text) { host_feed(reinterpret_cast<const uint8_t *>(text), strlen(text)); }
+  size_t host_pending();
+  std::string host_take_tx();
+  uint32_t host_rx_dropped() const { return rx_dropped_; }
+  void host_reset();
+
+ private:
+  void pump();
+
+  int port_;
+  unsigned long baud_ = 0;
+  size_t rx_cap_ = 256;
+  std::deque<uint8_t> in_flight_;
+  std::deque<uint8_t> rx_;
+  uint64_t arrive_from_ms_ = 0;
+  uint64_t arrived_ = 0;
+  uint32_t rx_dropped_ = 0;
+  std::string tx_;
+  std::mutex mu_;
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void yield();
+long random(long max_value);
+long random(long min_value, long max_value);
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  const long run = in_max - in_min;
+  return run == 0 ? -1 : (x - in_min) * (out_max - out_min) / run + out_min;
+}
+
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+  const size_t len = strlen(src);
+  if (size > 0) {
+    const size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+
+static const size_t HOST_HEAP_BYTES = 320 * 1024;
+
+class EspClass {
+ public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+  // A HOST_HEAP_BYTES heap minus the live bytes of operator new and of
+  // malloc() calls linked into the program; the host has no fragmentation,
+  // so the largest block is the free heap.
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+  void restart();
+};
+
+extern EspClass ESP;
+
+inline bool psramFound() { return true; }
+inline void *ps_malloc(size_t n) { return malloc(n); }
+
+// FreeRTOS: tasks run as detached threads; vTaskDelay sleeps real time.
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   unsigned priority, TaskHandle_t *handle, int core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t handle);
+
+#include "host.h"
@@ -0,0 +1,262 @@
+// Host shim for the ArduinoJson 7 subset the firmware uses: a document
+// tree with lazy member creation on write, `variant | default` reads,
+// deserializeJson() and serializeJson() to a Print. The allocator passed to
+// JsonDocument is accepted and not used; nodes live in the document.
+#pragma once
+
+#include <Arduino.h>
+
+#include <deque>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ArduinoJson {
+
+class Allocator {
+ public:
+  virtual void *allocate(size_t size) = 0;
+  virtual void deallocate(void *ptr) = 0;
+  virtual void *reallocate(void *ptr, size_t new_size) = 0;
+
+ protected:
+  ~Allocator() = default;
+};
+
+namespace detail {
+
+struct Node {
+  enum Type { Null, Bool, Int, Float, String, Array, Object } type = Null;
+  bool b = false;
+  int64_t i = 0;
+  double f = 0.0;
+  bool is_float32 = false;
+  std::string s;
+  std::vector<Node *> items;
+  std::vector<std::pair<std::string, Node *>> members;
+};
+
+struct Pool {
+  std::deque<Node> nodes;
+  Node *make() {
+    nodes.emplace_back();
+    return &nodes.back();
+  }
+};
+
+} // namespace detail
+} // namespace ArduinoJson
+
+class JsonArray;
+class JsonObject;
+
+// A slot in a document. Reading a missing member or element yields a null
+// variant; writing through one creates it (objects by key, arrays append).
+class JsonVariant {
+ public:
+  JsonVariant() {}
+  JsonVariant(ArduinoJson::detail::Pool *pool, ArduinoJson::detail::Node *node) : pool_(pool), node_(node) {}
+
+  JsonVariant operator[](const char *key) const;
+  JsonVariant operator[](const String &key) const { return (*this)[key.c_str()]; }
+  JsonVariant operator[](int index) const;
+  JsonVariant operator[](size_t index) const { return (*this)[static_cast<int>(index)]; }
+
+  JsonVariant &operator=(bool v) { set_bool(v); return *this; }
+  JsonVariant &operator=(const char *v) { set_string(v); return *this; }
+  JsonVariant &operator=(char *v) { set_string(v); return *this; }
+  JsonVariant &operator=(const String &v) { set_string(v.c_str()); return *this; }
+  JsonVariant &operator=(float v) { set_float(v, true); return *this; }
+  JsonVariant &operator=(double v) { set_float(v, false); return *this; }
+  template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+  JsonVariant &operator=(T v) { set_int(static_cast<int64_t>(v)); return *this; }
+
+  template <typename T>
+  T as() const;
+  template <typename T>
+  bool is() const;
+
+  bool isNull() const { return node_ == nullptr || node_->type == ArduinoJson::detail::Node::Null; }
+  size_t size() const;
+
+  template <typename T>
+  bool add(const T &v) {
+    JsonVariant slot = append();
+    if (slot.node_ == nullptr) {
+      return false;
+    }
+    slot = v;
+    return true;
+  }
+  bool add(const char *v) {
+    JsonVariant slot = append();
+    slot = v;
+    return slot.node_ != nullptr;
+  }
+  JsonArray createNestedArray() const;
+  JsonObject createNestedObject() const;
+  JsonArray createNestedArray(const char *key) const;
+  JsonObject createNestedObject(const char *key) const;
+
+  ArduinoJson::detail::Node *node() const { return node_; }
+  ArduinoJson::detail::Pool *pool() const { return pool_; }
+
+ protected:
+  ArduinoJson::detail::Node *make_array() const;
+  ArduinoJson::detail::Node *make_object() const;
+  JsonVariant append() const;
+  void set_bool(bool v);
+  void set_int(int64_t v);
+  void set_float(double v, bool is_float32);
+  void set_string(const char *v);
+
+  ArduinoJson::detail::Pool *pool_ = nullptr;
+  ArduinoJson::detail::Node *node_ = nullptr;
+  // Missing member: where to create it on write.
+  ArduinoJson::detail::Node *parent_ = nullptr;
+  std::string key_;
+};
+
+class JsonArray : public JsonVariant {
+ public:
+  JsonArray() {}
+  JsonArray(const JsonVariant &v)
+      : JsonVariant(v.node() != nullptr && v.node()->type == ArduinoJson::detail::Node::Array ? v : JsonVariant()) {}
+  bool isNull() const { return node_ == nullptr; }
+};
+
+class JsonObject : public JsonVariant {
+ public:
+  JsonObject() {}
+  JsonObject(const JsonVariant &v)
+      : JsonVariant(v.node() != nullptr && v.node()->type == ArduinoJson::detail::Node::Object ? v : JsonVariant()) {}
+  bool isNull() const { return node_ == nullptr; }
+};
+
+template <>
+inline bool JsonVariant::is<bool>() const {
+  return node_ != nullptr && node_->type == ArduinoJson::detail::Node::Bool;
+}
+template <>
+inline bool JsonVariant::is<const char *>() const {
+  return node_ != nullptr && node_->type == ArduinoJson::detail::Node::String;
+}
+template <>
+inline bool JsonVariant::is<float>() const {
+  return node_ != nullptr &&
+         (node_->type == ArduinoJson::detail::Node::Float || node_->type == ArduinoJson::detail::Node::Int);
+}
+template <>
+inline bool JsonVariant::is<double>() const {
+  return is<float>();
+}
+template <>
+inline bool JsonVariant::is<JsonArray>() const {
+  return node_ != nullptr && node_->type == ArduinoJson::detail::Node::Array;
+}
+template <>
+inline bool JsonVariant::is<JsonObject>() const {
+  return node_ != nullptr && node_->type == ArduinoJson::detail::Node::Object;
+}
+template <typename T>
+inline bool JsonVariant::is() const {
+  static_assert(std::is_integral<T>::value, "unsupported type");
+  if (node_ == nullptr || node_->type != ArduinoJson::detail::Node::Int) {
+    return false;
+  }
+  return node_->i >= static_cast<int64_t>(std::numeric_limits<T>::min()) &&
+         (node_->i < 0 || static_cast<uint64_t>(node_->i) <= static_cast<uint64_t>(std::numeric_limits<T>::max()));
+}
+
+template <>
+inline bool JsonVariant::as<bool>() const {
+  return is<bool>() && node_->b;
+}
+template <>
+inline const char *JsonVariant::as<const char *>() const {
+  return is<const char *>() ? node_->s.c_str() : nullptr;
+}
+template <>
+inline double JsonVariant::as<double>() const {
+  if (node_ == nullptr) {
+    return 0.0;
+  }
+  if (node_->type == ArduinoJson::detail::Node::Float) {
+    return node_->f;
+  }
+  return node_->type == ArduinoJson::detail::Node::Int ? static_cast<double>(node_->i) : 0.0;
+}
+template <>
+inline float JsonVariant::as<float>() const {
+  return static_cast<float>(as<double>());
+}
+template <>
+inline JsonArray JsonVariant::as<JsonArray>() const {
+  return JsonArray(*this);
+}
+template <>
+inline JsonObject JsonVariant::as<JsonObject>() const {
+  return JsonObject(*this);
+}
+template <typename T>
+inline T JsonVariant::as() const {
+  static_assert(std::is_integral<T>::value, "unsupported type");
+  if (node_ == nullptr) {
+    return 0;
+  }
+  if (node_->type == ArduinoJson::detail::Node::Float) {
+    return static_cast<T>(node_->f);
+  }
+  return node_->type == ArduinoJson::detail::Node::Int ? static_cast<T>(node_->i) : 0;
+}
+
+template <typename T>
+inline T operator|(const JsonVariant &v, const T &fallback) {
+  return v.is<T>() ? v.as<T>() : fallback;
+}
+inline const char *operator|(const JsonVariant &v, const char *fallback) {
+  return v.is<const char *>() ? v.as<const char *>() : fallback;
+}
+
+class JsonDocument : public JsonVariant {
+ public:
+  JsonDocument() { reset(); }
+  explicit JsonDocument(ArduinoJson::Allocator *) { reset(); }
+  JsonDocument(const JsonDocument &) = delete;
+  JsonDocument &operator=(const JsonDocument &) = delete;
+
+  void clear() { reset(); }
+  bool overflowed() const { return false; }
+  using JsonVariant::operator[];
+
+ private:
+  void reset() {
+    store_.nodes.clear();
+    pool_ = &store_;
+    node_ = store_.make();
+  }
+
+  ArduinoJson::detail::Pool store_;
+};
+
+class DeserializationError {
+ public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+  DeserializationError(Code code = Ok) : code_(code) {}
+  explicit operator bool() const { return code_ != Ok; }
+  Code code() const { return code_; }
+  const char *c_str() const;
+
+ private:
+  Code code_;
+};
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *input, size_t len);
+DeserializationError deserializeJson(JsonDocument &doc, const char *input);
+DeserializationError deserializeJson(JsonDocument &doc, const String &input);
+size_t serializeJson(const JsonVariant &v, Print &out);
+size_t serializeJson(const JsonVariant &v, String &out);
+size_t serializeJson(const JsonVariant &v, char *out, size_t cap);
+size_t measureJson(const JsonVariant &v);
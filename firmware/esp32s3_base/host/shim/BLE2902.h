@@ -0,0 +1,10 @@
+// Client Characteristic Configuration descriptor (notifications on/off).
+#pragma once
+
+#include <BLEDevice.h>
+
+class BLE2902 : public BLEDescriptor {
+ public:
+  void setNotifications(bool) {}
+  void setIndications(bool) {}
+};
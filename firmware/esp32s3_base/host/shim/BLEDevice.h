@@ -0,0 +1,155 @@
+// Host shim for the Bluedroid BLE classes, run in-process: the host plays
+// the central through host_ble_*(), writes land in onWrite() on the calling
+// thread and notifications go to host_ble_on_notify. The link can be given
+// a limited number of controller buffers (host_ble_link()); notifications
+// then wait in them for host_ble_deliver() and the GATTS handler sees the
+// same CONF/CONGEST events as on the device.
+#pragma once
+
+#include <Arduino.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class BLEServer;
+class BLECharacteristic;
+
+class BLEUUID {
+ public:
+  BLEUUID(const char *uuid) : uuid_(uuid) {}
+  const std::string &toString() const { return uuid_; }
+
+ private:
+  std::string uuid_;
+};
+
+class BLEDescriptor {
+ public:
+  virtual ~BLEDescriptor() {}
+};
+
+class BLECharacteristicCallbacks {
+ public:
+  enum Status { SUCCESS_INDICATE, SUCCESS_NOTIFY, ERROR_INDICATE_DISABLED, ERROR_NOTIFY_DISABLED, ERROR_GATT,
+                ERROR_NO_CLIENT, ERROR_INDICATE_TIMEOUT, ERROR_INDICATE_FAILURE };
+  virtual ~BLECharacteristicCallbacks() {}
+  virtual void onRead(BLECharacteristic *characteristic) {}
+  virtual void onWrite(BLECharacteristic *characteristic) {}
+  virtual void onNotify(BLECharacteristic *characteristic) {}
+  virtual void onStatus(BLECharacteristic *characteristic, Status s, uint32_t code) {}
+};
+
+class BLECharacteristic {
+ public:
+  static const uint32_t PROPERTY_READ = 1 << 0;
+  static const uint32_t PROPERTY_WRITE = 1 << 1;
+  static const uint32_t PROPERTY_NOTIFY = 1 << 2;
+  static const uint32_t PROPERTY_BROADCAST = 1 << 3;
+  static const uint32_t PROPERTY_INDICATE = 1 << 4;
+  static const uint32_t PROPERTY_WRITE_NR = 1 << 5;
+
+  BLECharacteristic(const char *uuid, uint32_t properties) : uuid_(uuid), properties_(properties) {}
+
+  void setValue(const uint8_t *data, size_t len);
+  void setValue(uint8_t *data, size_t len) { setValue(static_cast<const uint8_t *>(data), len); }
+  void setValue(const char *value) { setValue(reinterpret_cast<const uint8_t *>(value), strlen(value)); }
+  void setValue(const std::string &value) { setValue(reinterpret_cast<const uint8_t *>(value.data()), value.size()); }
+  std::string getValue();
+  uint8_t *getData() { return value_.empty() ? nullptr : value_.data(); }
+  size_t getLength() { return value_.size(); }
+  void notify(bool is_notification = true);
+  void indicate() { notify(false); }
+  void setCallbacks(BLECharacteristicCallbacks *callbacks) { callbacks_ = callbacks; }
+  void addDescriptor(BLEDescriptor *descriptor) { descriptors_.push_back(descriptor); }
+  const std::string &uuid() const { return uuid_; }
+  BLECharacteristicCallbacks *callbacks() const { return callbacks_; }
+
+ private:
+  std::string uuid_;
+  uint32_t properties_;
+  std::vector<uint8_t> value_;
+  std::vector<BLEDescriptor *> descriptors_;
+  BLECharacteristicCallbacks *callbacks_ = nullptr;
+  std::mutex mu_;
+};
+
+class BLEService {
+ public:
+  explicit BLEService(const char *uuid) : uuid_(uuid) {}
+  BLECharacteristic *createCharacteristic(const char *uuid, uint32_t properties);
+  void start() {}
+
+ private:
+  std::string uuid_;
+};
+
+class BLEServerCallbacks {
+ public:
+  virtual ~BLEServerCallbacks() {}
+  virtual void onConnect(BLEServer *server) {}
+  virtual void onConnect(BLEServer *server, esp_ble_gatts_cb_param_t *param) {}
+  virtual void onDisconnect(BLEServer *server) {}
+  virtual void onMtuChanged(BLEServer *server, esp_ble_gatts_cb_param_t *param) {}
+};
+
+class BLEServer {
+ public:
+  BLEService *createService(const char *uuid) { return new BLEService(uuid); }
+  BLEService *createService(const char *uuid, uint32_t handles, uint8_t inst_id = 0) { return new BLEService(uuid); }
+  void setCallbacks(BLEServerCallbacks *callbacks) { callbacks_ = callbacks; }
+  BLEServerCallbacks *callbacks() const { return callbacks_; }
+  uint32_t getConnectedCount() const { return connected_; }
+  uint16_t getConnId() const { return 0; }
+  uint16_t getPeerMTU(uint16_t) const { return mtu_; }
+  void startAdvertising() {}
+
+ private:
+  friend void host_ble_connect(uint16_t mtu);
+  friend void host_ble_disconnect();
+  BLEServerCallbacks *callbacks_ = nullptr;
+  uint32_t connected_ = 0;
+  uint16_t mtu_ = 23;
+};
+
+class BLEAdvertising {
+ public:
+  void addServiceUUID(const char *) {}
+  void setScanResponse(bool) {}
+  void setMinPreferred(uint8_t) {}
+  void start() {}
+  void stop() {}
+};
+
+typedef void (*gatts_event_handler)(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
+                                    esp_ble_gatts_cb_param_t *param);
+
+class BLEDevice {
+ public:
+  static void init(const char *name);
+  static BLEServer *createServer();
+  static BLEAdvertising *getAdvertising();
+  static void startAdvertising() {}
+  static int setMTU(uint16_t mtu);
+  static uint16_t getMTU();
+  static bool getInitialized();
+  static void setCustomGattsHandler(gatts_event_handler handler);
+};
+
+// Host side (the central). Connect negotiates min(mtu, BLEDevice::setMTU()).
+void host_ble_connect(uint16_t mtu);
+void host_ble_disconnect();
+bool host_ble_write(const char *uuid, const uint8_t *data, size_t len);
+std::string host_ble_read(const char *uuid);
+extern std::function<void(const std::string &uuid, const std::string &value)> host_ble_on_notify;
+// Controller buffers for outgoing notifications; 0 (the default) sends each
+// one at once. When all are in use the link is congested (CONGEST_EVT) and
+// a further notify fails with GATT_CONGESTED and is lost.
+void host_ble_link(size_t buffers);
+// Send up to max queued notifications, each followed by its CONF_EVT;
+// returns how many went out.
+size_t host_ble_deliver(size_t max);
+size_t host_ble_queued();
+uint32_t host_ble_dropped();
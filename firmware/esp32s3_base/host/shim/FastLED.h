@@ -0,0 +1,196 @@
+// Host shim for the FastLED 3.7 subset the firmware uses. The color and
+// lib8tion math follows FastLED's portable C code so host renders match the
+// device bit for bit; controllers only hold a pixel pointer, and show()
+// hands every strip to the capture hook instead of a data pin.
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+#if defined(USE_GET_MILLISECOND_TIMER)
+uint32_t get_millisecond_timer();
+#define GET_MILLIS get_millisecond_timer
+#else
+#define GET_MILLIS millis
+#endif
+
+typedef uint8_t fract8;
+typedef uint16_t fract16;
+typedef uint16_t accum88;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+  return static_cast<uint8_t>((static_cast<uint16_t>(i) * (1 + static_cast<uint16_t>(scale))) >> 8);
+}
+
+inline uint8_t scale8_video(uint8_t i, fract8 scale) {
+  return static_cast<uint8_t>(((static_cast<int>(i) * static_cast<int>(scale)) >> 8) + ((i && scale) ? 1 : 0));
+}
+
+inline uint16_t scale16(uint16_t i, fract16 scale) {
+  return static_cast<uint16_t>((static_cast<uint32_t>(i) * (1 + static_cast<uint32_t>(scale))) >> 16);
+}
+
+inline uint8_t qadd8(uint8_t a, uint8_t b) {
+  const unsigned t = a + b;
+  return static_cast<uint8_t>(t > 255 ? 255 : t);
+}
+
+inline uint8_t qsub8(uint8_t a, uint8_t b) {
+  const int t = a - b;
+  return static_cast<uint8_t>(t < 0 ? 0 : t);
+}
+
+inline void nscale8x3(uint8_t &r, uint8_t &g, uint8_t &b, fract8 scale) {
+  const uint16_t s = 1 + static_cast<uint16_t>(scale);
+  r = static_cast<uint8_t>((r * s) >> 8);
+  g = static_cast<uint8_t>((g * s) >> 8);
+  b = static_cast<uint8_t>((b * s) >> 8);
+}
+
+uint8_t sin8(uint8_t theta);
+int16_t sin16(uint16_t theta);
+uint8_t random8();
+uint8_t random8(uint8_t lim);
+uint8_t random8(uint8_t min_value, uint8_t lim);
+uint16_t random16();
+uint16_t random16(uint16_t lim);
+void random16_set_seed(uint16_t seed);
+uint16_t random16_get_seed();
+void random16_add_entropy(uint16_t entropy);
+uint8_t beatsin8(accum88 bpm, uint8_t lowest = 0, uint8_t highest = 255, uint32_t timebase = 0,
+                 uint8_t phase_offset = 0);
+uint16_t beatsin16(accum88 bpm, uint16_t lowest = 0, uint16_t highest = 65535, uint32_t timebase = 0,
+                   uint16_t phase_offset = 0);
+
+struct CHSV {
+  union {
+    struct {
+      uint8_t hue;
+      uint8_t sat;
+      uint8_t val;
+    };
+    struct {
+      uint8_t h;
+      uint8_t s;
+      uint8_t v;
+    };
+    uint8_t raw[3];
+  };
+  CHSV() : hue(0), sat(0), val(0) {}
+  CHSV(uint8_t ih, uint8_t is, uint8_t iv) : hue(ih), sat(is), val(iv) {}
+};
+
+struct CRGB;
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb);
+
+struct CRGB {
+  union {
+    struct {
+      uint8_t r;
+      uint8_t g;
+      uint8_t b;
+    };
+    uint8_t raw[3];
+  };
+
+  enum HTMLColorCode : uint32_t { Black = 0x000000, White = 0xFFFFFF, Red = 0xFF0000, Green = 0x008000, Blue = 0x0000FF };
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  CRGB(uint32_t code) : r((code >> 16) & 0xFF), g((code >> 8) & 0xFF), b(code & 0xFF) {}
+  CRGB(HTMLColorCode code) : CRGB(static_cast<uint32_t>(code)) {}
+  CRGB(const CHSV &hsv) { hsv2rgb_rainbow(hsv, *this); }
+  CRGB &operator=(const CHSV &hsv) { hsv2rgb_rainbow(hsv, *this); return *this; }
+
+  uint8_t &operator[](uint8_t x) { return raw[x]; }
+  const uint8_t &operator[](uint8_t x) const { return raw[x]; }
+
+  CRGB &nscale8(uint8_t scale) { nscale8x3(r, g, b, scale); return *this; }
+  CRGB &fadeToBlackBy(uint8_t amount) { nscale8x3(r, g, b, 255 - amount); return *this; }
+  CRGB &operator+=(const CRGB &o) {
+    r = qadd8(r, o.r);
+    g = qadd8(g, o.g);
+    b = qadd8(b, o.b);
+    return *this;
+  }
+  CRGB &operator|=(const CRGB &o) {
+    r = max(r, o.r);
+    g = max(g, o.g);
+    b = max(b, o.b);
+    return *this;
+  }
+  bool operator==(const CRGB &o) const { return r == o.r && g == o.g && b == o.b; }
+  bool operator!=(const CRGB &o) const { return !(*this == o); }
+};
+
+inline CRGB operator+(const CRGB &a, const CRGB &b) {
+  CRGB out = a;
+  out += b;
+  return out;
+}
+
+CRGB HeatColor(uint8_t temperature);
+void fill_solid(CRGB *leds, int count, const CRGB &color);
+void fill_rainbow(CRGB *leds, int count, uint8_t initial_hue, uint8_t delta_hue = 5);
+
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER = RGB>
+class SK6812 {};
+
+class CLEDController {
+ public:
+  CLEDController &setLeds(CRGB *leds, int count) {
+    leds_ = leds;
+    count_ = count;
+    return *this;
+  }
+  CLEDController &setCorrection(const CRGB &) { return *this; }
+  CRGB *leds() { return leds_; }
+  int size() const { return count_; }
+  uint8_t pin() const { return pin_; }
+
+ private:
+  friend class CFastLED;
+  CRGB *leds_ = nullptr;
+  int count_ = 0;
+  uint8_t pin_ = 0;
+};
+
+// One show(): every controller's pixels (still in wire order) and the
+// global brightness, at the virtual time of the call.
+struct HostLedFrame {
+  uint64_t ms;
+  uint8_t brightness;
+  std::vector<const CLEDController *> strips;
+};
+
+class CFastLED {
+ public:
+  template <template <uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  CLEDController &addLeds(CRGB *leds, int count, int offset = 0) {
+    return add(DATA_PIN, leds + offset, count);
+  }
+  void setBrightness(uint8_t scale) { brightness_ = scale; }
+  uint8_t getBrightness() const { return brightness_; }
+  void show() { show(brightness_); }
+  void show(uint8_t scale);
+  void clear(bool write_data = false);
+  void setMaxRefreshRate(uint16_t, bool = false) {}
+  int count() const { return static_cast<int>(controllers_.size()); }
+  CLEDController &operator[](int x) { return *controllers_[x]; }
+
+  // Host side: called on every show(); frames counts them.
+  std::function<void(const HostLedFrame &)> host_on_show;
+  uint32_t host_frames = 0;
+
+ private:
+  CLEDController &add(uint8_t pin, CRGB *leds, int count);
+
+  std::vector<CLEDController *> controllers_;
+  uint8_t brightness_ = 255;
+};
+
+extern CFastLED FastLED;
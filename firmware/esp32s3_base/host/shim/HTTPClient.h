@@ -0,0 +1,36 @@
+// Host shim for HTTPClient: blocking HTTP/1.0 POST over a real socket to
+// an http://host:port/path URL, or to host_http_post when that is set.
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+// Test hook: handles every POST instead of the network; returns the status.
+extern std::function<int(const std::string &url, const std::string &body)> host_http_post;
+
+class HTTPClient {
+ public:
+  bool begin(const String &url) { return begin(url.c_str()); }
+  bool begin(const char *url);
+  void end() { headers_.clear(); }
+  void setTimeout(uint16_t ms) { timeout_ms_ = ms; }
+  void setConnectTimeout(int32_t ms) { timeout_ms_ = static_cast<uint32_t>(ms); }
+  void addHeader(const String &name, const String &value) { headers_.emplace_back(name.str(), value.str()); }
+  int POST(uint8_t *payload, size_t size);
+  int POST(const String &payload) { return POST(reinterpret_cast<uint8_t *>(const_cast<char *>(payload.c_str())), payload.length()); }
+
+ private:
+  std::string url_;
+  std::string host_;
+  uint16_t port_ = 80;
+  std::string path_;
+  uint32_t timeout_ms_ = 5000;
+  std::vector<std::pair<std::string, std::string>> headers_;
+};
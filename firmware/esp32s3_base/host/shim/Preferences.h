@@ -0,0 +1,52 @@
+// Host shim for Preferences (NVS). Keys are typed blobs per namespace; see
+// host_nvs_open() for file-backed storage.
+#pragma once
+
+#include <Arduino.h>
+
+class Preferences {
+ public:
+  bool begin(const char *name, bool read_only = false, const char *partition = nullptr);
+  void end() {}
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putUChar(const char *key, uint8_t v) { return put(key, 'u', &v, sizeof(v)); }
+  size_t putUShort(const char *key, uint16_t v) { return put(key, 'u', &v, sizeof(v)); }
+  size_t putUInt(const char *key, uint32_t v) { return put(key, 'u', &v, sizeof(v)); }
+  size_t putInt(const char *key, int32_t v) { return put(key, 'i', &v, sizeof(v)); }
+  size_t putULong(const char *key, uint32_t v) { return put(key, 'u', &v, sizeof(v)); }
+  size_t putFloat(const char *key, float v) { return put(key, 'f', &v, sizeof(v)); }
+  size_t putDouble(const char *key, double v) { return put(key, 'f', &v, sizeof(v)); }
+  size_t putString(const char *key, const char *v) { return put(key, 's', v, strlen(v) + 1) - 1; }
+  size_t putString(const char *key, const String &v) { return putString(key, v.c_str()); }
+  size_t putBytes(const char *key, const void *v, size_t len) { return put(key, 'b', v, len); }
+
+  uint8_t getUChar(const char *key, uint8_t fallback = 0) { return get_scalar(key, 'u', fallback); }
+  uint16_t getUShort(const char *key, uint16_t fallback = 0) { return get_scalar(key, 'u', fallback); }
+  uint32_t getUInt(const char *key, uint32_t fallback = 0) { return get_scalar(key, 'u', fallback); }
+  int32_t getInt(const char *key, int32_t fallback = 0) { return get_scalar(key, 'i', fallback); }
+  uint32_t getULong(const char *key, uint32_t fallback = 0) { return get_scalar(key, 'u', fallback); }
+  float getFloat(const char *key, float fallback = 0) { return get_scalar(key, 'f', fallback); }
+  double getDouble(const char *key, double fallback = 0) { return get_scalar(key, 'f', fallback); }
+  String getString(const char *key, const String fallback = String());
+  size_t getString(const char *key, char *out, size_t cap);
+  size_t getBytes(const char *key, void *out, size_t cap);
+  size_t getBytesLength(const char *key);
+
+ private:
+  size_t put(const char *key, char type, const void *data, size_t len);
+  // Copy a stored value of the given type and exact size; false if absent.
+  bool get(const char *key, char type, void *out, size_t len);
+
+  template <typename T>
+  T get_scalar(const char *key, char type, T fallback) {
+    T v;
+    return get(key, type, &v, sizeof(v)) ? v : fallback;
+  }
+
+  std::string ns_;
+  bool open_ = false;
+  bool read_only_ = false;
+};
@@ -0,0 +1,93 @@
+// Host shim for the core's WebServer: a real listener on 127.0.0.1 (see
+// host_http_port()), one request per connection. Request parsing, raw body
+// callbacks, the "plain" argument and chunked responses for
+// CONTENT_LENGTH_UNKNOWN follow the core's behavior.
+#pragma once
+
+#include <WiFi.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPRawStatus { RAW_START, RAW_WRITE, RAW_END, RAW_ABORTED };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+#define HTTP_RAW_BUFLEN 1436
+
+struct HTTPRaw {
+  HTTPRawStatus status;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_RAW_BUFLEN];
+  void *data;
+};
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit WebServer(int port = 80) : port_(port) {}
+  ~WebServer();
+
+  void begin();
+  void close();
+  void handleClient();
+  void on(const char *uri, HTTPMethod method, THandlerFunction fn) { on(uri, method, fn, nullptr); }
+  void on(const char *uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn);
+  void onNotFound(THandlerFunction fn) { not_found_ = fn; }
+
+  String uri() const { return String(uri_); }
+  HTTPMethod method() const { return method_; }
+  WiFiClient client() { return client_; }
+  HTTPRaw &raw() { return raw_; }
+
+  String arg(const String &name) const;
+  String arg(int i) const { return i < static_cast<int>(args_.size()) ? String(args_[i].second) : String(); }
+  int args() const { return static_cast<int>(args_.size()); }
+  bool hasArg(const String &name) const;
+  void collectHeaders(const char *header_keys[], size_t count);
+  String header(const String &name) const;
+  bool hasHeader(const String &name) const;
+
+  void setContentLength(size_t len) { content_length_ = len; }
+  void sendHeader(const String &name, const String &value, bool first = false);
+  void send(int code, const char *content_type = nullptr, const String &content = String());
+  void send(int code, const String &content_type, const String &content) {
+    send(code, content_type.c_str(), content);
+  }
+  void send(int code, const char *content_type, const char *content) { send(code, content_type, String(content)); }
+  void send_P(int code, PGM_P content_type, PGM_P content) { send(code, content_type, String(content)); }
+  void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char *content, size_t len);
+
+ private:
+  struct Route {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction ufn;
+  };
+
+  bool read_request();
+  void dispatch();
+  void write_all(const char *data, size_t len);
+
+  int port_;
+  int listen_fd_ = -1;
+  std::vector<Route> routes_;
+  THandlerFunction not_found_;
+  WiFiClient client_;
+  HTTPRaw raw_ = {};
+  HTTPMethod method_ = HTTP_GET;
+  std::string uri_;
+  std::vector<std::pair<std::string, std::string>> args_;
+  std::vector<std::string> header_keys_;
+  std::vector<std::pair<std::string, std::string>> headers_;
+  std::string body_;
+  std::string response_headers_;
+  size_t content_length_ = CONTENT_LENGTH_NOT_SET;
+  bool chunked_ = false;
+};
@@ -0,0 +1,64 @@
+// Host shim for WiFi: the radio is always "up" in AP mode; STA joins
+// succeed when host_wifi_sta() allows it. WiFiClient wraps a real socket,
+// shared between copies like the core's client handle.
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+
+typedef enum { WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_CONNECTED = 3, WL_CONNECT_FAILED = 4, WL_DISCONNECTED = 6 } wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+class IPAddress {
+ public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr_{a, b, c, d} {}
+  String toString() const;
+
+ private:
+  uint8_t addr_[4] = {0, 0, 0, 0};
+};
+
+class WiFiClient : public Stream {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+
+  uint8_t connected();
+  void stop() { sock_.reset(); }
+  int fd() const { return sock_ ? *sock_ : -1; }
+  int setNoDelay(bool nodelay);
+  operator bool() { return sock_ != nullptr; }
+
+  int available() override;
+  int read() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t n) override;
+  using Print::write;
+
+ private:
+  std::shared_ptr<int> sock_;
+};
+
+class WiFiClass {
+ public:
+  bool mode(wifi_mode_t m) { mode_ = m; return true; }
+  wifi_mode_t getMode() const { return mode_; }
+  bool softAP(const char *ssid, const char *pass = nullptr, int channel = 1, int hidden = 0, int max_conn = 4);
+  bool softAPdisconnect(bool wifioff = false);
+  wl_status_t begin(const char *ssid, const char *pass = nullptr);
+  wl_status_t status();
+  bool disconnect(bool wifioff = false);
+  IPAddress localIP() const { return IPAddress(127, 0, 0, 1); }
+  IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
+
+ private:
+  wifi_mode_t mode_ = WIFI_OFF;
+  bool sta_started_ = false;
+};
+
+extern WiFiClass WiFi;
+
+// Whether STA joins succeed (default: no, so the firmware stays in AP mode).
+void host_wifi_sta(bool reachable);
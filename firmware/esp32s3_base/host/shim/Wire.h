@@ -0,0 +1,53 @@
+// Host shim for Wire (I2C): no device answers unless a test installs a
+// register model through host_i2c.
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+// Register model: write(addr, bytes) returns the endTransmission() status,
+// read(addr, len) the bytes for requestFrom() (empty = NACK).
+struct HostI2cDevice {
+  std::function<uint8_t(uint8_t addr, const std::vector<uint8_t> &bytes)> write;
+  std::function<std::vector<uint8_t>(uint8_t addr, size_t len)> read;
+};
+
+extern HostI2cDevice host_i2c;
+
+class TwoWire : public Stream {
+ public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+  void setClock(uint32_t) {}
+  void beginTransmission(uint8_t addr) {
+    addr_ = addr;
+    tx_.clear();
+  }
+  size_t write(uint8_t c) override {
+    tx_.push_back(c);
+    return 1;
+  }
+  size_t write(const uint8_t *data, size_t n) override {
+    tx_.insert(tx_.end(), data, data + n);
+    return n;
+  }
+  uint8_t endTransmission(bool stop = true) { return host_i2c.write ? host_i2c.write(addr_, tx_) : 2; }
+  size_t requestFrom(uint8_t addr, size_t len, bool stop = true) {
+    rx_ = host_i2c.read ? host_i2c.read(addr, len) : std::vector<uint8_t>();
+    pos_ = 0;
+    return rx_.size();
+  }
+  int available() override { return static_cast<int>(rx_.size() - pos_); }
+  int read() override { return pos_ < rx_.size() ? rx_[pos_++] : -1; }
+  using Print::write;
+  using Stream::readBytes;
+
+ private:
+  uint8_t addr_ = 0;
+  std::vector<uint8_t> tx_;
+  std::vector<uint8_t> rx_;
+  size_t pos_ = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,289 @@
+// Arduino core shim: virtual clock, UARTs, FreeRTOS tasks, ESP class.
+#include <Arduino.h>
+#include <Wire.h>
+
+#include <atomic>
+#include <chrono>
+#include <malloc.h>
+#include <new>
+#include <thread>
+#include <sys/time.h>
+
+HardwareSerial Serial(0);
+EspClass ESP;
+TwoWire Wire;
+HostI2cDevice host_i2c;
+
+namespace {
+
+std::atomic<uint64_t> clock_ms{0};
+std::atomic<int64_t> clock_real_us{0}; // Real time of the last advance.
+std::atomic<bool> serial_capture{false};
+std::atomic<int64_t> unix_base{0};      // Unix seconds at unix_base_ms; 0 = unset.
+std::atomic<uint64_t> unix_base_ms{0};
+
+int64_t real_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+uint64_t host_now_ms() { return clock_ms.load(); }
+
+void host_set_ms(uint64_t ms) {
+  clock_ms.store(ms);
+  clock_real_us.store(real_us());
+}
+
+void host_advance_ms(uint64_t ms) { host_set_ms(clock_ms.load() + ms); }
+
+void host_set_unix(uint32_t unix_s) {
+  unix_base.store(unix_s);
+  unix_base_ms.store(clock_ms.load());
+}
+
+void host_serial_capture(bool on) { serial_capture.store(on); }
+
+unsigned long millis() { return static_cast<unsigned long>(static_cast<uint32_t>(clock_ms.load())); }
+
+unsigned long micros() {
+  const int64_t since = real_us() - clock_real_us.load();
+  const uint64_t sub = static_cast<uint64_t>(max<int64_t>(0, min<int64_t>(since, 999)));
+  return static_cast<unsigned long>(static_cast<uint32_t>(clock_ms.load() * 1000 + sub));
+}
+
+void delay(unsigned long ms) { host_advance_ms(ms); }
+void delayMicroseconds(unsigned int) {}
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+void yield() {}
+
+long random(long max_value) { return max_value <= 0 ? 0 : static_cast<long>(rand() % max_value); }
+
+long random(long min_value, long max_value) {
+  return max_value <= min_value ? min_value : min_value + random(max_value - min_value);
+}
+
+// Counts at getCpuFreqMHz() on real time, so cycle-based benchmarks in the
+// firmware report host microseconds.
+uint32_t EspClass::getCycleCount() { return static_cast<uint32_t>(real_us() * getCpuFreqMHz()); }
+
+// Heap accounting. malloc() and friends are wrapped at link time for the
+// firmware and shim objects; operator new is replaced for everything,
+// including the C++ library. Memory the C library allocates for itself and
+// frees itself is not seen, so the counters stay balanced.
+extern "C" void *__real_malloc(size_t n);
+extern "C" void *__real_calloc(size_t n, size_t size);
+extern "C" void *__real_realloc(void *p, size_t n);
+extern "C" void __real_free(void *p);
+
+namespace {
+
+std::atomic<int64_t> heap_live{0};
+std::atomic<int64_t> heap_peak{0};
+
+void *heap_note(void *p) {
+  if (p != nullptr) {
+    const int64_t live = heap_live += static_cast<int64_t>(malloc_usable_size(p));
+    int64_t peak = heap_peak.load();
+    while (live > peak && !heap_peak.compare_exchange_weak(peak, live)) {
+    }
+  }
+  return p;
+}
+
+void heap_forget(void *p) {
+  if (p != nullptr) {
+    heap_live -= static_cast<int64_t>(malloc_usable_size(p));
+  }
+}
+
+uint32_t heap_left(int64_t used) {
+  return static_cast<uint32_t>(max<int64_t>(0, static_cast<int64_t>(HOST_HEAP_BYTES) - used));
+}
+
+} // namespace
+
+uint32_t EspClass::getFreeHeap() { return heap_left(heap_live.load()); }
+uint32_t EspClass::getMinFreeHeap() { return heap_left(heap_peak.load()); }
+
+extern "C" void *__wrap_malloc(size_t n) { return heap_note(__real_malloc(n)); }
+extern "C" void *__wrap_calloc(size_t n, size_t size) { return heap_note(__real_calloc(n, size)); }
+
+extern "C" void *__wrap_realloc(void *p, size_t n) {
+  const int64_t old = p != nullptr ? static_cast<int64_t>(malloc_usable_size(p)) : 0;
+  void *q = __real_realloc(p, n);
+  if (q != nullptr || n == 0) {
+    heap_live -= old;
+    heap_note(q);
+  }
+  return q;
+}
+
+extern "C" void __wrap_free(void *p) {
+  heap_forget(p);
+  __real_free(p);
+}
+
+void *operator new(size_t n) {
+  void *p = heap_note(__real_malloc(n != 0 ? n : 1));
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { __wrap_free(p); }
+void operator delete[](void *p) noexcept { __wrap_free(p); }
+void operator delete(void *p, size_t) noexcept { __wrap_free(p); }
+void operator delete[](void *p, size_t) noexcept { __wrap_free(p); }
+
+void EspClass::restart() {
+  fflush(stdout);
+  printf("[host] ESP.restart()\n");
+  exit(0);
+}
+
+size_t Print::printf(const char *fmt, ...) {
+  char small[256];
+  va_list args;
+  va_start(args, fmt);
+  const int n = vsnprintf(small, sizeof(small), fmt, args);
+  va_end(args);
+  if (n < 0) {
+    return 0;
+  }
+  if (static_cast<size_t>(n) < sizeof(small)) {
+    return write(reinterpret_cast<const uint8_t *>(small), n);
+  }
+  std::string big(n + 1, '\0');
+  va_start(args, fmt);
+  vsnprintf(&big[0], big.size(), fmt, args);
+  va_end(args);
+  return write(reinterpret_cast<const uint8_t *>(big.data()), n);
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t, int8_t, int8_t) {
+  std::lock_guard<std::mutex> lock(mu_);
+  // The console is a USB CDC port: input arrives as fast as it is fed.
+  baud_ = (port_ == 0) ? 0 : baud;
+  arrive_from_ms_ = clock_ms.load();
+  arrived_ = 0;
+}
+
+void HardwareSerial::host_feed(const uint8_t *data, size_t n) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (in_flight_.empty()) {
+    arrive_from_ms_ = clock_ms.load();
+    arrived_ = 0;
+  }
+  in_flight_.insert(in_flight_.end(), data, data + n);
+}
+
+size_t HardwareSerial::host_pending() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return in_flight_.size() + rx_.size();
+}
+
+// Move bytes that have had time to arrive (10 bits per byte at baud_) into
+// the RX buffer, dropping what does not fit.
+void HardwareSerial::pump() {
+  uint64_t due = in_flight_.size();
+  if (baud_ > 0) {
+    const uint64_t total = (clock_ms.load() - arrive_from_ms_) * baud_ / 10000;
+    due = min<uint64_t>(due, total > arrived_ ? total - arrived_ : 0);
+  }
+  for (uint64_t i = 0; i < due; ++i) {
+    if (rx_.size() < rx_cap_ || baud_ == 0) {
+      rx_.push_back(in_flight_.front());
+    } else {
+      rx_dropped_++;
+    }
+    in_flight_.pop_front();
+    arrived_++;
+  }
+}
+
+int HardwareSerial::available() {
+  std::lock_guard<std::mutex> lock(mu_);
+  pump();
+  return static_cast<int>(rx_.size());
+}
+
+int HardwareSerial::read() {
+  std::lock_guard<std::mutex> lock(mu_);
+  pump();
+  if (rx_.empty()) {
+    return -1;
+  }
+  const int c = rx_.front();
+  rx_.pop_front();
+  return c;
+}
+
+int HardwareSerial::peek() {
+  std::lock_guard<std::mutex> lock(mu_);
+  pump();
+  return rx_.empty() ? -1 : rx_.front();
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t n) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (port_ == 0 && !serial_capture.load()) {
+    fwrite(data, 1, n, stdout);
+    return n;
+  }
+  tx_.append(reinterpret_cast<const char *>(data), n);
+  return n;
+}
+
+std::string HardwareSerial::host_take_tx() {
+  std::lock_guard<std::mutex> lock(mu_);
+  std::string out;
+  out.swap(tx_);
+  return out;
+}
+
+void HardwareSerial::host_reset() {
+  std::lock_guard<std::mutex> lock(mu_);
+  in_flight_.clear();
+  rx_.clear();
+  tx_.clear();
+  rx_dropped_ = 0;
+  arrived_ = 0;
+  arrive_from_ms_ = clock_ms.load();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void *arg, unsigned, TaskHandle_t *handle,
+                                   int) {
+  std::thread(fn, arg).detach();
+  if (handle != nullptr) {
+    *handle = nullptr;
+  }
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+
+// Tasks end by returning from their function after this.
+void vTaskDelete(TaskHandle_t) {}
+
+// Wall clock on the virtual clock (see host_set_unix()).
+extern "C" time_t __wrap_time(time_t *out) {
+  const int64_t base = unix_base.load();
+  const time_t now = (base == 0) ? 0 : static_cast<time_t>(base + (clock_ms.load() - unix_base_ms.load()) / 1000);
+  if (out != nullptr) {
+    *out = now;
+  }
+  return now;
+}
+
+extern "C" int __wrap_settimeofday(const struct timeval *tv, const void *) {
+  if (tv != nullptr) {
+    host_set_unix(static_cast<uint32_t>(tv->tv_sec));
+  }
+  return 0;
+}
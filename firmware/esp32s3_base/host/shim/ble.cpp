@@ -0,0 +1,240 @@
+// In-process BLE shim.
+#include <BLE2902.h>
+#include <BLEDevice.h>
+
+#include <deque>
+#include <map>
+
+std::function<void(const std::string &uuid, const std::string &value)> host_ble_on_notify;
+
+namespace {
+
+std::mutex registry_mu;
+std::map<std::string, BLECharacteristic *> characteristics;
+BLEServer *server = nullptr;
+BLEAdvertising advertising;
+bool initialized = false;
+uint16_t local_mtu = 23;
+gatts_event_handler gatts_handler = nullptr;
+
+struct Queued {
+  std::string uuid;
+  std::string value;
+};
+
+std::mutex link_mu;
+size_t link_buffers = 0;
+std::deque<Queued> link_queue;
+bool link_congested = false;
+uint32_t link_dropped = 0;
+
+void gatts_event(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t *param) {
+  if (gatts_handler != nullptr) {
+    gatts_handler(event, 3, param);
+  }
+}
+
+void send_conf() {
+  esp_ble_gatts_cb_param_t param = {};
+  param.conf.status = ESP_GATT_OK;
+  gatts_event(ESP_GATTS_CONF_EVT, &param);
+}
+
+void send_congest(bool congested) {
+  esp_ble_gatts_cb_param_t param = {};
+  param.congest.congested = congested;
+  gatts_event(ESP_GATTS_CONGEST_EVT, &param);
+}
+
+BLECharacteristic *find(const char *uuid) {
+  std::lock_guard<std::mutex> lock(registry_mu);
+  const auto it = characteristics.find(uuid);
+  return it == characteristics.end() ? nullptr : it->second;
+}
+
+} // namespace
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t, uint16_t) { return 0; }
+
+void BLECharacteristic::setValue(const uint8_t *data, size_t len) {
+  std::lock_guard<std::mutex> lock(mu_);
+  value_.assign(data, data + len);
+}
+
+std::string BLECharacteristic::getValue() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return std::string(value_.begin(), value_.end());
+}
+
+void BLECharacteristic::notify(bool) {
+  if (callbacks_ != nullptr) {
+    callbacks_->onNotify(this);
+  }
+  if (server == nullptr || server->getConnectedCount() == 0) {
+    if (callbacks_ != nullptr) {
+      callbacks_->onStatus(this, BLECharacteristicCallbacks::ERROR_NO_CLIENT, 0);
+    }
+    return;
+  }
+  bool queued = false;
+  bool refused = false;
+  bool congested = false;
+  {
+    std::lock_guard<std::mutex> lock(link_mu);
+    if (link_buffers > 0 && link_queue.size() >= link_buffers) {
+      refused = true;
+      link_dropped++;
+    } else if (link_buffers > 0) {
+      queued = true;
+      link_queue.push_back({uuid_, getValue()});
+      congested = link_queue.size() == link_buffers;
+      link_congested = link_congested || congested;
+    }
+  }
+  if (refused) {
+    if (callbacks_ != nullptr) {
+      callbacks_->onStatus(this, BLECharacteristicCallbacks::ERROR_GATT, ESP_GATT_CONGESTED);
+    }
+    return;
+  }
+  if (!queued && host_ble_on_notify) {
+    host_ble_on_notify(uuid_, getValue());
+  }
+  if (callbacks_ != nullptr) {
+    callbacks_->onStatus(this, BLECharacteristicCallbacks::SUCCESS_NOTIFY, 0);
+  }
+  if (!queued) {
+    send_conf();
+  } else if (congested) {
+    send_congest(true);
+  }
+}
+
+BLECharacteristic *BLEService::createCharacteristic(const char *uuid, uint32_t properties) {
+  BLECharacteristic *c = new BLECharacteristic(uuid, properties);
+  std::lock_guard<std::mutex> lock(registry_mu);
+  characteristics[uuid] = c;
+  return c;
+}
+
+void BLEDevice::init(const char *) { initialized = true; }
+
+BLEServer *BLEDevice::createServer() {
+  server = new BLEServer();
+  return server;
+}
+
+BLEAdvertising *BLEDevice::getAdvertising() { return &advertising; }
+
+int BLEDevice::setMTU(uint16_t mtu) {
+  local_mtu = mtu;
+  return 0;
+}
+
+uint16_t BLEDevice::getMTU() { return local_mtu; }
+bool BLEDevice::getInitialized() { return initialized; }
+void BLEDevice::setCustomGattsHandler(gatts_event_handler handler) { gatts_handler = handler; }
+
+void host_ble_connect(uint16_t mtu) {
+  if (server == nullptr) {
+    return;
+  }
+  server->connected_ = 1;
+  server->mtu_ = 23;
+  esp_ble_gatts_cb_param_t param = {};
+  if (server->callbacks() != nullptr) {
+    server->callbacks()->onConnect(server);
+    server->callbacks()->onConnect(server, &param);
+  }
+  server->mtu_ = min(mtu, local_mtu);
+  param.mtu.mtu = server->mtu_;
+  if (server->callbacks() != nullptr) {
+    server->callbacks()->onMtuChanged(server, &param);
+  }
+}
+
+void host_ble_disconnect() {
+  if (server == nullptr || server->connected_ == 0) {
+    return;
+  }
+  server->connected_ = 0;
+  {
+    std::lock_guard<std::mutex> lock(link_mu);
+    link_queue.clear();
+    link_congested = false;
+  }
+  if (server->callbacks() != nullptr) {
+    server->callbacks()->onDisconnect(server);
+  }
+}
+
+bool host_ble_write(const char *uuid, const uint8_t *data, size_t len) {
+  BLECharacteristic *c = find(uuid);
+  if (c == nullptr) {
+    return false;
+  }
+  c->setValue(data, len);
+  if (c->callbacks() != nullptr) {
+    c->callbacks()->onWrite(c);
+  }
+  return true;
+}
+
+std::string host_ble_read(const char *uuid) {
+  BLECharacteristic *c = find(uuid);
+  if (c == nullptr) {
+    return std::string();
+  }
+  if (c->callbacks() != nullptr) {
+    c->callbacks()->onRead(c);
+  }
+  return c->getValue();
+}
+
+void host_ble_link(size_t buffers) {
+  std::lock_guard<std::mutex> lock(link_mu);
+  link_buffers = buffers;
+  link_queue.clear();
+  link_congested = false;
+  link_dropped = 0;
+}
+
+size_t host_ble_deliver(size_t max) {
+  size_t sent = 0;
+  while (sent < max) {
+    Queued q;
+    {
+      std::lock_guard<std::mutex> lock(link_mu);
+      if (link_queue.empty()) {
+        break;
+      }
+      q = std::move(link_queue.front());
+      link_queue.pop_front();
+    }
+    if (host_ble_on_notify) {
+      host_ble_on_notify(q.uuid, q.value);
+    }
+    send_conf();
+    sent++;
+  }
+  bool cleared = false;
+  {
+    std::lock_guard<std::mutex> lock(link_mu);
+    cleared = link_congested && link_queue.size() < link_buffers;
+    link_congested = link_congested && !cleared;
+  }
+  if (cleared) {
+    send_congest(false);
+  }
+  return sent;
+}
+
+size_t host_ble_queued() {
+  std::lock_guard<std::mutex> lock(link_mu);
+  return link_queue.size();
+}
+
+uint32_t host_ble_dropped() {
+  std::lock_guard<std::mutex> lock(link_mu);
+  return link_dropped;
+}
@@ -0,0 +1,36 @@
+// Host shim for the Bluedroid GAP/GATTS types the firmware touches.
+#pragma once
+
+#include <cstdint>
+
+typedef int esp_err_t;
+typedef uint8_t esp_bd_addr_t[6];
+
+typedef enum {
+  ESP_GATT_OK = 0x00,
+  ESP_GATT_CONGESTED = 0x8f,
+} esp_gatt_status_t;
+
+typedef union {
+  struct {
+    uint16_t conn_id;
+    esp_bd_addr_t remote_bda;
+  } connect;
+  struct {
+    uint16_t conn_id;
+    uint16_t mtu;
+  } mtu;
+  struct {
+    esp_gatt_status_t status;
+    uint16_t conn_id;
+    uint16_t handle;
+    uint16_t len;
+    uint8_t *value;
+  } conf;
+  struct {
+    uint16_t conn_id;
+    bool congested;
+  } congest;
+} esp_ble_gatts_cb_param_t;
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length);
@@ -0,0 +1,15 @@
+// Host shim for the Bluedroid GATT server events the firmware handles
+// through BLEDevice::setCustomGattsHandler().
+#pragma once
+
+#include <esp_gap_ble_api.h>
+
+typedef uint8_t esp_gatt_if_t;
+
+typedef enum {
+  ESP_GATTS_MTU_EVT = 4,
+  ESP_GATTS_CONF_EVT = 5,
+  ESP_GATTS_CONNECT_EVT = 14,
+  ESP_GATTS_DISCONNECT_EVT = 15,
+  ESP_GATTS_CONGEST_EVT = 20,
+} esp_gatts_cb_event_t;
@@ -0,0 +1,244 @@
+// FastLED shim: lib8tion and color math ported from FastLED's C versions.
+#include <FastLED.h>
+
+CFastLED FastLED;
+
+static uint16_t rand16seed = 1337;
+
+uint8_t random8() {
+  rand16seed = static_cast<uint16_t>(rand16seed * 2053 + 13849);
+  return static_cast<uint8_t>(static_cast<uint8_t>(rand16seed & 0xFF) + static_cast<uint8_t>(rand16seed >> 8));
+}
+
+uint8_t random8(uint8_t lim) {
+  return static_cast<uint8_t>((random8() * lim) >> 8);
+}
+
+uint8_t random8(uint8_t min_value, uint8_t lim) {
+  return static_cast<uint8_t>(random8(static_cast<uint8_t>(lim - min_value)) + min_value);
+}
+
+uint16_t random16() {
+  rand16seed = static_cast<uint16_t>(rand16seed * 2053 + 13849);
+  return rand16seed;
+}
+
+uint16_t random16(uint16_t lim) {
+  return static_cast<uint16_t>((static_cast<uint32_t>(lim) * random16()) >> 16);
+}
+
+void random16_set_seed(uint16_t seed) { rand16seed = seed; }
+uint16_t random16_get_seed() { return rand16seed; }
+void random16_add_entropy(uint16_t entropy) { rand16seed = static_cast<uint16_t>(rand16seed + entropy); }
+
+uint8_t sin8(uint8_t theta) {
+  static const uint8_t b_m16_interleave[] = {0, 49, 49, 41, 90, 27, 117, 10};
+  uint8_t offset = theta;
+  if (theta & 0x40) {
+    offset = static_cast<uint8_t>(255 - offset);
+  }
+  offset &= 0x3F;
+  uint8_t secoffset = offset & 0x0F;
+  if (theta & 0x40) {
+    ++secoffset;
+  }
+  const uint8_t section = offset >> 4;
+  const uint8_t b = b_m16_interleave[section * 2];
+  const uint8_t m16 = b_m16_interleave[section * 2 + 1];
+  const uint8_t mx = static_cast<uint8_t>((m16 * secoffset) >> 4);
+  int8_t y = static_cast<int8_t>(mx + b);
+  if (theta & 0x80) {
+    y = static_cast<int8_t>(-y);
+  }
+  y = static_cast<int8_t>(y + 128);
+  return static_cast<uint8_t>(y);
+}
+
+int16_t sin16(uint16_t theta) {
+  static const uint16_t base[] = {0, 6393, 12539, 18204, 23170, 27245, 30273, 32137};
+  static const uint8_t slope[] = {49, 48, 44, 38, 31, 23, 14, 4};
+  uint16_t offset = (theta & 0x3FFF) >> 3;
+  if (theta & 0x4000) {
+    offset = static_cast<uint16_t>(2047 - offset);
+  }
+  const uint8_t section = static_cast<uint8_t>(offset / 256);
+  const uint16_t b = base[section];
+  const uint8_t m = slope[section];
+  const uint8_t secoffset8 = static_cast<uint8_t>(static_cast<uint8_t>(offset) / 2);
+  const uint16_t mx = static_cast<uint16_t>(m * secoffset8);
+  int16_t y = static_cast<int16_t>(mx + b);
+  if (theta & 0x8000) {
+    y = static_cast<int16_t>(-y);
+  }
+  return y;
+}
+
+static uint16_t beat88(accum88 bpm88, uint32_t timebase) {
+  return static_cast<uint16_t>(((GET_MILLIS() - timebase) * bpm88 * 280) >> 16);
+}
+
+static uint16_t beat16(accum88 bpm, uint32_t timebase) {
+  if (bpm < 256) {
+    bpm = static_cast<accum88>(bpm << 8);
+  }
+  return beat88(bpm, timebase);
+}
+
+uint8_t beatsin8(accum88 bpm, uint8_t lowest, uint8_t highest, uint32_t timebase, uint8_t phase_offset) {
+  const uint8_t beat = static_cast<uint8_t>(beat16(bpm, timebase) >> 8);
+  const uint8_t beatsin = sin8(static_cast<uint8_t>(beat + phase_offset));
+  const uint8_t rangewidth = static_cast<uint8_t>(highest - lowest);
+  return static_cast<uint8_t>(lowest + scale8(beatsin, rangewidth));
+}
+
+uint16_t beatsin16(accum88 bpm, uint16_t lowest, uint16_t highest, uint32_t timebase, uint16_t phase_offset) {
+  const uint16_t beat = beat16(bpm, timebase);
+  const uint16_t beatsin = static_cast<uint16_t>(sin16(static_cast<uint16_t>(beat + phase_offset)) + 32768);
+  const uint16_t rangewidth = static_cast<uint16_t>(highest - lowest);
+  return static_cast<uint16_t>(lowest + scale16(beatsin, rangewidth));
+}
+
+// hsv2rgb_rainbow() with FastLED's defaults (Y1 yellow boost, no green
+// scaling, FASTLED_SCALE8_FIXED).
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb) {
+  const uint8_t hue = hsv.hue;
+  const uint8_t sat = hsv.sat;
+  uint8_t val = hsv.val;
+  const uint8_t offset8 = static_cast<uint8_t>((hue & 0x1F) << 3);
+  const uint8_t third = scale8(offset8, 256 / 3);
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  if (!(hue & 0x80)) {
+    if (!(hue & 0x40)) {
+      if (!(hue & 0x20)) {
+        r = static_cast<uint8_t>(255 - third);
+        g = third;
+        b = 0;
+      } else {
+        r = 171;
+        g = static_cast<uint8_t>(85 + third);
+        b = 0;
+      }
+    } else {
+      if (!(hue & 0x20)) {
+        const uint8_t twothirds = scale8(offset8, (256 * 2) / 3);
+        r = static_cast<uint8_t>(171 - twothirds);
+        g = static_cast<uint8_t>(170 + third);
+        b = 0;
+      } else {
+        r = 0;
+        g = static_cast<uint8_t>(255 - third);
+        b = third;
+      }
+    }
+  } else {
+    if (!(hue & 0x40)) {
+      if (!(hue & 0x20)) {
+        const uint8_t twothirds = scale8(offset8, (256 * 2) / 3);
+        r = 0;
+        g = static_cast<uint8_t>(171 - twothirds);
+        b = static_cast<uint8_t>(85 + twothirds);
+      } else {
+        r = third;
+        g = 0;
+        b = static_cast<uint8_t>(255 - third);
+      }
+    } else {
+      if (!(hue & 0x20)) {
+        r = static_cast<uint8_t>(85 + third);
+        g = 0;
+        b = static_cast<uint8_t>(171 - third);
+      } else {
+        r = static_cast<uint8_t>(170 + third);
+        g = 0;
+        b = static_cast<uint8_t>(85 - third);
+      }
+    }
+  }
+
+  if (sat != 255) {
+    if (sat == 0) {
+      r = 255;
+      g = 255;
+      b = 255;
+    } else {
+      uint8_t desat = static_cast<uint8_t>(255 - sat);
+      desat = scale8_video(desat, desat);
+      const uint8_t satscale = static_cast<uint8_t>(255 - desat);
+      r = static_cast<uint8_t>(scale8(r, satscale) + desat);
+      g = static_cast<uint8_t>(scale8(g, satscale) + desat);
+      b = static_cast<uint8_t>(scale8(b, satscale) + desat);
+    }
+  }
+
+  if (val != 255) {
+    val = scale8_video(val, val);
+    if (val == 0) {
+      r = 0;
+      g = 0;
+      b = 0;
+    } else {
+      r = scale8(r, val);
+      g = scale8(g, val);
+      b = scale8(b, val);
+    }
+  }
+  rgb.r = r;
+  rgb.g = g;
+  rgb.b = b;
+}
+
+CRGB HeatColor(uint8_t temperature) {
+  const uint8_t t192 = scale8_video(temperature, 191);
+  const uint8_t heatramp = static_cast<uint8_t>((t192 & 0x3F) << 2);
+  if (t192 & 0x80) {
+    return CRGB(255, 255, heatramp);
+  }
+  if (t192 & 0x40) {
+    return CRGB(255, heatramp, 0);
+  }
+  return CRGB(heatramp, 0, 0);
+}
+
+void fill_solid(CRGB *leds, int count, const CRGB &color) {
+  for (int i = 0; i < count; ++i) {
+    leds[i] = color;
+  }
+}
+
+void fill_rainbow(CRGB *leds, int count, uint8_t initial_hue, uint8_t delta_hue) {
+  CHSV hsv(initial_hue, 240, 255);
+  for (int i = 0; i < count; ++i) {
+    leds[i] = hsv;
+    hsv.hue = static_cast<uint8_t>(hsv.hue + delta_hue);
+  }
+}
+
+CLEDController &CFastLED::add(uint8_t pin, CRGB *leds, int count) {
+  CLEDController *c = new CLEDController();
+  c->pin_ = pin;
+  c->setLeds(leds, count);
+  controllers_.push_back(c);
+  return *c;
+}
+
+void CFastLED::show(uint8_t scale) {
+  host_frames++;
+  if (host_on_show) {
+    HostLedFrame frame;
+    frame.ms = host_now_ms();
+    frame.brightness = scale;
+    frame.strips.assign(controllers_.begin(), controllers_.end());
+    host_on_show(frame);
+  }
+}
+
+void CFastLED::clear(bool write_data) {
+  for (CLEDController *c : controllers_) {
+    fill_solid(c->leds(), c->size(), CRGB(0, 0, 0));
+  }
+  if (write_data) {
+    show(0);
+  }
+}
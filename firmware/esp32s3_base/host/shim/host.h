@@ -0,0 +1,41 @@
+// Host-side controls for the shims: the virtual clock, the wall clock the
+// firmware sets from GNSS, and where NVS and the log partition live.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Virtual millisecond clock behind millis()/micros()/delay(). It only moves
+// when the host (or delay()) advances it; micros() adds the real time spent
+// since the last advance, capped below one millisecond, so short intervals
+// measured with micros() are real and the clock stays monotonic.
+uint64_t host_now_ms();
+void host_set_ms(uint64_t ms);
+void host_advance_ms(uint64_t ms);
+
+// Wall clock seen by time(): 0 (unset) until settimeofday(), then it runs
+// on the virtual clock. Linked in with -Wl,--wrap=time,--wrap=settimeofday.
+void host_set_unix(uint32_t unix_s);
+
+// Preferences storage. With a path, every namespace is loaded from and
+// written back to that file; without one it is kept in memory. Reset drops
+// everything (a factory-fresh NVS).
+void host_nvs_open(const char *path);
+void host_nvs_reset();
+
+// The "log" data partition: 0xFF (erased) RAM by default, or a file that is
+// created at the partition size. host_flash_fill() overwrites it, e.g. with
+// stale app bytes to model a partition that was never formatted.
+void host_flash_open(const char *path);
+void host_flash_fill(uint8_t value, size_t offset, size_t len);
+uint8_t *host_flash_data();
+size_t host_flash_size();
+
+// Console capture: when on, Serial output is kept for Serial.host_take_tx()
+// instead of going to stdout.
+void host_serial_capture(bool on);
+
+// HTTP listener port for WebServer::begin() (0 picks a free port) and the
+// port actually bound, once begun.
+void host_http_port(uint16_t port);
+uint16_t host_http_bound_port();
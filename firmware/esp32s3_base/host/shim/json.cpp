@@ -0,0 +1,586 @@
+// ArduinoJson shim: tree operations, parser and serializer.
+#include <ArduinoJson.h>
+
+#include <cerrno>
+
+using ArduinoJson::detail::Node;
+using ArduinoJson::detail::Pool;
+
+static Node *find_member(Node *obj, const char *key) {
+  for (auto &m : obj->members) {
+    if (m.first == key) {
+      return m.second;
+    }
+  }
+  return nullptr;
+}
+
+JsonVariant JsonVariant::operator[](const char *key) const {
+  Node *self = node_;
+  if (self == nullptr && parent_ != nullptr) {
+    // A nested path through a missing member: create it as an object.
+    self = make_object();
+  }
+  if (self == nullptr || (self->type != Node::Object && self->type != Node::Null)) {
+    return JsonVariant();
+  }
+  JsonVariant v(pool_, self->type == Node::Object ? find_member(self, key) : nullptr);
+  if (v.node_ == nullptr) {
+    v.parent_ = self;
+    v.key_ = key;
+  }
+  return v;
+}
+
+JsonVariant JsonVariant::operator[](int index) const {
+  if (node_ == nullptr || node_->type != Node::Array || index < 0 ||
+      static_cast<size_t>(index) >= node_->items.size()) {
+    return JsonVariant();
+  }
+  return JsonVariant(pool_, node_->items[index]);
+}
+
+size_t JsonVariant::size() const {
+  if (node_ == nullptr) {
+    return 0;
+  }
+  if (node_->type == Node::Array) {
+    return node_->items.size();
+  }
+  return node_->type == Node::Object ? node_->members.size() : 0;
+}
+
+// Materialize this slot: a missing member is added to its parent object
+// (a null parent becomes an object first).
+static Node *materialize(Pool *pool, Node *node, Node *parent, const std::string &key) {
+  if (node != nullptr || parent == nullptr || pool == nullptr) {
+    return node;
+  }
+  if (parent->type == Node::Null) {
+    parent->type = Node::Object;
+  }
+  if (parent->type != Node::Object) {
+    return nullptr;
+  }
+  Node *existing = find_member(parent, key.c_str());
+  if (existing != nullptr) {
+    return existing;
+  }
+  Node *n = pool->make();
+  parent->members.emplace_back(key, n);
+  return n;
+}
+
+static void reset_node(Node *n, Node::Type type) {
+  n->type = type;
+  n->items.clear();
+  n->members.clear();
+  n->s.clear();
+}
+
+Node *JsonVariant::make_array() const {
+  Node *n = materialize(pool_, node_, parent_, key_);
+  if (n != nullptr && n->type != Node::Array) {
+    reset_node(n, Node::Array);
+  }
+  const_cast<JsonVariant *>(this)->node_ = n;
+  return n;
+}
+
+Node *JsonVariant::make_object() const {
+  Node *n = materialize(pool_, node_, parent_, key_);
+  if (n != nullptr && n->type != Node::Object) {
+    reset_node(n, Node::Object);
+  }
+  const_cast<JsonVariant *>(this)->node_ = n;
+  return n;
+}
+
+JsonVariant JsonVariant::append() const {
+  Node *arr = (node_ != nullptr && node_->type == Node::Array) ? node_ : make_array();
+  if (arr == nullptr) {
+    return JsonVariant();
+  }
+  Node *n = pool_->make();
+  arr->items.push_back(n);
+  return JsonVariant(pool_, n);
+}
+
+JsonArray JsonVariant::createNestedArray() const {
+  JsonVariant slot = append();
+  slot.make_array();
+  return JsonArray(slot);
+}
+
+JsonObject JsonVariant::createNestedObject() const {
+  JsonVariant slot = append();
+  slot.make_object();
+  return JsonObject(slot);
+}
+
+JsonArray JsonVariant::createNestedArray(const char *key) const {
+  JsonVariant slot = (*this)[key];
+  slot.make_array();
+  return JsonArray(slot);
+}
+
+JsonObject JsonVariant::createNestedObject(const char *key) const {
+  JsonVariant slot = (*this)[key];
+  slot.make_object();
+  return JsonObject(slot);
+}
+
+void JsonVariant::set_bool(bool v) {
+  node_ = materialize(pool_, node_, parent_, key_);
+  if (node_ != nullptr) {
+    reset_node(node_, Node::Bool);
+    node_->b = v;
+  }
+}
+
+void JsonVariant::set_int(int64_t v) {
+  node_ = materialize(pool_, node_, parent_, key_);
+  if (node_ != nullptr) {
+    reset_node(node_, Node::Int);
+    node_->i = v;
+  }
+}
+
+void JsonVariant::set_float(double v, bool is_float32) {
+  node_ = materialize(pool_, node_, parent_, key_);
+  if (node_ != nullptr) {
+    reset_node(node_, Node::Float);
+    node_->f = v;
+    node_->is_float32 = is_float32;
+  }
+}
+
+void JsonVariant::set_string(const char *v) {
+  node_ = materialize(pool_, node_, parent_, key_);
+  if (node_ != nullptr) {
+    if (v == nullptr) {
+      reset_node(node_, Node::Null);
+      return;
+    }
+    reset_node(node_, Node::String);
+    node_->s = v;
+  }
+}
+
+const char *DeserializationError::c_str() const {
+  static const char *names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+  return names[code_];
+}
+
+namespace {
+
+const int MAX_DEPTH = 10;
+
+class Parser {
+ public:
+  Parser(Pool *pool, const char *p, const char *end) : pool_(pool), p_(p), end_(end) {}
+
+  DeserializationError::Code parse(Node *out) {
+    skip_ws();
+    if (p_ >= end_) {
+      return DeserializationError::EmptyInput;
+    }
+    return value(out, 0);
+  }
+
+ private:
+  void skip_ws() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n')) {
+      ++p_;
+    }
+  }
+
+  DeserializationError::Code value(Node *out, int depth) {
+    if (depth > MAX_DEPTH) {
+      return DeserializationError::TooDeep;
+    }
+    skip_ws();
+    if (p_ >= end_) {
+      return DeserializationError::IncompleteInput;
+    }
+    const char c = *p_;
+    if (c == '{') {
+      return object(out, depth);
+    }
+    if (c == '[') {
+      return array(out, depth);
+    }
+    if (c == '"') {
+      out->type = Node::String;
+      return string(out->s);
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+      return number(out);
+    }
+    return literal(out);
+  }
+
+  DeserializationError::Code object(Node *out, int depth) {
+    out->type = Node::Object;
+    ++p_;
+    skip_ws();
+    if (p_ < end_ && *p_ == '}') {
+      ++p_;
+      return DeserializationError::Ok;
+    }
+    for (;;) {
+      skip_ws();
+      if (p_ >= end_) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (*p_ != '"') {
+        return DeserializationError::InvalidInput;
+      }
+      std::string key;
+      DeserializationError::Code err = string(key);
+      if (err != DeserializationError::Ok) {
+        return err;
+      }
+      skip_ws();
+      if (p_ >= end_) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (*p_++ != ':') {
+        return DeserializationError::InvalidInput;
+      }
+      Node *child = find_member(out, key.c_str());
+      if (child == nullptr) {
+        child = pool_->make();
+        out->members.emplace_back(key, child);
+      } else {
+        reset_node(child, Node::Null);
+      }
+      err = value(child, depth + 1);
+      if (err != DeserializationError::Ok) {
+        return err;
+      }
+      skip_ws();
+      if (p_ >= end_) {
+        return DeserializationError::IncompleteInput;
+      }
+      const char c = *p_++;
+      if (c == '}') {
+        return DeserializationError::Ok;
+      }
+      if (c != ',') {
+        return DeserializationError::InvalidInput;
+      }
+    }
+  }
+
+  DeserializationError::Code array(Node *out, int depth) {
+    out->type = Node::Array;
+    ++p_;
+    skip_ws();
+    if (p_ < end_ && *p_ == ']') {
+      ++p_;
+      return DeserializationError::Ok;
+    }
+    for (;;) {
+      Node *child = pool_->make();
+      out->items.push_back(child);
+      const DeserializationError::Code err = value(child, depth + 1);
+      if (err != DeserializationError::Ok) {
+        return err;
+      }
+      skip_ws();
+      if (p_ >= end_) {
+        return DeserializationError::IncompleteInput;
+      }
+      const char c = *p_++;
+      if (c == ']') {
+        return DeserializationError::Ok;
+      }
+      if (c != ',') {
+        return DeserializationError::InvalidInput;
+      }
+    }
+  }
+
+  static void put_utf8(std::string &s, uint32_t cp) {
+    if (cp < 0x80) {
+      s += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      s += static_cast<char>(0xC0 | (cp >> 6));
+      s += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      s += static_cast<char>(0xE0 | (cp >> 12));
+      s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      s += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+      s += static_cast<char>(0xF0 | (cp >> 18));
+      s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+      s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      s += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  }
+
+  bool hex4(uint32_t &cp) {
+    if (end_ - p_ < 4) {
+      return false;
+    }
+    cp = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = *p_++;
+      cp <<= 4;
+      if (c >= '0' && c <= '9') {
+        cp |= static_cast<uint32_t>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        cp |= static_cast<uint32_t>(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        cp |= static_cast<uint32_t>(c - 'A' + 10);
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  DeserializationError::Code string(std::string &s) {
+    ++p_;
+    while (p_ < end_) {
+      const char c = *p_++;
+      if (c == '"') {
+        return DeserializationError::Ok;
+      }
+      if (c != '\\') {
+        s += c;
+        continue;
+      }
+      if (p_ >= end_) {
+        break;
+      }
+      const char e = *p_++;
+      switch (e) {
+        case '"': s += '"'; break;
+        case '\\': s += '\\'; break;
+        case '/': s += '/'; break;
+        case 'b': s += '\b'; break;
+        case 'f': s += '\f'; break;
+        case 'n': s += '\n'; break;
+        case 'r': s += '\r'; break;
+        case 't': s += '\t'; break;
+        case 'u': {
+          uint32_t cp = 0;
+          if (!hex4(cp)) {
+            return DeserializationError::InvalidInput;
+          }
+          if (cp >= 0xD800 && cp < 0xDC00 && end_ - p_ >= 6 && p_[0] == '\\' && p_[1] == 'u') {
+            const char *save = p_;
+            p_ += 2;
+            uint32_t lo = 0;
+            if (hex4(lo) && lo >= 0xDC00 && lo < 0xE000) {
+              cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            } else {
+              p_ = save;
+            }
+          }
+          put_utf8(s, cp);
+          break;
+        }
+        default:
+          return DeserializationError::InvalidInput;
+      }
+    }
+    return DeserializationError::IncompleteInput;
+  }
+
+  DeserializationError::Code number(Node *out) {
+    const char *start = p_;
+    bool is_float = false;
+    if (p_ < end_ && *p_ == '-') {
+      ++p_;
+    }
+    while (p_ < end_) {
+      const char c = *p_;
+      if (c >= '0' && c <= '9') {
+        ++p_;
+      } else if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+        is_float = true;
+        ++p_;
+      } else {
+        break;
+      }
+    }
+    const std::string text(start, p_);
+    char *end = nullptr;
+    if (!is_float) {
+      errno = 0;
+      const long long v = strtoll(text.c_str(), &end, 10);
+      if (*end == '\0' && errno == 0) {
+        out->type = Node::Int;
+        out->i = v;
+        return DeserializationError::Ok;
+      }
+    }
+    const double d = strtod(text.c_str(), &end);
+    if (end == text.c_str() || *end != '\0') {
+      return DeserializationError::InvalidInput;
+    }
+    out->type = Node::Float;
+    out->f = d;
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError::Code literal(Node *out) {
+    static const struct {
+      const char *text;
+      Node::Type type;
+      bool b;
+    } words[] = {{"true", Node::Bool, true}, {"false", Node::Bool, false}, {"null", Node::Null, false}};
+    for (const auto &w : words) {
+      const size_t n = strlen(w.text);
+      if (static_cast<size_t>(end_ - p_) >= n && strncmp(p_, w.text, n) == 0) {
+        p_ += n;
+        out->type = w.type;
+        out->b = w.b;
+        return DeserializationError::Ok;
+      }
+      if (static_cast<size_t>(end_ - p_) < n && strncmp(p_, w.text, end_ - p_) == 0) {
+        return DeserializationError::IncompleteInput;
+      }
+    }
+    return DeserializationError::InvalidInput;
+  }
+
+  Pool *pool_;
+  const char *p_;
+  const char *end_;
+};
+
+class StringPrint : public Print {
+ public:
+  explicit StringPrint(std::string &s) : s_(s) {}
+  size_t write(uint8_t c) override {
+    s_ += static_cast<char>(c);
+    return 1;
+  }
+  size_t write(const uint8_t *data, size_t n) override {
+    s_.append(reinterpret_cast<const char *>(data), n);
+    return n;
+  }
+
+ private:
+  std::string &s_;
+};
+
+size_t write_string(Print &out, const std::string &s) {
+  size_t n = out.write('"');
+  for (const char c : s) {
+    switch (c) {
+      case '"': n += out.write("\\\""); break;
+      case '\\': n += out.write("\\\\"); break;
+      case '\b': n += out.write("\\b"); break;
+      case '\f': n += out.write("\\f"); break;
+      case '\n': n += out.write("\\n"); break;
+      case '\r': n += out.write("\\r"); break;
+      case '\t': n += out.write("\\t"); break;
+      default:
+        if (static_cast<uint8_t>(c) < 0x20) {
+          n += out.printf("\\u%04x", static_cast<unsigned>(c));
+        } else {
+          n += out.write(static_cast<uint8_t>(c));
+        }
+    }
+  }
+  return n + out.write('"');
+}
+
+size_t write_node(Print &out, const Node *node) {
+  if (node == nullptr) {
+    return out.write("null");
+  }
+  switch (node->type) {
+    case Node::Null:
+      return out.write("null");
+    case Node::Bool:
+      return out.write(node->b ? "true" : "false");
+    case Node::Int:
+      return out.printf("%lld", static_cast<long long>(node->i));
+    case Node::Float:
+      if (!std::isfinite(node->f)) {
+        return out.write("null");
+      }
+      return out.printf(node->is_float32 ? "%.7g" : "%.15g", node->f);
+    case Node::String:
+      return write_string(out, node->s);
+    case Node::Array: {
+      size_t n = out.write('[');
+      for (size_t i = 0; i < node->items.size(); ++i) {
+        n += (i > 0) ? out.write(',') : 0;
+        n += write_node(out, node->items[i]);
+      }
+      return n + out.write(']');
+    }
+    case Node::Object: {
+      size_t n = out.write('{');
+      for (size_t i = 0; i < node->members.size(); ++i) {
+        n += (i > 0) ? out.write(',') : 0;
+        n += write_string(out, node->members[i].first);
+        n += out.write(':');
+        n += write_node(out, node->members[i].second);
+      }
+      return n + out.write('}');
+    }
+  }
+  return 0;
+}
+
+} // namespace
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *input, size_t len) {
+  doc.clear();
+  if (input == nullptr) {
+    return DeserializationError::EmptyInput;
+  }
+  Parser parser(doc.pool(), input, input + len);
+  const DeserializationError::Code err = parser.parse(doc.node());
+  if (err != DeserializationError::Ok) {
+    doc.clear();
+  }
+  return err;
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *input) {
+  return deserializeJson(doc, input, input == nullptr ? 0 : strlen(input));
+}
+
+DeserializationError deserializeJson(JsonDocument &doc, const String &input) {
+  return deserializeJson(doc, input.c_str(), input.length());
+}
+
+size_t serializeJson(const JsonVariant &v, Print &out) {
+  return write_node(out, v.node());
+}
+
+size_t serializeJson(const JsonVariant &v, String &out) {
+  std::string s;
+  StringPrint p(s);
+  const size_t n = write_node(p, v.node());
+  out = String(s);
+  return n;
+}
+
+size_t serializeJson(const JsonVariant &v, char *out, size_t cap) {
+  std::string s;
+  StringPrint p(s);
+  write_node(p, v.node());
+  if (cap == 0) {
+    return 0;
+  }
+  const size_t n = min(s.size(), cap - 1);
+  memcpy(out, s.data(), n);
+  out[n] = '\0';
+  return n;
+}
+
+size_t measureJson(const JsonVariant &v) {
+  std::string s;
+  StringPrint p(s);
+  return write_node(p, v.node());
+}
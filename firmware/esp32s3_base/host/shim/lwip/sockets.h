@@ -0,0 +1,11 @@
+// Host shim for lwIP sockets: lwip_send() is the host send() unless a test
+// installs host_lwip_send (e.g. to model a slow viewer).
+#pragma once
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+extern ssize_t (*host_lwip_send)(int fd, const void *data, size_t len, int flags);
+
+ssize_t lwip_send(int fd, const void *data, size_t len, int flags);
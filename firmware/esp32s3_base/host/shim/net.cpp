@@ -0,0 +1,494 @@
+// Network shims: WiFi, WiFiClient, WebServer, HTTPClient, mDNS, lwIP.
+#include <ESPmDNS.h>
+#include <HTTPClient.h>
+#include <WebServer.h>
+#include <lwip/sockets.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+namespace {
+
+bool sta_reachable = false;
+uint16_t http_port = 8080;
+uint16_t http_bound = 0;
+
+ssize_t default_send(int fd, const void *data, size_t len, int flags) {
+  return ::send(fd, data, len, flags | MSG_NOSIGNAL);
+}
+
+bool wait_fd(int fd, short events, int timeout_ms) {
+  pollfd p = {fd, events, 0};
+  return poll(&p, 1, timeout_ms) > 0;
+}
+
+} // namespace
+
+ssize_t (*host_lwip_send)(int fd, const void *data, size_t len, int flags) = default_send;
+
+ssize_t lwip_send(int fd, const void *data, size_t len, int flags) { return host_lwip_send(fd, data, len, flags); }
+
+void host_wifi_sta(bool reachable) { sta_reachable = reachable; }
+void host_http_port(uint16_t port) { http_port = port; }
+uint16_t host_http_bound_port() { return http_bound; }
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", addr_[0], addr_[1], addr_[2], addr_[3]);
+  return String(buf);
+}
+
+bool WiFiClass::softAP(const char *, const char *, int, int, int) {
+  if (mode_ == WIFI_OFF || mode_ == WIFI_STA) {
+    mode_ = static_cast<wifi_mode_t>(mode_ | WIFI_AP);
+  }
+  return true;
+}
+
+bool WiFiClass::softAPdisconnect(bool) {
+  mode_ = static_cast<wifi_mode_t>(mode_ & ~WIFI_AP);
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char *, const char *) {
+  mode_ = static_cast<wifi_mode_t>(mode_ | WIFI_STA);
+  sta_started_ = true;
+  return status();
+}
+
+wl_status_t WiFiClass::status() {
+  if (!sta_started_ || !(mode_ & WIFI_STA)) {
+    return WL_DISCONNECTED;
+  }
+  return sta_reachable ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+}
+
+bool WiFiClass::disconnect(bool) {
+  sta_started_ = false;
+  return true;
+}
+
+WiFiClient::WiFiClient(int fd)
+    : sock_(new int(fd), [](int *p) {
+        ::close(*p);
+        delete p;
+      }) {}
+
+uint8_t WiFiClient::connected() {
+  if (!sock_) {
+    return 0;
+  }
+  char c;
+  const ssize_t n = recv(*sock_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0) {
+    return 0;
+  }
+  return (n > 0 || errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : 0;
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+  const int on = nodelay ? 1 : 0;
+  return sock_ ? setsockopt(*sock_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) : -1;
+}
+
+int WiFiClient::available() {
+  if (!sock_) {
+    return 0;
+  }
+  char buf[512];
+  const ssize_t n = recv(*sock_, buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 ? static_cast<int>(n) : 0;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return (sock_ && recv(*sock_, &c, 1, MSG_DONTWAIT) == 1) ? c : -1;
+}
+
+size_t WiFiClient::write(const uint8_t *data, size_t n) {
+  size_t sent = 0;
+  while (sock_ && sent < n) {
+    const ssize_t k = ::send(*sock_, data + sent, n - sent, MSG_NOSIGNAL);
+    if (k <= 0) {
+      break;
+    }
+    sent += static_cast<size_t>(k);
+  }
+  return sent;
+}
+
+WebServer::~WebServer() { close(); }
+
+void WebServer::begin() {
+  close();
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  const int on = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(http_port);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_fd_, 8) != 0) {
+    fprintf(stderr, "[host] http: cannot listen on 127.0.0.1:%u\n", http_port);
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    return;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+  http_bound = ntohs(addr.sin_port);
+  fcntl(listen_fd_, F_SETFL, O_NONBLOCK);
+  fprintf(stderr, "[host] http: listening on http://127.0.0.1:%u/ (port %d on the device)\n", http_bound, port_);
+}
+
+void WebServer::close() {
+  if (listen_fd_ >= 0) {
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+  }
+}
+
+void WebServer::on(const char *uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn) {
+  routes_.push_back({uri, method, fn, ufn});
+}
+
+void WebServer::collectHeaders(const char *header_keys[], size_t count) {
+  header_keys_.assign(header_keys, header_keys + count);
+}
+
+static bool same_name(const std::string &a, const char *b) {
+  return strcasecmp(a.c_str(), b) == 0;
+}
+
+String WebServer::arg(const String &name) const {
+  for (const auto &a : args_) {
+    if (a.first == name.c_str()) {
+      return String(a.second);
+    }
+  }
+  return String();
+}
+
+bool WebServer::hasArg(const String &name) const {
+  for (const auto &a : args_) {
+    if (a.first == name.c_str()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+String WebServer::header(const String &name) const {
+  for (const auto &h : headers_) {
+    if (same_name(h.first, name.c_str())) {
+      return String(h.second);
+    }
+  }
+  return String();
+}
+
+bool WebServer::hasHeader(const String &name) const {
+  for (const auto &h : headers_) {
+    if (same_name(h.first, name.c_str())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static std::string url_decode(const std::string &s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '+') {
+      out += ' ';
+    } else if (s[i] == '%' && i + 2 < s.size()) {
+      out += static_cast<char>(strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+      i += 2;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+static void parse_args(const std::string &query, std::vector<std::pair<std::string, std::string>> &args) {
+  size_t pos = 0;
+  while (pos < query.size()) {
+    size_t amp = query.find('&', pos);
+    if (amp == std::string::npos) {
+      amp = query.size();
+    }
+    const std::string pair = query.substr(pos, amp - pos);
+    const size_t eq = pair.find('=');
+    if (!pair.empty()) {
+      args.emplace_back(url_decode(pair.substr(0, eq)),
+                        eq == std::string::npos ? std::string() : url_decode(pair.substr(eq + 1)));
+    }
+    pos = amp + 1;
+  }
+}
+
+// Read one request (headers and Content-Length body), blocking up to 1 s
+// like the core's client timeout.
+bool WebServer::read_request() {
+  const int fd = client_.fd();
+  std::string data;
+  size_t header_end = std::string::npos;
+  size_t need = 0;
+  char buf[2048];
+  for (;;) {
+    if (header_end != std::string::npos && data.size() >= header_end + 4 + need) {
+      break;
+    }
+    if (!wait_fd(fd, POLLIN, 1000)) {
+      return false;
+    }
+    const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return false;
+    }
+    data.append(buf, static_cast<size_t>(n));
+    if (header_end == std::string::npos) {
+      header_end = data.find("\r\n\r\n");
+      if (header_end != std::string::npos) {
+        const std::string head = data.substr(0, header_end);
+        size_t line_end = head.find("\r\n");
+        const std::string request_line = head.substr(0, line_end);
+        char method[16] = {0};
+        char target[2048] = {0};
+        if (sscanf(request_line.c_str(), "%15s %2047s", method, target) != 2) {
+          return false;
+        }
+        static const struct {
+          const char *name;
+          HTTPMethod method;
+        } methods[] = {{"GET", HTTP_GET},   {"HEAD", HTTP_HEAD},     {"POST", HTTP_POST},      {"PUT", HTTP_PUT},
+                       {"PATCH", HTTP_PATCH}, {"DELETE", HTTP_DELETE}, {"OPTIONS", HTTP_OPTIONS}};
+        method_ = HTTP_GET;
+        for (const auto &m : methods) {
+          if (strcmp(method, m.name) == 0) {
+            method_ = m.method;
+          }
+        }
+        const std::string t = target;
+        const size_t q = t.find('?');
+        uri_ = t.substr(0, q);
+        args_.clear();
+        if (q != std::string::npos) {
+          parse_args(t.substr(q + 1), args_);
+        }
+        headers_.clear();
+        while (line_end != std::string::npos && line_end < head.size()) {
+          const size_t next = head.find("\r\n", line_end + 2);
+          const std::string line = head.substr(line_end + 2, next == std::string::npos ? std::string::npos : next - line_end - 2);
+          const size_t colon = line.find(':');
+          if (colon != std::string::npos) {
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            const std::string name = line.substr(0, colon);
+            if (same_name(name, "Content-Length")) {
+              need = strtoul(value.c_str(), nullptr, 10);
+            }
+            for (const std::string &k : header_keys_) {
+              if (same_name(name, k.c_str())) {
+                headers_.emplace_back(k, value);
+              }
+            }
+          }
+          line_end = next;
+        }
+      }
+    }
+  }
+  body_ = data.substr(header_end + 4, need);
+  return true;
+}
+
+void WebServer::dispatch() {
+  const Route *route = nullptr;
+  for (const Route &r : routes_) {
+    if (r.uri == uri_ && (r.method == HTTP_ANY || r.method == method_)) {
+      route = &r;
+      break;
+    }
+  }
+  if (route != nullptr && route->ufn && !body_.empty()) {
+    raw_.status = RAW_START;
+    raw_.totalSize = 0;
+    raw_.currentSize = 0;
+    route->ufn();
+    for (size_t at = 0; at < body_.size(); at += HTTP_RAW_BUFLEN) {
+      raw_.status = RAW_WRITE;
+      raw_.currentSize = min<size_t>(HTTP_RAW_BUFLEN, body_.size() - at);
+      memcpy(raw_.buf, &body_[at], raw_.currentSize);
+      raw_.totalSize += raw_.currentSize;
+      route->ufn();
+    }
+    raw_.status = RAW_END;
+    raw_.currentSize = 0;
+    route->ufn();
+  } else if (!body_.empty()) {
+    if (strstr(header("Content-Type").c_str(), "application/x-www-form-urlencoded") != nullptr) {
+      parse_args(body_, args_);
+    } else {
+      args_.emplace_back("plain", body_);
+    }
+  }
+  if (route != nullptr) {
+    route->fn();
+  } else if (not_found_) {
+    not_found_();
+  } else {
+    send(404, "text/plain", String("Not found: ") + uri_.c_str());
+  }
+}
+
+void WebServer::handleClient() {
+  if (listen_fd_ < 0) {
+    return;
+  }
+  const int fd = accept(listen_fd_, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+  client_ = WiFiClient(fd);
+  response_headers_.clear();
+  content_length_ = CONTENT_LENGTH_NOT_SET;
+  chunked_ = false;
+  if (read_request()) {
+    dispatch();
+  }
+  if (chunked_) {
+    write_all("0\r\n\r\n", 5);
+  }
+  client_ = WiFiClient();
+}
+
+void WebServer::write_all(const char *data, size_t len) {
+  client_.write(reinterpret_cast<const uint8_t *>(data), len);
+}
+
+void WebServer::sendHeader(const String &name, const String &value, bool first) {
+  const std::string line = name.str() + ": " + value.str() + "\r\n";
+  response_headers_ = first ? line + response_headers_ : response_headers_ + line;
+}
+
+static const char *reason(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 416: return "Range Not Satisfiable";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+void WebServer::send(int code, const char *content_type, const String &content) {
+  std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+  head += std::string("Content-Type: ") + (content_type != nullptr ? content_type : "text/html") + "\r\n";
+  if (content_length_ == CONTENT_LENGTH_UNKNOWN) {
+    chunked_ = true;
+    head += "Transfer-Encoding: chunked\r\n";
+  } else {
+    const size_t len = (content_length_ == CONTENT_LENGTH_NOT_SET) ? content.length() : content_length_;
+    head += "Content-Length: " + std::to_string(len) + "\r\n";
+  }
+  head += response_headers_;
+  head += "Connection: close\r\n\r\n";
+  response_headers_.clear();
+  write_all(head.data(), head.size());
+  if (content.length() > 0) {
+    sendContent(content);
+  }
+  content_length_ = CONTENT_LENGTH_NOT_SET;
+}
+
+void WebServer::sendContent(const char *content, size_t len) {
+  if (!chunked_) {
+    write_all(content, len);
+    return;
+  }
+  char size_line[20]; // 16 hex digits, CRLF, NUL.
+  snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+  write_all(size_line, strlen(size_line));
+  write_all(content, len);
+  write_all("\r\n", 2);
+  if (len == 0) {
+    chunked_ = false; // That was the terminating chunk.
+  }
+}
+
+std::function<int(const std::string &url, const std::string &body)> host_http_post;
+
+bool HTTPClient::begin(const char *url) {
+  url_ = url;
+  if (strncmp(url, "http://", 7) != 0) {
+    return false;
+  }
+  const std::string rest = url + 7;
+  const size_t slash = rest.find('/');
+  const std::string authority = rest.substr(0, slash);
+  path_ = (slash == std::string::npos) ? "/" : rest.substr(slash);
+  const size_t colon = authority.find(':');
+  host_ = authority.substr(0, colon);
+  port_ = (colon == std::string::npos) ? 80 : static_cast<uint16_t>(atoi(authority.c_str() + colon + 1));
+  return !host_.empty();
+}
+
+int HTTPClient::POST(uint8_t *payload, size_t size) {
+  const std::string body(reinterpret_cast<const char *>(payload), size);
+  if (host_http_post) {
+    return host_http_post(url_, body);
+  }
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &res) != 0 || res == nullptr) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  const int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  const int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+  freeaddrinfo(res);
+  WiFiClient conn(fd);
+  if (rc != 0) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  std::string req = "POST " + path_ + " HTTP/1.0\r\nHost: " + host_ + "\r\n";
+  for (const auto &h : headers_) {
+    req += h.first + ": " + h.second + "\r\n";
+  }
+  req += "Content-Length: " + std::to_string(size) + "\r\n\r\n";
+  req += body;
+  if (conn.write(reinterpret_cast<const uint8_t *>(req.data()), req.size()) != req.size()) {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+  std::string resp;
+  char buf[512];
+  while (wait_fd(fd, POLLIN, static_cast<int>(timeout_ms_))) {
+    const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      break;
+    }
+    resp.append(buf, static_cast<size_t>(n));
+  }
+  int code = 0;
+  if (sscanf(resp.c_str(), "HTTP/%*s %d", &code) != 1) {
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+  return code;
+}
@@ -0,0 +1,283 @@
+// Preferences and esp_partition shims.
+#include <Preferences.h>
+#include <esp_partition.h>
+
+#include <map>
+#include <vector>
+
+namespace {
+
+struct Value {
+  char type;
+  std::vector<uint8_t> data;
+};
+
+typedef std::map<std::string, std::map<std::string, Value>> Store;
+
+Store nvs;
+std::string nvs_path;
+std::mutex nvs_mu;
+
+// File format: repeated [u8 ns_len][ns][u8 key_len][key][type][u32 len][data].
+void nvs_load() {
+  nvs.clear();
+  FILE *f = fopen(nvs_path.c_str(), "rb");
+  if (f == nullptr) {
+    return;
+  }
+  for (;;) {
+    uint8_t n = 0;
+    if (fread(&n, 1, 1, f) != 1) {
+      break;
+    }
+    std::string ns(n, '\0');
+    uint8_t k = 0;
+    Value v;
+    uint32_t len = 0;
+    if (fread(&ns[0], 1, n, f) != n || fread(&k, 1, 1, f) != 1) {
+      break;
+    }
+    std::string key(k, '\0');
+    if (fread(&key[0], 1, k, f) != k || fread(&v.type, 1, 1, f) != 1 || fread(&len, 4, 1, f) != 1) {
+      break;
+    }
+    v.data.resize(len);
+    if (len > 0 && fread(v.data.data(), 1, len, f) != len) {
+      break;
+    }
+    nvs[ns][key] = v;
+  }
+  fclose(f);
+}
+
+void nvs_save() {
+  if (nvs_path.empty()) {
+    return;
+  }
+  const std::string tmp = nvs_path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (f == nullptr) {
+    return;
+  }
+  for (const auto &ns : nvs) {
+    for (const auto &kv : ns.second) {
+      const uint8_t n = static_cast<uint8_t>(ns.first.size());
+      const uint8_t k = static_cast<uint8_t>(kv.first.size());
+      const uint32_t len = static_cast<uint32_t>(kv.second.data.size());
+      fwrite(&n, 1, 1, f);
+      fwrite(ns.first.data(), 1, n, f);
+      fwrite(&k, 1, 1, f);
+      fwrite(kv.first.data(), 1, k, f);
+      fwrite(&kv.second.type, 1, 1, f);
+      fwrite(&len, 4, 1, f);
+      fwrite(kv.second.data.data(), 1, len, f);
+    }
+  }
+  fclose(f);
+  rename(tmp.c_str(), nvs_path.c_str());
+}
+
+} // namespace
+
+void host_nvs_open(const char *path) {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  nvs_path = (path != nullptr) ? path : "";
+  if (!nvs_path.empty()) {
+    nvs_load();
+  }
+}
+
+void host_nvs_reset() {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  nvs.clear();
+  nvs_save();
+}
+
+bool Preferences::begin(const char *name, bool read_only, const char *) {
+  // NVS namespaces are at most 15 characters.
+  if (name == nullptr || strlen(name) > 15) {
+    return false;
+  }
+  ns_ = name;
+  read_only_ = read_only;
+  open_ = true;
+  return true;
+}
+
+bool Preferences::clear() {
+  if (!open_ || read_only_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  nvs[ns_].clear();
+  nvs_save();
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  if (!open_ || read_only_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  const bool found = nvs[ns_].erase(key) > 0;
+  nvs_save();
+  return found;
+}
+
+bool Preferences::isKey(const char *key) {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  return open_ && nvs[ns_].count(key) > 0;
+}
+
+size_t Preferences::put(const char *key, char type, const void *data, size_t len) {
+  // Keys are at most 15 characters; blobs and strings have NVS limits too.
+  if (!open_ || read_only_ || key == nullptr || strlen(key) > 15 || len > 508000) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  Value &v = nvs[ns_][key];
+  v.type = type;
+  v.data.assign(static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + len);
+  nvs_save();
+  return len;
+}
+
+bool Preferences::get(const char *key, char type, void *out, size_t len) {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  if (!open_) {
+    return false;
+  }
+  const auto &ns = nvs[ns_];
+  const auto it = ns.find(key);
+  if (it == ns.end() || it->second.type != type || it->second.data.size() != len) {
+    return false;
+  }
+  memcpy(out, it->second.data.data(), len);
+  return true;
+}
+
+String Preferences::getString(const char *key, const String fallback) {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  const auto &ns = nvs[ns_];
+  const auto it = ns.find(key);
+  if (!open_ || it == ns.end() || it->second.type != 's') {
+    return fallback;
+  }
+  return String(reinterpret_cast<const char *>(it->second.data.data()));
+}
+
+size_t Preferences::getString(const char *key, char *out, size_t cap) {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  const auto &ns = nvs[ns_];
+  const auto it = ns.find(key);
+  if (!open_ || it == ns.end() || it->second.type != 's' || it->second.data.size() > cap) {
+    return 0;
+  }
+  memcpy(out, it->second.data.data(), it->second.data.size());
+  return it->second.data.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *out, size_t cap) {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  const auto &ns = nvs[ns_];
+  const auto it = ns.find(key);
+  if (!open_ || it == ns.end() || it->second.type != 'b' || it->second.data.size() > cap) {
+    return 0;
+  }
+  memcpy(out, it->second.data.data(), it->second.data.size());
+  return it->second.data.size();
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  std::lock_guard<std::mutex> lock(nvs_mu);
+  const auto &ns = nvs[ns_];
+  const auto it = ns.find(key);
+  return (!open_ || it == ns.end() || it->second.type != 'b') ? 0 : it->second.data.size();
+}
+
+// Log partition: 0x1E0000 bytes as in partitions.csv.
+namespace {
+
+const uint32_t FLASH_SECTOR = 4096;
+esp_partition_t log_partition = {ESP_PARTITION_TYPE_DATA, 0x40, 0x610000, 0x1E0000, FLASH_SECTOR, "log", false};
+std::vector<uint8_t> flash(log_partition.size, 0xFF);
+FILE *flash_file = nullptr;
+
+void flash_sync(size_t offset, size_t len) {
+  if (flash_file != nullptr) {
+    fseek(flash_file, static_cast<long>(offset), SEEK_SET);
+    fwrite(&flash[offset], 1, len, flash_file);
+    fflush(flash_file);
+  }
+}
+
+bool in_range(const esp_partition_t *part, size_t offset, size_t size) {
+  return part == &log_partition && offset <= part->size && size <= part->size - offset;
+}
+
+} // namespace
+
+void host_flash_open(const char *path) {
+  if (flash_file != nullptr) {
+    fclose(flash_file);
+    flash_file = nullptr;
+  }
+  std::fill(flash.begin(), flash.end(), 0xFF);
+  if (path == nullptr) {
+    return;
+  }
+  flash_file = fopen(path, "r+b");
+  if (flash_file != nullptr) {
+    const size_t n = fread(flash.data(), 1, flash.size(), flash_file);
+    (void)n;
+  } else {
+    flash_file = fopen(path, "w+b");
+  }
+  flash_sync(0, flash.size());
+}
+
+void host_flash_fill(uint8_t value, size_t offset, size_t len) {
+  len = min(len, flash.size() - min(offset, flash.size()));
+  memset(&flash[offset], value, len);
+  flash_sync(offset, len);
+}
+
+uint8_t *host_flash_data() { return flash.data(); }
+size_t host_flash_size() { return flash.size(); }
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t,
+                                                 const char *label) {
+  if (type != ESP_PARTITION_TYPE_DATA || label == nullptr || strcmp(label, log_partition.label) != 0) {
+    return nullptr;
+  }
+  return &log_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size) {
+  if (!in_range(part, offset, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(dst, &flash[offset], size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size) {
+  if (!in_range(part, offset, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  const uint8_t *s = static_cast<const uint8_t *>(src);
+  for (size_t i = 0; i < size; ++i) {
+    flash[offset + i] &= s[i];
+  }
+  flash_sync(offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size) {
+  if (!in_range(part, offset, size) || offset % FLASH_SECTOR != 0 || size % FLASH_SECTOR != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(&flash[offset], 0xFF, size);
+  flash_sync(offset, size);
+  return ESP_OK;
+}
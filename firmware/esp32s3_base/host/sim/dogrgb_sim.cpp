@@ -0,0 +1,131 @@
+// dogrgb_sim: the whole firmware on the host (see harness.h).
+//
+//   dogrgb_sim --days 2 --synth                 two synthetic days, as fast as it runs
+//   dogrgb_sim --hours 1 --nmea walk.nmea --nvs nvs.bin --flash log.bin
+//   dogrgb_sim --minutes 5 --synth --realtime --port 8080
+//
+// With --realtime the virtual clock follows the wall clock, so time spent in
+// HTTP handlers shows up as late LED frames; run tools/portal_load.py against
+// the printed port. Otherwise virtual time only advances --step-ms per
+// loop() pass and days run in minutes.
+#include "../../src/main.cpp"
+
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+#include "harness.h"
+
+namespace {
+
+std::atomic<uint64_t> ble_notifies{0};
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--days N | --hours N | --minutes N | --seconds N] [--synth | --nmea FILE]\n"
+          "          [--nvs FILE] [--flash FILE] [--frames FILE] [--port N] [--step-ms N] [--ble] [--realtime]\n",
+          argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  SimOptions opt;
+  uint64_t run_ms = 60 * 1000;
+  bool synth = false;
+  bool ble = false;
+  bool realtime = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (a == "--days" && has_value) {
+      run_ms = strtoull(argv[++i], nullptr, 10) * 86400000ull;
+    } else if (a == "--hours" && has_value) {
+      run_ms = strtoull(argv[++i], nullptr, 10) * 3600000ull;
+    } else if (a == "--minutes" && has_value) {
+      run_ms = strtoull(argv[++i], nullptr, 10) * 60000ull;
+    } else if (a == "--seconds" && has_value) {
+      run_ms = strtoull(argv[++i], nullptr, 10) * 1000ull;
+    } else if (a == "--synth") {
+      synth = true;
+    } else if (a == "--nmea" && has_value) {
+      opt.nmea_path = argv[++i];
+    } else if (a == "--nvs" && has_value) {
+      opt.nvs_path = argv[++i];
+    } else if (a == "--flash" && has_value) {
+      opt.flash_path = argv[++i];
+    } else if (a == "--frames" && has_value) {
+      opt.frames_path = argv[++i];
+    } else if (a == "--port" && has_value) {
+      opt.http_port = static_cast<uint16_t>(atoi(argv[++i]));
+    } else if (a == "--step-ms" && has_value) {
+      opt.step_ms = std::max(1, atoi(argv[++i]));
+    } else if (a == "--ble") {
+      ble = true;
+    } else if (a == "--realtime") {
+      realtime = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  FirmwareSim sim(opt);
+  if (!sim.boot()) {
+    return 1;
+  }
+  host_ble_on_notify = [](const std::string &, const std::string &) { ble_notifies++; };
+
+  const auto real_start = std::chrono::steady_clock::now();
+  const uint64_t virtual_start = host_now_ms();
+  bool ble_connected = false;
+  while (host_now_ms() - virtual_start < run_ms) {
+    if (ble && !ble_connected && ble_ready) {
+      host_ble_connect(247);
+      ble_connected = true;
+    }
+    if (realtime) {
+      // Keep virtual time at wall-clock time since the start.
+      sim.run_ms(1, synth);
+      const uint64_t real_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now() - real_start)
+                                   .count();
+      if (virtual_start + real_ms > host_now_ms()) {
+        host_set_ms(virtual_start + real_ms);
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+      }
+    } else {
+      sim.run_ms(std::min<uint64_t>(1000, run_ms - (host_now_ms() - virtual_start)), synth);
+    }
+    if (opt.nmea_path != nullptr && sim.nmea_done() && GPS.host_pending() == 0) {
+      break;
+    }
+  }
+  const double real_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - real_start).count();
+
+  const SimStats &st = sim.stats();
+  const MetricsSnapshot m = metrics_pub.read();
+  fflush(stdout);
+  fprintf(stderr,
+          "[sim] virtual_s=%.1f real_s=%.1f speedup=%.0fx passes=%llu epochs=%llu gps_rx_dropped=%u\n"
+          "[sim] frames=%llu max_frame_gap_ms=%llu led_late=%lu led_max_gap_ms=%lu\n"
+          "[sim] date=%lu distance_m=%lu active_s=%lu max_kph=%.1f log_records=%lu\n",
+          (host_now_ms() - virtual_start) / 1000.0, real_s, (host_now_ms() - virtual_start) / 1000.0 / real_s,
+          static_cast<unsigned long long>(st.passes), static_cast<unsigned long long>(st.epochs),
+          GPS.host_rx_dropped(), static_cast<unsigned long long>(st.frames),
+          static_cast<unsigned long long>(st.max_frame_gap_ms), static_cast<unsigned long>(led_stats.late),
+          static_cast<unsigned long>(led_stats.max_gap_ms), static_cast<unsigned long>(m.date_yyyymmdd),
+          static_cast<unsigned long>(m.distance_m), static_cast<unsigned long>(m.active_time_ms / 1000),
+          m.max_speed_kph, static_cast<unsigned long>(log_size() / sizeof(LogRecord)));
+  if (ble) {
+    fprintf(stderr, "[sim] ble_connected=%d notifies=%llu\n", ble_connected ? 1 : 0,
+            static_cast<unsigned long long>(ble_notifies.load()));
+  }
+  save_metrics();
+  // Firmware tasks (BLE start, IMU, upload) are detached threads; leave
+  // without running static destructors under them.
+  fflush(stderr);
+  _exit(0);
+}
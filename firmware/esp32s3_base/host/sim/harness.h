@@ -0,0 +1,197 @@
+// Whole-firmware simulator: runs setup() and loop() from src/main.cpp (which
+// must be included first) on the virtual clock. GNSS epochs go into the GPS
+// UART once per virtual second, from an NMEA file or synthetic fixes; LED
+// frames are captured from FastLED.show(); NVS and the log partition can be
+// files; the portal listens on a real localhost port and BLE is the
+// in-process shim.
+#pragma once
+
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct SimOptions {
+  const char *nvs_path = nullptr;    // Preferences file (kept across runs).
+  const char *flash_path = nullptr;  // Log partition image.
+  const char *nmea_path = nullptr;   // NMEA log; one epoch per RMC sentence.
+  const char *frames_path = nullptr; // Binary LED frame dump.
+  uint32_t synth_start_unix = 1736121600; // 2025-01-06 00:00:00 UTC.
+  uint16_t http_port = 0;            // 0 = any free port.
+  uint32_t step_ms = 1;              // Virtual time per loop() pass.
+};
+
+struct SimStats {
+  uint64_t passes = 0;
+  uint64_t epochs = 0;
+  uint64_t frames = 0;
+  uint64_t max_frame_gap_ms = 0;
+  uint64_t last_frame_ms = 0;
+};
+
+class FirmwareSim {
+ public:
+  explicit FirmwareSim(const SimOptions &opt) : opt_(opt) {}
+
+  ~FirmwareSim() {
+    if (frames_out_ != nullptr) {
+      fclose(frames_out_);
+    }
+  }
+
+  bool boot() {
+    if (opt_.nmea_path != nullptr && !load_nmea(opt_.nmea_path)) {
+      fprintf(stderr, "cannot read %s\n", opt_.nmea_path);
+      return false;
+    }
+    if (opt_.frames_path != nullptr && (frames_out_ = fopen(opt_.frames_path, "wb")) == nullptr) {
+      fprintf(stderr, "cannot write %s\n", opt_.frames_path);
+      return false;
+    }
+    if (opt_.nvs_path != nullptr) {
+      host_nvs_open(opt_.nvs_path);
+    }
+    if (opt_.flash_path != nullptr) {
+      host_flash_open(opt_.flash_path);
+    }
+    host_http_port(opt_.http_port);
+    FastLED.host_on_show = [this](const HostLedFrame &f) { on_frame(f); };
+    synth_s_ = 0;
+    next_epoch_ms_ = host_now_ms() + 1000;
+    setup();
+    return true;
+  }
+
+  // Run loop() for ms of virtual time, feeding one GNSS epoch per second.
+  // Synthetic fixes are used when no NMEA file was given and synth is set.
+  void run_ms(uint64_t ms, bool synth) {
+    const uint64_t end = host_now_ms() + ms;
+    while (host_now_ms() < end) {
+      if (host_now_ms() >= next_epoch_ms_) {
+        next_epoch_ms_ += 1000;
+        feed_epoch(synth);
+      }
+      loop();
+      stats_.passes++;
+      host_advance_ms(opt_.step_ms);
+    }
+  }
+
+  const SimStats &stats() const { return stats_; }
+  bool nmea_done() const { return !epochs_.empty() && next_line_ >= epochs_.size(); }
+
+  // One RMC sentence, as tools/nmea_replay.py writes them.
+  static std::string rmc(uint32_t unix_s, double lat, double lon, double knots) {
+    const time_t t = static_cast<time_t>(unix_s);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char body[128];
+    snprintf(body, sizeof(body), "GNRMC,%02d%02d%02d.00,A,%s,%c,%s,%c,%.1f,0.0,%02d%02d%02d,,,A", tm.tm_hour,
+             tm.tm_min, tm.tm_sec, dm(lat, 2).c_str(), lat < 0 ? 'S' : 'N', dm(lon, 3).c_str(), lon < 0 ? 'W' : 'E',
+             knots, tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+    uint8_t sum = 0;
+    for (const char *p = body; *p != '\0'; ++p) {
+      sum ^= static_cast<uint8_t>(*p);
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "$%s*%02X\r\n", body, sum);
+    return line;
+  }
+
+  // tools/nmea_replay.py --synth: a 10 min walk at 5 km/h, 10 min at
+  // 14 km/h, then 2.5 h of rest, repeating, while turning slowly.
+  static double synth_kph(uint32_t s) {
+    const uint32_t phase = (s / 600) % 18;
+    return phase > 3 ? 0.0 : (phase < 3 ? 5.0 : 14.0);
+  }
+
+ private:
+  static std::string dm(double v, int width) {
+    v = fabs(v);
+    const int deg = static_cast<int>(v);
+    char out[32];
+    snprintf(out, sizeof(out), "%0*d%07.4f", width, deg, (v - deg) * 60.0);
+    return out;
+  }
+
+  bool load_nmea(const char *path) {
+    std::ifstream in(path);
+    if (!in) {
+      return false;
+    }
+    std::string line;
+    std::string epoch;
+    while (std::getline(in, line)) {
+      while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+        line.pop_back();
+      }
+      if (line.empty() || line[0] != '$') {
+        continue;
+      }
+      epoch += line + "\r\n";
+      if (line.compare(3, 3, "RMC") == 0) {
+        epochs_.push_back(epoch);
+        epoch.clear();
+      }
+    }
+    return true;
+  }
+
+  void feed_epoch(bool synth) {
+    std::string bytes;
+    if (!epochs_.empty()) {
+      if (next_line_ < epochs_.size()) {
+        bytes = epochs_[next_line_++];
+      }
+    } else if (synth) {
+      const double kph = synth_kph(synth_s_);
+      heading_ += 0.02;
+      const double step = kph / 3.6 / 111320.0;
+      lat_ += step * cos(heading_);
+      lon_ += step * sin(heading_) / cos(lat_ * M_PI / 180.0);
+      bytes = rmc(opt_.synth_start_unix + synth_s_, lat_, lon_, kph / 1.852);
+      synth_s_++;
+    }
+    if (!bytes.empty()) {
+      GPS.host_feed(reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size());
+      stats_.epochs++;
+    }
+  }
+
+  void on_frame(const HostLedFrame &f) {
+    if (stats_.frames > 0) {
+      stats_.max_frame_gap_ms = std::max<uint64_t>(stats_.max_frame_gap_ms, f.ms - stats_.last_frame_ms);
+    }
+    stats_.last_frame_ms = f.ms;
+    stats_.frames++;
+    if (frames_out_ == nullptr) {
+      return;
+    }
+    // Record: u64 ms, u8 brightness, u8 strips, then per strip u16 count
+    // and count x RGB in wire order (little-endian).
+    const uint8_t head[10] = {static_cast<uint8_t>(f.ms),       static_cast<uint8_t>(f.ms >> 8),
+                              static_cast<uint8_t>(f.ms >> 16), static_cast<uint8_t>(f.ms >> 24),
+                              static_cast<uint8_t>(f.ms >> 32), static_cast<uint8_t>(f.ms >> 40),
+                              static_cast<uint8_t>(f.ms >> 48), static_cast<uint8_t>(f.ms >> 56),
+                              f.brightness,                     static_cast<uint8_t>(f.strips.size())};
+    fwrite(head, 1, sizeof(head), frames_out_);
+    for (const CLEDController *c : f.strips) {
+      const uint16_t n = static_cast<uint16_t>(c->size());
+      const uint8_t len[2] = {static_cast<uint8_t>(n), static_cast<uint8_t>(n >> 8)};
+      fwrite(len, 1, 2, frames_out_);
+      fwrite(const_cast<CLEDController *>(c)->leds(), sizeof(CRGB), n, frames_out_);
+    }
+  }
+
+  SimOptions opt_;
+  SimStats stats_;
+  FILE *frames_out_ = nullptr;
+  std::vector<std::string> epochs_;
+  size_t next_line_ = 0;
+  uint64_t next_epoch_ms_ = 0;
+  uint32_t synth_s_ = 0;
+  double lat_ = -34.6;
+  double lon_ = -58.4;
+  double heading_ = 0.0;
+};
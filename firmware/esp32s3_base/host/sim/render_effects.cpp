@@ -0,0 +1,207 @@
+// Offline effect renderer: runs the firmware's effect simulator
+// (sim_run_case() in src/main.cpp) on the host against the FastLED shim and
+// writes each case as a PNG (one row per frame, one column per LED) or
+// checks the case CRCs against a golden file.
+//
+//   dogrgb_render --png out/             effect<E>_range<R>.png at 50 LEDs
+//   dogrgb_render --crc                  print "effect range len crc" lines
+//   dogrgb_render --check golden.txt     exit 1 if any CRC differs
+//   dogrgb_render --record golden.txt    rewrite the golden file
+#include "../../src/main.cpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int PNG_SCALE = 4; // Pixels per LED and per frame.
+
+std::vector<CRGB> frames;
+
+void collect_frame(const CRGB *leds, int length) { frames.insert(frames.end(), leds, leds + length); }
+
+void put_u32_be(std::string &out, uint32_t v) {
+  out += static_cast<char>(v >> 24);
+  out += static_cast<char>(v >> 16);
+  out += static_cast<char>(v >> 8);
+  out += static_cast<char>(v);
+}
+
+void png_chunk(std::string &png, const char *type, const std::string &data) {
+  put_u32_be(png, static_cast<uint32_t>(data.size()));
+  const std::string body = std::string(type, 4) + data;
+  png += body;
+  put_u32_be(png, crc32_update(0, reinterpret_cast<const uint8_t *>(body.data()), body.size()));
+}
+
+// 8-bit RGB PNG; the image data is a zlib stream of stored (uncompressed)
+// deflate blocks, which every decoder accepts.
+bool write_png(const char *path, const std::vector<CRGB> &pixels, int width, int height) {
+  std::string raw;
+  for (int y = 0; y < height; ++y) {
+    raw += '\0'; // Filter: none.
+    for (int x = 0; x < width; ++x) {
+      const CRGB &c = pixels[y * width + x];
+      raw += static_cast<char>(c.r);
+      raw += static_cast<char>(c.g);
+      raw += static_cast<char>(c.b);
+    }
+  }
+  std::string z = "\x78\x01";
+  for (size_t at = 0; at < raw.size() || at == 0; at += 65535) {
+    const size_t n = std::min<size_t>(65535, raw.size() - at);
+    z += static_cast<char>(at + n >= raw.size() ? 1 : 0);
+    z += static_cast<char>(n & 0xFF);
+    z += static_cast<char>(n >> 8);
+    z += static_cast<char>(~n & 0xFF);
+    z += static_cast<char>((~n >> 8) & 0xFF);
+    z.append(raw, at, n);
+  }
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (unsigned char c : raw) {
+    a = (a + c) % 65521;
+    b = (b + a) % 65521;
+  }
+  put_u32_be(z, (b << 16) | a);
+
+  std::string ihdr;
+  put_u32_be(ihdr, static_cast<uint32_t>(width));
+  put_u32_be(ihdr, static_cast<uint32_t>(height));
+  ihdr += std::string("\x08\x02\x00\x00\x00", 5); // 8 bit, RGB.
+  std::string png = "\x89PNG\r\n\x1a\n";
+  png_chunk(png, "IHDR", ihdr);
+  png_chunk(png, "IDAT", z);
+  png_chunk(png, "IEND", std::string());
+
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  const bool ok = fwrite(png.data(), 1, png.size(), f) == png.size();
+  return fclose(f) == 0 && ok;
+}
+
+// Renders one case the way the device's `sim` does (seeded RNG, virtual
+// clock, compile-time defaults).
+SimResult render_case(int effect_id, uint8_t range, int length, bool keep_frames) {
+  frames.clear();
+  sim_active = true;
+  const SimResult r = sim_run_case(effect_id, range, length, keep_frames ? collect_frame : nullptr);
+  sim_active = false;
+  return r;
+}
+
+int write_pngs(const std::string &dir) {
+  for (int effect_id = 0; effect_id < SIM_EFFECT_COUNT; ++effect_id) {
+    for (uint8_t range = 1; range <= 6; ++range) {
+      render_case(effect_id, range, SIM_MAX_LEDS, true);
+      const int height = static_cast<int>(frames.size() / SIM_MAX_LEDS);
+      std::vector<CRGB> scaled;
+      for (int y = 0; y < height * PNG_SCALE; ++y) {
+        for (int x = 0; x < SIM_MAX_LEDS * PNG_SCALE; ++x) {
+          scaled.push_back(frames[(y / PNG_SCALE) * SIM_MAX_LEDS + x / PNG_SCALE]);
+        }
+      }
+      char path[512];
+      snprintf(path, sizeof(path), "%s/effect%02d_range%u.png", dir.c_str(), effect_id, range);
+      if (!write_png(path, scaled, SIM_MAX_LEDS * PNG_SCALE, height * PNG_SCALE)) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+      }
+    }
+  }
+  printf("wrote %d PNGs to %s\n", SIM_EFFECT_COUNT * 6, dir.c_str());
+  return 0;
+}
+
+std::string crc_lines() {
+  std::string out;
+  for (int effect_id = 0; effect_id < SIM_EFFECT_COUNT; ++effect_id) {
+    for (uint8_t range = 1; range <= 6; ++range) {
+      for (int li = 0; li < SIM_LENGTH_COUNT; ++li) {
+        const SimResult r = render_case(effect_id, range, SIM_STRIP_LENGTHS[li], false);
+        char line[64];
+        snprintf(line, sizeof(line), "%d %u %d %08lx\n", effect_id, range, SIM_STRIP_LENGTHS[li],
+                 static_cast<unsigned long>(r.crc));
+        out += line;
+      }
+    }
+  }
+  return out;
+}
+
+int check_golden(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == nullptr) {
+    fprintf(stderr, "cannot read %s (run --record)\n", path);
+    return 1;
+  }
+  std::map<std::string, std::string> golden;
+  char line[128];
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    char key[32];
+    char crc[16];
+    int e, r, l;
+    if (line[0] != '#' && sscanf(line, "%d %d %d %15s", &e, &r, &l, crc) == 4) {
+      snprintf(key, sizeof(key), "%d %d %d", e, r, l);
+      golden[key] = crc;
+    }
+  }
+  fclose(f);
+
+  int failures = 0;
+  int cases = 0;
+  const std::string now = crc_lines();
+  for (size_t at = 0; at < now.size();) {
+    const size_t eol = now.find('\n', at);
+    const std::string l = now.substr(at, eol - at);
+    at = eol + 1;
+    const size_t sp = l.rfind(' ');
+    const std::string key = l.substr(0, sp);
+    const std::string crc = l.substr(sp + 1);
+    cases++;
+    const auto it = golden.find(key);
+    if (it == golden.end() || it->second != crc) {
+      failures++;
+      fprintf(stderr, "effect/range/len %s: crc %s, golden %s\n", key.c_str(), crc.c_str(),
+              it == golden.end() ? "missing" : it->second.c_str());
+    }
+  }
+  printf("sim golden: cases=%d failures=%d\n", cases, failures);
+  return failures == 0 ? 0 : 1;
+}
+
+int record_golden(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (f == nullptr) {
+    fprintf(stderr, "cannot write %s\n", path);
+    return 1;
+  }
+  fprintf(f, "# effect range len crc32 of all frames (host/sim/render_effects.cpp --record)\n");
+  fputs(crc_lines().c_str(), f);
+  fclose(f);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::string mode = argc > 1 ? argv[1] : "";
+  if (mode == "--png" && argc > 2) {
+    return write_pngs(argv[2]);
+  }
+  if (mode == "--crc") {
+    fputs(crc_lines().c_str(), stdout);
+    return 0;
+  }
+  if (mode == "--check" && argc > 2) {
+    return check_golden(argv[2]);
+  }
+  if (mode == "--record" && argc > 2) {
+    return record_golden(argv[2]);
+  }
+  fprintf(stderr, "usage: %s --png DIR | --crc | --check FILE | --record FILE\n", argv[0]);
+  return 2;
+}
@@ -0,0 +1,34 @@
+// Minimal checks for the host tests: CHECK() logs and counts failures,
+// check_done() prints the summary and returns the process exit code.
+#pragma once
+
+#include <cstdio>
+
+static int check_failures = 0;
+static int check_count = 0;
+
+#define CHECK(cond)                                                          \
+  do {                                                                       \
+    check_count++;                                                           \
+    if (!(cond)) {                                                           \
+      check_failures++;                                                      \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+    }                                                                        \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                                          \
+  do {                                                                                          \
+    check_count++;                                                                              \
+    const long long check_a = static_cast<long long>(a);                                        \
+    const long long check_b = static_cast<long long>(b);                                        \
+    if (check_a != check_b) {                                                                   \
+      check_failures++;                                                                         \
+      fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %s (%lld vs %lld)\n", __FILE__, __LINE__, \
+              #a, #b, check_a, check_b);                                                        \
+    }                                                                                           \
+  } while (0)
+
+static int check_done(const char *name) {
+  fprintf(stderr, "%s: %d checks, %d failed\n", name, check_count, check_failures);
+  return check_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+// One HTTP request against the firmware's `server` (include after main.cpp
+// and call setup_http() first): the request is written from this thread,
+// server.handleClient() serves it and a reader thread collects the reply.
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+struct HttpReply {
+  int status = 0;
+  std::string headers;
+  std::string body;
+};
+
+static std::string http_dechunk(const std::string &in) {
+  std::string out;
+  size_t at = 0;
+  while (at < in.size()) {
+    const size_t eol = in.find("\r\n", at);
+    if (eol == std::string::npos) {
+      break;
+    }
+    const size_t len = strtoul(in.substr(at, eol - at).c_str(), nullptr, 16);
+    if (len == 0) {
+      break;
+    }
+    out += in.substr(eol + 2, len);
+    at = eol + 2 + len + 2;
+  }
+  return out;
+}
+
+static HttpReply http_request(const char *method, const std::string &path, const std::string &body = std::string(),
+                              const char *content_type = "application/json") {
+  HttpReply reply;
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(host_http_bound_port());
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return reply;
+  }
+  std::string request = std::string(method) + " " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+  if (!body.empty()) {
+    request += std::string("Content-Type: ") + content_type + "\r\nContent-Length: " + std::to_string(body.size()) +
+               "\r\n";
+  }
+  request += "\r\n" + body;
+  send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+
+  std::string raw;
+  std::thread reader([fd, &raw]() {
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+      raw.append(buf, static_cast<size_t>(n));
+    }
+  });
+  server.handleClient();
+  reader.join();
+  close(fd);
+
+  const size_t head_end = raw.find("\r\n\r\n");
+  if (head_end == std::string::npos) {
+    return reply;
+  }
+  reply.headers = raw.substr(0, head_end);
+  reply.body = raw.substr(head_end + 4);
+  sscanf(raw.c_str(), "HTTP/1.1 %d", &reply.status);
+  if (reply.headers.find("Transfer-Encoding: chunked") != std::string::npos) {
+    reply.body = http_dechunk(reply.body);
+  }
+  return reply;
+}
+
+static void http_start() {
+  host_http_port(0);
+  setup_http();
+}
@@ -0,0 +1,99 @@
+// BLE bulk transfer over a link with few controller buffers, drained one
+// notification per loop pass: a full-day timeline requested from another
+// thread (the BLE task's mailbox) arrives whole, in order and matching the
+// CRC-32 of the START response, with no notification refused, whether the
+// credits or the CONGEST event are what hold the sender back. Pumping
+// without flow control on the same link loses chunks.
+#include "../../src/main.cpp"
+
+#include <thread>
+
+#include "check.h"
+
+struct Received {
+  std::string data;
+  uint32_t total = 0;
+  uint32_t crc = 0;
+  uint32_t bad_chunks = 0;
+  int done_status = -1;
+};
+
+static Received rx;
+
+static void on_notify(const std::string &uuid, const std::string &value) {
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(value.data());
+  if (uuid == BLE_BULK_CONTROL_UUID && value.size() == 11) {
+    if (b[0] == (BULK_OP_START | 0x80)) {
+      rx.total = get_u32_le(&b[3]);
+      rx.crc = get_u32_le(&b[7]);
+    } else if (b[0] == (BULK_OP_DONE | 0x80)) {
+      rx.done_status = b[1];
+    }
+    return;
+  }
+  const size_t n = value.size() - BULK_CHUNK_OVERHEAD;
+  const bool ok = value.size() > BULK_CHUNK_OVERHEAD && get_u32_le(b) == rx.data.size() &&
+                  get_u32_le(b + 4 + n) == crc32_update(0, b, 4 + n);
+  if (!ok) {
+    rx.bad_chunks++;
+    return;
+  }
+  rx.data.append(value, 4, n);
+}
+
+static void request_timeline() {
+  uint8_t req[BULK_REQUEST_LEN] = {BULK_OP_START, BULK_OBJ_TIMELINE};
+  host_ble_write(BLE_BULK_CONTROL_UUID, req, sizeof(req));
+}
+
+static void transfer(size_t buffers) {
+  host_ble_link(buffers);
+  rx = Received();
+  std::thread central(request_timeline);
+  size_t most_queued = 0;
+  uint32_t passes = 0;
+  while (rx.done_status < 0 && passes < 1000000) {
+    bulk_poll();
+    most_queued = max(most_queued, host_ble_queued());
+    host_ble_deliver(1);
+    passes++;
+  }
+  central.join();
+  CHECK_EQ(rx.done_status, static_cast<int>(BULK_OK));
+  CHECK_EQ(host_ble_dropped(), 0u);
+  CHECK_EQ(rx.bad_chunks, 0u);
+  CHECK_EQ(rx.total, sizeof(timeline));
+  CHECK_EQ(rx.data.size(), sizeof(timeline));
+  CHECK_EQ(crc32_update(0, reinterpret_cast<const uint8_t *>(rx.data.data()), rx.data.size()), rx.crc);
+  CHECK(most_queued <= min<size_t>(buffers, BLE_BULK_CREDITS));
+  printf("ble: %zu buffers, %zu bytes in %u passes, at most %zu queued, %u waits\n", buffers, rx.data.size(),
+         passes, most_queued, bulk.waits);
+}
+
+static void test_without_flow_control() {
+  host_ble_link(3);
+  BulkTransfer t = {};
+  t.data = reinterpret_cast<const uint8_t *>(timeline);
+  t.total = sizeof(timeline);
+  bulk_pump(t, bulk_notify_sink, 247, 8);
+  CHECK_EQ(host_ble_dropped(), 5u);
+  host_ble_deliver(3);
+  host_ble_link(0);
+}
+
+int main() {
+  current_date_yyyymmdd = 20250102;
+  last_update_min = TIMELINE_MINUTES;
+  for (int m = 0; m < TIMELINE_MINUTES; ++m) {
+    timeline[m] = {static_cast<uint16_t>(m * 7), static_cast<uint8_t>(m % 61), static_cast<uint8_t>(m)};
+  }
+  host_serial_capture(true);
+  setup_ble();
+  host_ble_on_notify = on_notify;
+  host_ble_connect(247);
+  transfer(3); // Fewer buffers than credits: CONGEST_EVT stops the sender.
+  transfer(32); // More buffers than credits: the credits do.
+  test_without_flow_control();
+  host_serial_capture(false);
+  return check_done("test_ble");
+}
@@ -0,0 +1,230 @@
+// CBOR transcoding: each CBOR endpoint's JSON written through CborStream
+// and decoded back with cbor_item_to_json() must carry the same strings,
+// structure and numbers (float32 precision) as the JSON; a config sent as
+// CBOR parses to the same RuntimeConfig; \u escapes, including surrogate
+// pairs, come out as UTF-8; long strings are chunked; malformed input is
+// rejected. Prints bytes and encode/decode time per endpoint.
+#include "../../src/main.cpp"
+
+#include <chrono>
+
+#include "check.h"
+
+static std::string to_json(void (*writer)(Print &)) {
+  static char text[8192];
+  BufferPrint out(text, sizeof(text));
+  writer(out);
+  return std::string(text, out.len);
+}
+
+static std::string to_cbor(void (*writer)(Print &)) {
+  static char bin[8192];
+  BufferPrint out(bin, sizeof(bin));
+  {
+    CborStream stream(out);
+    writer(stream);
+  }
+  return std::string(bin, out.len);
+}
+
+static std::string cbor_of(const char *json) {
+  static char bin[1024];
+  BufferPrint out(bin, sizeof(bin));
+  {
+    CborStream stream(out);
+    stream.print(json);
+  }
+  return std::string(bin, out.len);
+}
+
+static std::string back_to_json(const std::string &cbor) {
+  static char text[8192];
+  const size_t n = cbor_to_json(reinterpret_cast<const uint8_t *>(cbor.data()), cbor.size(), text, sizeof(text));
+  return std::string(text, n);
+}
+
+// Test oracle: a JSON string's content as UTF-8 (p at the opening quote).
+static std::string json_string(const char *&p) {
+  std::string out;
+  uint32_t high = 0;
+  auto put = [&out](uint32_t cp) {
+    if (cp < 0x80) {
+      out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      out += static_cast<char>(0xC0 | (cp >> 6));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      out += static_cast<char>(0xE0 | (cp >> 12));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (cp >> 18));
+      out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  };
+  for (++p; *p != '"'; ++p) {
+    if (*p != '\\') {
+      out += *p;
+      continue;
+    }
+    ++p;
+    if (*p == 'u') {
+      const uint32_t cp = static_cast<uint32_t>(strtoul(std::string(p + 1, 4).c_str(), nullptr, 16));
+      p += 4;
+      if (cp >= 0xD800 && cp <= 0xDBFF) {
+        high = cp;
+      } else if (cp >= 0xDC00 && cp <= 0xDFFF && high != 0) {
+        put(0x10000 + ((high - 0xD800) << 10) + (cp - 0xDC00));
+        high = 0;
+      } else {
+        put(cp);
+      }
+    } else {
+      const char *from = "bfnrt";
+      const char *to = "\b\f\n\r\t";
+      const char *at = strchr(from, *p);
+      out += at != nullptr ? to[at - from] : *p;
+    }
+  }
+  ++p;
+  return out;
+}
+
+// Same tokens; numbers equal to float32 precision.
+static bool same_json(const std::string &a, const std::string &b) {
+  const char *p = a.c_str();
+  const char *q = b.c_str();
+  while (*p != '\0' && *q != '\0') {
+    if (*p == '"' || *q == '"') {
+      if (*p != *q || json_string(p) != json_string(q)) {
+        return false;
+      }
+    } else if (*p == '-' || isdigit(static_cast<unsigned char>(*p))) {
+      char *pe = nullptr;
+      char *qe = nullptr;
+      const double x = strtod(p, &pe);
+      const double y = strtod(q, &qe);
+      if (qe == q || fabs(x - y) > 1e-6 * max(1.0, fabs(x))) {
+        fprintf(stderr, "number %.9g vs %.9g at %.20s\n", x, y, p);
+        return false;
+      }
+      p = pe;
+      q = qe;
+    } else if (*p++ != *q++) {
+      fprintf(stderr, "json differs at %.20s\n", p - 1);
+      return false;
+    }
+  }
+  return *p == *q;
+}
+
+struct Endpoint {
+  const char *name;
+  void (*writer)(Print &);
+};
+
+static const Endpoint ENDPOINTS[] = {{"summary", write_summary_json}, {"status", write_status_json},
+                                     {"config", write_config_json}, {"zones", write_zones_json}};
+
+static void test_endpoints_round_trip() {
+  for (const Endpoint &e : ENDPOINTS) {
+    const std::string json = to_json(e.writer);
+    const std::string back = back_to_json(to_cbor(e.writer));
+    CHECK(!back.empty());
+    const bool same = same_json(json, back);
+    if (!same) {
+      fprintf(stderr, "%s differs after the round trip\n", e.name);
+    }
+    CHECK(same);
+  }
+
+  // A config POSTed as CBOR parses like the JSON one.
+  const std::string json = to_json(write_config_json);
+  const std::string back = back_to_json(to_cbor(write_config_json));
+  RuntimeConfig from_json = g_cfg;
+  RuntimeConfig from_cbor = g_cfg;
+  JsonDocument a;
+  JsonDocument b;
+  CHECK(!deserializeJson(a, json.c_str()) && parse_config_json(a, from_json) == nullptr);
+  CHECK(!deserializeJson(b, back.c_str()) && parse_config_json(b, from_cbor) == nullptr);
+  CHECK(memcmp(&from_json, &from_cbor, sizeof(RuntimeConfig)) == 0);
+}
+
+static void test_strings() {
+  // Dog face (surrogate pair), e-acute, lone high and low halves, escapes.
+  const std::string cbor = cbor_of("[\"\\ud83d\\udc36 \\u00e9 \\ud800x \\udc00 \\ud83d\\n\\\"\\u003c ok\"]");
+  const std::string want = "\xF0\x9F\x90\xB6 \xC3\xA9 \xEF\xBF\xBDx \xEF\xBF\xBD \xEF\xBF\xBD\n\"< ok";
+  // 0x9F 0x78 len: indefinite array, text string with a one-byte length.
+  CHECK(cbor.size() == 4 + want.size() && static_cast<uint8_t>(cbor[1]) == 0x78);
+  CHECK(cbor.compare(3, want.size(), want) == 0);
+  const std::string back = back_to_json(cbor);
+  const char *p = back.c_str() + 1;
+  CHECK(json_string(p) == want);
+
+  // Longer than the 64-byte string buffer: indefinite chunked string.
+  std::string long_json = "{\"k\":\"";
+  for (int i = 0; i < 300; ++i) {
+    long_json += static_cast<char>('a' + i % 26);
+  }
+  long_json += "\"}";
+  const std::string long_cbor = cbor_of(long_json.c_str());
+  CHECK(long_cbor.find('\x7F') != std::string::npos);
+  CHECK(back_to_json(long_cbor) == long_json);
+}
+
+static void test_rejects() {
+  const uint8_t truncated[] = {0xBF, 0x61, 'a'};
+  const uint8_t tagged[] = {0xC1, 0x00};
+  const uint8_t bytes[] = {0x42, 0x01, 0x02};
+  const uint8_t trailing[] = {0x01, 0x02};
+  uint8_t deep[12];
+  memset(deep, 0x81, sizeof(deep));
+  deep[11] = 0x00;
+  char text[64];
+  CHECK_EQ(cbor_to_json(truncated, sizeof(truncated), text, sizeof(text)), 0u);
+  CHECK_EQ(cbor_to_json(tagged, sizeof(tagged), text, sizeof(text)), 0u);
+  CHECK_EQ(cbor_to_json(bytes, sizeof(bytes), text, sizeof(text)), 0u);
+  CHECK_EQ(cbor_to_json(trailing, sizeof(trailing), text, sizeof(text)), 0u);
+  CHECK_EQ(cbor_to_json(deep, sizeof(deep), text, sizeof(text)), 0u);
+}
+
+static void bench() {
+  const int runs = 2000;
+  for (const Endpoint &e : ENDPOINTS) {
+    CountingPrint json;
+    CountingPrint cbor;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+      json.count = 0;
+      e.writer(json);
+    }
+    const double json_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+      cbor.count = 0;
+      CborStream stream(cbor);
+      e.writer(stream);
+    }
+    const double cbor_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    const std::string bin = to_cbor(e.writer);
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+      back_to_json(bin);
+    }
+    const double decode_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    printf("cbor %-7s json_bytes=%zu cbor_bytes=%zu (%.0f%%) json_us=%.2f cbor_us=%.2f decode_us=%.2f\n", e.name,
+           json.count, cbor.count, 100.0 * cbor.count / json.count, json_us / runs, cbor_us / runs,
+           decode_us / runs);
+  }
+}
+
+int main() {
+  set_default_config();
+  test_endpoints_round_trip();
+  test_strings();
+  test_rejects();
+  bench();
+  return check_done("test_cbor");
+}
@@ -0,0 +1,127 @@
+// Whole firmware on the virtual clock (sim/harness.h): 20 minutes of NMEA
+// from a file through the GPS UART, then checks the metrics, the LED frame
+// cadence, /api/summary and /api/config over HTTP, the BLE summary
+// characteristic (BLE started no earlier than the first fix) and the NVS
+// file. Also checks that the first fix is sampled
+// whatever its timestamp.
+#include "../../src/main.cpp"
+
+#include <unistd.h>
+
+#include "../sim/harness.h"
+#include "check.h"
+#include "http.h"
+
+static std::string temp_path(const char *name) {
+  return "/tmp/dogrgb_" + std::to_string(getpid()) + "_" + name;
+}
+
+// A fix whose unix time * 1000 wraps to under a second used to be skipped,
+// because samples were spaced on that product.
+static void test_first_fix_sampled() {
+  has_last_point = false;
+  last_sample_s = 0;
+  const std::string line = FirmwareSim::rmc(1739461755, 40.4, -3.7, 2.0); // 2025-02-13 15:49:15.
+  char buf[160];
+  set_str(buf, line.substr(0, line.size() - 2).c_str());
+  handle_nmea_line(buf);
+  CHECK(has_last_point);
+}
+
+static void write_nmea(const std::string &path, int seconds) {
+  FILE *f = fopen(path.c_str(), "w");
+  double lat = -34.6;
+  double lon = -58.4;
+  double heading = 0.0;
+  for (int s = 0; s < seconds; ++s) {
+    const double kph = FirmwareSim::synth_kph(static_cast<uint32_t>(s));
+    heading += 0.02;
+    const double step = kph / 3.6 / 111320.0;
+    lat += step * cos(heading);
+    lon += step * sin(heading) / cos(lat * M_PI / 180.0);
+    // Other sentences in the epoch are ignored by the firmware.
+    fprintf(f, "$GNGGA,000000.00,,,,,0,00,99.99,,,,,,*56\r\n");
+    fputs(FirmwareSim::rmc(1736121600 + s, lat, lon, kph / 1.852).c_str(), f);
+  }
+  fclose(f);
+}
+
+static void test_twenty_minutes() {
+  const std::string nmea = temp_path("walk.nmea");
+  const std::string nvs = temp_path("nvs.bin");
+  write_nmea(nmea, 20 * 60);
+  SimOptions opt;
+  opt.nmea_path = nmea.c_str();
+  opt.nvs_path = nvs.c_str();
+  FirmwareSim sim(opt);
+  host_serial_capture(true);
+  CHECK(sim.boot());
+  sim.run_ms(20 * 60 * 1000 + 2000, false);
+  // BLE waited for the first fix.
+  CHECK(Serial.host_take_tx().find("ble start: first_fix") != std::string::npos);
+
+  // 20 min at 5 km/h, within the GNSS step rounding.
+  const MetricsSnapshot m = metrics_pub.read();
+  CHECK_EQ(m.date_yyyymmdd, 20250106u);
+  CHECK(fabsf(m.distance_exact_m - 1666.7f) < 1666.7f * 0.03f);
+  CHECK(m.active_time_ms >= 1190u * 1000u);
+  CHECK_EQ(sim.stats().epochs, 1200u);
+  CHECK_EQ(GPS.host_rx_dropped(), 0u);
+
+  // LED frames kept their cadence on the virtual clock.
+  CHECK(sim.stats().frames > 20u * 60u * 1000u / LED_UPDATE_MS / 2);
+  CHECK_EQ(led_stats.late, 0u);
+
+  // Portal over a real socket.
+  CHECK(boot_ms.portal_ms != 0);
+  HttpReply r = http_request("GET", "/api/summary");
+  CHECK_EQ(r.status, 200);
+  JsonDocument doc;
+  CHECK(!deserializeJson(doc, r.body.c_str()));
+  CHECK_EQ(doc["date"] | 0u, 20250106u);
+  CHECK(fabsf((doc["distance_m"] | 0.0f) - m.distance_exact_m) < 1.0f);
+
+  r = http_request("GET", "/api/config");
+  CHECK_EQ(r.status, 200);
+  CHECK(!deserializeJson(doc, r.body.c_str()));
+  CHECK_EQ(doc["led"]["brightness"] | -1, g_cfg.brightness);
+  doc["led"]["brightness"] = 40;
+  String body;
+  serializeJson(doc, body);
+  r = http_request("POST", "/api/config", body.c_str());
+  CHECK_EQ(r.status, 200);
+  CHECK_EQ(g_cfg.brightness, 40);
+
+  // BLE summary: date and rounded distance, little-endian.
+  for (int i = 0; i < 200 && !ble_ready; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  CHECK(ble_ready);
+  host_ble_connect(247);
+  sim.run_ms(10, false);
+  const std::string summary = host_ble_read(BLE_CHAR_UUID);
+  CHECK_EQ(summary.size(), 16u);
+  if (summary.size() == 16) {
+    const uint8_t *b = reinterpret_cast<const uint8_t *>(summary.data());
+    CHECK_EQ(b[0] | b[1] << 8 | b[2] << 16 | static_cast<uint32_t>(b[3]) << 24, 20250106u);
+    CHECK_EQ(b[4] | b[5] << 8 | b[6] << 16 | static_cast<uint32_t>(b[7]) << 24, m.distance_m);
+  }
+
+  // Metrics and config are in the NVS file.
+  save_metrics();
+  host_nvs_open(nvs.c_str());
+  Preferences check;
+  CHECK(check.begin("dogrgb_cfg", true));
+  CHECK_EQ(check.getUChar("brightness", 0), 40);
+  host_serial_capture(false);
+  unlink(nmea.c_str());
+  unlink(nvs.c_str());
+}
+
+int main() {
+  test_first_fix_sampled();
+  test_twenty_minutes();
+  const int rc = check_done("test_firmware");
+  fflush(stderr);
+  _exit(rc); // Firmware tasks are still running as detached threads.
+}
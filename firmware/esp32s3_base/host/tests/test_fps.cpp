@@ -0,0 +1,70 @@
+// Frame-rate independence: every effect rendered at each SIM_FPS_PERIODS
+// period must match the LED_UPDATE_MS run at the common SIM_SNAP_MS
+// timestamps, pixel for pixel (CONFETTI only up to LED_UPDATE_MS). Then the
+// whole firmware on the virtual clock: the body runs at the fast adaptive
+// period, and the late counter ignores gaps under two LED_UPDATE_MS
+// periods but counts a real stall.
+#include "../../src/main.cpp"
+
+#include <unistd.h>
+
+#include "../sim/harness.h"
+#include "check.h"
+
+static void test_motion_matches() {
+  static const int len = SIM_MAX_LEDS;
+  static const int snaps = SIM_FRAMES * LED_UPDATE_MS / SIM_SNAP_MS;
+  static CRGB ref[snaps * len];
+  static CRGB run[snaps * len];
+  sim_active = true;
+  for (int effect_id = 0; effect_id < SIM_EFFECT_COUNT; ++effect_id) {
+    for (uint8_t range = 1; range <= 6; ++range) {
+      sim_run_case(effect_id, range, len, nullptr, LED_UPDATE_MS, ref);
+      for (uint32_t period : SIM_FPS_PERIODS) {
+        if (effect_id == 6 && period > LED_UPDATE_MS) {
+          continue;
+        }
+        sim_run_case(effect_id, range, len, nullptr, period, run);
+        const bool same = memcmp(ref, run, sizeof(ref)) == 0;
+        if (!same) {
+          fprintf(stderr, "effect %d range %u at %lu ms differs\n", effect_id, range,
+                  static_cast<unsigned long>(period));
+        }
+        CHECK(same);
+      }
+    }
+  }
+  sim_active = false;
+}
+
+static void test_late_frames() {
+  SimOptions opt;
+  FirmwareSim sim(opt);
+  host_serial_capture(true);
+  CHECK(sim.boot());
+  sim.run_ms(5000, true);
+  CHECK(has_gps_fix);
+  CHECK(led_frame_ms < LED_UPDATE_MS);
+  CHECK_EQ(led_stats.late, 0u);
+
+  // Over two fast periods but under two LED_UPDATE_MS: on time.
+  host_advance_ms(LED_UPDATE_MS + LED_UPDATE_MS / 2);
+  sim.run_ms(200, true);
+  CHECK_EQ(led_stats.late, 0u);
+
+  // loop() blocked for three reference periods: late.
+  host_advance_ms(3 * LED_UPDATE_MS);
+  sim.run_ms(200, true);
+  CHECK_EQ(led_stats.late, 1u);
+  CHECK(led_stats.max_gap_ms >= 3 * LED_UPDATE_MS);
+  Serial.host_take_tx();
+  host_serial_capture(false);
+}
+
+int main() {
+  test_motion_matches();
+  test_late_frames();
+  const int rc = check_done("test_fps");
+  fflush(stderr);
+  _exit(rc); // Firmware tasks are still running as detached threads.
+}
@@ -0,0 +1,186 @@
+// Effect interpreter: fx_validate() accepts well-formed programs and rejects
+// bad opcodes, registers, jumps and names; fx_run() gives the documented
+// result for every ALU op, the jumps and the outputs. Also checks that
+// /api/effects/programs rejects names that would break its JSON and that
+// the editor page does not read ids shadowed by window properties.
+#include "../../src/main.cpp"
+
+#include "check.h"
+#include "http.h"
+
+static CRGB test_palette[256];
+
+static FxProgram program(std::initializer_list<uint8_t> code) {
+  FxProgram p;
+  memset(&p, 0, sizeof(p));
+  size_t k = 0;
+  for (uint8_t b : code) {
+    p.code[k++] = b;
+  }
+  p.op_count = static_cast<uint8_t>(k / 4);
+  return p;
+}
+
+// Runs prog on one black pixel (index 0 of 1) and returns it.
+static CRGB run_one(const FxProgram &prog, uint32_t t_ms = 0) {
+  CRGB px(0, 0, 0);
+  EffectState state;
+  fx_run(prog, &px, 0, 1, test_palette, 100, 50, state, t_ms);
+  return px;
+}
+
+// Loads a and b, applies op into r8 and outputs r8 as red, clamped.
+static int alu(uint8_t op, int16_t a, int16_t b) {
+  const FxProgram p = program({FX_LDI, 6, static_cast<uint8_t>(a), static_cast<uint8_t>(a >> 8),
+                               FX_LDI, 7, static_cast<uint8_t>(b), static_cast<uint8_t>(b >> 8),
+                               op, 8, 6, 7,
+                               FX_RGB, 8, 9, 9});
+  CHECK(fx_validate(p));
+  return run_one(p).r;
+}
+
+static void test_validate() {
+  FxProgram p = program({FX_LDI, 6, 0xFF, 0xFF, FX_PAL, 6, 0, 0, FX_END, 0, 0, 0});
+  CHECK(fx_validate(p));
+  set_str(p.name, "wave 2_a-b");
+  CHECK(fx_validate(p));
+
+  set_str(p.name, "<img src=x>");
+  CHECK(!fx_validate(p));
+  set_str(p.name, "a\"b");
+  CHECK(!fx_validate(p));
+  memset(p.name, 'a', sizeof(p.name)); // Not terminated.
+  CHECK(!fx_validate(p));
+
+  CHECK(!fx_validate(program({FX_OP_COUNT, 0, 0, 0})));
+  CHECK(!fx_validate(program({FX_ADD, 16, 0, 0})));
+  CHECK(!fx_validate(program({FX_ADD, 1, 16, 0})));
+  CHECK(fx_validate(program({FX_LDI, 1, 200, 200}))); // LDI a/b are data.
+  CHECK(fx_validate(program({FX_JMP, 0, 1, 0, FX_END, 0, 0, 0})));
+  CHECK(!fx_validate(program({FX_JMP, 0, 2, 0, FX_END, 0, 0, 0})));
+  CHECK(!fx_validate(program({FX_JZ, 6, 1, 0})));
+  FxProgram long_prog = program({FX_END, 0, 0, 0});
+  long_prog.op_count = FX_PROGRAM_MAX_OPS + 1;
+  CHECK(!fx_validate(long_prog));
+}
+
+static void test_alu() {
+  CHECK_EQ(alu(FX_MOV, 77, 0), 77);
+  CHECK_EQ(alu(FX_ADD, 100, 27), 127);
+  CHECK_EQ(alu(FX_SUB, 100, 27), 73);
+  CHECK_EQ(alu(FX_SUB, 5, 27), 0); // -22 clamps to 0.
+  CHECK_EQ(alu(FX_MUL, 12, 11), 132);
+  CHECK_EQ(alu(FX_DIV, 250, 7), 35);
+  CHECK_EQ(alu(FX_DIV, 250, 0), 0);
+  CHECK_EQ(alu(FX_MOD, 250, 7), 5);
+  CHECK_EQ(alu(FX_MOD, 250, 0), 0);
+  CHECK_EQ(alu(FX_AND, 0xF3, 0x3C), 0x30);
+  CHECK_EQ(alu(FX_OR, 0x03, 0x30), 0x33);
+  CHECK_EQ(alu(FX_XOR, 0xFF, 0x0F), 0xF0);
+  CHECK_EQ(alu(FX_SHL, 3, 5), 96);
+  CHECK_EQ(alu(FX_SHL, 3, 37), 96); // Shift count masked to 0..31.
+  CHECK_EQ(alu(FX_SHR, 200, 3), 25);
+  CHECK_EQ(alu(FX_SHR, -64, 1), 0); // Arithmetic: -32 clamps to 0.
+  CHECK_EQ(alu(FX_MIN, 9, -4), 0);
+  CHECK_EQ(alu(FX_MAX, 9, -4), 9);
+  CHECK_EQ(alu(FX_SIN, 64, 0), sin8(64));
+  CHECK_EQ(alu(FX_SLT, 3, 4), 1);
+  CHECK_EQ(alu(FX_SLT, 4, 3), 0);
+
+  // INT32_MIN / -1 and % -1 would trap on the host; the VM returns 0.
+  const FxProgram p = program({FX_LDI, 6, 1, 0, FX_LDI, 7, 31, 0, FX_SHL, 6, 6, 7, // r6 = INT32_MIN
+                               FX_LDI, 7, 0xFF, 0xFF,                              // r7 = -1
+                               FX_DIV, 8, 6, 7, FX_MOD, 9, 6, 7,
+                               FX_ADD, 8, 8, 9, FX_LDI, 10, 1, 0, FX_ADD, 8, 8, 10,
+                               FX_RGB, 8, 8, 8});
+  CHECK(fx_validate(p));
+  CHECK_EQ(run_one(p).r, 1);
+}
+
+static void test_control_and_outputs() {
+  for (int i = 0; i < 256; ++i) {
+    test_palette[i] = CRGB(static_cast<uint8_t>(i), static_cast<uint8_t>(255 - i), 7);
+  }
+  // JZ skips when zero, JMP always; END stops before the later RGB.
+  FxProgram p = program({FX_JZ, 6, 1, 0, FX_LDI, 7, 50, 0, FX_LDI, 8, 9, 0, FX_JMP, 0, 1, 0,
+                         FX_LDI, 8, 99, 0, FX_RGB, 7, 8, 8, FX_END, 0, 0, 0, FX_RGB, 1, 1, 1});
+  CHECK(fx_validate(p));
+  CRGB c = run_one(p);
+  CHECK_EQ(c.r, 0);
+  CHECK_EQ(c.g, 9);
+
+  // Palette, rainbow and scale outputs.
+  c = run_one(program({FX_LDI, 6, 0x2C, 0x01, FX_PAL, 6, 0, 0})); // 300 & 255 = 44.
+  CHECK(c == test_palette[44]);
+  c = run_one(program({FX_LDI, 6, 96, 0, FX_HUE, 6, 0, 0}));
+  CHECK(c == rainbow_table()[96]);
+  c = run_one(program({FX_LDI, 6, 10, 0, FX_PAL, 6, 0, 0, FX_LDI, 7, 127, 0, FX_SCALE, 7, 0, 0}));
+  CRGB want = test_palette[10];
+  want.nscale8(127);
+  CHECK(c == want);
+
+  // Inputs: r0 index, r1 count, r2 time, r3 speed, r4 intensity, r5
+  // position, r13-r15 current color; r6-r12 carry from pixel to pixel.
+  CRGB px[4] = {CRGB(1, 2, 3), CRGB(4, 5, 6), CRGB(7, 8, 9), CRGB(10, 11, 12)};
+  EffectState state;
+  const FxProgram inputs = program({FX_ADD, 6, 6, 13,     // r6 += red (running sum)
+                                    FX_ADD, 7, 0, 1,      // r7 = index + count
+                                    FX_ADD, 7, 7, 5,      // r7 += position
+                                    FX_ADD, 8, 3, 4,      // r8 = speed + intensity
+                                    FX_RGB, 6, 7, 8});
+  fx_run(inputs, px, 0, 4, test_palette, 100, 50, state, 20);
+  CHECK_EQ(px[0].r, 1);
+  CHECK_EQ(px[3].r, 1 + 4 + 7 + 10);
+  CHECK_EQ(px[2].g, 2 + 4 + 128);
+  CHECK_EQ(px[1].b, 150);
+  CHECK_EQ(state.pos, 20u);
+
+  // No output op: the pixel keeps its color.
+  CRGB keep(5, 6, 7);
+  EffectState s2;
+  fx_run(program({FX_ADD, 6, 6, 6}), &keep, 0, 1, test_palette, 0, 0, s2, 0);
+  CHECK(keep == CRGB(5, 6, 7));
+
+  // The bench programs validate.
+  FxProgram wave = program({});
+  memcpy(wave.code, FX_BENCH_WAVE, sizeof(FX_BENCH_WAVE));
+  wave.op_count = sizeof(FX_BENCH_WAVE) / 4;
+  CHECK(fx_validate(wave));
+}
+
+static void test_programs_api() {
+  http_start();
+  HttpReply r = http_request("POST", "/api/effects/programs",
+                             "{\"slot\":1,\"name\":\"\\\",\\\"x\\\":\\\"<img src=x onerror=alert(1)>\",\"code\":\"15060000\"}");
+  CHECK_EQ(r.status, 400);
+  CHECK(r.body.find("\"name\"") != std::string::npos);
+  CHECK(fx_programs[1].op_count == 0);
+
+  r = http_request("POST", "/api/effects/programs", "{\"slot\":1,\"name\":\"wave-2\",\"code\":\"1506000000000000\"}");
+  CHECK_EQ(r.status, 200);
+  r = http_request("GET", "/api/effects/programs");
+  JsonDocument doc;
+  CHECK(!deserializeJson(doc, r.body.c_str()));
+  CHECK(strcmp(doc["slots"][1]["name"] | "", "wave-2") == 0);
+  CHECK_EQ(doc["slots"][1]["ops"] | 0, 2);
+
+  // Clearing with an empty name is allowed.
+  r = http_request("POST", "/api/effects/programs", "{\"slot\":1,\"name\":\"\",\"code\":\"\"}");
+  CHECK_EQ(r.status, 200);
+  CHECK_EQ(fx_programs[1].op_count, 0);
+
+  r = http_request("GET", "/effects");
+  CHECK_EQ(r.status, 200);
+  CHECK(r.body.find("id='name'") == std::string::npos);
+  CHECK(r.body.find("id='status'") == std::string::npos);
+  CHECK(r.body.find("innerHTML") == std::string::npos);
+  CHECK(r.body.find("innerText") == std::string::npos);
+}
+
+int main() {
+  test_validate();
+  test_alu();
+  test_control_and_outputs();
+  test_programs_api();
+  return check_done("test_fx");
+}
@@ -0,0 +1,121 @@
+// Geofence lookup: the grid index must give the same zone mask as checking
+// every zone, on random zone sets and fixes; plus exact circle/polygon
+// edges and the {"zones":[...]} parser.
+#include "../../src/main.cpp"
+
+#include "check.h"
+
+static float frand(float lo, float hi) {
+  return lo + (hi - lo) * (rand() / static_cast<float>(RAND_MAX));
+}
+
+static void random_zones(GeoIndex &g, int count) {
+  memset(&g.table, 0, sizeof(g.table));
+  g.table.count = static_cast<uint8_t>(count);
+  for (int i = 0; i < count; ++i) {
+    GeoZone &z = g.table.zones[i];
+    snprintf(z.name, sizeof(z.name), "z%d", i);
+    const float lat = frand(40.40f, 40.49f);
+    const float lon = frand(-3.75f, -3.63f);
+    if (i % 2 == 0) {
+      z.type = GEO_CIRCLE;
+      z.lat[0] = lat;
+      z.lon[0] = lon;
+      z.radius_m = frand(20.0f, 1500.0f);
+    } else {
+      z.type = GEO_POLYGON;
+      z.vertex_count = static_cast<uint8_t>(3 + rand() % (GEOFENCE_MAX_VERTICES - 2));
+      for (int v = 0; v < z.vertex_count; ++v) {
+        const float a = 6.2831853f * v / z.vertex_count;
+        const float r = frand(0.001f, 0.01f);
+        z.lat[v] = lat + r * sinf(a);
+        z.lon[v] = lon + r * cosf(a);
+      }
+    }
+  }
+  geo_build(g);
+}
+
+static void test_grid_matches_brute_force() {
+  static GeoIndex g;
+  srand(42);
+  int hits = 0;
+  for (int round = 0; round < 20; ++round) {
+    random_zones(g, 1 + round % GEOFENCE_MAX_ZONES + (round > 10 ? 20 : 0) % GEOFENCE_MAX_ZONES);
+    for (int q = 0; q < 5000; ++q) {
+      const float lat = frand(40.38f, 40.51f);
+      const float lon = frand(-3.77f, -3.61f);
+      uint32_t tests_grid = 0;
+      uint32_t tests_all = 0;
+      const uint32_t with_grid = geo_query(g, lat, lon, true, &tests_grid);
+      const uint32_t without = geo_query(g, lat, lon, false, &tests_all);
+      if (with_grid != without) {
+        CHECK_EQ(with_grid, without);
+        return;
+      }
+      hits += with_grid != 0;
+    }
+  }
+  CHECK(hits > 1000); // The fixes actually land in zones.
+}
+
+static void test_exact_shapes() {
+  static GeoIndex g;
+  memset(&g.table, 0, sizeof(g.table));
+  g.table.count = 2;
+  GeoZone &circle = g.table.zones[0];
+  circle.type = GEO_CIRCLE;
+  circle.lat[0] = 40.0f;
+  circle.lon[0] = -3.0f;
+  circle.radius_m = 100.0f;
+  GeoZone &square = g.table.zones[1];
+  square.type = GEO_POLYGON;
+  square.vertex_count = 4;
+  const float lats[] = {41.0f, 41.0f, 41.01f, 41.01f};
+  const float lons[] = {-3.0f, -2.99f, -2.99f, -3.0f};
+  memcpy(square.lat, lats, sizeof(lats));
+  memcpy(square.lon, lons, sizeof(lons));
+  geo_build(g);
+
+  uint32_t tests = 0;
+  CHECK_EQ(geo_query(g, 40.0f, -3.0f, true, &tests), 1u);
+  CHECK_EQ(geo_query(g, 40.0f + 95.0f / M_PER_DEG_LAT, -3.0f, true, &tests), 1u);
+  CHECK_EQ(geo_query(g, 40.0f + 105.0f / M_PER_DEG_LAT, -3.0f, true, &tests), 0u);
+  CHECK_EQ(geo_query(g, 41.005f, -2.995f, true, &tests), 2u);
+  CHECK_EQ(geo_query(g, 41.011f, -2.995f, true, &tests), 0u);
+  CHECK_EQ(geo_query(g, 42.0f, -2.995f, true, &tests), 0u); // Outside the grid.
+}
+
+static void test_parse_zones() {
+  static GeoZoneTable t;
+  JsonDocument doc;
+  const char *body =
+      "{\"zones\":[{\"name\":\"park\",\"type\":\"circle\",\"lat\":40.41,\"lon\":-3.70,\"radius_m\":250,"
+      "\"alert\":\"enter\"},{\"name\":\"home_2\",\"type\":\"polygon\",\"points\":[[40.0,-3.0],[40.0,-2.9],"
+      "[40.1,-2.9]]}]}";
+  CHECK(!deserializeJson(doc, body));
+  CHECK(parse_zones_json(doc, t) == nullptr);
+  CHECK_EQ(t.count, 2);
+  CHECK(strcmp(t.zones[0].name, "park") == 0);
+  CHECK_EQ(t.zones[0].type, GEO_CIRCLE);
+  CHECK(fabsf(t.zones[0].radius_m - 250.0f) < 1e-3f);
+  CHECK_EQ(t.zones[1].type, GEO_POLYGON);
+  CHECK_EQ(t.zones[1].vertex_count, 3);
+  CHECK(validate_zones(t));
+
+  CHECK(!deserializeJson(doc, "{\"zones\":[{\"name\":\"<b>\",\"type\":\"circle\",\"lat\":1,\"lon\":1,"
+                              "\"radius_m\":50}]}"));
+  CHECK(parse_zones_json(doc, t) != nullptr);
+  CHECK(!deserializeJson(doc, "{\"zones\":[{\"name\":\"a\",\"type\":\"circle\",\"lat\":91,\"lon\":1,"
+                              "\"radius_m\":50}]}"));
+  CHECK(parse_zones_json(doc, t) != nullptr);
+  CHECK(!deserializeJson(doc, "{\"zones\":[{\"name\":\"a\",\"type\":\"polygon\",\"points\":[[1,1],[1,2]]}]}"));
+  CHECK(parse_zones_json(doc, t) != nullptr);
+}
+
+int main() {
+  test_grid_matches_brute_force();
+  test_exact_shapes();
+  test_parse_zones();
+  return check_done("test_geofence");
+}
@@ -0,0 +1,159 @@
+// GNSS warm start against a fake receiver on the GPS UART: the first NMEA
+// line it sends gets exactly one CASIC AID-INI frame back, decoded here
+// field by field, with position and time flags following the stored fix age
+// and the clock. TTFF is measured from gnss_start_ms, the almanac time
+// survives an NVS round trip, and `gnss` prints the whole 66-byte frame.
+#include "../../src/main.cpp"
+
+#include "../sim/harness.h"
+#include "check.h"
+
+struct AidIni {
+  bool ok = false;
+  double lat = 0;
+  double lon = 0;
+  double tow = 0;
+  uint16_t week = 0;
+  uint8_t flags = 0;
+};
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+// Parse one frame as the receiver would: sync, length, class/id, checksum.
+static AidIni parse_aid_ini(const std::string &tx) {
+  AidIni a;
+  const uint8_t *f = reinterpret_cast<const uint8_t *>(tx.data());
+  if (tx.size() != 66 || f[0] != 0xBA || f[1] != 0xCE || (f[2] | f[3] << 8) != 56 || f[4] != 0x0B || f[5] != 0x01) {
+    return a;
+  }
+  uint32_t ck = (0x01u << 24) + (0x0Bu << 16) + 56;
+  for (int i = 0; i < 56; i += 4) {
+    ck += le32(&f[6 + i]);
+  }
+  if (ck != le32(&f[62])) {
+    return a;
+  }
+  memcpy(&a.lat, &f[6], 8);
+  memcpy(&a.lon, &f[14], 8);
+  memcpy(&a.tow, &f[30], 8);
+  a.week = static_cast<uint16_t>(f[58] | f[59] << 8);
+  a.flags = f[61];
+  a.ok = true;
+  return a;
+}
+
+// Fresh boot: no NMEA seen yet, receiver silent, nothing sent.
+static void reboot(uint32_t stored_fix_unix, uint32_t clock_unix) {
+  boot_ms.first_nmea_ms = 0;
+  gnss_aid = {40.4168f, -3.7038f, stored_fix_unix};
+  gnss_aid_flags = 0;
+  gnss_ttff_ms = 0;
+  gnss_start_ms = millis();
+  host_set_unix(clock_unix);
+  GPS.host_reset();
+}
+
+// The fake receiver wakes up and talks; returns what the firmware sent it.
+static std::string receiver_talks() {
+  GPS.host_feed("$GNGGA,,,,,,0,00,99.99,,,,,,*48\r\n$GNGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99*2E\r\n");
+  read_gps();
+  return GPS.host_take_tx();
+}
+
+static void test_injection() {
+  const uint32_t fix = 1736150400;   // 2025-01-06 08:00:00.
+  const uint32_t now = fix + 3600;   // Clock kept across a soft reset.
+  reboot(fix, now);
+  const AidIni a = parse_aid_ini(receiver_talks());
+  CHECK(a.ok);
+  CHECK_EQ(a.flags, CASIC_AID_POS_VALID | CASIC_AID_POS_LLA | CASIC_AID_TIME_VALID);
+  CHECK(fabs(a.lat - 40.4168) < 1e-4 && fabs(a.lon + 3.7038) < 1e-4);
+  const uint32_t gps_s = now - 315964800 + 18;
+  CHECK_EQ(a.week, gps_s / 604800);
+  CHECK_EQ(static_cast<uint32_t>(a.tow), gps_s % 604800);
+  CHECK_EQ(gnss_aid_flags, a.flags);
+  // Once per boot.
+  CHECK_EQ(receiver_talks().size(), 0u);
+
+  // Stored fix too old: time only.
+  reboot(fix, fix + GNSS_AID_MAX_AGE_S + 1);
+  CHECK_EQ(parse_aid_ini(receiver_talks()).flags, CASIC_AID_TIME_VALID);
+
+  // Clock lost (power cycle): position only.
+  reboot(fix, 0);
+  CHECK_EQ(parse_aid_ini(receiver_talks()).flags, CASIC_AID_POS_VALID | CASIC_AID_POS_LLA);
+
+  // Nothing stored, no clock: nothing sent.
+  reboot(0, 0);
+  CHECK_EQ(receiver_talks().size(), 0u);
+}
+
+static void test_ttff_and_almanac() {
+  reboot(0, 0);
+  gnss_almanac_unix = 0;
+  gnss_run_start_unix = 0;
+  receiver_talks();
+  host_advance_ms(23000);
+  char line[160];
+  const uint32_t start = 1736150400;
+  for (uint32_t s = 0; s <= GNSS_ALMANAC_FIX_S; ++s) {
+    const std::string rmc = FirmwareSim::rmc(start + s, 40.4168, -3.7038, 0.0);
+    set_str(line, rmc.substr(0, rmc.size() - 2).c_str());
+    handle_nmea_line(line);
+    if (s == 0) {
+      CHECK_EQ(gnss_ttff_ms, 23000u);
+      CHECK_EQ(gnss_almanac_unix, 0u);
+    }
+    if (s == GNSS_ALMANAC_FIX_S - 1) {
+      CHECK_EQ(gnss_almanac_unix, 0u); // One second short.
+    }
+  }
+  CHECK_EQ(gnss_almanac_unix, start + GNSS_ALMANAC_FIX_S);
+
+  // A gap restarts the run; the almanac time is not moved back.
+  const std::string late = FirmwareSim::rmc(start + GNSS_ALMANAC_FIX_S + 60, 40.4168, -3.7038, 0.0);
+  set_str(line, late.substr(0, late.size() - 2).c_str());
+  handle_nmea_line(line);
+  CHECK_EQ(gnss_almanac_unix, start + GNSS_ALMANAC_FIX_S);
+  CHECK_EQ(gnss_run_start_unix, start + GNSS_ALMANAC_FIX_S + 60);
+
+  // Persisted and reported.
+  prefs.begin("dogrgb", false);
+  save_metrics();
+  gnss_almanac_unix = 0;
+  load_metrics();
+  CHECK_EQ(gnss_almanac_unix, start + GNSS_ALMANAC_FIX_S);
+  host_set_unix(start + GNSS_ALMANAC_FIX_S + 7200);
+  CHECK_EQ(gnss_almanac_age_s(), 7200);
+}
+
+static void test_console_frame() {
+  reboot(1736150400, 1736150400 + 60);
+  host_serial_capture(true);
+  Serial.host_feed("gnss\n");
+  read_serial_commands();
+  const std::string out = Serial.host_take_tx();
+  host_serial_capture(false);
+  std::string hex;
+  for (size_t at = 0; (at = out.find("AID-INI ", at)) != std::string::npos;) {
+    at += 8;
+    const size_t eol = out.find_first_of("\r\n", at);
+    hex += out.substr(at, eol - at);
+  }
+  CHECK_EQ(hex.size(), 2 * CASIC_AID_INI_FRAME);
+  std::string bytes;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    bytes += static_cast<char>(strtoul(hex.substr(i, 2).c_str(), nullptr, 16));
+  }
+  CHECK(parse_aid_ini(bytes).ok);
+  CHECK(out.find("almanac_age_s=") != std::string::npos);
+}
+
+int main() {
+  test_injection();
+  test_ttff_and_almanac();
+  test_console_frame();
+  return check_done("test_gnss");
+}
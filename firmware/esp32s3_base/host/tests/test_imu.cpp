@@ -0,0 +1,156 @@
+// IMU record and replay. A fake ICM-42688 on the I2C shim serves a walking
+// pattern to the real IMU task with `imu rec` on; loop()'s imu_rec_poll()
+// prints the captured FIFO dumps. Replaying those `IMU <hex>` lines through
+// the console (replay on) must rebuild the task's published filter state
+// exactly in loop()'s replay filter, and the lines are refused outside
+// replay.
+#include "../../src/main.cpp"
+
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+#include "check.h"
+
+namespace {
+
+std::mutex fifo_mutex;
+std::deque<uint8_t> fifo;
+uint8_t reg = 0;
+
+void push_packet(uint8_t header, int16_t ax, int16_t ay, int16_t az) {
+  const uint8_t p[IMU_PACKET] = {header,
+                                 static_cast<uint8_t>(ax >> 8), static_cast<uint8_t>(ax),
+                                 static_cast<uint8_t>(ay >> 8), static_cast<uint8_t>(ay),
+                                 static_cast<uint8_t>(az >> 8), static_cast<uint8_t>(az),
+                                 25};
+  std::lock_guard<std::mutex> lock(fifo_mutex);
+  fifo.insert(fifo.end(), p, p + IMU_PACKET);
+}
+
+size_t fifo_size() {
+  std::lock_guard<std::mutex> lock(fifo_mutex);
+  return fifo.size();
+}
+
+void fake_icm() {
+  host_i2c.write = [](uint8_t addr, const std::vector<uint8_t> &bytes) -> uint8_t {
+    if (addr != IMU_I2C_ADDR) {
+      return 2;
+    }
+    if (!bytes.empty()) {
+      reg = bytes[0];
+    }
+    return 0;
+  };
+  host_i2c.read = [](uint8_t, size_t len) {
+    std::lock_guard<std::mutex> lock(fifo_mutex);
+    std::vector<uint8_t> out;
+    if (reg == ICM_WHO_AM_I) {
+      out.push_back(ICM_WHO_AM_I_VALUE);
+    } else if (reg == ICM_FIFO_COUNTH) {
+      out.push_back(static_cast<uint8_t>(fifo.size() >> 8));
+      out.push_back(static_cast<uint8_t>(fifo.size()));
+    } else if (reg == ICM_FIFO_DATA) {
+      for (size_t i = 0; i < len && !fifo.empty(); ++i) {
+        out.push_back(fifo.front());
+        fifo.pop_front();
+      }
+    }
+    out.resize(len);
+    return out;
+  };
+}
+
+bool same_filter(const ImuState &a, const ImuState &b) {
+  return a.gravity_q8 == b.gravity_q8 && a.intensity_q8 == b.intensity_q8 && a.samples == b.samples &&
+         a.active_samples == b.active_samples && a.bad_packets == b.bad_packets;
+}
+
+} // namespace
+
+int main() {
+  fake_icm();
+  host_serial_capture(true);
+  imu_begin();
+  CHECK(imu_ready);
+
+  // Record: 2 s at 200 Hz, handed over one 20 ms poll (4 packets) at a time:
+  // standing, then a 2 Hz gait of +-0.4 g, with a few malformed packets.
+  Serial.host_feed("imu rec 1000\n");
+  read_serial_commands();
+  std::string dumps;
+  const int packets = 2 * IMU_ODR_HZ;
+  for (int i = 0; i < packets; i += 4) {
+    for (int k = i; k < i + 4; ++k) {
+      const bool walking = k >= packets / 2;
+      const float swing = walking ? sinf(k * 2.0f * static_cast<float>(M_PI) * 2.0f / IMU_ODR_HZ) : 0.0f;
+      push_packet(k % 97 == 50 ? 0x00 : 0x40, static_cast<int16_t>(300 * swing), static_cast<int16_t>(k % 7 - 3),
+                  static_cast<int16_t>(IMU_LSB_PER_G + 0.4f * IMU_LSB_PER_G * swing));
+    }
+    for (int wait = 0; wait < 500 && fifo_size() > 0; ++wait) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Let the drain finish ingesting.
+    imu_rec_poll();
+    dumps += Serial.host_take_tx();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  while (imu_rec_head.load() != imu_rec_tail.load()) {
+    imu_rec_poll();
+  }
+  dumps += Serial.host_take_tx();
+  const ImuState live = imu_pub.read();
+  CHECK_EQ(live.samples + live.bad_packets, static_cast<uint32_t>(packets));
+  CHECK(live.bad_packets > 0);
+  CHECK(live.active_samples > 0);
+  CHECK_EQ(imu_rec_dropped.load(), 0u);
+
+  // Every dump line is whole packets of hex.
+  int lines = 0;
+  size_t dumped = 0;
+  bool well_formed = true;
+  for (size_t at = 0; at < dumps.size();) {
+    size_t eol = dumps.find('\n', at);
+    std::string line = dumps.substr(at, eol - at);
+    at = eol + 1;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    well_formed = well_formed && line.compare(0, 4, "IMU ") == 0 && (line.size() - 4) % (2 * IMU_PACKET) == 0 &&
+                  line.size() - 4 <= 8 * IMU_PACKET;
+    dumped += (line.size() - 4) / 2;
+    lines++;
+  }
+  CHECK(well_formed);
+  CHECK_EQ(dumped, packets * IMU_PACKET);
+
+  // Refused outside replay: the task owns the filter.
+  const ImuState before = imu_pub.read();
+  Serial.host_feed(dumps.substr(0, dumps.find('\n') + 1).c_str());
+  read_serial_commands();
+  CHECK(Serial.host_take_tx().find("need replay on") != std::string::npos);
+  CHECK(same_filter(imu_pub.read(), before));
+  CHECK(same_filter(imu_replay, IMU_CLEAN));
+
+  // Replay from a clean filter.
+  Serial.host_feed("replay on\n");
+  read_serial_commands();
+  for (size_t at = 0; at < dumps.size();) {
+    const size_t eol = dumps.find('\n', at);
+    Serial.host_feed(dumps.substr(at, eol + 1 - at).c_str());
+    read_serial_commands();
+    at = eol + 1;
+  }
+  Serial.host_take_tx();
+  CHECK(same_filter(imu_replay, live));
+  CHECK_EQ(imu_intensity_mg(), static_cast<uint32_t>(live.intensity_q8) >> 8);
+  printf("imu: %d packets, %d dump lines, intensity_mg=%lu active_ms=%lu\n", packets, lines,
+         static_cast<unsigned long>(imu_intensity_mg()), static_cast<unsigned long>(imu_active_ms()));
+  host_serial_capture(false);
+
+  const int rc = check_done("test_imu");
+  fflush(stdout);
+  fflush(stderr);
+  _exit(rc); // The IMU task is still running as a detached thread.
+}
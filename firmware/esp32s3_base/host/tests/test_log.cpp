@@ -0,0 +1,211 @@
+// Fix log ring on the flash shim: a partition still holding app bytes is
+// formatted at the first boot and reads as empty; log_begin() finds the
+// same head and oldest record at every point of two trips round the ring
+// while the record times step back; a torn newest record is reported. The
+// upload's fix cursor (ring generation and offset) sends every fix once,
+// in order, across clock steps and trips round the ring.
+#include "../../src/main.cpp"
+
+#include "check.h"
+
+static void append_seq(uint32_t unix_s, uint32_t seq) {
+  // The sequence number rides in lat_e7 so the order can be checked.
+  log_append(unix_s, seq * 1e-7f, 0.0f, 3.0f);
+}
+
+static uint32_t lat_at(uint32_t pos) {
+  LogRecord r;
+  esp_partition_read(log_part, (log_oldest() + pos) % log_ring, &r, sizeof(r));
+  CHECK(r.check == log_check(r));
+  return static_cast<uint32_t>(r.lat_e7);
+}
+
+static void test_stale_app_bytes() {
+  host_flash_open(nullptr);
+  // An app image: 0xE9 magic, then bytes that are neither erased nor records.
+  uint8_t *flash = host_flash_data();
+  for (size_t i = 0; i < 600 * 1024; ++i) {
+    flash[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+  }
+  host_flash_fill(0xE9, 0, 1);
+  host_flash_fill(0x3C, host_flash_size() - 100, 50); // Even the header sector.
+  log_stats = {};
+  log_begin();
+  CHECK(log_part != nullptr);
+  CHECK_EQ(log_stats.formatted, 600u * 1024 / LOG_SECTOR + 1);
+  CHECK_EQ(log_size(), 0u);
+  CHECK(!log_wrapped);
+
+  for (uint32_t i = 0; i < 10; ++i) {
+    append_seq(1700000000 + i, i);
+  }
+  log_begin();
+  CHECK_EQ(log_stats.formatted, 600u * 1024 / LOG_SECTOR + 1); // Not formatted again.
+  CHECK_EQ(log_size(), 10 * sizeof(LogRecord));
+  CHECK_EQ(lat_at(0), 0u);
+}
+
+static void test_head_found_again() {
+  host_flash_open(nullptr);
+  log_stats = {};
+  log_begin();
+  const uint32_t records = log_ring / sizeof(LogRecord);
+  const uint32_t slots = LOG_SECTOR / sizeof(LogRecord);
+  uint32_t checked = 0;
+  bool same = true;
+  for (uint32_t seq = 0; seq < 2 * records + slots / 2; ++seq) {
+    // Every 1000 records the clock steps back a day.
+    append_seq(1700000000 + seq % 1000 * 86 - (seq / 1000) % 3 * 86400, seq);
+    const uint32_t slot = log_head % LOG_SECTOR / sizeof(LogRecord);
+    if (slot > 1 && slot < slots - 2 && seq % 997 != 0) {
+      continue;
+    }
+    // The wrapped flag itself can differ when the oldest record is at 0.
+    const uint32_t head = log_head;
+    const uint32_t oldest = log_oldest();
+    const uint32_t size = log_size();
+    log_begin();
+    same = same && log_head == head && log_oldest() == oldest && log_size() == size &&
+           lat_at(size - sizeof(LogRecord)) == seq && lat_at(0) == seq + 1 - size / sizeof(LogRecord);
+    if (!same) {
+      fprintf(stderr, "seq %u: head %u/%u oldest %u/%u size %u/%u\n", seq, log_head, head, log_oldest(), oldest,
+              log_size(), size);
+      break;
+    }
+    checked++;
+  }
+  CHECK(same);
+  CHECK(log_wrapped);
+  CHECK(log_size() >= log_ring - 2 * LOG_SECTOR);
+  CHECK_EQ(log_stats.errors, 0u);
+  printf("log: head found again at %u points over %u records\n", checked, 2 * records + slots / 2);
+}
+
+static void test_torn_record() {
+  const uint32_t head = log_head;
+  const uint32_t newest = (log_head + log_ring - sizeof(LogRecord)) % log_ring;
+  host_flash_data()[newest + 12] &= 0x0F; // Power cut mid-write: some bits never cleared.
+  log_stats = {};
+  log_begin();
+  CHECK_EQ(log_head, head);
+  CHECK_EQ(log_stats.errors, 1u);
+}
+
+// Decode a fix batch built by upload_build_fixes() back to sequence numbers.
+static std::vector<uint32_t> batch_seqs(const uint8_t *p, uint16_t count) {
+  std::vector<uint32_t> seqs;
+  LogRecord r;
+  memcpy(&r, p, sizeof(r));
+  p += sizeof(r);
+  int32_t lat = r.lat_e7;
+  seqs.push_back(static_cast<uint32_t>(lat));
+  auto zigzag = [&p]() {
+    uint32_t v = 0;
+    for (int shift = 0;; shift += 7) {
+      const uint8_t b = *p++;
+      v |= static_cast<uint32_t>(b & 0x7F) << shift;
+      if (b < 0x80) {
+        return static_cast<int32_t>((v >> 1) ^ -(v & 1));
+      }
+    }
+  };
+  for (uint16_t i = 1; i < count; ++i) {
+    zigzag();
+    lat += zigzag();
+    zigzag();
+    zigzag();
+    p++;
+    seqs.push_back(static_cast<uint32_t>(lat));
+  }
+  return seqs;
+}
+
+// Send everything pending as upload_poll() would on 2xx; returns the
+// sequence numbers sent, in order.
+static std::vector<uint32_t> upload_all() {
+  static uint8_t body[sizeof(upload_body)];
+  std::vector<uint32_t> sent;
+  for (;;) {
+    uint32_t len = 0;
+    uint64_t first = 0;
+    const uint16_t count = upload_build_fixes(body, &len, &first);
+    if (count == 0) {
+      return sent;
+    }
+    const std::vector<uint32_t> seqs = batch_seqs(body, count);
+    sent.insert(sent.end(), seqs.begin(), seqs.end());
+    upload.fix_gen = static_cast<uint32_t>(upload.next_fix / log_ring);
+    upload.fix_offset = static_cast<uint32_t>(upload.next_fix % log_ring);
+  }
+}
+
+static bool consecutive(const std::vector<uint32_t> &seqs, uint32_t from, uint32_t to) {
+  bool ok = seqs.size() == to - from;
+  for (size_t i = 0; ok && i < seqs.size(); ++i) {
+    ok = seqs[i] == from + i;
+  }
+  if (!ok) {
+    fprintf(stderr, "sent %zu fixes, wanted %u..%u\n", seqs.size(), from, to);
+  }
+  return ok;
+}
+
+static void test_upload_cursor() {
+  host_flash_open(nullptr);
+  log_begin();
+  upload = {};
+  // Three sectors an hour ahead, then the clock is corrected back: every
+  // fix after the correction is still sent, once.
+  const uint32_t slots = LOG_SECTOR / sizeof(LogRecord);
+  uint32_t seq = 0;
+  for (; seq < 3 * slots; ++seq) {
+    append_seq(1700003600 + seq, seq);
+  }
+  CHECK(consecutive(upload_all(), 0, seq));
+  for (; seq < 6 * slots; ++seq) {
+    append_seq(1700000000 + seq, seq);
+  }
+  CHECK(consecutive(upload_all(), 3 * slots, seq));
+  CHECK(upload_all().empty());
+
+  // Across the end of the ring: the generation keeps the cursor ordered.
+  const uint32_t records = log_ring / sizeof(LogRecord);
+  uint32_t sent_to = seq;
+  bool in_order = true;
+  while (seq < records + 100) {
+    append_seq(1700000000 + seq % 500, seq);
+    if (++seq % 5000 == 0) {
+      in_order = in_order && consecutive(upload_all(), sent_to, seq);
+      sent_to = seq;
+    }
+  }
+  CHECK(in_order);
+  CHECK_EQ(log_gen, 1u);
+  CHECK(consecutive(upload_all(), sent_to, seq));
+  CHECK_EQ(upload.fix_gen, 1u);
+  CHECK_EQ(upload.fix_offset, log_head);
+
+  // Offline for a whole trip: the overwritten fixes are gone, the rest go.
+  for (const uint32_t stop = seq + records; seq < stop; ++seq) {
+    append_seq(1700000000 + seq % 500, seq);
+  }
+  CHECK(consecutive(upload_all(), seq - log_size() / sizeof(LogRecord), seq));
+
+  // A cursor from an older log (or an old unix time) restarts at the oldest.
+  upload.fix_gen = 0;
+  upload.fix_offset = 1700000000;
+  CHECK(consecutive(upload_all(), seq - log_size() / sizeof(LogRecord), seq));
+  upload.fix_gen = log_gen + 1;
+  upload.fix_offset = 0;
+  CHECK_EQ(upload_all().size(), log_size() / sizeof(LogRecord));
+}
+
+int main() {
+  host_serial_capture(true);
+  test_stale_app_bytes();
+  test_head_found_again();
+  test_torn_record();
+  test_upload_cursor();
+  host_serial_capture(false);
+  return check_done("test_log");
+}
@@ -0,0 +1,105 @@
+// Range palette LUT: a known 4-stop palette expands to its stops at 0, 64,
+// 128 and 192 and to the linear blend between them, wrapping from the last
+// stop back to the first. palette_for_range() rebuilds the LUT only when the
+// range changes or the config is applied. Prints the per-frame cost of
+// GRADIENT_WAVE colors at 2 x 50 LEDs: CHSV per pixel against LUT loads.
+#include "../../src/main.cpp"
+
+#include <chrono>
+
+#include "check.h"
+
+static const RangePalette KNOWN = {{{255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 255}}};
+
+static void test_build() {
+  CRGB lut[256];
+  palette_build(KNOWN, lut);
+  for (int k = 0; k < PALETTE_STOPS; ++k) {
+    CHECK(lut[k * 64] == CRGB(KNOWN.stops[k][0], KNOWN.stops[k][1], KNOWN.stops[k][2]));
+  }
+  // Halfway red -> green, green -> blue, and white back towards red.
+  CHECK(lut[32] == CRGB(128, 127, 0));
+  CHECK(lut[96] == CRGB(0, 128, 127));
+  CHECK(lut[224] == CRGB(255, 128, 128));
+  CHECK(lut[255] == CRGB(255, 4, 4));
+
+  // Every entry within one step of the exact blend of its two stops.
+  uint32_t off = 0;
+  for (int i = 0; i < 256; ++i) {
+    const uint8_t *a = KNOWN.stops[i / 64];
+    const uint8_t *b = KNOWN.stops[(i / 64 + 1) % PALETTE_STOPS];
+    for (int c = 0; c < 3; ++c) {
+      const float exact = a[c] + (b[c] - a[c]) * (i % 64) / 64.0f;
+      off += fabsf(lut[i].raw[c] - exact) < 1.0f ? 0 : 1;
+    }
+  }
+  CHECK_EQ(off, 0u);
+}
+
+static void test_rebuilt_on_change_only() {
+  set_default_config();
+  g_cfg.palettes[1] = KNOWN;
+  palette_lut_range = 0;
+  const CRGB *lut = palette_for_range(2);
+  CHECK(lut[0] == CRGB(255, 0, 0));
+
+  // Same range, palette edited without applying: the LUT is not rebuilt.
+  g_cfg.palettes[1].stops[0][0] = 10;
+  CHECK(palette_for_range(2)[0] == CRGB(255, 0, 0));
+  CHECK(palette_for_range(2)[0] == CRGB(255, 0, 0));
+
+  // A range change rebuilds it.
+  palette_for_range(3);
+  CHECK_EQ(palette_lut_range, 3);
+  CHECK(palette_for_range(2)[0] == CRGB(10, 0, 0));
+
+  // So does applying a config.
+  g_cfg.palettes[1].stops[0][0] = 20;
+  CHECK(palette_for_range(2)[0] == CRGB(10, 0, 0));
+  const RuntimeConfig previous = g_cfg;
+  apply_config(previous);
+  CHECK(palette_for_range(2)[0] == CRGB(20, 0, 0));
+}
+
+static void print_frame_cost() {
+  CRGB lut[256];
+  palette_build(KNOWN, lut);
+  static CRGB out[BENCH_LEDS];
+  const int frames = 200000;
+  uint32_t sink = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (int f = 0; f < frames; ++f) {
+    const uint8_t hue = static_cast<uint8_t>(f);
+    for (int i = 0; i < BENCH_LEDS; ++i) {
+      out[i] = CHSV(static_cast<uint8_t>(hue + i * 8), 200, 255);
+    }
+    sink += out[f % BENCH_LEDS].r;
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  for (int f = 0; f < frames; ++f) {
+    const uint8_t hue = static_cast<uint8_t>(f);
+    for (int i = 0; i < BENCH_LEDS; ++i) {
+      out[i] = lut[static_cast<uint8_t>(hue + i * 8)];
+    }
+    sink += out[f % BENCH_LEDS].r;
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+  const int builds = 100000;
+  for (int b = 0; b < builds; ++b) {
+    lut[0].r = static_cast<uint8_t>(b);
+    palette_build(KNOWN, lut);
+    sink += lut[b & 255].g;
+  }
+  const auto t3 = std::chrono::steady_clock::now();
+  printf("palette leds=%d: hsv %.0f ns/frame, lut %.0f ns/frame, build %.0f ns (host, %u)\n", BENCH_LEDS,
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / frames,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / frames,
+         std::chrono::duration<double, std::nano>(t3 - t2).count() / builds, sink & 1);
+}
+
+int main() {
+  test_build();
+  test_rebuilt_on_change_only();
+  print_frame_cost();
+  return check_done("test_palette");
+}
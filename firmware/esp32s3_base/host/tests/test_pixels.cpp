@@ -0,0 +1,122 @@
+// Pixel kernels: px_scale/px_fade/px_fill must match the per-pixel FastLED
+// operations bit for bit at every amount, start alignment and length, and
+// must not touch bytes outside the span. Prints the cost per 2 x 50 frame.
+#include "../../src/main.cpp"
+
+#include <chrono>
+
+#include "check.h"
+
+static const int GUARD = 8;
+
+static uint8_t ref_scale8(uint8_t v, uint8_t scale) { return static_cast<uint8_t>((v * (scale + 1u)) >> 8); }
+
+static void test_swar_scale8_lanes() {
+  srand(7);
+  for (uint32_t s1 = 1; s1 <= 256; ++s1) {
+    for (int k = 0; k < 200; ++k) {
+      const uint32_t v = (static_cast<uint32_t>(rand()) << 16) ^ static_cast<uint32_t>(rand());
+      const uint32_t got = swar_scale8(v, s1);
+      uint32_t want = 0;
+      for (int b = 0; b < 4; ++b) {
+        want |= static_cast<uint32_t>(ref_scale8(static_cast<uint8_t>(v >> (b * 8)), static_cast<uint8_t>(s1 - 1)))
+                << (b * 8);
+      }
+      if (got != want) {
+        CHECK_EQ(got, want);
+        return;
+      }
+    }
+  }
+  CHECK_EQ(swar_scale8(0xFFFFFFFFu, 256), 0xFFFFFFFFu);
+  CHECK_EQ(swar_scale8(0xFFFFFFFFu, 1), 0u);
+}
+
+static void test_kernels_match_fastled() {
+  alignas(4) static CRGB ref[BENCH_LEDS + GUARD];
+  alignas(4) static CRGB fast[BENCH_LEDS + GUARD];
+  int mismatches = 0;
+  for (int op = 0; op < 3; ++op) {
+    for (int amount = 0; amount < 256; ++amount) {
+      const uint8_t a = static_cast<uint8_t>(amount);
+      const CRGB color(a, static_cast<uint8_t>(255 - a), static_cast<uint8_t>(a * 7));
+      for (int offset = 0; offset < 4; ++offset) {
+        for (int count : {0, 1, 2, 3, 4, 5, 7, 8, 13, 50, BENCH_LEDS}) {
+          for (int i = 0; i < BENCH_LEDS + GUARD; ++i) {
+            ref[i] = CRGB(random8(), random8(), random8());
+            fast[i] = ref[i];
+          }
+          for (int i = offset; i < offset + count; ++i) {
+            if (op == BENCH_FADE) {
+              ref[i].fadeToBlackBy(a);
+            } else if (op == BENCH_SCALE) {
+              ref[i].nscale8(a);
+            } else {
+              ref[i] = color;
+            }
+          }
+          if (op == BENCH_FADE) {
+            px_fade(&fast[offset], count, a);
+          } else if (op == BENCH_SCALE) {
+            px_scale(&fast[offset], count, a);
+          } else {
+            px_fill(&fast[offset], count, color);
+          }
+          if (memcmp(ref, fast, sizeof(ref)) != 0) {
+            if (mismatches++ == 0) {
+              fprintf(stderr, "mismatch op=%d amount=%d offset=%d count=%d\n", op, amount, offset, count);
+            }
+          }
+        }
+      }
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+// FastLED's scale8 with SCALE8_FIXED, written out here so the reference does
+// not depend on the shim.
+static void test_reference_formula() {
+  for (int s = 0; s < 256; ++s) {
+    for (int v = 0; v < 256; ++v) {
+      CRGB c(static_cast<uint8_t>(v), 0, 0);
+      c.nscale8(static_cast<uint8_t>(s));
+      if (c.r != ref_scale8(static_cast<uint8_t>(v), static_cast<uint8_t>(s))) {
+        CHECK_EQ(c.r, ref_scale8(static_cast<uint8_t>(v), static_cast<uint8_t>(s)));
+        return;
+      }
+    }
+  }
+}
+
+static double time_ns(void (*fn)(CRGB *, int, uint8_t), CRGB *leds) {
+  const int reps = 20000;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r) {
+    fn(leds, BENCH_LEDS, static_cast<uint8_t>(r | 0x80));
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / reps;
+}
+
+static void scalar_fade(CRGB *leds, int count, uint8_t amount) {
+  for (int i = 0; i < count; ++i) {
+    leds[i].fadeToBlackBy(amount);
+  }
+}
+
+static void print_costs() {
+  alignas(4) static CRGB leds[BENCH_LEDS];
+  fill_solid(leds, BENCH_LEDS, CRGB(200, 100, 50));
+  const double scalar = time_ns(scalar_fade, leds);
+  const double kernel = time_ns(px_fade, leds);
+  printf("fade %d leds: scalar %.0f ns/frame, kernel %.0f ns/frame (host)\n", BENCH_LEDS, scalar, kernel);
+}
+
+int main() {
+  test_reference_formula();
+  test_swar_scale8_lanes();
+  test_kernels_match_fastled();
+  print_costs();
+  return check_done("test_pixels");
+}
@@ -0,0 +1,139 @@
+// RGBW packing: at each white point from 2000 to 10000 K, every 24-bit color
+// packed to GRBW gives back the source pixel exactly when the W share is
+// added back (no channel underflows), and the channel sums agree with the
+// wire bytes. GRB packing is the source reordered. The soft status white
+// moves mostly to W. bench_rgbw() leaves the shown frame, the wire buffer
+// and led.rgbw untouched.
+#include "../../src/main.cpp"
+
+#include <chrono>
+
+#include "check.h"
+
+static void set_layout() {
+  set_default_config();
+  g_cfg.layout.strip_count = LED_MAX_STRIPS;
+  for (int s = 0; s < LED_MAX_STRIPS; ++s) {
+    g_cfg.layout.strip_len[s] = LED_MAX_PER_STRIP;
+  }
+  g_cfg.layout.segment_count = 0;
+  led_build_segments(g_cfg.layout);
+}
+
+static CRGB frame[LED_MAX_PIXELS];
+static CRGB wire[LED_MAX_STRIPS * LED_WIRE_PER_STRIP];
+
+// Unpack pixel i of the wire buffer, adding the W share back.
+static CRGB unpack(int i, bool rgbw) {
+  const int s = i / LED_MAX_PER_STRIP;
+  const uint8_t *p = wire[s * LED_WIRE_PER_STRIP].raw + (i % LED_MAX_PER_STRIP) * (rgbw ? 4 : 3);
+  int c[3] = {p[1], p[0], p[2]};
+  if (rgbw) {
+    for (int k = 0; k < 3; ++k) {
+      c[k] += div255(p[3] * white_point.rgb[k]);
+    }
+  }
+  // Out of range means the subtraction wrapped.
+  if (c[0] > 255 || c[1] > 255 || c[2] > 255) {
+    return CRGB(0, 0, 0);
+  }
+  return CRGB(static_cast<uint8_t>(c[0]), static_cast<uint8_t>(c[1]), static_cast<uint8_t>(c[2]));
+}
+
+static void test_every_color() {
+  static const uint16_t kelvins[] = {2000, 2700, 4000, 5000, 6500, 10000};
+  const auto t0 = std::chrono::steady_clock::now();
+  uint64_t packed = 0;
+  for (uint16_t k : kelvins) {
+    white_point_set(k);
+    uint32_t mismatches = 0;
+    uint32_t sum_errors = 0;
+    for (uint32_t base = 0; base < (1u << 24); base += LED_MAX_PIXELS) {
+      uint64_t want[3] = {};
+      for (int i = 0; i < LED_MAX_PIXELS; ++i) {
+        const uint32_t c = (base + i) & 0xFFFFFF;
+        frame[i] = CRGB(static_cast<uint8_t>(c >> 16), static_cast<uint8_t>(c >> 8), static_cast<uint8_t>(c));
+        want[0] += frame[i].r;
+        want[1] += frame[i].g;
+        want[2] += frame[i].b;
+      }
+      PixelSums sums;
+      led_pack(frame, wire, true, sums);
+      packed += LED_MAX_PIXELS;
+      for (int i = 0; i < LED_MAX_PIXELS; ++i) {
+        mismatches += (unpack(i, true) == frame[i]) ? 0 : 1;
+      }
+      for (int c = 0; c < 3; ++c) {
+        sum_errors += (sums.rgb[c] + sums.moved[c] == want[c]) ? 0 : 1;
+      }
+    }
+    if (mismatches != 0) {
+      fprintf(stderr, "%u K: %u colors do not come back\n", k, mismatches);
+    }
+    CHECK_EQ(mismatches, 0u);
+    CHECK_EQ(sum_errors, 0u);
+  }
+  const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  printf("rgbw: %llu pixels packed and checked, %.1f ns per pixel\n", static_cast<unsigned long long>(packed),
+         s * 1e9 / packed);
+}
+
+static void test_rgb_and_white() {
+  white_point_set(LED_WHITE_K);
+  for (int i = 0; i < LED_MAX_PIXELS; ++i) {
+    frame[i] = CRGB(static_cast<uint8_t>(i * 37), static_cast<uint8_t>(i * 11 + 5), static_cast<uint8_t>(255 - i));
+  }
+  PixelSums sums;
+  led_pack(frame, wire, false, sums);
+  bool same = true;
+  for (int i = 0; i < LED_MAX_PIXELS; ++i) {
+    same = same && unpack(i, false) == frame[i];
+  }
+  CHECK(same);
+  CHECK_EQ(sums.w, 0u);
+
+  // Soft status white, 2 x 20 LEDs: most of the current moves to W.
+  fill_solid(frame, LED_MAX_PIXELS, CRGB(0, 0, 0));
+  fill_solid(frame, 20, CRGB(60, 60, 60));
+  fill_solid(frame + LED_MAX_PER_STRIP, 20, CRGB(60, 60, 60));
+  PixelSums rgb;
+  PixelSums rgbw;
+  led_pack(frame, wire, false, rgb);
+  led_pack(frame, wire, true, rgbw);
+  CHECK(rgbw.w > 0);
+  CHECK(pixel_sums_ua(rgbw) < pixel_sums_ua(rgb) * 2 / 3);
+  CHECK(pixel_sums_saved_ua(rgbw) > 0);
+  printf("rgbw: status white 2 x 20 LEDs %lu mA RGB, %lu mA RGBW\n",
+         static_cast<unsigned long>(pixel_sums_ua(rgb) / 1000), static_cast<unsigned long>(pixel_sums_ua(rgbw) / 1000));
+}
+
+static void test_bench_leaves_frame() {
+  g_cfg.rgbw = 1;
+  for (int i = 0; i < LED_MAX_PIXELS; ++i) {
+    leds_frame[i] = CRGB(static_cast<uint8_t>(i), 40, static_cast<uint8_t>(200 - i / 2));
+  }
+  PixelSums sums;
+  led_pack(leds_frame, led_wire, true, sums);
+  static CRGB frame_before[LED_MAX_PIXELS];
+  static CRGB wire_before[LED_MAX_STRIPS * LED_WIRE_PER_STRIP];
+  memcpy(frame_before, leds_frame, sizeof(leds_frame));
+  memcpy(wire_before, led_wire, sizeof(led_wire));
+
+  host_serial_capture(true);
+  bench_rgbw();
+  const std::string out = Serial.host_take_tx();
+  host_serial_capture(false);
+  CHECK(out.find("bench rgbw white") != std::string::npos);
+  CHECK(out.find("bench rgbw range6") != std::string::npos);
+  CHECK(memcmp(frame_before, leds_frame, sizeof(leds_frame)) == 0);
+  CHECK(memcmp(wire_before, led_wire, sizeof(led_wire)) == 0);
+  CHECK_EQ(g_cfg.rgbw, 1u);
+}
+
+int main() {
+  set_layout();
+  test_every_color();
+  test_rgb_and_white();
+  test_bench_leaves_frame();
+  return check_done("test_rgbw");
+}
@@ -0,0 +1,80 @@
+// Seqlock under real threads: one writer publishes a 62-byte value whose
+// words all carry the publish number while three readers copy it as fast
+// as they can. Every read must be whole (no words from two publishes), its
+// number must match the version read() returns, and each reader's versions
+// must never go back. Prints reads per reader.
+#include "../../src/main.cpp"
+
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+namespace {
+
+struct Wide {
+  uint32_t n[15];
+  uint16_t tail; // Not a whole word: the last word is padded.
+};
+
+Seqlock<Wide> wide_pub;
+std::atomic<bool> writer_done{false};
+
+struct ReaderStats {
+  uint64_t reads = 0;
+  uint64_t torn = 0;
+  uint64_t mismatched = 0;
+  uint64_t backwards = 0;
+  uint32_t last = 0;
+};
+
+void reader(ReaderStats *st) {
+  while (!writer_done.load(std::memory_order_acquire)) {
+    uint32_t version = 0;
+    const Wide w = wide_pub.read(&version);
+    bool whole = w.tail == static_cast<uint16_t>(w.n[0]);
+    for (uint32_t x : w.n) {
+      whole = whole && x == w.n[0];
+    }
+    st->torn += whole ? 0 : 1;
+    st->mismatched += (w.n[0] == version) ? 0 : 1;
+    st->backwards += (version < st->last) ? 1 : 0;
+    st->last = version;
+    st->reads++;
+  }
+}
+
+} // namespace
+
+int main() {
+  const uint32_t publishes = 2000000;
+  std::vector<ReaderStats> stats(3);
+  std::vector<std::thread> readers;
+  for (ReaderStats &st : stats) {
+    readers.emplace_back(reader, &st);
+  }
+  Wide w = {};
+  for (uint32_t i = 1; i <= publishes; ++i) {
+    for (uint32_t &x : w.n) {
+      x = i;
+    }
+    w.tail = static_cast<uint16_t>(i);
+    wide_pub.publish(w);
+  }
+  writer_done.store(true, std::memory_order_release);
+  for (std::thread &t : readers) {
+    t.join();
+  }
+
+  CHECK_EQ(wide_pub.version(), publishes);
+  CHECK_EQ(wide_pub.read().n[14], publishes);
+  for (size_t i = 0; i < stats.size(); ++i) {
+    CHECK(stats[i].reads > 0);
+    CHECK_EQ(stats[i].torn, 0u);
+    CHECK_EQ(stats[i].mismatched, 0u);
+    CHECK_EQ(stats[i].backwards, 0u);
+    printf("seqlock reader %zu: %llu reads, last version %u of %u\n", i,
+           static_cast<unsigned long long>(stats[i].reads), stats[i].last, publishes);
+  }
+  return check_done("test_seqlock");
+}
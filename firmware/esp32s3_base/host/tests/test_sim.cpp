@@ -0,0 +1,107 @@
+// Effect simulator on the device side: the serial `sim` command returns at
+// once and sim_poll() renders one case per loop pass, CRCs do not depend
+// on the live config, the live RNG sequence is left as it was, and stored
+// golden CRCs are versioned.
+#include "../../src/main.cpp"
+
+#include "check.h"
+
+static int count_lines(const std::string &text, const char *prefix) {
+  int n = 0;
+  for (size_t at = 0; (at = text.find(prefix, at)) != std::string::npos; at += strlen(prefix)) {
+    n++;
+  }
+  return n;
+}
+
+static void test_config_independent() {
+  set_default_config();
+  sim_active = true;
+  const uint32_t before = sim_run_case(10, 4, 50).crc;
+  g_cfg.effects[3].speed = 7;
+  g_cfg.effects[3].intensity = 250;
+  memset(g_cfg.palettes, 0x33, sizeof(g_cfg.palettes));
+  palette_lut_range = 0;
+  const uint32_t after = sim_run_case(10, 4, 50).crc;
+  sim_active = false;
+  CHECK_EQ(before, after);
+  set_default_config();
+}
+
+static void test_command_is_incremental() {
+  host_serial_capture(true);
+  Serial.host_feed("sim\n");
+  read_serial_commands();
+  CHECK_EQ(sim_job.kind, SIM_JOB_CHECK);
+  CHECK_EQ(count_lines(Serial.host_take_tx(), "sim effect="), 0);
+
+  random16_set_seed(1234);
+  const uint8_t live_next = random8();
+  random16_set_seed(1234);
+  sim_poll();
+  CHECK_EQ(random8(), live_next); // The sim restored the live seed.
+  std::string out = Serial.host_take_tx();
+  CHECK_EQ(count_lines(out, "sim effect="), 1);
+
+  Serial.host_feed("sim fps\n");
+  read_serial_commands();
+  CHECK(Serial.host_take_tx().find("sim busy") != std::string::npos);
+
+  int passes = 1;
+  while (sim_job.kind != SIM_JOB_NONE && passes < 1000) {
+    sim_poll();
+    passes++;
+  }
+  out = Serial.host_take_tx();
+  CHECK_EQ(passes, SIM_CASES);
+  CHECK_EQ(count_lines(out, "sim effect="), SIM_CASES - 1);
+  CHECK(out.find("sim done: cases=216") != std::string::npos);
+
+  Serial.host_feed("sim fps\n");
+  read_serial_commands();
+  passes = 0;
+  while (sim_job.kind != SIM_JOB_NONE && passes < 1000) {
+    sim_poll();
+    passes++;
+  }
+  out = Serial.host_take_tx();
+  CHECK_EQ(passes, SIM_EFFECT_COUNT + 1);
+  CHECK(out.find("sim fps done: failures=0") != std::string::npos);
+  host_serial_capture(false);
+}
+
+// Golden CRCs count only with the SIM_GOLDEN_VERSION they were recorded
+// under; older ones read as "no golden" rather than 216 failures.
+static void test_golden_version() {
+  host_serial_capture(true);
+  prefs_sim.begin("dogrgb_sim", false);
+  sim_start(SIM_JOB_RECORD);
+  while (sim_job.kind != SIM_JOB_NONE) {
+    sim_poll();
+  }
+  CHECK_EQ(prefs_sim.getUShort("golden_v", 0), SIM_GOLDEN_VERSION);
+  sim_start(SIM_JOB_CHECK);
+  CHECK(sim_job.has_golden);
+  while (sim_job.kind != SIM_JOB_NONE) {
+    sim_poll();
+  }
+  CHECK(Serial.host_take_tx().find("sim done: cases=216 failures=0 ") != std::string::npos);
+
+  prefs_sim.putUShort("golden_v", SIM_GOLDEN_VERSION - 1);
+  sim_start(SIM_JOB_CHECK);
+  CHECK(!sim_job.has_golden);
+  while (sim_job.kind != SIM_JOB_NONE) {
+    sim_poll();
+  }
+  const std::string out = Serial.host_take_tx();
+  CHECK(out.find("FAIL") == std::string::npos);
+  CHECK(out.find("no golden for this firmware") != std::string::npos);
+  host_serial_capture(false);
+}
+
+int main() {
+  test_config_independent();
+  test_command_is_incremental();
+  test_golden_version();
+  return check_done("test_sim");
+}
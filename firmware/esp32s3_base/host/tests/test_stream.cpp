@@ -0,0 +1,146 @@
+// LED preview delta encoding: random frames (sparse changes, runs, long
+// unchanged stretches, key frames) and every effect's sim frames decode,
+// as the /config page does, back to the frame that was encoded, within
+// the 4 + count * 5 byte bound; an unchanged frame is the 4-byte header.
+// Then bytes per frame for every effect over all ranges at full strip
+// length, as `sim stream` prints on the device.
+#include "../../src/main.cpp"
+
+#include "check.h"
+
+// The page's decoder: apply one encoded frame to the client's pixels.
+static bool delta_decode(const uint8_t *b, size_t len, CRGB *px, int count) {
+  if (len < 4 || (b[2] | b[3] << 8) != count) {
+    return false;
+  }
+  if (b[0] & 1) {
+    fill_solid(px, count, CRGB(0, 0, 0));
+  }
+  int i = 0;
+  size_t p = 4;
+  while (p < len) {
+    if (p + 2 > len) {
+      return false;
+    }
+    i += b[p++];
+    const uint8_t n = b[p++];
+    const int k = n & 0x7F;
+    const size_t need = (n & 0x80) ? 3 : 3 * k;
+    if (p + need > len || i + k > count) {
+      return false;
+    }
+    for (int j = 0; j < k; ++j) {
+      const size_t at = (n & 0x80) ? p : p + 3 * j;
+      px[i++] = CRGB(b[at], b[at + 1], b[at + 2]);
+    }
+    p += need;
+  }
+  return i <= count;
+}
+
+static CRGB random_color(uint32_t &seed) {
+  seed = seed * 1664525u + 1013904223u;
+  // Few distinct colors so equal neighbours (repeat runs) are common.
+  const uint8_t v = static_cast<uint8_t>(seed >> 24);
+  return (seed & 0x100) ? CRGB(v, v / 2, 255 - v) : CRGB(v & 0xC0, 0, v & 0x0C);
+}
+
+static void test_random_round_trip() {
+  static const int counts[] = {1, 2, 50, LED_MAX_PIXELS, 600};
+  static CRGB cur[600];
+  static CRGB prev[600];
+  static CRGB client[600];
+  static uint8_t bin[4 + 600 * 5];
+  uint32_t seed = 12345;
+  uint32_t frames = 0;
+  uint32_t failures = 0;
+  for (int count : counts) {
+    fill_solid(cur, count, CRGB(0, 0, 0));
+    for (int f = 0; f < 20000; ++f) {
+      const bool key = (f % 50 == 0);
+      switch (f % 5) {
+        case 0: // A few scattered pixels.
+          for (int k = 0; k < 3; ++k) {
+            cur[random_color(seed).r % count] = random_color(seed);
+          }
+          break;
+        case 1: { // One run of a single color.
+          const int at = (seed >> 8) % count;
+          const int len = min<int>(count - at, 1 + (seed >> 3) % 300);
+          fill_solid(&cur[at], len, random_color(seed));
+          break;
+        }
+        case 2: // Everything new.
+          for (int i = 0; i < count; ++i) {
+            cur[i] = random_color(seed);
+          }
+          break;
+        case 3: // Only the last pixel, after a long unchanged stretch.
+          cur[count - 1] = random_color(seed);
+          break;
+        default: // Unchanged.
+          break;
+      }
+      const bool unchanged = !key && memcmp(cur, prev, count * sizeof(CRGB)) == 0;
+      const size_t n = led_delta_encode(cur, prev, count, key, 3, bin);
+      const bool ok = n <= 4 + static_cast<size_t>(count) * 5 && (!unchanged || n == 4) &&
+                      delta_decode(bin, n, client, count) && memcmp(client, cur, count * sizeof(CRGB)) == 0 &&
+                      memcmp(prev, cur, count * sizeof(CRGB)) == 0;
+      if (!ok && failures++ == 0) {
+        fprintf(stderr, "count %d frame %d: %zu bytes do not decode to the frame\n", count, f, n);
+      }
+      frames++;
+    }
+  }
+  CHECK_EQ(failures, 0u);
+  printf("stream: %u random frames round-tripped\n", frames);
+}
+
+// Every sim frame of every effect through a second encoder and the decoder.
+static CRGB fx_prev[SIM_MAX_LEDS];
+static CRGB fx_client[SIM_MAX_LEDS];
+static uint8_t fx_bin[4 + SIM_MAX_LEDS * 5];
+static bool fx_first = true;
+static uint32_t fx_failures = 0;
+
+static void round_trip_frame(const CRGB *leds, int length) {
+  const size_t n = led_delta_encode(leds, fx_prev, length, fx_first, 1, fx_bin);
+  fx_first = false;
+  if (!delta_decode(fx_bin, n, fx_client, length) || memcmp(fx_client, leds, length * sizeof(CRGB)) != 0) {
+    fx_failures++;
+  }
+}
+
+static void test_bytes_per_frame() {
+  sim_active = true;
+  const int raw = 4 + SIM_MAX_LEDS * 3;
+  uint64_t all_bytes = 0;
+  uint64_t all_frames = 0;
+  for (int effect_id = 0; effect_id < SIM_EFFECT_COUNT; ++effect_id) {
+    SimStream s = {};
+    for (uint8_t range = 1; range <= 6; ++range) {
+      fx_first = true;
+      sim_run_case(effect_id, range, SIM_MAX_LEDS, round_trip_frame, LED_UPDATE_MS, nullptr, &s);
+    }
+    const float avg = s.bytes / static_cast<float>(s.frames);
+    CHECK_EQ(s.frames, 6 * SIM_FRAMES);
+    CHECK(s.max_bytes <= 4u + SIM_MAX_LEDS * 5);
+    // On average no worse than resending every pixel raw.
+    CHECK(avg <= raw);
+    printf("stream effect=%d len=%d raw_bytes=%d avg_bytes=%.1f max_bytes=%u sse_bytes=%.1f\n", effect_id,
+           SIM_MAX_LEDS, raw, avg, s.max_bytes, s.sse_bytes / static_cast<float>(s.frames));
+    all_bytes += s.bytes;
+    all_frames += s.frames;
+  }
+  sim_active = false;
+  CHECK_EQ(fx_failures, 0u);
+  const float avg = all_bytes / static_cast<float>(all_frames);
+  CHECK(avg < raw / 2.0f);
+  printf("stream: all effects avg_bytes=%.1f of raw %d\n", avg, raw);
+}
+
+int main() {
+  test_random_round_trip();
+  test_bytes_per_frame();
+  return check_done("test_stream");
+}
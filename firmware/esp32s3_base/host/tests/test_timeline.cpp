@@ -0,0 +1,112 @@
+// Day timeline: the incrementally kept 1/5/15-minute windows must equal
+// sums over the buckets after every sample, including minute gaps and time
+// going backwards; /api/timeline must send the header plus the buckets.
+// Prints the update cost and the response size.
+#include "../../src/main.cpp"
+
+#include <chrono>
+
+#include "check.h"
+#include "http.h"
+
+static bool windows_match() {
+  for (const RollingWindow &w : rolling) {
+    uint32_t dm = 0;
+    uint32_t s = 0;
+    for (int m = max(0, timeline_minute - w.minutes + 1); m <= timeline_minute; ++m) {
+      dm += timeline[m].distance_dm;
+      s += timeline[m].active_s;
+    }
+    if (dm != w.distance_dm || s != w.active_s) {
+      fprintf(stderr, "window %u at minute %d: %u/%u vs buckets %u/%u\n", w.minutes, timeline_minute, w.distance_dm,
+              w.active_s, dm, s);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void test_windows_follow_buckets() {
+  timeline_reset();
+  srand(3);
+  int minute = 0;
+  bool ok = true;
+  for (int i = 0; i < 200000 && ok; ++i) {
+    const int r = rand() % 1000;
+    if (r < 30) {
+      minute += 1;
+    } else if (r < 33) {
+      minute += 1 + rand() % 40; // Gap (no fix).
+    } else if (r == 33) {
+      minute = max(0, minute - rand() % 30); // Clock stepped back.
+    }
+    if (minute >= TIMELINE_MINUTES) {
+      timeline_reset();
+      minute = 0;
+    }
+    timeline_add_sample(minute, (rand() % 4000) / 100.0f, rand() % 3 != 0, (rand() % 600) / 10.0f);
+    ok = windows_match();
+  }
+  CHECK(ok);
+
+  // Saturation: a bucket stops at 65535 dm and 255 active seconds, and the
+  // windows add only what the bucket took.
+  timeline_reset();
+  for (int i = 0; i < 400; ++i) {
+    timeline_add_sample(10, 500.0f, true, 250.0f);
+  }
+  CHECK_EQ(timeline[10].distance_dm, 65535);
+  CHECK_EQ(timeline[10].active_s, 255);
+  CHECK_EQ(timeline[10].max_speed_hkph, 255);
+  CHECK(windows_match());
+  timeline_add_sample(12, 1.0f, false, 3.0f);
+  CHECK_EQ(timeline_window_max(1), 6);
+  CHECK_EQ(timeline_window_max(5), 255);
+  CHECK(windows_match());
+}
+
+static void test_endpoint() {
+  timeline_reset();
+  current_date_yyyymmdd = 20250102;
+  for (int m = 0; m < TIMELINE_MINUTES; m += 7) {
+    timeline_add_sample(m, 12.3f, true, 8.0f);
+  }
+  http_start();
+  HttpReply r = http_request("GET", "/api/timeline");
+  CHECK_EQ(r.status, 200);
+  CHECK_EQ(r.body.size(), 12 + TIMELINE_MINUTES * sizeof(TimelineBucket));
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(r.body.data());
+  CHECK_EQ(b[0] | b[1] << 8 | b[2] << 16 | static_cast<uint32_t>(b[3]) << 24, 20250102u);
+  CHECK_EQ(b[6] | b[7] << 8, TIMELINE_MINUTES);
+  CHECK_EQ(b[8], sizeof(TimelineBucket));
+  CHECK(memcmp(&b[12], timeline, sizeof(timeline)) == 0);
+  printf("/api/timeline full day: %zu bytes\n", r.body.size());
+
+  r = http_request("GET", "/api/timeline?from=700&to=760");
+  CHECK_EQ(r.body.size(), 12 + 60 * sizeof(TimelineBucket));
+  b = reinterpret_cast<const uint8_t *>(r.body.data());
+  CHECK_EQ(b[4] | b[5] << 8, 700);
+  CHECK(memcmp(&b[12], &timeline[700], 60 * sizeof(TimelineBucket)) == 0);
+
+  r = http_request("GET", "/api/timeline?from=2000&to=10");
+  CHECK_EQ(r.body.size(), 12u);
+}
+
+static void print_update_cost() {
+  timeline_reset();
+  const int samples = 1000000;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < samples; ++i) {
+    timeline_add_sample((i / 60) % TIMELINE_MINUTES, 1.5f, true, 6.0f);
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  printf("timeline_add_sample: %.1f ns/sample (host)\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / samples);
+}
+
+int main() {
+  test_windows_follow_buckets();
+  test_endpoint();
+  print_update_cost();
+  return check_done("test_timeline");
+}
@@ -0,0 +1,70 @@
+// /api/track: a whole day at the 1 s level comes back in TRACK_MAX_POINTS
+// slices that a client walks with from=(first+count)*step and that add up
+// to the stored track; the auto level stays under TRACK_AUTO_MAX_POINTS;
+// non-numeric and out-of-range levels are rejected.
+#include "../../src/main.cpp"
+
+#include "check.h"
+#include "http.h"
+
+static uint32_t le32(const std::string &s, size_t at) {
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(s.data()) + at;
+  return b[0] | b[1] << 8 | b[2] << 16 | static_cast<uint32_t>(b[3]) << 24;
+}
+
+static void test_slices() {
+  track_begin();
+  track_reset();
+  current_date_yyyymmdd = 20250102;
+  for (uint32_t t = 0; t < 86400; t += 3) {
+    track_add(t, -34.6f + t * 1e-6f, -58.4f);
+  }
+  http_start();
+
+  std::string day;
+  uint32_t requests = 0;
+  uint32_t next = 0;
+  size_t largest = 0;
+  while (next < 86400 && requests < 100) {
+    const HttpReply r = http_request("GET", ("/api/track?level=0&from=" + std::to_string(next)).c_str());
+    CHECK_EQ(r.status, 200);
+    if (r.status != 200 || r.body.size() < 16) {
+      break;
+    }
+    const uint32_t first = le32(r.body, 4);
+    const uint32_t count = le32(r.body, 8);
+    CHECK_EQ(first, next);
+    CHECK(count <= TRACK_MAX_POINTS);
+    CHECK_EQ(r.body.size(), 16 + count * sizeof(TrackPoint));
+    largest = max(largest, r.body.size());
+    day += r.body.substr(16);
+    next = first + count;
+    requests++;
+  }
+  CHECK_EQ(requests, (86400 + TRACK_MAX_POINTS - 1) / TRACK_MAX_POINTS);
+  CHECK_EQ(day.size(), 86400 * sizeof(TrackPoint));
+  CHECK(memcmp(day.data(), track_level[0], day.size()) == 0);
+  printf("/api/track level 0 day: %u requests, largest %zu bytes\n", requests, largest);
+
+  // Auto level for the whole day: the finest one under the limit.
+  const HttpReply r = http_request("GET", "/api/track");
+  CHECK_EQ(r.status, 200);
+  CHECK(le32(r.body, 8) <= TRACK_AUTO_MAX_POINTS);
+}
+
+static void test_level_rejected() {
+  for (const char *q : {"level=x", "level=", "level=1x", "level=-1", "level=9", "level=12"}) {
+    const HttpReply r = http_request("GET", (std::string("/api/track?") + q).c_str());
+    if (r.status != 400) {
+      fprintf(stderr, "%s: %d\n", q, r.status);
+    }
+    CHECK_EQ(r.status, 400);
+  }
+  CHECK_EQ(http_request("GET", "/api/track?level=3").status, 200);
+}
+
+int main() {
+  test_slices();
+  test_level_rejected();
+  return check_done("test_track");
+}
@@ -11,7 +11,8 @@ static const float SPEED_RANGE_5_KPH = 7.5f;
 
 // Effect selection for Segment B (planned for FastLED).
 // 0=SOLID, 1=PULSE, 2=BREATH, 3=CHASE, 4=COMET, 5=SINELON,
-// 6=CONFETTI, 7=JUGGLE, 8=BPM, 9=RAINBOW, 10=FIRE, 11=GRADIENT_WAVE
+// 6=CONFETTI, 7=JUGGLE, 8=BPM, 9=RAINBOW, 10=FIRE, 11=GRADIENT_WAVE,
+// 12..15 = user programs in slots 0-3 (uploaded on /effects)
 static const int RANGE_1_EFFECT_A = 0;
 static const int RANGE_1_EFFECT_B = 1;
 static const int RANGE_2_EFFECT_A = 1;
@@ -39,22 +40,63 @@ static const uint8_t RANGE_5_INTENSITY = 180;
 static const uint8_t RANGE_6_SPEED = 170;
 static const uint8_t RANGE_6_INTENSITY = 200;
 
+// Palette per range: 4 colors (0xRRGGBB) spread evenly around a cyclic
+// 256-step palette. The first color is the range base color (SOLID, PULSE,
+// CHASE, ...); GRADIENT_WAVE, CONFETTI and JUGGLE sample the whole palette.
+static const uint32_t RANGE_1_PALETTE[4] = {0x00003C, 0x00103C, 0x000828, 0x00183C}; // Blue
+static const uint32_t RANGE_2_PALETTE[4] = {0x14003C, 0x00003C, 0x28003C, 0x0A0032}; // Blue/violet
+static const uint32_t RANGE_3_PALETTE[4] = {0x28003C, 0x1E0032, 0x32003C, 0x140028}; // Purple
+static const uint32_t RANGE_4_PALETTE[4] = {0x3C0028, 0x3C1400, 0x3C0032, 0x3C1E00}; // Magenta/orange
+static const uint32_t RANGE_5_PALETTE[4] = {0x3C0014, 0x3C1E00, 0x3C2800, 0x3C1400}; // Orange
+static const uint32_t RANGE_6_PALETTE[4] = {0x3C0000, 0x3C0A00, 0x280000, 0x3C0500}; // Red
+
+// User effect programs: bytecode run once per body pixel per frame.
+static const int FX_PROGRAM_SLOTS = 4;
+static const int FX_PROGRAM_MAX_OPS = 64; // Instructions per program (also the max per pixel).
+
 // Motion filters and activity thresholds.
 static const float SPEED_ACTIVE_KPH = 0.7f; // Min speed to count as "active".
 static const float SPEED_MAX_VALID_KPH = 40.0f; // Reject GPS spikes above this.
 
 // LED hardware (strip size and layout).
-// These are common to change per collar size.
-static const int LED_STRIP_MODE = 2; // 1 = single strip, 2 = dual strips.
+// These are defaults; strip count, lengths and segments can be changed on /config.
+static const int LED_STRIP_MODE = 2; // Number of strips (1-LED_MAX_STRIPS).
 static const int LED_STRIP_COUNT = 20; // LEDs per strip (min 10, max 50).
 static const int LED_STATUS_COUNT = 3; // First N LEDs reserved for status.
+static const int LED_MAX_STRIPS = 4; // Strips with a data pin in pins.h.
+static const int LED_MAX_PER_STRIP = 50; // Framebuffer capacity per strip.
+static const int LED_MAX_SEGMENTS = 16; // Logical segments in the segment map.
 static const uint8_t LED_BRIGHTNESS = 77; // ~30% brightness (0-255).
 
+// LED current model (SK6812 5050 at 5 V): per-channel draw at full duty,
+// linear in PWM duty, plus the quiescent draw of every LED.
+static const uint32_t LED_UA_RED = 12000;
+static const uint32_t LED_UA_GREEN = 12000;
+static const uint32_t LED_UA_BLUE = 12000;
+static const uint32_t LED_UA_IDLE = 1000;
+static const uint32_t LED_UA_WHITE = 12000; // White die of SK6812 RGBW parts.
+static const uint16_t POWER_BUDGET_MA = 1500; // LED current cap (boost 2 A minus MCU/GNSS); 0 = off.
+static const uint16_t POWER_RELEASE_PER_S = 64; // Brightness levels per second regained after a cap.
+
+// SK6812 RGBW strips: effects still render RGB; on output the part of each
+// pixel that matches the white die's color goes to the W channel.
+static const bool LED_RGBW = false; // true for RGBW parts (32 bits per LED).
+static const uint16_t LED_WHITE_K = 4500; // White die color temperature (K, 2000-10000).
+
 // LED UI timing.
-static const unsigned long LED_UPDATE_MS = 50; // Refresh interval for LED UI.
+static const unsigned long LED_UPDATE_MS = 50; // Reference frame period; effect speeds/fades are per this period.
+static const unsigned long LED_FRAME_MIN_MS = 8; // Fastest frame period (~125 fps) when the frame budget allows.
+static const unsigned long LED_FRAME_IDLE_MS = 100; // Frame period for status-only patterns (10 fps).
+static const unsigned long LED_FRAME_MAX_DT_MS = 250; // Longer stalls advance effects by at most this.
 static const unsigned long CRITICAL_NO_OK_MS = 600000; // Error if no GPS/Wi-Fi for this long.
 static const bool LED_UI_ENABLED = true; // Disable to turn off LED UI logic.
 
+// Live LED preview (/api/leds/stream).
+static const unsigned long LED_STREAM_MIN_MS = 50; // Fastest preview frame period (20 fps).
+static const uint32_t LED_STREAM_BUDGET_PCT = 3; // Max share of CPU time for encoding and sending.
+static const unsigned long LED_STREAM_KEEPALIVE_MS = 15000; // Comment line when nothing changed.
+static const unsigned long LED_PREVIEW_MAX_MS = 600000; // Forced range ends after this.
+
 // Wi-Fi settings (less common to change).
 static const char *AP_SSID = "dog"; // AP name for direct connection.
 static const char *AP_PASS = "Dog123456789"; // AP password (>= 8 chars).
@@ -62,11 +104,62 @@ static const char *MDNS_NAME = "dog-collar"; // mDNS hostname in STA mode.
 static const unsigned long STA_CONNECT_TIMEOUT_MS = 10000; // STA connect timeout.
 static const unsigned long WIFI_RETRY_INTERVAL_MS = 10000; // Watchdog retry interval.
 
+// Upload to a home server in STA mode (upload.url in /api/config).
+static const char *UPLOAD_URL = ""; // Default endpoint, e.g. "http://192.168.1.10:8080/dogrgb"; empty = off.
+static const uint16_t UPLOAD_BATCH_FIXES = 256; // Fix records per POST.
+static const uint16_t UPLOAD_TIMEOUT_MS = 5000; // Connect and response timeout of one POST.
+static const unsigned long UPLOAD_IDLE_MS = 60000; // Check for new data this often once caught up.
+static const unsigned long UPLOAD_RETRY_MIN_MS = 5000; // First retry after a failure; doubles each time.
+static const unsigned long UPLOAD_RETRY_MAX_MS = 600000; // Retry delay cap.
+static const size_t PORTAL_JSON_ARENA = 8192; // Static arena for portal JSON documents (bytes).
+static const size_t PORTAL_BODY_MAX = 2048; // Largest POST /api/config body, JSON or CBOR (bytes).
+static const size_t SUMMARY_CACHE_BYTES = 1024; // /api/summary JSON kept per metrics version (~510 bytes used).
+
 // GNSS settings (rare changes).
 static const uint32_t GPS_BAUD = 9600; // GNSS UART baudrate.
 static const unsigned long GPS_SAMPLE_MS = 1000; // Sampling interval.
+static const size_t GPS_RX_BUFFER = 1024; // UART RX buffer; covers radio bring-up stalls.
+static const bool GNSS_AID_ENABLED = true; // Send last fix/time to the receiver on boot.
+static const float GNSS_AID_POS_ACC_M = 5000.0f; // Assumed error of the stored position.
+static const uint32_t GNSS_AID_MAX_AGE_S = 7UL * 24 * 3600; // Older stored fixes are not sent.
+static const uint32_t GNSS_ALMANAC_FIX_S = 750; // Continuous tracking for a full almanac (12.5 min broadcast).
+
+// IMU (ICM-42688-P, accel only). Skipped at boot if the sensor is absent.
+static const bool IMU_ENABLED = true;
+static const uint8_t IMU_I2C_ADDR = 0x68; // 0x69 with AP_AD0 high.
+static const uint32_t IMU_I2C_HZ = 400000;
+static const uint16_t IMU_ODR_HZ = 200; // Accel output data rate (100/200/500).
+static const unsigned long IMU_POLL_MS = 20; // FIFO drain period of the IMU task.
+static const uint16_t IMU_ACTIVE_MG = 60; // Intensity above this counts as active.
+static const float IMU_KPH_PER_MG = 0.02f; // Initial intensity-to-speed ratio (learned from GNSS).
+
+// Day track pyramid (GET /api/track).
+static const uint32_t TRACK_AUTO_MAX_POINTS = 1000; // Without level=, finest level under this many points.
+static const uint32_t TRACK_MAX_POINTS = 4096; // Largest slice per request (32 KB); ask again from first+count.
+
+// Fix log in the "log" flash partition (GET /api/log).
+static const uint32_t LOG_CHUNK_BYTES = 1024; // Flash read / HTTP send buffer, the only RAM a download uses.
+
+// Geofence zones (set on /api/zones).
+static const int GEOFENCE_MAX_ZONES = 32; // Zone slots (one bit each in the grid index).
+static const int GEOFENCE_MAX_VERTICES = 12; // Max polygon vertices per zone.
+static const int GEOFENCE_GRID = 16; // Grid index cells per side over all zones.
+static const unsigned long GEOFENCE_ALERT_MS = 10000; // Status LED blink after an alert.
 
 // Persistence (rare changes).
 static const unsigned long SAVE_INTERVAL_MS = 60000; // NVS save interval.
 
+// BLE bulk transfer (rare changes).
+static const uint16_t BLE_MTU = 517; // Requested ATT MTU (23-517).
+static const int HISTORY_DAYS = 30; // Closed daily summaries kept in NVS for sync.
+static const int BLE_BULK_CHUNKS_PER_LOOP = 4; // Notifications queued per loop pass.
+static const int BLE_BULK_CREDITS = 6; // Notifications in flight before waiting for CONF_EVT.
+static const unsigned long BLE_START_DELAY_MS = 30000; // BLE waits for the first fix or this long.
+
+// Diagnostics (rare changes).
+static const bool TRACE_ENABLED = true; // Record hot-path events in the trace ring.
+static const uint32_t TRACE_RING_EVENTS = 1024; // Ring size (power of two, 8 bytes each).
+static const unsigned long SIM_FRAMES = 100; // Frames per case for the serial effect simulator.
+static const unsigned long SIM_SNAP_MS = 100; // Snapshot interval for the `sim fps` frame-rate check.
+
 #endif
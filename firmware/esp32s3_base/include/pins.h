@@ -7,7 +7,13 @@ static const int PIN_STATUS_LED = 3; // XIAO ESP32-S3 D2 / GPIO3 (external LED)
 static const int PIN_LED_A_DATA = 11;
 // SK6812 strip B (single-wire data) - Mapped to GPIO12
 static const int PIN_LED_B_DATA = 12;
+// SK6812 strips C/D (only driven when the layout uses 3-4 strips).
+static const int PIN_LED_C_DATA = 13;
+static const int PIN_LED_D_DATA = 14;
 static const int PIN_GPS_RX = 7; // XIAO ESP32-S3 D6 / GPIO7 (GPS TX -> ESP RX)
 static const int PIN_GPS_TX = 8; // XIAO ESP32-S3 D7 / GPIO8 (ESP TX -> GPS RX)
+// IMU (ICM-42688-P) on I2C.
+static const int PIN_IMU_SDA = 5; // XIAO ESP32-S3 D4 / GPIO5
+static const int PIN_IMU_SCL = 6; // XIAO ESP32-S3 D5 / GPIO6
 
 #endif
@@ -18,6 +18,7 @@
   - Status LED: D2 / GPIO3
   - LED A data: GPIO11
   - LED B data: GPIO12
+  - IMU SDA/SCL: D4 / GPIO5, D5 / GPIO6
 
   Dependencies:
   - FastLED
@@ -40,11 +41,21 @@
 #include <BLEDevice.h>
 #include <BLEServer.h>
 #include <BLEUtils.h>
+#include <BLE2902.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
 #include <WiFi.h>
 #include <WebServer.h>
 #include <ESPmDNS.h>
 #include <FastLED.h>
 #include <ArduinoJson.h>
+#include <Wire.h>
+#include <esp_partition.h>
+#include <HTTPClient.h>
+#include <lwip/sockets.h>
+#include <atomic>
+#include <sys/time.h>
+#include <time.h>
 #include "pins.h"
 #include "config.h"
 
@@ -58,6 +69,9 @@ static HardwareSerial GPS(1);
 static Preferences prefs;
 static Preferences prefs_cfg;
 static BLECharacteristic *summary_char = nullptr;
+static BLECharacteristic *activity_char = nullptr;
+static BLECharacteristic *bulk_control_char = nullptr;
+static BLECharacteristic *bulk_data_char = nullptr;
 static WebServer server(80);
 
 // NMEA line buffer for incoming GPS sentences.
@@ -71,13 +85,187 @@ static unsigned long last_gps_ms = 0;
 
 // Behavior thresholds and sampling are defined in config.h.
 
-// Rolling metrics for the current day.
-static unsigned long last_sample_ms = 0;
+// Rolling metrics for the current day. Samples are spaced by the GNSS
+// clock (fix time), not millis(), so replayed NMEA is accounted the same
+// at any feed rate.
+static uint32_t last_sample_s = 0; // Fix time of the last sample, seconds.
 static unsigned long active_time_ms = 0;
 static float total_distance_m = 0.0f;
 static float max_speed_kph = 0.0f;
 static uint16_t last_update_min = 0;
 
+// Single-writer seqlock. The writer makes seq odd, stores the value as
+// relaxed atomic words and makes seq even again; a reader copies the words
+// and retries if seq was odd or moved meanwhile. Readers on any task never
+// block the writer or see a torn value. version() (seq / 2) counts publishes.
+template <typename T>
+class Seqlock {
+ public:
+  void publish(const T &value) {
+    uint32_t words[WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+    const uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  T read(uint32_t *version = nullptr) const {
+    uint32_t words[WORDS];
+    uint32_t seq;
+    for (;;) {
+      seq = seq_.load(std::memory_order_acquire);
+      if (seq & 1) {
+        continue;
+      }
+      for (size_t i = 0; i < WORDS; ++i) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == seq) {
+        break;
+      }
+    }
+    if (version != nullptr) {
+      *version = seq / 2;
+    }
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+  uint32_t version() const {
+    return seq_.load(std::memory_order_acquire) / 2;
+  }
+
+ private:
+  static const size_t WORDS = (sizeof(T) + 3) / 4;
+  std::atomic<uint32_t> seq_{0};
+  std::atomic<uint32_t> words_[WORDS];
+};
+
+// Day metrics as the BLE, HTTP and serial readers see them, derived once
+// per handled RMC line by metrics_publish(). Version 0 = not yet published.
+struct MetricsSnapshot {
+  uint32_t date_yyyymmdd;
+  uint32_t active_time_ms;
+  uint32_t distance_m; // Rounded.
+  float distance_exact_m;
+  float avg_speed_kph;
+  float max_speed_kph;
+  float speed_kph; // Last RMC speed.
+  uint16_t avg_speed_cmps;
+  uint16_t max_speed_cmps;
+  uint16_t last_update_min;
+  bool gps_fix;
+};
+
+static Seqlock<MetricsSnapshot> metrics_pub;
+
+// Time and distance per speed range and per GPS hour of day, accumulated
+// once per sample (no raw samples kept). Persisted with the daily metrics.
+struct ActivityHistogram {
+  uint32_t range_time_ms[6];
+  float range_distance_m[6];
+  uint32_t hour_active_ms[24];
+  float hour_distance_m[24];
+};
+
+static ActivityHistogram activity;
+
+// Per-minute timeline of the current day, indexed by GPS minute of day and
+// filled on each sample. Buckets are little-endian words so /api/timeline
+// sends the array as-is (a Uint32Array on the client).
+struct TimelineBucket {
+  uint16_t distance_dm; // Decimeters travelled in the minute.
+  uint8_t active_s; // Active seconds in the minute.
+  uint8_t max_speed_hkph; // Max speed in 0.5 km/h units.
+};
+
+static_assert(sizeof(TimelineBucket) == 4, "timeline buckets are sent as 32-bit words");
+static const int TIMELINE_MINUTES = 1440;
+static TimelineBucket timeline[TIMELINE_MINUTES];
+
+// Rolling sums over the last 1/5/15 minutes ending at timeline_minute. They
+// are adjusted as minutes enter and leave, so updates cost O(windows).
+struct RollingWindow {
+  uint16_t minutes;
+  uint32_t distance_dm;
+  uint32_t active_s;
+};
+
+static RollingWindow rolling[3] = {{1, 0, 0}, {5, 0, 0}, {15, 0, 0}};
+static int timeline_minute = -1;
+
+// Day track pyramid for /api/track. Each level is indexed by time of day
+// (slot = second / step) and keeps the last fix in each slot, so any
+// from/to window is one contiguous slice sent as-is. Empty slots are
+// filled with 0x80 bytes (lat_e7 = TRACK_EMPTY, an invalid latitude). The
+// 1 s and 10 s levels (~760 KB) are allocated in PSRAM and skipped on
+// boards without it.
+struct TrackPoint {
+  int32_t lat_e7;
+  int32_t lon_e7;
+};
+
+static_assert(sizeof(TrackPoint) == 8, "track points are sent as-is");
+static const int TRACK_LEVELS = 4;
+static const uint16_t TRACK_STEP_S[TRACK_LEVELS] = {1, 10, 60, 600};
+static const int32_t TRACK_EMPTY = static_cast<int32_t>(0x80808080u);
+static TrackPoint track_1min[86400 / 60];
+static TrackPoint track_10min[86400 / 600];
+static TrackPoint *track_level[TRACK_LEVELS] = {nullptr, nullptr, track_1min, track_10min};
+
+// Fix log in the "log" flash partition (partitions.csv), one record per GPS
+// sample, for GET /api/log. The last sector holds a LogHeader; the rest is a
+// ring of 4 KB sectors. Before the head writes a sector's last slot, the next
+// sector is erased, so the head's sector (or the erased one after it) always
+// has a free slot. At boot the head is found from that free slot, not from
+// record times, which can step back with the clock.
+struct LogRecord {
+  uint32_t unix_s;
+  int32_t lat_e7;
+  int32_t lon_e7;
+  uint16_t speed_cmps;
+  uint8_t flags; // Bit 0: speed above SPEED_ACTIVE_KPH.
+  uint8_t check; // XOR of the first 15 bytes.
+};
+
+// Written once when the partition is formatted. Anything else in the header
+// sector (a new partition holding old app bytes, an older layout) formats it.
+struct LogHeader {
+  uint32_t magic;   // LOG_MAGIC.
+  uint32_t version; // LOG_VERSION.
+  uint32_t ring;    // Ring bytes at format time.
+  uint32_t check;   // magic ^ version ^ ring.
+};
+
+static_assert(sizeof(LogRecord) == 16, "log records are sent as-is");
+static const uint32_t LOG_SECTOR = 4096;
+static const uint32_t LOG_ERASED = 0xFFFFFFFFu;
+static const uint32_t LOG_MAGIC = 0x474F4C44u; // "DLOG".
+static const uint32_t LOG_VERSION = 2;         // 1 had no header sector.
+static const esp_partition_t *log_part = nullptr;
+static uint32_t log_ring = 0; // Ring bytes: the partition less the header sector.
+static uint32_t log_head = 0; // Partition offset of the next record.
+static bool log_wrapped = false;
+static uint32_t log_gen = 0; // Trips of the head back to 0 since the format (NVS "log_gen").
+static uint8_t log_chunk[LOG_CHUNK_BYTES]; // Reused by every download.
+
+struct LogStats {
+  uint32_t appends;
+  uint32_t errors;
+  uint32_t formatted; // Sectors erased by the last format, 0 if none.
+  uint32_t downloads;
+  uint32_t last_bytes;
+  uint32_t last_ms;
+};
+
+static LogStats log_stats = {};
+
 // Last position for distance calculation.
 static bool has_last_point = false;
 static float last_lat_deg = 0.0f;
@@ -91,35 +279,291 @@ static unsigned long last_save_ms = 0;
 static const char *BLE_DEVICE_NAME = "Dog-Collar";
 static const char *BLE_SERVICE_UUID = "8b4c0001-6c1d-4f3c-a5b0-1e0c5a00a101";
 static const char *BLE_CHAR_UUID = "8b4c0002-6c1d-4f3c-a5b0-1e0c5a00a101";
+static const char *BLE_ACTIVITY_UUID = "8b4c0003-6c1d-4f3c-a5b0-1e0c5a00a101";
+static const size_t BLE_ACTIVITY_LEN = 89;
+
+// BLE bulk transfer service (history/timeline sync, see docs/ble_spec.md).
+static const char *BLE_BULK_SERVICE_UUID = "8b4c0010-6c1d-4f3c-a5b0-1e0c5a00a101";
+static const char *BLE_BULK_CONTROL_UUID = "8b4c0011-6c1d-4f3c-a5b0-1e0c5a00a101";
+static const char *BLE_BULK_DATA_UUID = "8b4c0012-6c1d-4f3c-a5b0-1e0c5a00a101";
+
+// Closed days as 16-byte summary records (same layout as the BLE summary).
+// head is the next slot to write; persisted only on day change.
+struct DayHistory {
+  uint8_t head;
+  uint8_t count;
+  uint8_t records[HISTORY_DAYS][16];
+};
+
+static DayHistory history;
 
 // Wi-Fi settings are defined in config.h.
 
-static String wifi_ssid;
-static String wifi_pass;
+// Fixed capacities for credentials and names (802.11 / mDNS limits). These
+// live in static buffers so long uptimes do not fragment the heap.
+static const size_t SSID_MAX = 32;
+static const size_t PASS_MAX = 64;
+static const size_t MDNS_MAX = 32;
+static const size_t UPLOAD_URL_MAX = 96;
+
+static char wifi_ssid[SSID_MAX + 1];
+static char wifi_pass[PASS_MAX + 1];
 static bool wifi_sta_connected = false;
 static bool wifi_sta_connecting = false;
 static unsigned long wifi_sta_start_ms = 0;
 static unsigned long last_wifi_check_ms = 0;
 
+// Upload to a home server while on STA Wi-Fi. The loop builds one batch at
+// a time into upload_body and hands it to the "upload" task (core 0), which
+// does the blocking POST, so a slow or dead server never delays a frame.
+// The cursors (date of the last day record and time of the last fix the
+// server accepted) only move on a 2xx and are saved to NVS, so a batch is
+// repeated until it is accepted and not sent again after that.
+//
+// Body: "DRUP", version u8, kind u8, record count u16, previous cursor u32,
+// then for days the 16-byte summary records, for fixes the first LogRecord
+// as-is and every next one as zigzag varint deltas of time, lat, lon and
+// speed plus the flags byte (~7 bytes per fix at 1 Hz instead of 16).
+enum UploadKind : uint8_t {
+  UPLOAD_DAYS = 1,
+  UPLOAD_FIXES = 2,
+};
+
+static const size_t UPLOAD_HEADER = 12;
+static const size_t UPLOAD_FIX_MAX = 4 * 5 + 1; // Worst-case delta record.
+
+struct UploadState {
+  int code; // HTTP status, < 0 for connection errors (see upload_done).
+  uint8_t kind;
+  uint16_t count;
+  uint32_t body_len;
+  uint32_t next_cursor; // Cursor once this batch is accepted.
+  uint32_t day_cursor;
+  uint32_t fix_gen;    // Next fix to send: log_gen and partition offset
+  uint32_t fix_offset; // it had when written (see log_pos()).
+  uint64_t next_fix;   // Log position once this fix batch is accepted.
+  uint32_t next_ms;
+  uint32_t backoff_ms;
+  uint32_t days;
+  uint32_t fixes;
+  uint32_t batches;
+  uint32_t bytes;
+  uint32_t failures;
+  int last_code;
+  char url[UPLOAD_URL_MAX + 1];
+  char device[MDNS_MAX + 1];
+};
+
+static UploadState upload = {};
+// Handoff to the upload task on core 0. The loop builds the batch (body,
+// url, device) and then release-stores pending; the task acquire-loads it
+// before reading any of them. The task writes code, then release-stores
+// done and clears pending, so the loop sees the code that goes with done.
+static std::atomic<bool> upload_pending{false};
+static std::atomic<bool> upload_done{false};
+static uint8_t upload_body[UPLOAD_HEADER + sizeof(LogRecord) + (UPLOAD_BATCH_FIXES - 1) * UPLOAD_FIX_MAX];
+static_assert(sizeof(upload_body) >= UPLOAD_HEADER + HISTORY_DAYS * 16, "a days batch fits the body");
+static bool upload_task_started = false;
+
 // LED strip configuration is defined in config.h.
 static unsigned long last_led_update_ms = 0;
 
+// LED frame deadline counters. A frame is late when it starts more than
+// two frame periods after the previous one (loop() was blocked), counting
+// fast adaptive periods as LED_UPDATE_MS so they do not inflate the count.
+struct LedFrameStats {
+  uint32_t frames;
+  uint32_t late;
+  uint32_t max_gap_ms;
+  uint32_t max_frame_us;
+  uint32_t last_frame_us;
+  uint32_t frame_start_us; // 0 outside update_led_ui().
+};
+static LedFrameStats led_stats = {};
+static unsigned long led_frame_ms = LED_UPDATE_MS; // Current adaptive frame period.
+
+// LED current estimate and brightness cap (see power_update()).
+struct PowerStats {
+  uint32_t est_ma;            // Last frame, after the cap.
+  uint32_t peak_ma;
+  uint8_t brightness;         // Applied global brightness (<= config).
+  uint16_t level_q8;          // Applied brightness, Q8, for the slow release.
+  uint32_t capped_frames;
+  uint32_t white_saved_ma;    // Last frame: RGB draw replaced by the W die.
+  uint64_t white_saved_mams;  // mA x ms since boot.
+  uint64_t total_mams;        // mA x ms since boot.
+  uint32_t minute_mams[60];   // mA x ms per minute of the last hour.
+  uint32_t minute;            // millis() / 60000 of the current slot.
+  unsigned long last_ms;
+};
+static PowerStats power = {};
+
+// NMEA replay: while on, GPS UART bytes are dropped and sentences arrive
+// through the `nmea` serial command instead (tools/nmea_replay.py). Read
+// by the IMU task too.
+static std::atomic<bool> nmea_replay{false};
+
+// Staged boot. setup() only brings up NVS, LEDs and the GPS UART; loop()
+// then starts one radio stage per pass so GNSS bytes keep draining. BLE is
+// deferred until it is needed: the first fix (the walk is on and the day
+// will want syncing), BLE_START_DELAY_MS after reset, or serial `ble`; it
+// comes up on a background task. Milestones are millis() since reset
+// (0 = not reached yet).
+enum BootStage : uint8_t {
+  BOOT_WIFI = 0,
+  BOOT_HTTP = 1,
+  BOOT_BLE = 2,
+  BOOT_DONE = 3,
+};
+
+struct BootMilestones {
+  uint32_t first_frame_ms;
+  uint32_t first_nmea_ms;
+  uint32_t wifi_ms;
+  uint32_t portal_ms;
+  uint32_t ble_ms;
+  uint32_t first_fix_ms;
+};
+
+static BootStage boot_stage = BOOT_WIFI;
+static BootMilestones boot_ms = {};
+static bool ble_start_requested = false;
+// Set by the BLE init task once the characteristics exist; the release
+// store makes them visible to loop().
+static std::atomic<bool> ble_ready{false};
+
 static unsigned long last_ok_ms = 0;
 
 // Speed-to-color ranges are defined in config.h.
 
-static CRGB leds_a[LED_STRIP_COUNT];
-static CRGB leds_b[LED_STRIP_COUNT];
-static uint8_t heat_a[LED_STRIP_COUNT];
-static uint8_t heat_b[LED_STRIP_COUNT];
+// Every physical strip lives back to back in one contiguous, word-aligned
+// frame so the byte-wise pixel kernels (fill/fade/scale) run over all strips
+// in one pass. Strip lengths and the segment map are runtime config.
+static const int LED_MAX_PIXELS = LED_MAX_STRIPS * LED_MAX_PER_STRIP;
+alignas(4) static CRGB leds_frame[LED_MAX_PIXELS];
+static CLEDController *strip_ctrl[LED_MAX_STRIPS] = {nullptr};
+static uint16_t strip_offset[LED_MAX_STRIPS];
+static int led_pixel_count = 0;
+
+// What goes on the wire: GRB or, for RGBW parts, GRBW bytes per LED, packed
+// from leds_frame by led_pack(). The controllers send it as raw RGB-order
+// triples, so an RGBW LED simply takes 32 bits at the same SK6812 timing.
+// Each strip has a fixed slot sized for RGBW.
+static const int LED_WIRE_PER_STRIP = (LED_MAX_PER_STRIP * 4 + 2) / 3;
+alignas(4) static CRGB led_wire[LED_MAX_STRIPS * LED_WIRE_PER_STRIP];
+
+// White die color for W extraction (see white_point_set()): RGB scaled to a
+// largest channel of 255 and 255 * 256 / channel for the per-pixel minimum.
+struct WhitePoint {
+  uint8_t rgb[3];
+  uint16_t inv_q8[3];
+};
+static WhitePoint white_point = {{255, 255, 255}, {256, 256, 256}};
+
+// Live preview: one viewer of GET /api/leds/stream gets leds_frame as
+// server-sent events, delta/RLE encoded against the last frame queued on
+// its socket (see led_delta_encode()). Sends never block: while the socket
+// still holds part of the last event, new frames are skipped, so the rate
+// follows what the client drains. Encoding plus sending is kept under
+// LED_STREAM_BUDGET_PCT of CPU time by spacing frames out.
+static const int LED_DELTA_MAX_BYTES = 4 + LED_MAX_PIXELS * 5;
+static const int LED_STREAM_OUT_BYTES = 128 + (LED_DELTA_MAX_BYTES + 2) / 3 * 4;
+
+struct LedStream {
+  WiFiClient client;
+  bool active;
+  bool need_key;              // Next frame is a key frame (new viewer or layout).
+  bool owns_preview;          // Preview ends with this viewer.
+  uint8_t range;              // Range update_led_ui() is showing.
+  uint8_t sent_range;         // Range byte of the last frame sent.
+  unsigned long next_ms;
+  unsigned long last_send_ms;
+  uint16_t out_len;
+  uint16_t out_pos;           // Bytes of out already on the socket.
+  uint32_t viewers;
+  uint32_t frames;
+  uint32_t skipped;           // Frames due while the socket was still busy.
+  uint32_t bytes;
+  uint32_t last_us;           // Encode + send time of the last frame.
+  uint32_t max_us;
+  char out[LED_STREAM_OUT_BYTES];
+};
+static LedStream led_stream;
+static CRGB led_stream_prev[LED_MAX_PIXELS];
+static uint8_t led_stream_bin[LED_DELTA_MAX_BYTES];
+
+// Forced speed range for previews (0 = off): the body shows that range's
+// effects even without a fix until led_preview_until_ms.
+static uint8_t led_preview_range = 0;
+static unsigned long led_preview_until_ms = 0;
+
+// Channel sums of one packed frame, for the current estimate.
+struct PixelSums {
+  uint32_t rgb[3];  // Left on the RGB dies.
+  uint32_t w;       // On the W die.
+  uint32_t moved[3]; // Taken off the RGB dies by white extraction.
+};
 
+// Effects are evaluated from elapsed time: positions and hues are Q8
+// (1/256 pixel or hue step) and advance by their per-LED_UPDATE_MS speed
+// scaled by the frame's dt, so the look does not depend on frame rate.
 struct EffectState {
-  uint8_t hue = 0;
-  uint16_t pos = 0;
+  uint32_t pos = 0;     // Head position, Q8 pixels (CHASE, COMET).
+  uint16_t hue = 0;     // Hue, Q8 (RAINBOW, GRADIENT_WAVE).
+  uint16_t rem = 0;     // Advance remainder, exact across any dt split.
+  uint16_t tick_ms = 0; // Time not yet consumed by fixed-step effects.
+};
+
+// Logical segment of a physical strip. Body segments show the effect of
+// their channel (0 = effect A, 1 = effect B); mirrored segments are drawn
+// reversed, e.g. for symmetric halves.
+enum SegmentRole : uint8_t {
+  SEG_STATUS = 0,
+  SEG_BODY = 1,
+};
+
+static const uint8_t SEG_MIRROR = 0x01;
+
+struct LedSegment {
+  uint8_t strip;
+  uint8_t role;
+  uint8_t channel;
+  uint8_t flags;
+  uint8_t start;
+  uint8_t count;
 };
 
-static EffectState state_a;
-static EffectState state_b;
+// Strip layout. With segment_count == 0 the segment map is derived from the
+// strip lengths (status first, then body; optional mirrored body halves).
+struct LedLayout {
+  uint8_t strip_count;
+  uint8_t strip_len[LED_MAX_STRIPS];
+  uint8_t status_count;
+  uint8_t mirror;
+  uint8_t segment_count;
+  LedSegment segments[LED_MAX_SEGMENTS];
+};
+
+// Active segment map and the render plan built from it. Body segments with
+// the same effect and length share one render slot; the slot is rendered
+// once into render_buf and copied to every segment that uses it.
+struct RenderSlot {
+  int8_t effect_id;
+  uint8_t count;
+  uint16_t offset;
+};
+
+static LedSegment led_segments[LED_MAX_SEGMENTS];
+static uint8_t led_segment_count = 0;
+static uint8_t segment_slot[LED_MAX_SEGMENTS];
+static RenderSlot render_slots[LED_MAX_SEGMENTS];
+static uint8_t render_slot_count = 0;
+static int render_pixel_count = 0;
+static int planned_effect_a = -1;
+static int planned_effect_b = -1;
+alignas(4) static CRGB render_buf[LED_MAX_PIXELS];
+static uint8_t render_heat[LED_MAX_PIXELS];
+static EffectState render_state[LED_MAX_SEGMENTS];
 
 struct RangeEffect {
   uint8_t effect_a;
@@ -128,21 +572,180 @@ struct RangeEffect {
   uint8_t intensity;
 };
 
+static const int PALETTE_STOPS = 4;
+
+struct RangePalette {
+  uint8_t stops[PALETTE_STOPS][3]; // RGB, evenly spaced, wrapping.
+};
+
 struct RuntimeConfig {
   uint8_t brightness;
+  uint16_t power_budget_ma; // 0 = no cap.
+  uint8_t rgbw;             // 1 = SK6812 RGBW strips.
+  uint16_t white_k;         // W die color temperature.
   float ranges[5];
   RangeEffect effects[6];
-  String ap_ssid;
-  String ap_pass;
-  String mdns;
+  RangePalette palettes[6];
+  LedLayout layout;
+  char ap_ssid[SSID_MAX + 1];
+  char ap_pass[PASS_MAX + 1];
+  char mdns[MDNS_MAX + 1];
+  char upload_url[UPLOAD_URL_MAX + 1]; // Empty = no upload.
 };
 
 static RuntimeConfig g_cfg;
+
+// User effect programs, effect ids FX_EFFECT_BASE.. (one per slot). A
+// program is a list of 4-byte instructions {op, d, a, b} over 16 int32
+// registers, run once per pixel. Jumps only go forward, so a pixel costs at
+// most op_count instructions. Stored as NVS blob "programs".
+//
+// On entry to every pixel: r0 index, r1 count, r2 effect time (ms), r3
+// speed, r4 intensity, r5 index * 256 / count, r13-r15 the pixel's current
+// r/g/b, which is also the output until an RGB/PAL/HUE. r6-r12 start each
+// frame at 0 and carry over from one pixel to the next.
+static const int FX_EFFECT_BASE = 12;
+static const int FX_EFFECT_MAX = FX_EFFECT_BASE + FX_PROGRAM_SLOTS - 1;
+static const int FX_REGS = 16;
+
+enum FxOp : uint8_t {
+  FX_END = 0,    // Stop this pixel.
+  FX_LDI = 1,    // d = int16(a | b << 8)
+  FX_MOV = 2,    // d = a
+  FX_ADD = 3,    // d = a + b
+  FX_SUB = 4,    // d = a - b
+  FX_MUL = 5,    // d = a * b
+  FX_DIV = 6,    // d = a / b (0 if b is 0)
+  FX_MOD = 7,    // d = a % b (0 if b is 0)
+  FX_AND = 8,    // d = a & b
+  FX_OR = 9,     // d = a | b
+  FX_XOR = 10,   // d = a ^ b
+  FX_SHL = 11,   // d = a << (b & 31)
+  FX_SHR = 12,   // d = a >> (b & 31), arithmetic
+  FX_MIN = 13,   // d = min(a, b)
+  FX_MAX = 14,   // d = max(a, b)
+  FX_SIN = 15,   // d = sin8(a & 255), 0..255
+  FX_RND = 16,   // d = random8()
+  FX_SLT = 17,   // d = a < b
+  FX_JZ = 18,    // if d == 0, skip the next a instructions (a is a count)
+  FX_JMP = 19,   // skip the next a instructions
+  FX_RGB = 20,   // output (d, a, b), each clamped to 0..255
+  FX_PAL = 21,   // output range palette[d & 255]
+  FX_HUE = 22,   // output rainbow[d & 255]
+  FX_SCALE = 23, // output scaled by clamp(d) / 256
+  FX_OP_COUNT = 24,
+};
+
+struct FxProgram {
+  char name[16];
+  uint8_t op_count; // 0 = empty slot.
+  uint8_t reserved[3];
+  uint8_t code[FX_PROGRAM_MAX_OPS * 4];
+};
+
+static FxProgram fx_programs[FX_PROGRAM_SLOTS];
+
+// Color lookup tables for the effects (see palette_for_range()).
+static CRGB palette_lut[256];
+static uint8_t palette_lut_range = 0; // 0 = stale.
+static CRGB rainbow_lut[256];
+static bool rainbow_lut_ready = false;
 static const uint8_t CONFIG_VERSION = 1;
 static bool pending_ap_restart = false;
 static unsigned long pending_ap_at_ms = 0;
 static const unsigned long AP_RESTART_DELAY_MS = 500;
 
+// Hot-path trace ring. Each event is 8 bytes, timestamped with the CPU
+// cycle counter of the loop() core; the ring overwrites the oldest entries.
+enum TraceId : uint8_t {
+  TRACE_GPS_PARSE = 1,
+  TRACE_EFFECT_RENDER = 2,
+  TRACE_LED_SHOW = 3,
+  TRACE_HTTP = 4,
+  TRACE_NVS_COMMIT = 5,
+  TRACE_WIFI = 6,
+  TRACE_BOOT = 7,
+};
+
+enum TracePhase : uint8_t {
+  TRACE_BEGIN = 0,
+  TRACE_END = 1,
+  TRACE_INSTANT = 2,
+};
+
+// Wi-Fi transition codes carried in the arg field of TRACE_WIFI events.
+enum TraceWifi : uint16_t {
+  TRACE_WIFI_AP = 0,
+  TRACE_WIFI_STA_START = 1,
+  TRACE_WIFI_STA_UP = 2,
+  TRACE_WIFI_STA_LOST = 3,
+  TRACE_WIFI_STA_TIMEOUT = 4,
+  TRACE_WIFI_AP_RESTART = 5,
+};
+
+// Boot milestone codes carried in the arg field of TRACE_BOOT events.
+enum TraceBoot : uint16_t {
+  TRACE_BOOT_FIRST_FRAME = 0,
+  TRACE_BOOT_FIRST_NMEA = 1,
+  TRACE_BOOT_WIFI = 2,
+  TRACE_BOOT_PORTAL = 3,
+  TRACE_BOOT_BLE = 4,
+  TRACE_BOOT_FIRST_FIX = 5,
+};
+
+struct TraceEvent {
+  uint32_t cycles;
+  uint8_t id;
+  uint8_t phase;
+  uint16_t arg;
+};
+
+static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two");
+static TraceEvent trace_ring[TRACE_RING_EVENTS];
+static uint32_t trace_head = 0; // Total events written since boot/clear.
+
+// Dump header ("DTRC"), followed by events oldest first.
+static const uint8_t TRACE_DUMP_VERSION = 1;
+static const size_t TRACE_HEADER_SIZE = 16;
+
+// Serial command line buffer (trace dump and diagnostics).
+static char serial_line[128];
+static size_t serial_len = 0;
+
+// Offline effect simulator: renders frames into scratch buffers on a
+// virtual clock with a seeded RNG, independent of the physical strips.
+static const int SIM_MAX_LEDS = 50;
+static const int SIM_STRIP_LENGTHS[] = {10, 20, 50};
+static const int SIM_LENGTH_COUNT = sizeof(SIM_STRIP_LENGTHS) / sizeof(SIM_STRIP_LENGTHS[0]);
+static const int SIM_EFFECT_COUNT = 12;
+static const int SIM_CASES = SIM_EFFECT_COUNT * 6 * SIM_LENGTH_COUNT;
+static const uint16_t SIM_SEED = 0x5EED;
+static bool sim_active = false;
+static uint32_t sim_clock_ms = 0;
+static Preferences prefs_sim;
+
+// FastLED beat/wave helpers read time through this hook (built with
+// USE_GET_MILLISECOND_TIMER) so the simulator can drive them deterministically.
+uint32_t get_millisecond_timer() {
+  return sim_active ? sim_clock_ms : millis();
+}
+
+static inline void trace_event(uint8_t id, uint8_t phase, uint16_t arg = 0) {
+  if (!TRACE_ENABLED) {
+    return;
+  }
+  TraceEvent &e = trace_ring[trace_head & (TRACE_RING_EVENTS - 1)];
+  e.cycles = ESP.getCycleCount();
+  e.id = id;
+  e.phase = phase;
+  e.arg = arg;
+  trace_head++;
+}
+
+static void start_sta_mode();
+static void handle_nmea_line(const char *line);
+static float led_speed_kph();
+
 static float knots_to_kph(float knots) {
   return knots * 1.852f;
 }
@@ -157,6 +760,23 @@ static uint8_t clamp_u8(int value) {
   return static_cast<uint8_t>(value);
 }
 
+static void put_u16_le(uint8_t *out, uint16_t value) {
+  out[0] = static_cast<uint8_t>(value & 0xFF);
+  out[1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+}
+
+static void put_u32_le(uint8_t *out, uint32_t value) {
+  out[0] = static_cast<uint8_t>(value & 0xFF);
+  out[1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+  out[2] = static_cast<uint8_t>((value >> 16) & 0xFF);
+  out[3] = static_cast<uint8_t>((value >> 24) & 0xFF);
+}
+
+static uint32_t get_u32_le(const uint8_t *in) {
+  return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+         (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
 static float pulse_scale(unsigned long period_ms) {
   const unsigned long now_ms = millis();
   const float phase = static_cast<float>(now_ms % period_ms) / static_cast<float>(period_ms);
@@ -199,7 +819,8 @@ static bool parse_rmc(const char *line,
                       float *speed_kph,
                       bool *valid_fix,
                       uint32_t *date_yyyymmdd,
-                      uint16_t *time_min) {
+                      uint16_t *time_min,
+                      uint32_t *time_s) {
   if (strncmp(line, "$GPRMC,", 7) != 0 && strncmp(line, "$GNRMC,", 7) != 0) {
     return false;
   }
@@ -274,207 +895,2129 @@ static bool parse_rmc(const char *line,
     const int hour = (time_buf[0] - '0') * 10 + (time_buf[1] - '0');
     const int min = (time_buf[2] - '0') * 10 + (time_buf[3] - '0');
     *time_min = static_cast<uint16_t>(hour * 60 + min);
+    const int sec = (time_len >= 6) ? (time_buf[4] - '0') * 10 + (time_buf[5] - '0') : 0;
+    *time_s = static_cast<uint32_t>(hour * 3600 + min * 60 + sec);
   }
   return true;
 }
 
-// Persist daily metrics to NVS (throttled by SAVE_INTERVAL_MS).
-static void save_metrics() {
-  prefs.putUInt("date", current_date_yyyymmdd);
-  prefs.putFloat("dist_m", total_distance_m);
-  prefs.putULong("active_ms", active_time_ms);
-  prefs.putFloat("max_kph", max_speed_kph);
-  prefs.putUShort("upd_min", last_update_min);
+// Unix seconds for a UTC date (YYYYMMDD) and second of day.
+static uint32_t unix_from_utc(uint32_t date_yyyymmdd, uint32_t time_s) {
+  int y = static_cast<int>(date_yyyymmdd / 10000);
+  const int m = static_cast<int>((date_yyyymmdd / 100) % 100);
+  const int d = static_cast<int>(date_yyyymmdd % 100);
+  // Days from civil date (proleptic Gregorian), 1970-01-01 = 0.
+  y -= (m <= 2) ? 1 : 0;
+  const int era = y / 400;
+  const int yoe = y - era * 400;
+  const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  const int32_t days = era * 146097 + doe - 719468;
+  return static_cast<uint32_t>(days) * 86400u + time_s;
 }
 
-// Restore persisted metrics from NVS on boot.
-static void load_metrics() {
-  current_date_yyyymmdd = prefs.getUInt("date", 0);
-  total_distance_m = prefs.getFloat("dist_m", 0.0f);
-  active_time_ms = prefs.getULong("active_ms", 0);
-  max_speed_kph = prefs.getFloat("max_kph", 0.0f);
-  last_update_min = prefs.getUShort("upd_min", 0);
-}
+// GNSS warm-start assist. The last good fix is persisted with its UTC time;
+// on boot it is sent to the E108 (CASIC protocol) as an AID-INI message so
+// the receiver starts with an approximate position, and time when the
+// ESP32 clock survived the reset (soft reset / deep sleep). The time the
+// receiver last tracked long enough to hold a full almanac is kept too, so
+// its age can be reported next to the TTFF of each boot.
+struct GnssAid {
+  float lat_deg;
+  float lon_deg;
+  uint32_t unix_s; // UTC time of the fix.
+};
 
-static void load_wifi_creds() {
-  wifi_ssid = prefs.getString("wifi_ssid", "");
-  wifi_pass = prefs.getString("wifi_pass", "");
+static const uint8_t CASIC_CLASS_AID = 0x0B;
+static const uint8_t CASIC_ID_AID_INI = 0x01;
+static const size_t CASIC_AID_INI_LEN = 56;
+static const size_t CASIC_AID_INI_FRAME = 6 + CASIC_AID_INI_LEN + 4;
+static const uint8_t CASIC_AID_POS_VALID = 0x01;
+static const uint8_t CASIC_AID_TIME_VALID = 0x02;
+static const uint8_t CASIC_AID_POS_LLA = 0x20;
+static const uint32_t GPS_EPOCH_UNIX = 315964800; // 1980-01-06.
+static const uint32_t GPS_LEAP_SECONDS = 18;
+static const uint32_t CLOCK_VALID_UNIX = 1577836800; // 2020-01-01.
+
+static GnssAid gnss_aid = {};
+static bool gnss_clock_set = false;
+static uint8_t gnss_aid_flags = 0; // Flags of the AID-INI sent this boot.
+static unsigned long gnss_start_ms = 0;
+static unsigned long gnss_ttff_ms = 0;
+static uint32_t gnss_almanac_unix = 0; // Persisted as "gnss_alm".
+static uint32_t gnss_run_start_unix = 0; // First fix of the current tracking run.
+static uint32_t gnss_run_last_unix = 0;
+static const uint32_t GNSS_RUN_GAP_S = 10; // Longer fix gaps restart the run.
+
+static void put_f32_le(uint8_t *out, float value) {
+  memcpy(out, &value, sizeof(value));
 }
 
-static void save_wifi_creds(const String &ssid, const String &pass) {
-  prefs.putString("wifi_ssid", ssid);
-  prefs.putString("wifi_pass", pass);
-  wifi_ssid = ssid;
-  wifi_pass = pass;
+static void put_f64_le(uint8_t *out, double value) {
+  memcpy(out, &value, sizeof(value));
 }
 
-// Build the 16-byte payload for BLE read.
-static void build_summary_payload(uint8_t *out, size_t len) {
-  if (len < 16) {
-    return;
+// Build an AID-INI frame: BA CE, len, class, id, payload, checksum. The
+// checksum is (id << 24) + (class << 16) + len plus every payload word.
+static size_t casic_build_aid_ini(uint8_t *out, const GnssAid &aid, uint32_t now_unix, uint8_t flags) {
+  uint8_t *p = &out[6];
+  memset(p, 0, CASIC_AID_INI_LEN);
+  put_f64_le(&p[0], aid.lat_deg);
+  put_f64_le(&p[8], aid.lon_deg);
+  put_f64_le(&p[16], 0.0); // Altitude is not tracked.
+  uint16_t week = 0;
+  if (flags & CASIC_AID_TIME_VALID) {
+    const uint32_t gps_s = now_unix - GPS_EPOCH_UNIX + GPS_LEAP_SECONDS;
+    week = static_cast<uint16_t>(gps_s / 604800u);
+    put_f64_le(&p[24], static_cast<double>(gps_s % 604800u));
   }
+  put_f32_le(&p[32], 0.0f); // Clock frequency bias.
+  put_f32_le(&p[36], GNSS_AID_POS_ACC_M);
+  put_f32_le(&p[40], 2.0f); // Time accuracy (s) after an RTC-kept reset.
+  put_f32_le(&p[44], 0.0f);
+  put_u16_le(&p[52], week);
+  p[54] = 0; // Time source.
+  p[55] = flags;
 
-  const float avg_speed_kph = (active_time_ms > 0)
-                                  ? (total_distance_m / (active_time_ms / 1000.0f)) * 3.6f
-                                  : 0.0f;
-  const uint32_t distance_m = static_cast<uint32_t>(total_distance_m + 0.5f);
-  const uint16_t avg_speed_cmps = static_cast<uint16_t>(avg_speed_kph * 27.7778f);
-  const uint16_t max_speed_cmps = static_cast<uint16_t>(max_speed_kph * 27.7778f);
-
-  memset(out, 0, len);
-  out[0] = static_cast<uint8_t>(current_date_yyyymmdd & 0xFF);
-  out[1] = static_cast<uint8_t>((current_date_yyyymmdd >> 8) & 0xFF);
-  out[2] = static_cast<uint8_t>((current_date_yyyymmdd >> 16) & 0xFF);
-  out[3] = static_cast<uint8_t>((current_date_yyyymmdd >> 24) & 0xFF);
-
-  out[4] = static_cast<uint8_t>(distance_m & 0xFF);
-  out[5] = static_cast<uint8_t>((distance_m >> 8) & 0xFF);
-  out[6] = static_cast<uint8_t>((distance_m >> 16) & 0xFF);
-  out[7] = static_cast<uint8_t>((distance_m >> 24) & 0xFF);
+  out[0] = 0xBA;
+  out[1] = 0xCE;
+  put_u16_le(&out[2], CASIC_AID_INI_LEN);
+  out[4] = CASIC_CLASS_AID;
+  out[5] = CASIC_ID_AID_INI;
+  uint32_t ck = (static_cast<uint32_t>(CASIC_ID_AID_INI) << 24) +
+                (static_cast<uint32_t>(CASIC_CLASS_AID) << 16) + CASIC_AID_INI_LEN;
+  for (size_t i = 0; i < CASIC_AID_INI_LEN; i += 4) {
+    ck += static_cast<uint32_t>(p[i]) | (static_cast<uint32_t>(p[i + 1]) << 8) |
+          (static_cast<uint32_t>(p[i + 2]) << 16) | (static_cast<uint32_t>(p[i + 3]) << 24);
+  }
+  put_u32_le(&out[6 + CASIC_AID_INI_LEN], ck);
+  return CASIC_AID_INI_FRAME;
+}
 
-  out[8] = static_cast<uint8_t>(avg_speed_cmps & 0xFF);
-  out[9] = static_cast<uint8_t>((avg_speed_cmps >> 8) & 0xFF);
-  out[10] = static_cast<uint8_t>(max_speed_cmps & 0xFF);
-  out[11] = static_cast<uint8_t>((max_speed_cmps >> 8) & 0xFF);
+// Decide what can be aided and build the frame; returns 0 if nothing.
+static size_t gnss_prepare_aid(uint8_t *out, uint8_t *flags_out) {
+  const uint32_t now_unix = static_cast<uint32_t>(time(nullptr));
+  const bool clock_ok = now_unix >= CLOCK_VALID_UNIX;
+  uint8_t flags = 0;
+  if (gnss_aid.unix_s != 0 && (!clock_ok || now_unix - gnss_aid.unix_s <= GNSS_AID_MAX_AGE_S)) {
+    flags |= CASIC_AID_POS_VALID | CASIC_AID_POS_LLA;
+  }
+  if (clock_ok) {
+    flags |= CASIC_AID_TIME_VALID;
+  }
+  *flags_out = flags;
+  if (flags == 0) {
+    return 0;
+  }
+  return casic_build_aid_ini(out, gnss_aid, now_unix, flags);
+}
 
-  out[12] = static_cast<uint8_t>(last_update_min & 0xFF);
-  out[13] = static_cast<uint8_t>((last_update_min >> 8) & 0xFF);
+// Sent once the receiver is talking (first NMEA line), so it is listening.
+static void gnss_send_aid() {
+  if (!GNSS_AID_ENABLED) {
+    return;
+  }
+  uint8_t frame[CASIC_AID_INI_FRAME];
+  const size_t len = gnss_prepare_aid(frame, &gnss_aid_flags);
+  if (len > 0) {
+    GPS.write(frame, len);
+  }
+}
 
-  uint8_t flags = 0;
-  if (has_gps_fix) {
-    flags |= 0x01;
+// Record a good fix: kept for the next boot and used to set the clock.
+static void gnss_note_fix(float lat_deg, float lon_deg, uint32_t date_yyyymmdd, uint32_t time_s) {
+  if (gnss_ttff_ms == 0) {
+    gnss_ttff_ms = max<unsigned long>(1, millis() - gnss_start_ms);
   }
-  if (current_date_yyyymmdd != 0) {
-    flags |= 0x02;
+  if (date_yyyymmdd == 0) {
+    return;
   }
-  out[14] = flags;
+  gnss_aid.lat_deg = lat_deg;
+  gnss_aid.lon_deg = lon_deg;
+  gnss_aid.unix_s = unix_from_utc(date_yyyymmdd, time_s);
+  if (gnss_run_start_unix == 0 || gnss_aid.unix_s - gnss_run_last_unix > GNSS_RUN_GAP_S) {
+    gnss_run_start_unix = gnss_aid.unix_s;
+  }
+  gnss_run_last_unix = gnss_aid.unix_s;
+  if (gnss_aid.unix_s - gnss_run_start_unix >= GNSS_ALMANAC_FIX_S) {
+    gnss_almanac_unix = gnss_aid.unix_s;
+  }
+  if (!gnss_clock_set) {
+    timeval tv = {static_cast<time_t>(gnss_aid.unix_s), 0};
+    settimeofday(&tv, nullptr);
+    gnss_clock_set = true;
+  }
+}
 
-  uint8_t checksum = 0;
-  for (size_t i = 0; i < 15; ++i) {
-    checksum ^= out[i];
+// Seconds since the receiver last held a full almanac; -1 if unknown.
+static long gnss_almanac_age_s() {
+  const uint32_t now_unix = static_cast<uint32_t>(time(nullptr));
+  if (gnss_almanac_unix == 0 || now_unix < CLOCK_VALID_UNIX || now_unix < gnss_almanac_unix) {
+    return -1;
   }
-  out[15] = checksum;
+  return static_cast<long>(now_unix - gnss_almanac_unix);
 }
 
-static String build_summary_json() {
-  const float avg_speed_kph = (active_time_ms > 0)
-                                  ? (total_distance_m / (active_time_ms / 1000.0f)) * 3.6f
-                                  : 0.0f;
-  const uint32_t distance_m = static_cast<uint32_t>(total_distance_m + 0.5f);
-  const uint16_t avg_speed_cmps = static_cast<uint16_t>(avg_speed_kph * 27.7778f);
-  const uint16_t max_speed_cmps = static_cast<uint16_t>(max_speed_kph * 27.7778f);
-  const bool has_data = (current_date_yyyymmdd != 0);
+// Geofence zones. Each zone keeps a bounding box, and a grid over the union
+// of all boxes stores per cell the bitmask of zones whose box touches it,
+// so a fix only runs the exact circle/polygon test on zones nearby.
+enum GeoZoneType : uint8_t {
+  GEO_CIRCLE = 0,
+  GEO_POLYGON = 1,
+};
+
+// Alert flags: which transitions blink the status LEDs.
+enum GeoAlert : uint8_t {
+  GEO_ALERT_ENTER = 1,
+  GEO_ALERT_EXIT = 2,
+};
+
+struct GeoZone {
+  char name[16];
+  uint8_t type;
+  uint8_t alert;
+  uint8_t vertex_count; // Polygon only.
+  uint8_t reserved;
+  float radius_m; // Circle only; center is vertex 0.
+  float lat[GEOFENCE_MAX_VERTICES];
+  float lon[GEOFENCE_MAX_VERTICES];
+};
+
+// Persisted part of the engine (NVS blob "zones").
+struct GeoZoneTable {
+  uint8_t count;
+  GeoZone zones[GEOFENCE_MAX_ZONES];
+};
+
+struct GeoIndex {
+  GeoZoneTable table;
+  float min_lat[GEOFENCE_MAX_ZONES];
+  float max_lat[GEOFENCE_MAX_ZONES];
+  float min_lon[GEOFENCE_MAX_ZONES];
+  float max_lon[GEOFENCE_MAX_ZONES];
+  float m_per_deg_lon[GEOFENCE_MAX_ZONES]; // Circles: scale at the center latitude.
+  float grid_lat0;
+  float grid_lon0;
+  float cell_lat;
+  float cell_lon;
+  uint32_t cells[GEOFENCE_GRID * GEOFENCE_GRID];
+};
+
+struct GeoStats {
+  uint32_t checks; // Fixes checked.
+  uint32_t tests; // Exact zone tests run.
+  uint16_t enters[GEOFENCE_MAX_ZONES];
+  uint16_t exits[GEOFENCE_MAX_ZONES];
+};
+
+static_assert(GEOFENCE_MAX_ZONES <= 32, "geofence zones are tracked in a 32-bit mask");
+static const float M_PER_DEG_LAT = 110540.0f;
+static const float M_PER_DEG_LON_EQUATOR = 111320.0f;
 
-  String json = "{";
-  json += "\"date\":" + String(current_date_yyyymmdd);
-  json += ",\"distance_m\":" + String(distance_m);
-  json += ",\"avg_speed_cmps\":" + String(avg_speed_cmps);
-  json += ",\"max_speed_cmps\":" + String(max_speed_cmps);
-  json += ",\"last_update_min\":" + String(last_update_min);
-  json += ",\"gps_fix\":" + String(has_gps_fix ? "true" : "false");
-  json += ",\"has_data\":" + String(has_data ? "true" : "false");
-  json += "}";
-  return json;
+static GeoIndex geo;
+static GeoStats geo_stats;
+static uint32_t geo_inside = 0; // Zones containing the last fix.
+static bool geo_inside_known = false;
+static unsigned long geo_alert_until_ms = 0;
+static bool geo_alert_exit = false;
+static Preferences prefs_geo;
+
+static int geo_cell(float value, float origin, float size) {
+  return constrain(static_cast<int>((value - origin) / size), 0, GEOFENCE_GRID - 1);
 }
 
-static bool validate_ranges(const float *ranges) {
-  for (int i = 1; i < 5; ++i) {
-    if (!(ranges[i] > ranges[i - 1])) {
-      return false;
+// Recompute bounding boxes and the grid index from g.table.
+static void geo_build(GeoIndex &g) {
+  memset(g.cells, 0, sizeof(g.cells));
+  float lat0 = 90.0f;
+  float lat1 = -90.0f;
+  float lon0 = 180.0f;
+  float lon1 = -180.0f;
+  for (int i = 0; i < g.table.count; ++i) {
+    const GeoZone &z = g.table.zones[i];
+    if (z.type == GEO_CIRCLE) {
+      g.m_per_deg_lon[i] = M_PER_DEG_LON_EQUATOR * cosf(z.lat[0] * 0.01745329252f);
+      const float dlat = z.radius_m / M_PER_DEG_LAT;
+      const float dlon = z.radius_m / max(g.m_per_deg_lon[i], 1.0f);
+      g.min_lat[i] = z.lat[0] - dlat;
+      g.max_lat[i] = z.lat[0] + dlat;
+      g.min_lon[i] = z.lon[0] - dlon;
+      g.max_lon[i] = z.lon[0] + dlon;
+    } else {
+      g.min_lat[i] = g.max_lat[i] = z.lat[0];
+      g.min_lon[i] = g.max_lon[i] = z.lon[0];
+      for (int v = 1; v < z.vertex_count; ++v) {
+        g.min_lat[i] = min(g.min_lat[i], z.lat[v]);
+        g.max_lat[i] = max(g.max_lat[i], z.lat[v]);
+        g.min_lon[i] = min(g.min_lon[i], z.lon[v]);
+        g.max_lon[i] = max(g.max_lon[i], z.lon[v]);
+      }
+    }
+    lat0 = min(lat0, g.min_lat[i]);
+    lat1 = max(lat1, g.max_lat[i]);
+    lon0 = min(lon0, g.min_lon[i]);
+    lon1 = max(lon1, g.max_lon[i]);
+  }
+  g.grid_lat0 = lat0;
+  g.grid_lon0 = lon0;
+  g.cell_lat = max((lat1 - lat0) / GEOFENCE_GRID, 1e-6f);
+  g.cell_lon = max((lon1 - lon0) / GEOFENCE_GRID, 1e-6f);
+  for (int i = 0; i < g.table.count; ++i) {
+    const int r0 = geo_cell(g.min_lat[i], g.grid_lat0, g.cell_lat);
+    const int r1 = geo_cell(g.max_lat[i], g.grid_lat0, g.cell_lat);
+    const int c0 = geo_cell(g.min_lon[i], g.grid_lon0, g.cell_lon);
+    const int c1 = geo_cell(g.max_lon[i], g.grid_lon0, g.cell_lon);
+    for (int r = r0; r <= r1; ++r) {
+      for (int c = c0; c <= c1; ++c) {
+        g.cells[r * GEOFENCE_GRID + c] |= (1u << i);
+      }
     }
   }
-  return true;
 }
 
-static bool validate_effects(const RangeEffect *effects) {
-  for (int i = 0; i < 6; ++i) {
-    if (effects[i].effect_a > 11 || effects[i].effect_b > 11) {
-      return false;
+// Even-odd crossing test with longitude as x and latitude as y.
+static bool geo_in_polygon(const GeoZone &z, float lat, float lon) {
+  bool inside = false;
+  for (int i = 0, j = z.vertex_count - 1; i < z.vertex_count; j = i++) {
+    if ((z.lat[i] > lat) != (z.lat[j] > lat) &&
+        lon < (z.lon[j] - z.lon[i]) * (lat - z.lat[i]) / (z.lat[j] - z.lat[i]) + z.lon[i]) {
+      inside = !inside;
     }
   }
-  return true;
+  return inside;
 }
 
-static void set_default_config() {
-  g_cfg.brightness = LED_BRIGHTNESS;
-  g_cfg.ranges[0] = SPEED_RANGE_1_KPH;
-  g_cfg.ranges[1] = SPEED_RANGE_2_KPH;
-  g_cfg.ranges[2] = SPEED_RANGE_3_KPH;
-  g_cfg.ranges[3] = SPEED_RANGE_4_KPH;
-  g_cfg.ranges[4] = SPEED_RANGE_5_KPH;
-
-  g_cfg.effects[0] = {static_cast<uint8_t>(RANGE_1_EFFECT_A), static_cast<uint8_t>(RANGE_1_EFFECT_B),
-                      RANGE_1_SPEED, RANGE_1_INTENSITY};
-  g_cfg.effects[1] = {static_cast<uint8_t>(RANGE_2_EFFECT_A), static_cast<uint8_t>(RANGE_2_EFFECT_B),
-                      RANGE_2_SPEED, RANGE_2_INTENSITY};
-  g_cfg.effects[2] = {static_cast<uint8_t>(RANGE_3_EFFECT_A), static_cast<uint8_t>(RANGE_3_EFFECT_B),
-                      RANGE_3_SPEED, RANGE_3_INTENSITY};
-  g_cfg.effects[3] = {static_cast<uint8_t>(RANGE_4_EFFECT_A), static_cast<uint8_t>(RANGE_4_EFFECT_B),
-                      RANGE_4_SPEED, RANGE_4_INTENSITY};
-  g_cfg.effects[4] = {static_cast<uint8_t>(RANGE_5_EFFECT_A), static_cast<uint8_t>(RANGE_5_EFFECT_B),
-                      RANGE_5_SPEED, RANGE_5_INTENSITY};
-  g_cfg.effects[5] = {static_cast<uint8_t>(RANGE_6_EFFECT_A), static_cast<uint8_t>(RANGE_6_EFFECT_B),
-                      RANGE_6_SPEED, RANGE_6_INTENSITY};
-
-  g_cfg.ap_ssid = AP_SSID;
-  g_cfg.ap_pass = AP_PASS;
-  g_cfg.mdns = MDNS_NAME;
+// Mask of zones containing the point. Without the grid every zone goes
+// through the bounding box check (used by the benchmark as a baseline).
+static uint32_t geo_query(const GeoIndex &g, float lat, float lon, bool use_grid, uint32_t *tests) {
+  uint32_t candidates = 0;
+  if (use_grid) {
+    const float row = (lat - g.grid_lat0) / g.cell_lat;
+    const float col = (lon - g.grid_lon0) / g.cell_lon;
+    if (row < 0.0f || col < 0.0f || row >= GEOFENCE_GRID + 1 || col >= GEOFENCE_GRID + 1) {
+      return 0;
+    }
+    candidates = g.cells[geo_cell(lat, g.grid_lat0, g.cell_lat) * GEOFENCE_GRID +
+                         geo_cell(lon, g.grid_lon0, g.cell_lon)];
+  } else if (g.table.count > 0) {
+    candidates = (g.table.count >= 32) ? 0xFFFFFFFFu : ((1u << g.table.count) - 1);
+  }
+  uint32_t inside = 0;
+  while (candidates != 0) {
+    const int i = __builtin_ctz(candidates);
+    candidates &= candidates - 1;
+    if (lat < g.min_lat[i] || lat > g.max_lat[i] || lon < g.min_lon[i] || lon > g.max_lon[i]) {
+      continue;
+    }
+    (*tests)++;
+    const GeoZone &z = g.table.zones[i];
+    bool hit = false;
+    if (z.type == GEO_CIRCLE) {
+      const float dy = (lat - z.lat[0]) * M_PER_DEG_LAT;
+      const float dx = (lon - z.lon[0]) * g.m_per_deg_lon[i];
+      hit = (dx * dx + dy * dy) <= z.radius_m * z.radius_m;
+    } else {
+      hit = geo_in_polygon(z, lat, lon);
+    }
+    if (hit) {
+      inside |= (1u << i);
+    }
+  }
+  return inside;
 }
 
-static void save_config() {
-  prefs_cfg.putUChar("ver", CONFIG_VERSION);
-  prefs_cfg.putUChar("brightness", g_cfg.brightness);
-  prefs_cfg.putBytes("ranges", g_cfg.ranges, sizeof(g_cfg.ranges));
-  prefs_cfg.putBytes("effects", g_cfg.effects, sizeof(g_cfg.effects));
-  prefs_cfg.putString("ap_ssid", g_cfg.ap_ssid);
-  prefs_cfg.putString("ap_pass", g_cfg.ap_pass);
-  prefs_cfg.putString("mdns", g_cfg.mdns);
+static void geo_reset_state() {
+  memset(&geo_stats, 0, sizeof(geo_stats));
+  geo_inside = 0;
+  geo_inside_known = false;
+  geo_alert_until_ms = 0;
 }
 
-static void load_config() {
-  if (prefs_cfg.getUChar("ver", 0) != CONFIG_VERSION) {
-    set_default_config();
-    save_config();
-    return;
-  }
+static bool geo_alert_active(unsigned long now_ms) {
+  return geo_alert_until_ms != 0 && static_cast<long>(geo_alert_until_ms - now_ms) > 0;
+}
 
-  g_cfg.brightness = prefs_cfg.getUChar("brightness", LED_BRIGHTNESS);
-  if (g_cfg.brightness < 1) {
-    g_cfg.brightness = LED_BRIGHTNESS;
-  }
-  if (prefs_cfg.getBytes("ranges", g_cfg.ranges, sizeof(g_cfg.ranges)) != sizeof(g_cfg.ranges)) {
-    set_default_config();
-    save_config();
+// Check a fix against all zones and raise enter/exit events. The first fix
+// after boot or a zone change only establishes the state.
+static void geo_update(float lat, float lon) {
+  if (geo.table.count == 0) {
     return;
   }
-  if (prefs_cfg.getBytes("effects", g_cfg.effects, sizeof(g_cfg.effects)) != sizeof(g_cfg.effects)) {
-    set_default_config();
-    save_config();
+  const uint32_t inside = geo_query(geo, lat, lon, true, &geo_stats.tests);
+  geo_stats.checks++;
+  if (!geo_inside_known) {
+    geo_inside = inside;
+    geo_inside_known = true;
     return;
   }
-  g_cfg.ap_ssid = prefs_cfg.getString("ap_ssid", AP_SSID);
-  g_cfg.ap_pass = prefs_cfg.getString("ap_pass", AP_PASS);
-  g_cfg.mdns = prefs_cfg.getString("mdns", MDNS_NAME);
-
-  if (!validate_ranges(g_cfg.ranges) || !validate_effects(g_cfg.effects)) {
-    set_default_config();
-    save_config();
-  }
-}
-
-static void apply_config(const RuntimeConfig &previous) {
-  FastLED.setBrightness(g_cfg.brightness);
-  if (g_cfg.mdns != previous.mdns) {
-    if (wifi_sta_connected) {
-      MDNS.end();
-      MDNS.begin(g_cfg.mdns.c_str());
+  uint32_t changed = inside ^ geo_inside;
+  while (changed != 0) {
+    const int i = __builtin_ctz(changed);
+    changed &= changed - 1;
+    const GeoZone &z = geo.table.zones[i];
+    const bool entered = (inside & (1u << i)) != 0;
+    if (entered) {
+      geo_stats.enters[i]++;
+    } else {
+      geo_stats.exits[i]++;
     }
+    if (z.alert & (entered ? GEO_ALERT_ENTER : GEO_ALERT_EXIT)) {
+      geo_alert_until_ms = max<unsigned long>(1, millis() + GEOFENCE_ALERT_MS);
+      geo_alert_exit = !entered;
+    }
+    Serial.printf("geo %s zone=%s\n", entered ? "enter" : "exit", z.name);
   }
+  geo_inside = inside;
 }
 
-static String html_page() {
-  return String(
-      "<!doctype html><html><head><meta charset='utf-8'>"
+static bool validate_zones(const GeoZoneTable &t) {
+  if (t.count > GEOFENCE_MAX_ZONES) {
+    return false;
+  }
+  for (int i = 0; i < t.count; ++i) {
+    const GeoZone &z = t.zones[i];
+    if (z.name[sizeof(z.name) - 1] != '\0' || z.type > GEO_POLYGON) {
+      return false;
+    }
+    if (z.type == GEO_CIRCLE && !(z.radius_m > 0.0f)) {
+      return false;
+    }
+    if (z.type == GEO_POLYGON && (z.vertex_count < 3 || z.vertex_count > GEOFENCE_MAX_VERTICES)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void load_zones() {
+  if (prefs_geo.getBytes("zones", &geo.table, sizeof(geo.table)) != sizeof(geo.table) ||
+      !validate_zones(geo.table)) {
+    memset(&geo.table, 0, sizeof(geo.table));
+  }
+  geo_build(geo);
+}
+
+static void save_zones() {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 3);
+  prefs_geo.putBytes("zones", &geo.table, sizeof(geo.table));
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 3);
+}
+
+static const int GEO_BENCH_QUERIES = 10000;
+
+// Fixes per second with and without the grid at several zone counts, on a
+// synthetic set of circles and octagons scattered over ~10 km (serial
+// `geo bench`). The live zones are not touched.
+static void geo_bench() {
+  static GeoIndex bench;
+  static const int counts[] = {1, 8, 16, 32};
+  const float base_lat = -34.6f;
+  const float base_lon = -58.4f;
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  uint32_t seed = 12345;
+  auto next_unit = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<float>(seed >> 8) / 16777216.0f - 0.5f; // [-0.5, 0.5)
+  };
+  for (int zones : counts) {
+    memset(&bench.table, 0, sizeof(bench.table));
+    bench.table.count = static_cast<uint8_t>(min(zones, GEOFENCE_MAX_ZONES));
+    for (int i = 0; i < bench.table.count; ++i) {
+      GeoZone &z = bench.table.zones[i];
+      const float lat = base_lat + next_unit() * 0.1f;
+      const float lon = base_lon + next_unit() * 0.1f;
+      snprintf(z.name, sizeof(z.name), "z%d", i);
+      if (i % 2 == 0) {
+        z.type = GEO_CIRCLE;
+        z.lat[0] = lat;
+        z.lon[0] = lon;
+        z.radius_m = 300.0f;
+      } else {
+        z.type = GEO_POLYGON;
+        z.vertex_count = 8;
+        for (int v = 0; v < 8; ++v) {
+          z.lat[v] = lat + 0.003f * sinf(v * 0.785398f);
+          z.lon[v] = lon + 0.003f * cosf(v * 0.785398f);
+        }
+      }
+    }
+    geo_build(bench);
+
+    uint32_t cycles[2] = {0, 0};
+    uint32_t tests[2] = {0, 0};
+    uint32_t hits[2] = {0, 0};
+    for (int mode = 0; mode < 2; ++mode) {
+      seed = 777;
+      const uint32_t start = ESP.getCycleCount();
+      for (int q = 0; q < GEO_BENCH_QUERIES; ++q) {
+        const float lat = base_lat + next_unit() * 0.12f;
+        const float lon = base_lon + next_unit() * 0.12f;
+        hits[mode] += __builtin_popcount(geo_query(bench, lat, lon, mode == 0, &tests[mode]));
+      }
+      cycles[mode] = ESP.getCycleCount() - start;
+    }
+    const float grid_us = cycles[0] / static_cast<float>(mhz) / GEO_BENCH_QUERIES;
+    const float linear_us = cycles[1] / static_cast<float>(mhz) / GEO_BENCH_QUERIES;
+    Serial.printf("bench geo zones=%d grid_us=%.2f linear_us=%.2f fixes_per_s=%.0f exact_tests=%.2f match=%s\n",
+                  bench.table.count, grid_us, linear_us, grid_us > 0 ? 1e6f / grid_us : 0.0f,
+                  tests[0] / static_cast<float>(GEO_BENCH_QUERIES), hits[0] == hits[1] ? "ok" : "FAIL");
+  }
+}
+
+// Persist daily metrics to NVS (throttled by SAVE_INTERVAL_MS).
+static void save_metrics() {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 0);
+  prefs.putUInt("date", current_date_yyyymmdd);
+  prefs.putFloat("dist_m", total_distance_m);
+  prefs.putULong("active_ms", active_time_ms);
+  prefs.putFloat("max_kph", max_speed_kph);
+  prefs.putUShort("upd_min", last_update_min);
+  prefs.putBytes("activity", &activity, sizeof(activity));
+  if (gnss_aid.unix_s != 0) {
+    prefs.putBytes("gnss_aid", &gnss_aid, sizeof(gnss_aid));
+  }
+  if (gnss_almanac_unix != 0) {
+    prefs.putUInt("gnss_alm", gnss_almanac_unix);
+  }
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 0);
+}
+
+static void save_history() {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 0);
+  prefs.putBytes("history", &history, sizeof(history));
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 0);
+}
+
+// Restore persisted metrics from NVS on boot.
+static void load_metrics() {
+  current_date_yyyymmdd = prefs.getUInt("date", 0);
+  total_distance_m = prefs.getFloat("dist_m", 0.0f);
+  active_time_ms = prefs.getULong("active_ms", 0);
+  max_speed_kph = prefs.getFloat("max_kph", 0.0f);
+  last_update_min = prefs.getUShort("upd_min", 0);
+  if (prefs.getBytes("activity", &activity, sizeof(activity)) != sizeof(activity)) {
+    memset(&activity, 0, sizeof(activity));
+  }
+  if (prefs.getBytes("gnss_aid", &gnss_aid, sizeof(gnss_aid)) != sizeof(gnss_aid)) {
+    memset(&gnss_aid, 0, sizeof(gnss_aid));
+  }
+  gnss_almanac_unix = prefs.getUInt("gnss_alm", 0);
+  if (prefs.getBytes("history", &history, sizeof(history)) != sizeof(history) ||
+      history.head >= HISTORY_DAYS || history.count > HISTORY_DAYS) {
+    memset(&history, 0, sizeof(history));
+  }
+  upload.day_cursor = prefs.getUInt("up_day", 0);
+  upload.fix_gen = prefs.getUInt("up_fix_gen", 0);
+  upload.fix_offset = prefs.getUInt("up_fix_off", 0);
+}
+
+// Copy a C string into a fixed buffer, truncating and always terminating.
+template <size_t N>
+static void set_str(char (&dst)[N], const char *src) {
+  strlcpy(dst, src, N);
+}
+
+// Read a string key into a fixed buffer; missing or oversized keys give def.
+template <size_t N>
+static void get_pref_str(Preferences &p, const char *key, char (&dst)[N], const char *def) {
+  if (!p.isKey(key) || p.getString(key, dst, N) == 0) {
+    set_str(dst, def);
+  }
+}
+
+static void load_wifi_creds() {
+  get_pref_str(prefs, "wifi_ssid", wifi_ssid, "");
+  get_pref_str(prefs, "wifi_pass", wifi_pass, "");
+}
+
+static void save_wifi_creds(const char *ssid, const char *pass) {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 1);
+  prefs.putString("wifi_ssid", ssid);
+  prefs.putString("wifi_pass", pass);
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 1);
+  set_str(wifi_ssid, ssid);
+  set_str(wifi_pass, pass);
+}
+
+// Derive the reader view of the day metrics and publish it. Called by the
+// loop (the only writer) after every change to the metric globals.
+static void metrics_publish() {
+  MetricsSnapshot s = {};
+  s.date_yyyymmdd = current_date_yyyymmdd;
+  s.active_time_ms = active_time_ms;
+  s.distance_exact_m = total_distance_m;
+  s.distance_m = static_cast<uint32_t>(total_distance_m + 0.5f);
+  s.avg_speed_kph = (active_time_ms > 0) ? (total_distance_m / (active_time_ms / 1000.0f)) * 3.6f : 0.0f;
+  s.max_speed_kph = max_speed_kph;
+  s.speed_kph = last_speed_kph;
+  s.avg_speed_cmps = static_cast<uint16_t>(s.avg_speed_kph * 27.7778f);
+  s.max_speed_cmps = static_cast<uint16_t>(max_speed_kph * 27.7778f);
+  s.last_update_min = last_update_min;
+  s.gps_fix = has_gps_fix;
+  metrics_pub.publish(s);
+}
+
+// Seqlock torn-read check (serial `metrics stress [n]`): the loop publishes
+// n samples whose words all derive from one counter while a core-0 task
+// reads them back; a sample whose words disagree is a torn read.
+struct StressSample {
+  uint32_t words[sizeof(MetricsSnapshot) / 4];
+};
+
+static Seqlock<StressSample> stress_pub;
+static volatile bool stress_running = false;
+static volatile bool stress_reader_done = false;
+static volatile uint32_t stress_reads = 0;
+static volatile uint32_t stress_torn = 0;
+
+static void stress_reader_task(void *arg) {
+  while (stress_running) {
+    const StressSample s = stress_pub.read();
+    for (size_t i = 1; i < sizeof(s.words) / 4; ++i) {
+      if (s.words[i] != s.words[0] * (i + 1)) {
+        stress_torn = stress_torn + 1;
+        break;
+      }
+    }
+    stress_reads = stress_reads + 1;
+  }
+  stress_reader_done = true;
+  vTaskDelete(nullptr);
+}
+
+static void metrics_stress(uint32_t n) {
+  stress_reads = 0;
+  stress_torn = 0;
+  stress_reader_done = false;
+  stress_running = true;
+  xTaskCreatePinnedToCore(stress_reader_task, "stress", 2048, nullptr, 1, nullptr, 0);
+  StressSample s;
+  const uint32_t start_us = micros();
+  for (uint32_t k = 1; k <= n; ++k) {
+    for (size_t i = 0; i < sizeof(s.words) / 4; ++i) {
+      s.words[i] = k * (i + 1);
+    }
+    stress_pub.publish(s);
+  }
+  const uint32_t publish_us = micros() - start_us;
+  stress_running = false;
+  while (!stress_reader_done) {
+    delay(1);
+  }
+  uint32_t version = 0;
+  const uint32_t read_start_us = micros();
+  for (uint32_t k = 0; k < n; ++k) {
+    s = stress_pub.read(&version);
+  }
+  const uint32_t read_us = micros() - read_start_us;
+  Serial.printf("metrics stress publishes=%lu reads=%lu torn=%lu version=%lu publish_ns=%lu read_ns=%lu\n",
+                static_cast<unsigned long>(n), static_cast<unsigned long>(stress_reads),
+                static_cast<unsigned long>(stress_torn), static_cast<unsigned long>(version),
+                static_cast<unsigned long>(n ? publish_us * 1000ull / n : 0),
+                static_cast<unsigned long>(n ? read_us * 1000ull / n : 0));
+}
+
+// Build the 16-byte payload for BLE read.
+static void build_summary_payload(uint8_t *out, size_t len) {
+  if (len < 16) {
+    return;
+  }
+
+  const MetricsSnapshot s = metrics_pub.read();
+  const uint32_t distance_m = s.distance_m;
+  const uint16_t avg_speed_cmps = s.avg_speed_cmps;
+  const uint16_t max_speed_cmps = s.max_speed_cmps;
+
+  memset(out, 0, len);
+  out[0] = static_cast<uint8_t>(s.date_yyyymmdd & 0xFF);
+  out[1] = static_cast<uint8_t>((s.date_yyyymmdd >> 8) & 0xFF);
+  out[2] = static_cast<uint8_t>((s.date_yyyymmdd >> 16) & 0xFF);
+  out[3] = static_cast<uint8_t>((s.date_yyyymmdd >> 24) & 0xFF);
+
+  out[4] = static_cast<uint8_t>(distance_m & 0xFF);
+  out[5] = static_cast<uint8_t>((distance_m >> 8) & 0xFF);
+  out[6] = static_cast<uint8_t>((distance_m >> 16) & 0xFF);
+  out[7] = static_cast<uint8_t>((distance_m >> 24) & 0xFF);
+
+  out[8] = static_cast<uint8_t>(avg_speed_cmps & 0xFF);
+  out[9] = static_cast<uint8_t>((avg_speed_cmps >> 8) & 0xFF);
+  out[10] = static_cast<uint8_t>(max_speed_cmps & 0xFF);
+  out[11] = static_cast<uint8_t>((max_speed_cmps >> 8) & 0xFF);
+
+  out[12] = static_cast<uint8_t>(s.last_update_min & 0xFF);
+  out[13] = static_cast<uint8_t>((s.last_update_min >> 8) & 0xFF);
+
+  uint8_t flags = 0;
+  if (s.gps_fix) {
+    flags |= 0x01;
+  }
+  if (s.date_yyyymmdd != 0) {
+    flags |= 0x02;
+  }
+  out[14] = flags;
+
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < 15; ++i) {
+    checksum ^= out[i];
+  }
+  out[15] = checksum;
+}
+
+static uint32_t track_slots(int level) {
+  return 86400u / TRACK_STEP_S[level];
+}
+
+static void track_reset() {
+  for (int l = 0; l < TRACK_LEVELS; ++l) {
+    if (track_level[l] != nullptr) {
+      memset(track_level[l], 0x80, track_slots(l) * sizeof(TrackPoint));
+    }
+  }
+}
+
+static void track_begin() {
+  for (int l = 0; l < TRACK_LEVELS; ++l) {
+    if (track_level[l] == nullptr && psramFound()) {
+      track_level[l] = static_cast<TrackPoint *>(ps_malloc(track_slots(l) * sizeof(TrackPoint)));
+    }
+  }
+  track_reset();
+}
+
+// Store a fix at second of day in every level: O(levels) per fix.
+static void track_add(uint32_t time_s, float lat_deg, float lon_deg) {
+  if (time_s >= 86400u) {
+    return;
+  }
+  const TrackPoint p = {static_cast<int32_t>(lround(lat_deg * 1e7)), static_cast<int32_t>(lround(lon_deg * 1e7))};
+  for (int l = 0; l < TRACK_LEVELS; ++l) {
+    if (track_level[l] != nullptr) {
+      track_level[l][time_s / TRACK_STEP_S[l]] = p;
+    }
+  }
+}
+
+// Finest allocated level with at most TRACK_AUTO_MAX_POINTS slots in
+// [from_s, to_s); the coarsest one if none is that small.
+static int track_pick_level(uint32_t from_s, uint32_t to_s) {
+  for (int l = 0; l < TRACK_LEVELS; ++l) {
+    if (track_level[l] != nullptr && (to_s - from_s) / TRACK_STEP_S[l] <= TRACK_AUTO_MAX_POINTS) {
+      return l;
+    }
+  }
+  return TRACK_LEVELS - 1;
+}
+
+static uint32_t log_read_u32(uint32_t offset) {
+  uint32_t value = LOG_ERASED;
+  esp_partition_read(log_part, offset, &value, sizeof(value));
+  return value;
+}
+
+static uint8_t log_check(const LogRecord &r) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&r);
+  uint8_t check = 0;
+  for (size_t i = 0; i < 15; ++i) {
+    check ^= bytes[i];
+  }
+  return check;
+}
+
+// True if the 16-byte slot at offset was never written (a torn write is not).
+static bool log_slot_erased(uint32_t offset) {
+  uint32_t words[4];
+  if (esp_partition_read(log_part, offset, words, sizeof(words)) != ESP_OK) {
+    return false;
+  }
+  return (words[0] & words[1] & words[2] & words[3]) == LOG_ERASED;
+}
+
+// Partition offset of the oldest record. Once the head reaches a sector's
+// last slot, the sector after it is already erased.
+static uint32_t log_oldest() {
+  if (!log_wrapped) {
+    return 0;
+  }
+  uint32_t next = (log_head / LOG_SECTOR + 1) * LOG_SECTOR;
+  if (log_head % LOG_SECTOR == LOG_SECTOR - sizeof(LogRecord)) {
+    next += LOG_SECTOR;
+  }
+  return next % log_ring;
+}
+
+// Logged bytes, oldest to newest.
+static uint32_t log_size() {
+  if (!log_wrapped) {
+    return log_head;
+  }
+  return (log_head + log_ring - log_oldest()) % log_ring;
+}
+
+// Bytes written since the format: the generation and the head offset as
+// one number that only grows, unlike record times or the offset alone.
+static uint64_t log_pos() {
+  return static_cast<uint64_t>(log_gen) * log_ring + log_head;
+}
+
+static void save_log_gen() {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 6);
+  prefs.putUInt("log_gen", log_gen);
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 6);
+}
+
+static bool log_sector_erased(uint32_t offset) {
+  for (uint32_t at = offset; at < offset + LOG_SECTOR; at += LOG_CHUNK_BYTES) {
+    if (esp_partition_read(log_part, at, log_chunk, LOG_CHUNK_BYTES) != ESP_OK) {
+      return false;
+    }
+    for (uint32_t i = 0; i < LOG_CHUNK_BYTES; ++i) {
+      if (log_chunk[i] != 0xFF) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Erase every written sector and write the header. Only on the first boot
+// of a new partition or layout: up to ~45 ms per written sector.
+static bool log_format() {
+  log_stats.formatted = 0;
+  for (uint32_t at = 0; at < log_part->size; at += LOG_SECTOR) {
+    if (!log_sector_erased(at)) {
+      if (esp_partition_erase_range(log_part, at, LOG_SECTOR) != ESP_OK) {
+        return false;
+      }
+      ++log_stats.formatted;
+    }
+  }
+  LogHeader h = {LOG_MAGIC, LOG_VERSION, log_ring, LOG_MAGIC ^ LOG_VERSION ^ log_ring};
+  return esp_partition_write(log_part, log_ring, &h, sizeof(h)) == ESP_OK;
+}
+
+static void log_begin() {
+  log_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "log");
+  if (log_part == nullptr || log_part->size < 4 * LOG_SECTOR) {
+    log_part = nullptr;
+    return;
+  }
+  log_ring = log_part->size - LOG_SECTOR;
+  log_head = 0;
+  log_wrapped = false;
+  log_gen = prefs.getUInt("log_gen", 0);
+  LogHeader h = {};
+  esp_partition_read(log_part, log_ring, &h, sizeof(h));
+  if (h.magic != LOG_MAGIC || h.version != LOG_VERSION || h.ring != log_ring ||
+      h.check != (h.magic ^ h.version ^ h.ring)) {
+    if (!log_format()) {
+      ++log_stats.errors;
+      log_part = nullptr;
+      Serial.println("log: format failed, log off");
+      return;
+    }
+    log_gen = 0;
+    save_log_gen();
+    Serial.printf("log: formatted, %lu sectors erased\n", static_cast<unsigned long>(log_stats.formatted));
+    return;
+  }
+
+  // The head's sector is the one with a free slot after written ones, or
+  // the erased sector right after a full one. Neither means an empty log.
+  const uint32_t sectors = log_ring / LOG_SECTOR;
+  int32_t head_sector = -1;
+  for (uint32_t s = 0; s < sectors && head_sector < 0; ++s) {
+    const uint32_t at = s * LOG_SECTOR;
+    const uint32_t prev = ((s + sectors - 1) % sectors) * LOG_SECTOR;
+    if (log_slot_erased(at + LOG_SECTOR - sizeof(LogRecord)) &&
+        (!log_slot_erased(at) || !log_slot_erased(prev + LOG_SECTOR - sizeof(LogRecord)))) {
+      head_sector = static_cast<int32_t>(s);
+    }
+  }
+  if (head_sector < 0) {
+    // Empty, or every slot written (not a state log_append leaves): restart
+    // at sector 0 rather than guess from the record times.
+    if (!log_slot_erased(0) && esp_partition_erase_range(log_part, 0, LOG_SECTOR) != ESP_OK) {
+      ++log_stats.errors;
+    }
+    log_wrapped = !log_slot_erased(LOG_SECTOR);
+    return;
+  }
+  log_head = static_cast<uint32_t>(head_sector) * LOG_SECTOR;
+  while (!log_slot_erased(log_head)) {
+    log_head += sizeof(LogRecord);
+  }
+  // Written data past the erased part means the ring has gone round.
+  log_wrapped = true;
+  log_wrapped = !log_slot_erased(log_oldest());
+
+  // A reset mid-write leaves the newest record torn; readers skip it.
+  LogRecord r;
+  const uint32_t newest = (log_head + log_ring - sizeof(r)) % log_ring;
+  if (log_size() > 0 && esp_partition_read(log_part, newest, &r, sizeof(r)) == ESP_OK && r.check != log_check(r)) {
+    ++log_stats.errors;
+    Serial.println("log: newest record fails its check");
+  }
+}
+
+// Append one fix. Before the last slot of a sector the next one is erased
+// (~45 ms on the loop, once every 256 records).
+static void log_append(uint32_t unix_s, float lat_deg, float lon_deg, float speed_kph) {
+  if (log_part == nullptr) {
+    return;
+  }
+  if (log_head % LOG_SECTOR == LOG_SECTOR - sizeof(LogRecord)) {
+    const uint32_t next = (log_head + sizeof(LogRecord)) % log_ring;
+    if (esp_partition_erase_range(log_part, next, LOG_SECTOR) != ESP_OK) {
+      ++log_stats.errors;
+      return;
+    }
+    if (next == 0) {
+      log_wrapped = true;
+    }
+  }
+  LogRecord r;
+  r.unix_s = unix_s;
+  r.lat_e7 = static_cast<int32_t>(lround(lat_deg * 1e7));
+  r.lon_e7 = static_cast<int32_t>(lround(lon_deg * 1e7));
+  r.speed_cmps = static_cast<uint16_t>(constrain(lroundf(speed_kph / 0.036f), 0L, 65535L));
+  r.flags = (speed_kph > SPEED_ACTIVE_KPH) ? 0x01 : 0x00;
+  r.check = log_check(r);
+  if (esp_partition_write(log_part, log_head, &r, sizeof(r)) != ESP_OK) {
+    ++log_stats.errors;
+    return;
+  }
+  ++log_stats.appends;
+  log_head += sizeof(r);
+  if (log_head == log_ring) {
+    log_head = 0;
+    ++log_gen;
+    save_log_gen();
+  }
+}
+
+// Parse a single "bytes=a-b", "bytes=a-" or "bytes=-n" range into
+// [*from, *to). False if it is malformed or outside [0, total).
+static bool parse_byte_range(const char *s, uint32_t total, uint32_t *from, uint32_t *to) {
+  if (strncmp(s, "bytes=", 6) != 0) {
+    return false;
+  }
+  s += 6;
+  char *end = nullptr;
+  if (*s == '-') {
+    const unsigned long n = strtoul(s + 1, &end, 10);
+    if (end == s + 1 || *end != '\0' || n == 0 || total == 0) {
+      return false;
+    }
+    *from = total - min<uint32_t>(n, total);
+    *to = total;
+    return true;
+  }
+  const unsigned long a = strtoul(s, &end, 10);
+  if (end == s || *end != '-') {
+    return false;
+  }
+  s = end + 1;
+  unsigned long b = total;
+  if (*s != '\0') {
+    b = strtoul(s, &end, 10);
+    if (end == s || *end != '\0') {
+      return false;
+    }
+    ++b;
+  }
+  if (a >= total || b <= a) {
+    return false;
+  }
+  *from = a;
+  *to = min<uint32_t>(b, total);
+  return true;
+}
+
+static size_t put_varint(uint8_t *out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = static_cast<uint8_t>(value);
+  return n;
+}
+
+static size_t put_zigzag(uint8_t *out, int32_t value) {
+  return put_varint(out, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+}
+
+static void save_upload_cursors() {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 5);
+  prefs.putUInt("up_day", upload.day_cursor);
+  prefs.putUInt("up_fix_gen", upload.fix_gen);
+  prefs.putUInt("up_fix_off", upload.fix_offset);
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 5);
+}
+
+// Closed days newer than the day cursor, oldest first. Returns the count.
+static uint16_t upload_build_days(uint8_t *out) {
+  uint16_t count = 0;
+  upload.next_cursor = upload.day_cursor;
+  for (int i = 0; i < history.count; ++i) {
+    const int slot = (history.head - history.count + i + HISTORY_DAYS) % HISTORY_DAYS;
+    const uint32_t date = get_u32_le(history.records[slot]);
+    if (date > upload.day_cursor) {
+      memcpy(&out[count * 16], history.records[slot], 16);
+      upload.next_cursor = max(upload.next_cursor, date);
+      count++;
+    }
+  }
+  return count;
+}
+
+// Log position of the next fix to send: the cursor, moved up to the oldest
+// record if the ring has overwritten it, or to the oldest if it does not
+// belong to this log (formatted since, or an old time-based cursor).
+static uint64_t upload_fix_from() {
+  const uint64_t head = log_pos();
+  const uint64_t oldest = head - log_size();
+  const uint64_t cursor = static_cast<uint64_t>(upload.fix_gen) * log_ring + upload.fix_offset;
+  if (upload.fix_offset >= log_ring || upload.fix_offset % sizeof(LogRecord) != 0 || cursor > head) {
+    return oldest;
+  }
+  return max(cursor, oldest);
+}
+
+// Up to UPLOAD_BATCH_FIXES logged fixes from the fix cursor on, in ring
+// order and delta encoded. Sets *len to the encoded size, *first to the
+// log position of the first one, and returns the count.
+static uint16_t upload_build_fixes(uint8_t *out, uint32_t *len, uint64_t *first) {
+  *len = 0;
+  if (log_part == nullptr) {
+    return 0;
+  }
+  const uint64_t from = upload_fix_from();
+  const uint64_t oldest_pos = log_pos() - log_size();
+  const uint32_t total = log_size();
+  const uint32_t oldest = log_oldest();
+  uint32_t pos = static_cast<uint32_t>(from - oldest_pos);
+  uint16_t count = 0;
+  LogRecord prev = {};
+  *first = from;
+  while (pos < total && count < UPLOAD_BATCH_FIXES) {
+    const uint32_t at = (oldest + pos) % log_ring;
+    const uint32_t n = min(min<uint32_t>(total - pos, LOG_CHUNK_BYTES), log_ring - at);
+    if (esp_partition_read(log_part, at, log_chunk, n) != ESP_OK) {
+      break;
+    }
+    uint32_t off = 0;
+    for (; off < n && count < UPLOAD_BATCH_FIXES; off += sizeof(LogRecord)) {
+      LogRecord r;
+      memcpy(&r, &log_chunk[off], sizeof(r));
+      if (r.check != log_check(r)) {
+        continue;
+      }
+      uint8_t *p = out + *len;
+      if (count == 0) {
+        *first = oldest_pos + pos + off;
+        memcpy(p, &r, sizeof(r));
+        p += sizeof(r);
+      } else {
+        p += put_zigzag(p, static_cast<int32_t>(r.unix_s - prev.unix_s));
+        p += put_zigzag(p, r.lat_e7 - prev.lat_e7);
+        p += put_zigzag(p, r.lon_e7 - prev.lon_e7);
+        p += put_zigzag(p, static_cast<int32_t>(r.speed_cmps) - prev.speed_cmps);
+        *p++ = r.flags;
+      }
+      *len = static_cast<uint32_t>(p - out);
+      prev = r;
+      count++;
+    }
+    pos += off;
+  }
+  upload.next_fix = oldest_pos + pos;
+  return count;
+}
+
+// Fill upload_body with the next batch, days before fixes. Returns its
+// length, 0 when everything has been sent.
+static uint32_t upload_build() {
+  uint8_t *payload = upload_body + UPLOAD_HEADER;
+  uint32_t len = 0;
+  uint32_t cursor = upload.day_cursor;
+  upload.kind = UPLOAD_DAYS;
+  upload.count = upload_build_days(payload);
+  len = upload.count * 16u;
+  if (upload.count == 0) {
+    upload.kind = UPLOAD_FIXES;
+    uint64_t first = 0;
+    upload.count = upload_build_fixes(payload, &len, &first);
+    cursor = static_cast<uint32_t>(first / sizeof(LogRecord));
+  }
+  if (upload.count == 0) {
+    return 0;
+  }
+  memcpy(upload_body, "DRUP", 4);
+  upload_body[4] = 2;
+  upload_body[5] = upload.kind;
+  put_u16_le(&upload_body[6], upload.count);
+  put_u32_le(&upload_body[8], cursor);
+  upload.body_len = UPLOAD_HEADER + len;
+  return upload.body_len;
+}
+
+// Network side of the upload: POST the batch handed over by upload_poll().
+static void upload_task(void *arg) {
+  HTTPClient http;
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(100));
+    if (!upload_pending.load(std::memory_order_acquire)) {
+      continue;
+    }
+    int code = HTTPC_ERROR_CONNECTION_REFUSED;
+    http.setConnectTimeout(UPLOAD_TIMEOUT_MS);
+    http.setTimeout(UPLOAD_TIMEOUT_MS);
+    if (http.begin(upload.url)) {
+      http.addHeader("Content-Type", "application/octet-stream");
+      http.addHeader("X-Device", upload.device);
+      code = http.POST(upload_body, upload.body_len);
+      http.end();
+    }
+    upload.code = code;
+    upload_done.store(true, std::memory_order_release);
+    upload_pending.store(false, std::memory_order_release);
+  }
+}
+
+// Loop side of the upload: take the task's result, then hand it the next
+// batch once STA is up, an endpoint is set and any backoff has passed.
+// Failures back off from UPLOAD_RETRY_MIN_MS doubling to _MAX_MS; when
+// everything is sent, check again after UPLOAD_IDLE_MS.
+static void upload_poll(uint32_t now_ms) {
+  if (upload_pending.load(std::memory_order_acquire)) {
+    return;
+  }
+  if (upload_done.load(std::memory_order_acquire)) {
+    upload_done.store(false, std::memory_order_relaxed);
+    upload.last_code = upload.code;
+    if (upload.code >= 200 && upload.code < 300) {
+      if (upload.kind == UPLOAD_DAYS) {
+        upload.day_cursor = upload.next_cursor;
+        upload.days += upload.count;
+      } else {
+        upload.fix_gen = static_cast<uint32_t>(upload.next_fix / log_ring);
+        upload.fix_offset = static_cast<uint32_t>(upload.next_fix % log_ring);
+        upload.fixes += upload.count;
+      }
+      upload.batches++;
+      upload.bytes += upload.body_len;
+      save_upload_cursors();
+      upload.backoff_ms = 0;
+      upload.next_ms = now_ms;
+    } else {
+      upload.failures++;
+      upload.backoff_ms = (upload.backoff_ms == 0) ? UPLOAD_RETRY_MIN_MS
+                                                   : min<uint32_t>(upload.backoff_ms * 2, UPLOAD_RETRY_MAX_MS);
+      upload.next_ms = now_ms + upload.backoff_ms;
+    }
+  }
+  if (!wifi_sta_connected || g_cfg.upload_url[0] == '\0' || static_cast<int32_t>(now_ms - upload.next_ms) < 0) {
+    return;
+  }
+  if (upload_build() == 0) {
+    upload.next_ms = now_ms + UPLOAD_IDLE_MS;
+    return;
+  }
+  if (!upload_task_started) {
+    xTaskCreatePinnedToCore(upload_task, "upload", 6144, nullptr, 1, nullptr, 0);
+    upload_task_started = true;
+  }
+  set_str(upload.url, g_cfg.upload_url);
+  set_str(upload.device, g_cfg.mdns);
+  upload_pending.store(true, std::memory_order_release);
+}
+
+static void timeline_reset() {
+  memset(timeline, 0, sizeof(timeline));
+  for (RollingWindow &w : rolling) {
+    w.distance_dm = 0;
+    w.active_s = 0;
+  }
+  timeline_minute = -1;
+}
+
+// Move the rolling windows forward to minute. Minutes that leave a window are
+// subtracted; after a long gap (or time going backwards) the windows are
+// summed from the buckets, which is at most 15 reads.
+static void timeline_advance(int minute) {
+  if (minute < 0 || minute >= TIMELINE_MINUTES || minute == timeline_minute) {
+    return;
+  }
+  if (timeline_minute < 0 || minute < timeline_minute || minute - timeline_minute >= 15) {
+    for (RollingWindow &w : rolling) {
+      w.distance_dm = 0;
+      w.active_s = 0;
+      for (int m = max(0, minute - w.minutes + 1); m <= minute; ++m) {
+        w.distance_dm += timeline[m].distance_dm;
+        w.active_s += timeline[m].active_s;
+      }
+    }
+    timeline_minute = minute;
+    return;
+  }
+  while (timeline_minute < minute) {
+    timeline_minute++;
+    for (RollingWindow &w : rolling) {
+      const int leaving = timeline_minute - w.minutes;
+      if (leaving >= 0) {
+        w.distance_dm -= timeline[leaving].distance_dm;
+        w.active_s -= timeline[leaving].active_s;
+      }
+      w.distance_dm += timeline[timeline_minute].distance_dm;
+      w.active_s += timeline[timeline_minute].active_s;
+    }
+  }
+}
+
+static void timeline_add_sample(int minute, float segment_m, bool active, float speed_kph) {
+  if (minute < 0 || minute >= TIMELINE_MINUTES) {
+    return;
+  }
+  timeline_advance(minute);
+  TimelineBucket &b = timeline[minute];
+  const uint16_t dm = static_cast<uint16_t>(segment_m * 10.0f + 0.5f);
+  const uint16_t room = static_cast<uint16_t>(65535 - b.distance_dm);
+  const uint16_t added_dm = (dm < room) ? dm : room;
+  const uint8_t added_s = (active && b.active_s < 255) ? 1 : 0;
+  b.distance_dm += added_dm;
+  b.active_s += added_s;
+  b.max_speed_hkph = max(b.max_speed_hkph, clamp_u8(static_cast<int>(speed_kph * 2.0f + 0.5f)));
+  for (RollingWindow &w : rolling) {
+    w.distance_dm += added_dm;
+    w.active_s += added_s;
+  }
+}
+
+// Max speed over the last `minutes` buckets ending at timeline_minute.
+static uint8_t timeline_window_max(int minutes) {
+  uint8_t top = 0;
+  for (int m = max(0, timeline_minute - minutes + 1); m <= timeline_minute; ++m) {
+    top = max(top, timeline[m].max_speed_hkph);
+  }
+  return top;
+}
+
+// Close the current day into the history ring before the metrics reset.
+static void history_append_day() {
+  if (current_date_yyyymmdd == 0) {
+    return;
+  }
+  build_summary_payload(history.records[history.head], 16);
+  history.head = static_cast<uint8_t>((history.head + 1) % HISTORY_DAYS);
+  if (history.count < HISTORY_DAYS) {
+    history.count++;
+  }
+  save_history();
+}
+
+// Build the activity payload for BLE read (see docs/ble_spec.md).
+static void build_activity_payload(uint8_t *out, size_t len) {
+  if (len < BLE_ACTIVITY_LEN) {
+    return;
+  }
+  memset(out, 0, len);
+  put_u32_le(&out[0], current_date_yyyymmdd);
+  for (int i = 0; i < 6; ++i) {
+    put_u32_le(&out[4 + i * 4], activity.range_time_ms[i] / 1000);
+    put_u16_le(&out[28 + i * 2], static_cast<uint16_t>(min(activity.range_distance_m[i] + 0.5f, 65535.0f)));
+  }
+  for (int h = 0; h < 24; ++h) {
+    put_u16_le(&out[40 + h * 2], static_cast<uint16_t>(activity.hour_active_ms[h] / 1000));
+  }
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < BLE_ACTIVITY_LEN - 1; ++i) {
+    checksum ^= out[i];
+  }
+  out[BLE_ACTIVITY_LEN - 1] = checksum;
+}
+
+// Response body streamed as HTTP chunks from a small buffer, so handlers
+// never assemble a whole body on the heap. Keep printf formats short: the
+// core formats up to 64 bytes on the stack and mallocs beyond that.
+class ResponseStream : public Print {
+ public:
+  ResponseStream(int code, const char *content_type) {
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(code, content_type, "");
+  }
+
+  ~ResponseStream() {
+    send_chunk();
+    server.sendContent("", 0); // Terminating chunk.
+  }
+
+  size_t write(uint8_t c) override {
+    if (len_ == sizeof(buf_)) {
+      send_chunk();
+    }
+    buf_[len_++] = static_cast<char>(c);
+    return 1;
+  }
+
+  size_t write(const uint8_t *data, size_t n) override {
+    for (size_t i = 0; i < n;) {
+      if (len_ == sizeof(buf_)) {
+        send_chunk();
+      }
+      const size_t k = min(n - i, sizeof(buf_) - len_);
+      memcpy(&buf_[len_], &data[i], k);
+      len_ += k;
+      i += k;
+    }
+    return n;
+  }
+
+ private:
+  void send_chunk() {
+    if (len_ > 0) {
+      server.sendContent(buf_, len_);
+      len_ = 0;
+    }
+  }
+
+  char buf_[512];
+  size_t len_ = 0;
+};
+
+// JSON inlined in a <script> element. '<' can only occur inside JSON
+// strings, where \u003c means the same, so no config value can close the tag.
+class ScriptJsonPrint : public Print {
+ public:
+  explicit ScriptJsonPrint(Print &out) : out_(out) {}
+
+  size_t write(uint8_t c) override {
+    if (c == '<') {
+      out_.print("\\u003c");
+      return 1;
+    }
+    return out_.write(c);
+  }
+
+ private:
+  Print &out_;
+};
+
+// Server time to stream the root and config pages with their inlined
+// state (last request each), in /api/status "portal".
+static uint32_t portal_page_us[2] = {0, 0};
+
+// Writes into a caller buffer, truncating; always NUL-terminated.
+class BufferPrint : public Print {
+ public:
+  BufferPrint(char *buf, size_t cap) : buf_(buf), cap_(cap) {
+    buf_[0] = '\0';
+  }
+
+  size_t write(uint8_t c) override {
+    if (len + 1 >= cap_) {
+      return 0;
+    }
+    buf_[len++] = static_cast<char>(c);
+    buf_[len] = '\0';
+    return 1;
+  }
+
+  size_t len = 0;
+
+ private:
+  char *buf_;
+  size_t cap_;
+};
+
+// Discards output and counts bytes.
+class CountingPrint : public Print {
+ public:
+  size_t write(uint8_t) override {
+    count++;
+    return 1;
+  }
+
+  size_t write(const uint8_t *data, size_t n) override {
+    count += n;
+    return n;
+  }
+
+  size_t count = 0;
+};
+
+// Transcodes the JSON text written into it to CBOR on the fly, so the JSON
+// writers serve both formats with one schema. Maps and arrays become
+// indefinite-length, numbers with a '.' or exponent float32, the rest
+// integers; strings longer than the buffer are sent as chunks. \u escapes
+// become UTF-8, surrogate pairs as one 4-byte sequence and unpaired
+// surrogates as U+FFFD.
+class CborStream : public Print {
+ public:
+  explicit CborStream(Print &out) : out_(out) {}
+
+  ~CborStream() {
+    if (state_ == NUMBER) {
+      end_number();
+    }
+  }
+
+  size_t write(uint8_t c) override {
+    switch (state_) {
+      case STRING:
+        if (c == '\\') {
+          state_ = ESCAPE;
+          return 1;
+        }
+        end_surrogate();
+        if (c == '"') {
+          end_string();
+        } else {
+          str_put(c);
+        }
+        return 1;
+      case ESCAPE:
+        state_ = STRING;
+        if (c != 'u') {
+          end_surrogate();
+        }
+        switch (c) {
+          case 'b': str_put('\b'); break;
+          case 'f': str_put('\f'); break;
+          case 'n': str_put('\n'); break;
+          case 'r': str_put('\r'); break;
+          case 't': str_put('\t'); break;
+          case 'u': state_ = UNICODE; code_ = 0; code_len_ = 0; break;
+          default: str_put(c); break;
+        }
+        return 1;
+      case UNICODE:
+        code_ = static_cast<uint16_t>((code_ << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10)));
+        if (++code_len_ == 4) {
+          state_ = STRING;
+          if (high_ != 0 && code_ >= 0xDC00 && code_ <= 0xDFFF) {
+            str_put_utf8(0x10000 + ((static_cast<uint32_t>(high_) - 0xD800) << 10) + (code_ - 0xDC00));
+            high_ = 0;
+            return 1;
+          }
+          end_surrogate();
+          if (code_ >= 0xD800 && code_ <= 0xDBFF) {
+            high_ = code_; // Wait for the low half.
+          } else {
+            str_put_utf8((code_ >= 0xDC00 && code_ <= 0xDFFF) ? 0xFFFD : code_);
+          }
+        }
+        return 1;
+      case NUMBER:
+        if (isdigit(c) || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E') {
+          if (num_len_ + 1 < sizeof(num_)) {
+            num_[num_len_++] = static_cast<char>(c);
+          }
+          return 1;
+        }
+        end_number();
+        break;
+      case LITERAL:
+        if (isalpha(c)) {
+          return 1;
+        }
+        state_ = VALUE;
+        break;
+      default:
+        break;
+    }
+    switch (c) {
+      case '{': out_.write(0xBF); break;
+      case '[': out_.write(0x9F); break;
+      case '}':
+      case ']': out_.write(0xFF); break;
+      case '"':
+        state_ = STRING;
+        str_len_ = 0;
+        chunked_ = false;
+        break;
+      case 't': out_.write(0xF5); state_ = LITERAL; break;
+      case 'f': out_.write(0xF4); state_ = LITERAL; break;
+      case 'n': out_.write(0xF6); state_ = LITERAL; break;
+      default:
+        if (c == '-' || isdigit(c)) {
+          state_ = NUMBER;
+          num_[0] = static_cast<char>(c);
+          num_len_ = 1;
+        }
+        break; // ',', ':' and whitespace carry no data in CBOR.
+    }
+    return 1;
+  }
+
+  using Print::write;
+
+ private:
+  enum State : uint8_t { VALUE, STRING, ESCAPE, UNICODE, NUMBER, LITERAL };
+
+  void head(uint8_t major, uint64_t value) {
+    const uint8_t type = static_cast<uint8_t>(major << 5);
+    if (value < 24) {
+      out_.write(static_cast<uint8_t>(type | value));
+      return;
+    }
+    const int bytes = (value < 0x100) ? 1 : (value < 0x10000) ? 2 : (value <= 0xFFFFFFFFull) ? 4 : 8;
+    out_.write(static_cast<uint8_t>(type | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27)));
+    for (int i = bytes - 1; i >= 0; --i) {
+      out_.write(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void end_number() {
+    num_[num_len_] = '\0';
+    state_ = VALUE;
+    if (strpbrk(num_, ".eE") != nullptr) {
+      const float value = strtof(num_, nullptr);
+      uint32_t bits = 0;
+      memcpy(&bits, &value, sizeof(bits));
+      out_.write(0xFA);
+      for (int i = 3; i >= 0; --i) {
+        out_.write(static_cast<uint8_t>(bits >> (8 * i)));
+      }
+      return;
+    }
+    const long long value = strtoll(num_, nullptr, 10);
+    if (value < 0) {
+      head(1, static_cast<uint64_t>(-1 - value));
+    } else {
+      head(0, static_cast<uint64_t>(value));
+    }
+  }
+
+  void flush_chunk() {
+    if (!chunked_) {
+      out_.write(0x7F);
+      chunked_ = true;
+    }
+    head(3, str_len_);
+    out_.write(str_, str_len_);
+    str_len_ = 0;
+  }
+
+  void str_put(uint8_t c) {
+    if (str_len_ == sizeof(str_)) {
+      flush_chunk();
+    }
+    str_[str_len_++] = c;
+  }
+
+  void str_put_utf8(uint32_t cp) {
+    if (cp < 0x80) {
+      str_put(static_cast<uint8_t>(cp));
+    } else if (cp < 0x800) {
+      str_put(static_cast<uint8_t>(0xC0 | (cp >> 6)));
+      str_put(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      str_put(static_cast<uint8_t>(0xE0 | (cp >> 12)));
+      str_put(static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F)));
+      str_put(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+    } else {
+      str_put(static_cast<uint8_t>(0xF0 | (cp >> 18)));
+      str_put(static_cast<uint8_t>(0x80 | ((cp >> 12) & 0x3F)));
+      str_put(static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F)));
+      str_put(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  // A high surrogate not followed by its low half.
+  void end_surrogate() {
+    if (high_ != 0) {
+      str_put_utf8(0xFFFD);
+      high_ = 0;
+    }
+  }
+
+  void end_string() {
+    state_ = VALUE;
+    if (!chunked_) {
+      head(3, str_len_);
+      out_.write(str_, str_len_);
+      return;
+    }
+    if (str_len_ > 0) {
+      flush_chunk();
+    }
+    out_.write(0xFF);
+  }
+
+  Print &out_;
+  State state_ = VALUE;
+  uint8_t str_[64];
+  size_t str_len_ = 0;
+  bool chunked_ = false;
+  char num_[24];
+  size_t num_len_ = 0;
+  uint16_t code_ = 0;
+  uint8_t code_len_ = 0;
+  uint16_t high_ = 0; // Pending high surrogate.
+};
+
+static void json_escape(Print &out, const uint8_t *s, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      out.write('\\');
+      out.write(s[i]);
+    } else if (s[i] < 0x20) {
+      out.printf("\\u%04x", s[i]);
+    } else {
+      out.write(s[i]);
+    }
+  }
+}
+
+// Read a CBOR item head into major type, additional info and argument.
+// Returns the byte after it, or nullptr if truncated or reserved.
+static const uint8_t *cbor_head(const uint8_t *p, const uint8_t *end, uint8_t &major, uint8_t &info,
+                                uint64_t &value) {
+  if (p >= end) {
+    return nullptr;
+  }
+  major = *p >> 5;
+  info = *p++ & 0x1F;
+  value = info;
+  if (info >= 24 && info <= 27) {
+    const int bytes = 1 << (info - 24);
+    if (end - p < bytes) {
+      return nullptr;
+    }
+    value = 0;
+    for (int i = 0; i < bytes; ++i) {
+      value = (value << 8) | *p++;
+    }
+  } else if (info > 27 && !(info == 31 && major >= 3 && major <= 5)) {
+    return nullptr;
+  }
+  return p;
+}
+
+// Decode one CBOR item at p as JSON text. Returns the byte after the item,
+// or nullptr if the input is malformed, uses byte strings or tags, or
+// nests deeper than 8 levels.
+static const uint8_t *cbor_item_to_json(const uint8_t *p, const uint8_t *end, Print &out, int depth) {
+  uint8_t major = 0;
+  uint8_t info = 0;
+  uint64_t value = 0;
+  p = cbor_head(p, end, major, info, value);
+  if (p == nullptr || depth > 8) {
+    return nullptr;
+  }
+  const bool indefinite = (info == 31);
+  switch (major) {
+    case 0:
+      out.printf("%llu", static_cast<unsigned long long>(value));
+      break;
+    case 1:
+      if (value > 0x7FFFFFFFFFFFFFFFull) {
+        return nullptr;
+      }
+      out.printf("%lld", -1 - static_cast<long long>(value));
+      break;
+    case 3:
+      out.write('"');
+      // An indefinite string is a run of definite chunks ended by 0xFF.
+      while (true) {
+        if (indefinite) {
+          if (p < end && *p == 0xFF) {
+            p++;
+            break;
+          }
+          uint8_t chunk_major = 0;
+          uint8_t chunk_info = 0;
+          p = cbor_head(p, end, chunk_major, chunk_info, value);
+          if (p == nullptr || chunk_major != 3 || chunk_info == 31) {
+            return nullptr;
+          }
+        }
+        if (static_cast<uint64_t>(end - p) < value) {
+          return nullptr;
+        }
+        json_escape(out, p, value);
+        p += value;
+        if (!indefinite) {
+          break;
+        }
+      }
+      out.write('"');
+      break;
+    case 4:
+    case 5:
+      out.write(major == 4 ? '[' : '{');
+      for (uint64_t i = 0; indefinite || i < value; ++i) {
+        if (indefinite && p < end && *p == 0xFF) {
+          p++;
+          break;
+        }
+        if (i > 0) {
+          out.write(',');
+        }
+        if (major == 5) {
+          if (p >= end || (*p >> 5) != 3) {
+            return nullptr; // JSON keys are strings.
+          }
+          p = cbor_item_to_json(p, end, out, depth + 1);
+          if (p == nullptr) {
+            return nullptr;
+          }
+          out.write(':');
+        }
+        p = cbor_item_to_json(p, end, out, depth + 1);
+        if (p == nullptr) {
+          return nullptr;
+        }
+      }
+      out.write(major == 4 ? ']' : '}');
+      break;
+    case 7: {
+      double number = 0.0;
+      if (info == 20 || info == 21) {
+        out.print(info == 21 ? "true" : "false");
+        break;
+      } else if (info == 22) {
+        out.print("null");
+        break;
+      } else if (info == 25) {
+        // Half float: sign, 5-bit exponent, 10-bit mantissa.
+        const int exponent = (value >> 10) & 0x1F;
+        const int mantissa = value & 0x3FF;
+        number = (exponent == 0) ? ldexp(mantissa, -24)
+               : (exponent == 31) ? NAN : ldexp(mantissa + 1024, exponent - 25);
+        number = (value & 0x8000) ? -number : number;
+      } else if (info == 26) {
+        float f = 0.0f;
+        const uint32_t bits = static_cast<uint32_t>(value);
+        memcpy(&f, &bits, sizeof(f));
+        number = f;
+      } else if (info == 27) {
+        memcpy(&number, &value, sizeof(number));
+      } else {
+        return nullptr;
+      }
+      if (isfinite(number)) {
+        out.printf(info == 27 ? "%.17g" : "%.9g", number);
+      } else {
+        out.print("null");
+      }
+      break;
+    }
+    default:
+      return nullptr;
+  }
+  return p;
+}
+
+// CBOR request body to JSON text for deserializeJson(). Returns the text
+// length, or 0 if the body is not exactly one valid item or the text did
+// not fit.
+static size_t cbor_to_json(const uint8_t *data, size_t len, char *text, size_t cap) {
+  BufferPrint out(text, cap);
+  const uint8_t *end = data + len;
+  if (cbor_item_to_json(data, end, out, 0) != end || out.len + 1 >= cap) {
+    return 0;
+  }
+  return out.len;
+}
+
+// Bump allocator for ArduinoJson documents. Handlers build one document at
+// a time, so the arena rewinds when its last block is freed; requests that
+// do not fit fall back to the heap. Blocks carry an 8-byte size header.
+class JsonArena : public ArduinoJson::Allocator {
+ public:
+  void *allocate(size_t size) override {
+    const size_t need = align(size) + HEADER;
+    if (used_ + need > sizeof(buf_)) {
+      fallbacks++;
+      return malloc(size);
+    }
+    uint8_t *block = &buf_[used_];
+    const uint32_t stored = static_cast<uint32_t>(align(size));
+    memcpy(block, &stored, sizeof(stored));
+    used_ += need;
+    live_++;
+    peak = max(peak, used_);
+    return block + HEADER;
+  }
+
+  void deallocate(void *ptr) override {
+    if (!owns(ptr)) {
+      free(ptr);
+      return;
+    }
+    if (--live_ == 0) {
+      used_ = 0;
+    }
+  }
+
+  void *reallocate(void *ptr, size_t new_size) override {
+    if (ptr == nullptr) {
+      return allocate(new_size);
+    }
+    if (!owns(ptr)) {
+      return realloc(ptr, new_size);
+    }
+    uint8_t *block = static_cast<uint8_t *>(ptr) - HEADER;
+    uint32_t old_size = 0;
+    memcpy(&old_size, block, sizeof(old_size));
+    // The newest block grows or shrinks in place.
+    const size_t offset = static_cast<size_t>(block - buf_);
+    if (offset + HEADER + old_size == used_ && offset + HEADER + align(new_size) <= sizeof(buf_)) {
+      const uint32_t stored = static_cast<uint32_t>(align(new_size));
+      memcpy(block, &stored, sizeof(stored));
+      used_ = offset + HEADER + stored;
+      peak = max(peak, used_);
+      return ptr;
+    }
+    if (new_size <= old_size) {
+      return ptr;
+    }
+    void *moved = allocate(new_size);
+    if (moved != nullptr) {
+      memcpy(moved, ptr, old_size);
+      deallocate(ptr);
+    }
+    return moved;
+  }
+
+  size_t peak = 0;
+  uint32_t fallbacks = 0;
+
+ private:
+  static const size_t HEADER = 8;
+
+  static size_t align(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+  }
+
+  bool owns(const void *ptr) const {
+    const uint8_t *p = static_cast<const uint8_t *>(ptr);
+    return p >= buf_ && p < buf_ + sizeof(buf_);
+  }
+
+  alignas(8) uint8_t buf_[PORTAL_JSON_ARENA];
+  size_t used_ = 0;
+  uint32_t live_ = 0;
+};
+
+static JsonArena json_arena;
+
+static void render_summary_json(Print &out, const MetricsSnapshot &s) {
+  out.printf("{\"date\":%lu", static_cast<unsigned long>(s.date_yyyymmdd));
+  out.printf(",\"distance_m\":%lu", static_cast<unsigned long>(s.distance_m));
+  out.printf(",\"avg_speed_cmps\":%u", s.avg_speed_cmps);
+  out.printf(",\"max_speed_cmps\":%u", s.max_speed_cmps);
+  out.printf(",\"last_update_min\":%u", s.last_update_min);
+  out.printf(",\"gps_fix\":%s", s.gps_fix ? "true" : "false");
+  out.printf(",\"has_data\":%s", (s.date_yyyymmdd != 0) ? "true" : "false");
+  out.print(",\"ranges\":{\"time_s\":[");
+  for (int i = 0; i < 6; ++i) {
+    out.printf(i ? ",%lu" : "%lu", static_cast<unsigned long>(activity.range_time_ms[i] / 1000));
+  }
+  out.print("],\"distance_m\":[");
+  for (int i = 0; i < 6; ++i) {
+    out.printf(i ? ",%lu" : "%lu", static_cast<unsigned long>(activity.range_distance_m[i] + 0.5f));
+  }
+  out.print("]},\"hours\":{\"active_s\":[");
+  for (int h = 0; h < 24; ++h) {
+    out.printf(h ? ",%lu" : "%lu", static_cast<unsigned long>(activity.hour_active_ms[h] / 1000));
+  }
+  out.print("],\"distance_m\":[");
+  for (int h = 0; h < 24; ++h) {
+    out.printf(h ? ",%lu" : "%lu", static_cast<unsigned long>(activity.hour_distance_m[h] + 0.5f));
+  }
+  out.print("]}");
+  // Rolling windows end at the latest GPS minute, even without a fix.
+  timeline_advance(s.last_update_min);
+  out.print(",\"windows\":[");
+  for (int i = 0; i < 3; ++i) {
+    const RollingWindow &w = rolling[i];
+    out.printf("%s{\"minutes\":%u", i ? "," : "", w.minutes);
+    out.printf(",\"distance_m\":%lu", static_cast<unsigned long>((w.distance_dm + 5) / 10));
+    out.printf(",\"active_s\":%lu", static_cast<unsigned long>(w.active_s));
+    out.printf(",\"max_speed_cmps\":%u}",
+               static_cast<uint16_t>(timeline_window_max(w.minutes) * 0.5f * 27.7778f));
+  }
+  out.print("]}");
+}
+
+// Every summary field (metrics, histograms, windows) only changes when a
+// GPS line is handled, so the JSON is rendered once per metrics version
+// and replayed from summary_cache until the next publish.
+static char summary_cache[SUMMARY_CACHE_BYTES];
+static size_t summary_cache_len = 0;
+static uint32_t summary_cache_version = 0;
+
+static void write_summary_json(Print &out) {
+  uint32_t version = 0;
+  const MetricsSnapshot s = metrics_pub.read(&version);
+  if (summary_cache_len == 0 || version != summary_cache_version) {
+    BufferPrint cache(summary_cache, sizeof(summary_cache));
+    render_summary_json(cache, s);
+    // Too large for the cache: render straight to the client.
+    summary_cache_len = (cache.len + 1 < sizeof(summary_cache)) ? cache.len : 0;
+    summary_cache_version = version;
+    if (summary_cache_len == 0) {
+      render_summary_json(out, s);
+      return;
+    }
+  }
+  out.write(reinterpret_cast<const uint8_t *>(summary_cache), summary_cache_len);
+}
+
+static bool validate_ranges(const float *ranges) {
+  for (int i = 1; i < 5; ++i) {
+    if (!(ranges[i] > ranges[i - 1])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool validate_effects(const RangeEffect *effects) {
+  for (int i = 0; i < 6; ++i) {
+    if (effects[i].effect_a > FX_EFFECT_MAX || effects[i].effect_b > FX_EFFECT_MAX) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void set_default_palettes(RangePalette *palettes) {
+  const uint32_t *defaults[6] = {RANGE_1_PALETTE, RANGE_2_PALETTE, RANGE_3_PALETTE,
+                                 RANGE_4_PALETTE, RANGE_5_PALETTE, RANGE_6_PALETTE};
+  for (int i = 0; i < 6; ++i) {
+    for (int k = 0; k < PALETTE_STOPS; ++k) {
+      palettes[i].stops[k][0] = static_cast<uint8_t>(defaults[i][k] >> 16);
+      palettes[i].stops[k][1] = static_cast<uint8_t>(defaults[i][k] >> 8);
+      palettes[i].stops[k][2] = static_cast<uint8_t>(defaults[i][k]);
+    }
+  }
+}
+
+static void set_default_layout(LedLayout &layout) {
+  memset(&layout, 0, sizeof(layout));
+  layout.strip_count = static_cast<uint8_t>(LED_STRIP_MODE);
+  for (int i = 0; i < LED_MAX_STRIPS; ++i) {
+    layout.strip_len[i] = static_cast<uint8_t>(LED_STRIP_COUNT);
+  }
+  layout.status_count = static_cast<uint8_t>(LED_STATUS_COUNT);
+}
+
+static bool validate_layout(const LedLayout &layout) {
+  if (layout.strip_count < 1 || layout.strip_count > LED_MAX_STRIPS) {
+    return false;
+  }
+  for (int i = 0; i < layout.strip_count; ++i) {
+    if (layout.strip_len[i] < 1 || layout.strip_len[i] > LED_MAX_PER_STRIP) {
+      return false;
+    }
+    if (layout.segment_count == 0 && layout.status_count >= layout.strip_len[i]) {
+      return false;
+    }
+  }
+  if (layout.segment_count > LED_MAX_SEGMENTS) {
+    return false;
+  }
+  int body_pixels = 0;
+  for (int i = 0; i < layout.segment_count; ++i) {
+    const LedSegment &seg = layout.segments[i];
+    if (seg.strip >= layout.strip_count || seg.role > SEG_BODY || seg.channel > 1 || seg.count < 1 ||
+        seg.start + seg.count > layout.strip_len[seg.strip]) {
+      return false;
+    }
+    if (seg.role == SEG_BODY) {
+      body_pixels += seg.count;
+    }
+  }
+  return body_pixels <= LED_MAX_PIXELS;
+}
+
+// Compile-time defaults from config.h.
+static void default_config(RuntimeConfig &cfg) {
+  cfg.brightness = LED_BRIGHTNESS;
+  cfg.power_budget_ma = POWER_BUDGET_MA;
+  cfg.rgbw = LED_RGBW ? 1 : 0;
+  cfg.white_k = LED_WHITE_K;
+  cfg.ranges[0] = SPEED_RANGE_1_KPH;
+  cfg.ranges[1] = SPEED_RANGE_2_KPH;
+  cfg.ranges[2] = SPEED_RANGE_3_KPH;
+  cfg.ranges[3] = SPEED_RANGE_4_KPH;
+  cfg.ranges[4] = SPEED_RANGE_5_KPH;
+
+  cfg.effects[0] = {static_cast<uint8_t>(RANGE_1_EFFECT_A), static_cast<uint8_t>(RANGE_1_EFFECT_B),
+                      RANGE_1_SPEED, RANGE_1_INTENSITY};
+  cfg.effects[1] = {static_cast<uint8_t>(RANGE_2_EFFECT_A), static_cast<uint8_t>(RANGE_2_EFFECT_B),
+                      RANGE_2_SPEED, RANGE_2_INTENSITY};
+  cfg.effects[2] = {static_cast<uint8_t>(RANGE_3_EFFECT_A), static_cast<uint8_t>(RANGE_3_EFFECT_B),
+                      RANGE_3_SPEED, RANGE_3_INTENSITY};
+  cfg.effects[3] = {static_cast<uint8_t>(RANGE_4_EFFECT_A), static_cast<uint8_t>(RANGE_4_EFFECT_B),
+                      RANGE_4_SPEED, RANGE_4_INTENSITY};
+  cfg.effects[4] = {static_cast<uint8_t>(RANGE_5_EFFECT_A), static_cast<uint8_t>(RANGE_5_EFFECT_B),
+                      RANGE_5_SPEED, RANGE_5_INTENSITY};
+  cfg.effects[5] = {static_cast<uint8_t>(RANGE_6_EFFECT_A), static_cast<uint8_t>(RANGE_6_EFFECT_B),
+                      RANGE_6_SPEED, RANGE_6_INTENSITY};
+
+  set_default_palettes(cfg.palettes);
+  set_default_layout(cfg.layout);
+
+  set_str(cfg.ap_ssid, AP_SSID);
+  set_str(cfg.ap_pass, AP_PASS);
+  set_str(cfg.mdns, MDNS_NAME);
+  set_str(cfg.upload_url, UPLOAD_URL);
+}
+
+static void set_default_config() {
+  default_config(g_cfg);
+}
+
+static void save_config() {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 2);
+  prefs_cfg.putUChar("ver", CONFIG_VERSION);
+  prefs_cfg.putUChar("brightness", g_cfg.brightness);
+  prefs_cfg.putUShort("power_ma", g_cfg.power_budget_ma);
+  prefs_cfg.putUChar("rgbw", g_cfg.rgbw);
+  prefs_cfg.putUShort("white_k", g_cfg.white_k);
+  prefs_cfg.putBytes("ranges", g_cfg.ranges, sizeof(g_cfg.ranges));
+  prefs_cfg.putBytes("effects", g_cfg.effects, sizeof(g_cfg.effects));
+  prefs_cfg.putBytes("palettes", g_cfg.palettes, sizeof(g_cfg.palettes));
+  prefs_cfg.putBytes("layout", &g_cfg.layout, sizeof(g_cfg.layout));
+  prefs_cfg.putString("ap_ssid", g_cfg.ap_ssid);
+  prefs_cfg.putString("ap_pass", g_cfg.ap_pass);
+  prefs_cfg.putString("mdns", g_cfg.mdns);
+  prefs_cfg.putString("upload_url", g_cfg.upload_url);
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 2);
+}
+
+static void load_config() {
+  if (prefs_cfg.getUChar("ver", 0) != CONFIG_VERSION) {
+    set_default_config();
+    save_config();
+    return;
+  }
+
+  g_cfg.brightness = prefs_cfg.getUChar("brightness", LED_BRIGHTNESS);
+  if (g_cfg.brightness < 1) {
+    g_cfg.brightness = LED_BRIGHTNESS;
+  }
+  g_cfg.power_budget_ma = prefs_cfg.getUShort("power_ma", POWER_BUDGET_MA);
+  g_cfg.rgbw = prefs_cfg.getUChar("rgbw", LED_RGBW ? 1 : 0) != 0 ? 1 : 0;
+  g_cfg.white_k = prefs_cfg.getUShort("white_k", LED_WHITE_K);
+  if (g_cfg.white_k < 2000 || g_cfg.white_k > 10000) {
+    g_cfg.white_k = LED_WHITE_K;
+  }
+  if (prefs_cfg.getBytes("ranges", g_cfg.ranges, sizeof(g_cfg.ranges)) != sizeof(g_cfg.ranges)) {
+    set_default_config();
+    save_config();
+    return;
+  }
+  if (prefs_cfg.getBytes("effects", g_cfg.effects, sizeof(g_cfg.effects)) != sizeof(g_cfg.effects)) {
+    set_default_config();
+    save_config();
+    return;
+  }
+  // Older configs have no palette or layout blob; fall back to config.h.
+  if (prefs_cfg.getBytes("palettes", g_cfg.palettes, sizeof(g_cfg.palettes)) != sizeof(g_cfg.palettes)) {
+    set_default_palettes(g_cfg.palettes);
+  }
+  if (prefs_cfg.getBytes("layout", &g_cfg.layout, sizeof(g_cfg.layout)) != sizeof(g_cfg.layout) ||
+      !validate_layout(g_cfg.layout)) {
+    set_default_layout(g_cfg.layout);
+  }
+  get_pref_str(prefs_cfg, "ap_ssid", g_cfg.ap_ssid, AP_SSID);
+  get_pref_str(prefs_cfg, "ap_pass", g_cfg.ap_pass, AP_PASS);
+  get_pref_str(prefs_cfg, "mdns", g_cfg.mdns, MDNS_NAME);
+  get_pref_str(prefs_cfg, "upload_url", g_cfg.upload_url, UPLOAD_URL);
+
+  if (!validate_ranges(g_cfg.ranges) || !validate_effects(g_cfg.effects)) {
+    set_default_config();
+    save_config();
+  }
+}
+
+// Zone and program names are printed into JSON and shown in the portal, so
+// they are limited to letters, digits, space, '-' and '_' (1 to size - 1).
+static bool valid_name(const char *name, size_t size) {
+  const size_t len = strlen(name);
+  if (len < 1 || len > size - 1) {
+    return false;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    const char c = name[i];
+    if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != ' ') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reject anything the interpreter does not expect: unknown opcodes,
+// registers past r15 and jumps past the end of the program.
+static bool fx_validate(const FxProgram &p) {
+  if (p.op_count > FX_PROGRAM_MAX_OPS || p.name[sizeof(p.name) - 1] != '\0') {
+    return false;
+  }
+  if (p.name[0] != '\0' && !valid_name(p.name, sizeof(p.name))) {
+    return false;
+  }
+  for (int pc = 0; pc < p.op_count; ++pc) {
+    const uint8_t *ins = &p.code[pc * 4];
+    if (ins[0] >= FX_OP_COUNT || ins[1] >= FX_REGS) {
+      return false;
+    }
+    if (ins[0] == FX_JZ || ins[0] == FX_JMP) {
+      if (pc + 1 + ins[2] > p.op_count) {
+        return false;
+      }
+    } else if (ins[0] != FX_LDI && (ins[2] >= FX_REGS || ins[3] >= FX_REGS)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void load_programs() {
+  if (prefs_cfg.getBytes("programs", fx_programs, sizeof(fx_programs)) != sizeof(fx_programs)) {
+    memset(fx_programs, 0, sizeof(fx_programs));
+  }
+  for (int i = 0; i < FX_PROGRAM_SLOTS; ++i) {
+    if (!fx_validate(fx_programs[i])) {
+      memset(&fx_programs[i], 0, sizeof(fx_programs[i]));
+    }
+  }
+}
+
+static void save_programs() {
+  trace_event(TRACE_NVS_COMMIT, TRACE_BEGIN, 4);
+  prefs_cfg.putBytes("programs", fx_programs, sizeof(fx_programs));
+  trace_event(TRACE_NVS_COMMIT, TRACE_END, 4);
+}
+
+static void led_apply_layout();
+static void white_point_set(uint16_t kelvin);
+
+static void apply_config(const RuntimeConfig &previous) {
+  FastLED.setBrightness(g_cfg.brightness);
+  palette_lut_range = 0;
+  white_point_set(g_cfg.white_k);
+  if (LED_UI_ENABLED && (memcmp(&g_cfg.layout, &previous.layout, sizeof(g_cfg.layout)) != 0 ||
+                         g_cfg.rgbw != previous.rgbw)) {
+    led_apply_layout();
+  }
+  if (strcmp(g_cfg.mdns, previous.mdns) != 0) {
+    if (wifi_sta_connected) {
+      MDNS.end();
+      MDNS.begin(g_cfg.mdns);
+    }
+  }
+}
+
+// Root page, served as HTML_ROOT + the state JSON + HTML_ROOT_SCRIPT so the
+// first paint needs no second request (see handle_root()).
+static const char HTML_ROOT[] PROGMEM =
+      "<!doctype html><html><head><meta charset='utf-8'>"
       "<meta name='viewport' content='width=device-width,initial-scale=1'>"
       "<title>Dog Collar</title>"
       "<style>body{font-family:Arial,sans-serif;margin:20px;color:#111}"
@@ -487,54 +3030,584 @@ static String html_page() {
       "<div class='card'><div>Distancia (km)</div><div id='dist'>--</div></div>"
       "<div class='card'><div>Velocidad promedio (km/h)</div><div id='avg'>--</div></div>"
       "<div class='card'><div>Velocidad maxima (km/h)</div><div id='max'>--</div></div>"
+      "<div class='card'><div>Tiempo por rango (min)</div><div id='ranges'>--</div></div>"
+      "<div class='card'><div>Distancia por minuto</div><canvas id='tl' width='288' height='60' style='width:100%'></canvas></div>"
       "<div class='muted' id='updated'>Ultima lectura: --</div>"
-      "<p><a href='/wifi'>Configurar Wi-Fi</a> | <a href='/config'>Config</a></p>"
-      "<script>"
-      "function minToTime(m){var h=Math.floor(m/60);var mm=m%60;return String(h).padStart(2,'0')+':'+String(mm).padStart(2,'0');}"
+      "<div class='muted' id='paint'></div>"
+      "<p><a href='/wifi'>Configurar Wi-Fi</a> | <a href='/config'>Config</a> | <a href='/effects'>Efectos</a></p>"
+      "<script>var S=";
+
+static const char HTML_ROOT_SCRIPT[] PROGMEM =
+      ";function minToTime(m){var h=Math.floor(m/60);var mm=m%60;return String(h).padStart(2,'0')+':'+String(mm).padStart(2,'0');}"
       "function cmpsToKph(v){return (v*0.036).toFixed(1);}"
-      "function loadData(){fetch('/api/summary').then(r=>r.json()).then(d=>{"
+      "function show(s){const d=s.summary;"
+      "document.getElementById('paint').innerText='Encendido: '+minToTime(Math.floor(s.status.uptime_ms/60000));"
       "if(!d.has_data){document.getElementById('status').innerText='Estado: Sin datos';return;}"
       "document.getElementById('dist').innerText=(d.distance_m/1000).toFixed(2);"
       "document.getElementById('avg').innerText=cmpsToKph(d.avg_speed_cmps);"
       "document.getElementById('max').innerText=cmpsToKph(d.max_speed_cmps);"
+      "document.getElementById('ranges').innerText=d.ranges.time_s.map((t,i)=>'R'+(i+1)+': '+Math.round(t/60)).join(' | ');"
       "document.getElementById('updated').innerText='Ultima lectura: '+minToTime(d.last_update_min);"
-      "document.getElementById('status').innerText='Estado: '+(d.gps_fix?'GPS OK':'Sin GPS');"
-      "}).catch(()=>{document.getElementById('status').innerText='Estado: Error';});}"
-      "loadData();"
-      "</script></body></html>");
+      "document.getElementById('status').innerText='Estado: '+(d.gps_fix?'GPS OK':'Sin GPS');}"
+      "function loadData(){fetch('/api/state').then(r=>r.json()).then(show)"
+      ".catch(()=>{document.getElementById('status').innerText='Estado: Error';});loadTimeline();}"
+      "function loadTimeline(){fetch('/api/timeline').then(r=>r.arrayBuffer()).then(b=>{"
+      "const v=new DataView(b);const first=v.getUint16(4,true);const n=v.getUint16(6,true);"
+      "const w=new Uint32Array(b,12,n);const c=document.getElementById('tl');const x=c.getContext('2d');"
+      "const bins=new Float32Array(c.width);let top=1;"
+      "for(let i=0;i<n;i++){const k=Math.floor((first+i)*c.width/1440);bins[k]+=(w[i]&0xffff);top=Math.max(top,bins[k]);}"
+      "x.clearRect(0,0,c.width,c.height);x.fillStyle='#111';"
+      "for(let k=0;k<c.width;k++){const h=bins[k]/top*c.height;x.fillRect(k,c.height-h,1,h);}"
+      "}).catch(()=>{});}"
+      "show(S);"
+      "document.getElementById('paint').innerText+=' | Carga: '+Math.round(performance.now())+' ms';"
+      "loadTimeline();"
+      "</script></body></html>";
+
+static void write_wifi_page(Print &out) {
+  out.print("<!doctype html><html><head><meta charset='utf-8'>"
+            "<meta name='viewport' content='width=device-width,initial-scale=1'>"
+            "<title>Wi-Fi</title></head><body><h1>Configurar Wi-Fi</h1>"
+            "<form method='post' action='/api/wifi'>"
+            "<label>SSID</label><br><input name='ssid' value='");
+  out.print(wifi_ssid);
+  out.print("'><br>"
+            "<label>Password</label><br><input name='pass' type='password'><br><br>"
+            "<button type='submit'>Guardar y conectar</button>"
+            "</form><p><a href='/'>Volver</a></p></body></html>");
+}
+
+static void add_segment(uint8_t strip, uint8_t role, uint8_t channel, uint8_t flags, int start, int count) {
+  if (led_segment_count >= LED_MAX_SEGMENTS || count < 1) {
+    return;
+  }
+  led_segments[led_segment_count++] = {strip, role, channel, flags,
+                                       static_cast<uint8_t>(start), static_cast<uint8_t>(count)};
+}
+
+// Build the active segment map and strip offsets from the layout. Without an
+// explicit map each strip gets a status segment followed by its body; strips
+// alternate between effect A and B, and mirror splits the body into two
+// halves (the second drawn reversed, sharing the middle pixel if odd).
+static void led_build_segments(const LedLayout &layout) {
+  int offset = 0;
+  for (int s = 0; s < LED_MAX_STRIPS; ++s) {
+    strip_offset[s] = static_cast<uint16_t>(offset);
+    if (s < layout.strip_count) {
+      offset += layout.strip_len[s];
+    }
+  }
+  led_pixel_count = offset;
+
+  led_segment_count = 0;
+  if (layout.segment_count > 0) {
+    for (int i = 0; i < layout.segment_count; ++i) {
+      led_segments[led_segment_count++] = layout.segments[i];
+    }
+  } else {
+    for (uint8_t s = 0; s < layout.strip_count; ++s) {
+      const int status = layout.status_count;
+      const int body = layout.strip_len[s] - status;
+      const uint8_t channel = s % 2;
+      add_segment(s, SEG_STATUS, 0, 0, 0, status);
+      if (layout.mirror && body >= 2) {
+        const int half = (body + 1) / 2;
+        add_segment(s, SEG_BODY, channel, 0, status, half);
+        add_segment(s, SEG_BODY, channel, SEG_MIRROR, status + body - half, half);
+      } else {
+        add_segment(s, SEG_BODY, channel, 0, status, body);
+      }
+    }
+  }
+  planned_effect_a = -1;
+  planned_effect_b = -1;
+}
+
+static CLEDController *add_strip_controller(int strip) {
+  switch (strip) {
+    case 0:
+      return &FastLED.addLeds<SK6812, PIN_LED_A_DATA, RGB>(led_wire, 0);
+    case 1:
+      return &FastLED.addLeds<SK6812, PIN_LED_B_DATA, RGB>(led_wire, 0);
+    case 2:
+      return &FastLED.addLeds<SK6812, PIN_LED_C_DATA, RGB>(led_wire, 0);
+    default:
+      return &FastLED.addLeds<SK6812, PIN_LED_D_DATA, RGB>(led_wire, 0);
+  }
+}
+
+// Point each strip's controller at its wire slot, sized in 3-byte units for
+// 3 or 4 bytes per LED. The old layout is blanked first so shortened or
+// removed strips do not keep stale pixels. Controllers are added the first
+// time a strip is used.
+static void led_apply_layout() {
+  FastLED.clear(true);
+  fill_solid(led_wire, LED_MAX_STRIPS * LED_WIRE_PER_STRIP, CRGB(0, 0, 0));
+  led_build_segments(g_cfg.layout);
+  led_stream.need_key = true;
+  const int bytes_per_led = g_cfg.rgbw ? 4 : 3;
+  for (int s = 0; s < LED_MAX_STRIPS; ++s) {
+    if (s < g_cfg.layout.strip_count) {
+      if (strip_ctrl[s] == nullptr) {
+        strip_ctrl[s] = add_strip_controller(s);
+      }
+      strip_ctrl[s]->setLeds(&led_wire[s * LED_WIRE_PER_STRIP], (g_cfg.layout.strip_len[s] * bytes_per_led + 2) / 3);
+    } else if (strip_ctrl[s] != nullptr) {
+      strip_ctrl[s]->setLeds(led_wire, 0);
+    }
+  }
+}
+
+// RGB of a white die at kelvin (Tanner Helland's blackbody fit), scaled so
+// the largest channel is 255. Runs on config changes only.
+static void white_point_set(uint16_t kelvin) {
+  const float t = kelvin / 100.0f;
+  float c[3];
+  c[0] = (t <= 66) ? 255.0f : 329.698727446f * powf(t - 60, -0.1332047592f);
+  c[1] = (t <= 66) ? 99.4708025861f * logf(t) - 161.1195681661f : 288.1221695283f * powf(t - 60, -0.0755148492f);
+  c[2] = (t >= 66) ? 255.0f : ((t <= 19) ? 0.0f : 138.5177312231f * logf(t - 10) - 305.0447927307f);
+  const float top = max(c[0], max(c[1], c[2]));
+  for (int k = 0; k < 3; ++k) {
+    white_point.rgb[k] = static_cast<uint8_t>(constrain(lroundf(c[k] * 255.0f / top), 1L, 255L));
+    white_point.inv_q8[k] = static_cast<uint16_t>(255u * 256u / white_point.rgb[k]);
+  }
+}
+
+static inline uint8_t div255(uint32_t x) {
+  return static_cast<uint8_t>((x + 1 + (x >> 8)) >> 8);
+}
+
+// Pack a frame laid out like leds_frame into wire slots laid out like
+// led_wire (G, R, B[, W]) and sum the channels. For RGBW the W die takes
+// the largest multiple of the white point that fits in the pixel,
+// w = min(c * 255 / white_c), and w * white_c / 255 comes off each channel.
+// Pastels and status whites end up mostly on W.
+static void led_pack(const CRGB *frame, CRGB *wire, bool rgbw, PixelSums &sums) {
+  memset(&sums, 0, sizeof(sums));
+  for (int s = 0; s < g_cfg.layout.strip_count; ++s) {
+    const CRGB *src = &frame[strip_offset[s]];
+    uint8_t *out = wire[s * LED_WIRE_PER_STRIP].raw;
+    for (int i = 0; i < g_cfg.layout.strip_len[s]; ++i) {
+      uint8_t r = src[i].r;
+      uint8_t g = src[i].g;
+      uint8_t b = src[i].b;
+      if (rgbw) {
+        const uint32_t w = min<uint32_t>(min(min(r * white_point.inv_q8[0], g * white_point.inv_q8[1]),
+                                             b * white_point.inv_q8[2]) >> 8, 255);
+        const uint8_t wr = div255(w * white_point.rgb[0]);
+        const uint8_t wg = div255(w * white_point.rgb[1]);
+        const uint8_t wb = div255(w * white_point.rgb[2]);
+        r -= wr;
+        g -= wg;
+        b -= wb;
+        sums.moved[0] += wr;
+        sums.moved[1] += wg;
+        sums.moved[2] += wb;
+        sums.w += w;
+        out[0] = g;
+        out[1] = r;
+        out[2] = b;
+        out[3] = static_cast<uint8_t>(w);
+        out += 4;
+      } else {
+        out[0] = g;
+        out[1] = r;
+        out[2] = b;
+        out += 3;
+      }
+      sums.rgb[0] += r;
+      sums.rgb[1] += g;
+      sums.rgb[2] += b;
+    }
+  }
+}
+
+// Full-duty LED current (uA, no idle draw) of the channel sums.
+static uint32_t pixel_sums_ua(const PixelSums &sums) {
+  return (sums.rgb[0] * LED_UA_RED + sums.rgb[1] * LED_UA_GREEN + sums.rgb[2] * LED_UA_BLUE +
+          sums.w * LED_UA_WHITE) / 255;
+}
+
+// Full-duty current the RGB dies would have drawn for what W took over,
+// minus what W draws for it.
+static uint32_t pixel_sums_saved_ua(const PixelSums &sums) {
+  const uint32_t moved_ua = sums.moved[0] * LED_UA_RED + sums.moved[1] * LED_UA_GREEN + sums.moved[2] * LED_UA_BLUE;
+  const uint32_t white_ua = sums.w * LED_UA_WHITE;
+  return (moved_ua > white_ua) ? (moved_ua - white_ua) / 255 : 0;
+}
+
+static void led_begin() {
+  white_point_set(g_cfg.white_k);
+  led_apply_layout();
+  FastLED.setBrightness(g_cfg.brightness);
+  power.level_q8 = static_cast<uint16_t>(g_cfg.brightness) << 8;
+  FastLED.clear(true);
+}
+
+// Build the trace dump header and return the number of events held in the ring.
+// Layout: "DTRC", version, event size, cpu MHz (u16), count (u32), dropped (u32).
+static uint32_t trace_fill_header(uint8_t *out, uint32_t *first) {
+  const uint32_t count = (trace_head < TRACE_RING_EVENTS) ? trace_head : TRACE_RING_EVENTS;
+  *first = trace_head - count;
+  memcpy(out, "DTRC", 4);
+  out[4] = TRACE_DUMP_VERSION;
+  out[5] = static_cast<uint8_t>(sizeof(TraceEvent));
+  put_u16_le(&out[6], static_cast<uint16_t>(ESP.getCpuFreqMHz()));
+  put_u32_le(&out[8], count);
+  put_u32_le(&out[12], *first);
+  return count;
+}
+
+// CRC-32 (IEEE 802.3, reflected), bitwise to keep flash use small.
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+// Hex dump, 32 bytes per line, each line starting with prefix.
+static void print_hex_line(const char *prefix, const uint8_t *data, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  size_t i = 0;
+  do {
+    char line[2 * 32 + 1];
+    size_t n = 0;
+    for (; i < len && n + 2 < sizeof(line); ++i) {
+      line[n++] = hex[data[i] >> 4];
+      line[n++] = hex[data[i] & 0x0F];
+    }
+    line[n] = '\0';
+    Serial.print(prefix);
+    Serial.println(line);
+  } while (i < len);
 }
 
-static String html_wifi_page() {
-  String page = "<!doctype html><html><head><meta charset='utf-8'>"
-                "<meta name='viewport' content='width=device-width,initial-scale=1'>"
-                "<title>Wi-Fi</title></head><body><h1>Configurar Wi-Fi</h1>"
-                "<form method='post' action='/api/wifi'>"
-                "<label>SSID</label><br><input name='ssid' value='" + wifi_ssid + "'><br>"
-                "<label>Password</label><br><input name='pass' type='password'><br><br>"
-                "<button type='submit'>Guardar y conectar</button>"
-                "</form><p><a href='/'>Volver</a></p></body></html>";
-  return page;
+// Dump the trace ring over serial as hex lines between TRACE BEGIN/END markers.
+static void dump_trace_serial() {
+  uint8_t header[TRACE_HEADER_SIZE];
+  uint32_t first = 0;
+  const uint32_t count = trace_fill_header(header, &first);
+  Serial.println("TRACE BEGIN");
+  print_hex_line("TRACE ", header, sizeof(header));
+  for (uint32_t i = 0; i < count; i += 4) {
+    uint8_t chunk[4 * sizeof(TraceEvent)];
+    const uint32_t n = min(static_cast<uint32_t>(4), count - i);
+    for (uint32_t k = 0; k < n; ++k) {
+      memcpy(&chunk[k * sizeof(TraceEvent)],
+             &trace_ring[(first + i + k) & (TRACE_RING_EVENTS - 1)],
+             sizeof(TraceEvent));
+    }
+    print_hex_line("TRACE ", chunk, n * sizeof(TraceEvent));
+  }
+  Serial.println("TRACE END");
 }
 
-static void led_begin() {
-  FastLED.addLeds<SK6812, PIN_LED_A_DATA, GRB>(leds_a, LED_STRIP_COUNT);
-  if (LED_STRIP_MODE == 2) {
-    FastLED.addLeds<SK6812, PIN_LED_B_DATA, GRB>(leds_b, LED_STRIP_COUNT);
+static void boot_mark(uint32_t &slot, uint16_t code) {
+  if (slot == 0) {
+    slot = max<uint32_t>(1, millis());
+    trace_event(TRACE_BOOT, TRACE_INSTANT, code);
   }
-  FastLED.setBrightness(g_cfg.brightness);
-  FastLED.clear(true);
 }
 
-static void fill_range(CRGB *leds, int start, int count, const CRGB &color) {
-  for (int i = start; i < start + count; ++i) {
+// Estimate the frame's LED current and pick the global brightness that keeps
+// it under the budget. Caps apply at once (brownout); recovery ramps up at
+// POWER_RELEASE_PER_S so capped effects do not pump.
+static void power_update(const PixelSums &sums) {
+  const unsigned long now_ms = millis();
+  const uint32_t dt_ms = min<uint32_t>(now_ms - power.last_ms, 1000);
+  power.last_ms = now_ms;
+
+  const uint32_t idle_ua = static_cast<uint32_t>(led_pixel_count) * LED_UA_IDLE;
+  const uint32_t full_ua = pixel_sums_ua(sums);
+
+  uint8_t target = g_cfg.brightness;
+  const uint32_t budget_ua = static_cast<uint32_t>(g_cfg.power_budget_ma) * 1000;
+  if (budget_ua > 0 && full_ua > 0 && idle_ua + full_ua * (target + 1) / 256 > budget_ua) {
+    const uint32_t avail_ua = (budget_ua > idle_ua) ? budget_ua - idle_ua : 0;
+    target = static_cast<uint8_t>(constrain(static_cast<int32_t>(avail_ua * 256ull / full_ua) - 1, 1, static_cast<int32_t>(target)));
+  }
+  const uint16_t target_q8 = static_cast<uint16_t>(target) << 8;
+  if (target_q8 <= power.level_q8) {
+    power.level_q8 = target_q8;
+  } else {
+    power.level_q8 = min<uint32_t>(target_q8, power.level_q8 + POWER_RELEASE_PER_S * 256u * dt_ms / 1000);
+  }
+  power.brightness = static_cast<uint8_t>(power.level_q8 >> 8);
+  if (power.brightness < g_cfg.brightness) {
+    power.capped_frames++;
+  }
+  FastLED.setBrightness(power.brightness);
+
+  power.est_ma = (idle_ua + full_ua * (power.brightness + 1) / 256) / 1000;
+  power.peak_ma = max(power.peak_ma, power.est_ma);
+  power.white_saved_ma = pixel_sums_saved_ua(sums) * (power.brightness + 1) / 256 / 1000;
+  power.white_saved_mams += static_cast<uint64_t>(power.white_saved_ma) * dt_ms;
+  const uint32_t minute = now_ms / 60000;
+  for (int k = 0; k < 60 && power.minute != minute; ++k) {
+    power.minute++;
+    power.minute_mams[power.minute % 60] = 0;
+  }
+  power.minute = minute;
+  power.minute_mams[minute % 60] += power.est_ma * dt_ms;
+  power.total_mams += static_cast<uint64_t>(power.est_ma) * dt_ms;
+}
+
+// mAh drawn by the LEDs over the last 60 minutes (estimated).
+static float power_last_hour_mah() {
+  uint64_t mams = 0;
+  for (int i = 0; i < 60; ++i) {
+    mams += power.minute_mams[i];
+  }
+  return mams / 3600000.0f;
+}
+
+// Encode count pixels of cur against prev, then copy cur to prev. Layout:
+// flags (bit 0: key frame, the client starts from black), range (bit 7:
+// forced preview), count (u16 LE), then ops up to the last changed pixel:
+// skip (unchanged pixels before the op, u8) and n (u8, bits 0-6 pixels;
+// bit 7 set: one RGB for all of them, else n RGB triples). Runs of three
+// or more equal pixels use the repeat form. Returns the bytes written, at
+// most 4 + count * 5.
+static size_t led_delta_encode(const CRGB *cur, CRGB *prev, int count, bool key, uint8_t range, uint8_t *out) {
+  if (key) {
+    fill_solid(prev, count, CRGB(0, 0, 0));
+  }
+  uint8_t *p = out;
+  *p++ = key ? 1 : 0;
+  *p++ = range;
+  put_u16_le(p, static_cast<uint16_t>(count));
+  p += 2;
+  int i = 0;
+  while (i < count) {
+    int skip = 0;
+    while (i + skip < count && cur[i + skip] == prev[i + skip]) {
+      skip++;
+    }
+    if (i + skip == count) {
+      break;
+    }
+    i += skip;
+    for (; skip > 255; skip -= 255) {
+      *p++ = 255;
+      *p++ = 0; // Empty op: skip only.
+    }
+    *p++ = static_cast<uint8_t>(skip);
+    int rep = 1;
+    while (i + rep < count && rep < 127 && cur[i + rep] == cur[i]) {
+      rep++;
+    }
+    if (rep >= 3) {
+      *p++ = static_cast<uint8_t>(0x80 | rep);
+      *p++ = cur[i].r;
+      *p++ = cur[i].g;
+      *p++ = cur[i].b;
+      i += rep;
+      continue;
+    }
+    uint8_t *n_out = p++;
+    int n = 0;
+    while (i < count && n < 127 && cur[i] != prev[i] &&
+           !(n > 0 && i + 2 < count && cur[i + 1] == cur[i] && cur[i + 2] == cur[i])) {
+      *p++ = cur[i].r;
+      *p++ = cur[i].g;
+      *p++ = cur[i].b;
+      i++;
+      n++;
+    }
+    *n_out = static_cast<uint8_t>(n);
+  }
+  memcpy(prev, cur, count * sizeof(CRGB));
+  return p - out;
+}
+
+static size_t base64_encode(const uint8_t *in, size_t len, char *out) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char *p = out;
+  for (size_t i = 0; i < len; i += 3) {
+    const uint32_t v = (static_cast<uint32_t>(in[i]) << 16) | ((i + 1 < len) ? in[i + 1] << 8 : 0) |
+                       ((i + 2 < len) ? in[i + 2] : 0);
+    *p++ = table[(v >> 18) & 63];
+    *p++ = table[(v >> 12) & 63];
+    *p++ = (i + 1 < len) ? table[(v >> 6) & 63] : '=';
+    *p++ = (i + 2 < len) ? table[v & 63] : '=';
+  }
+  return p - out;
+}
+
+static void led_stream_close() {
+  led_stream.client.stop();
+  led_stream.active = false;
+  if (led_stream.owns_preview) {
+    led_preview_range = 0;
+    led_stream.owns_preview = false;
+  }
+}
+
+// Push the rest of the pending event without blocking. False when the
+// viewer is gone.
+static bool led_stream_flush() {
+  while (led_stream.out_pos < led_stream.out_len) {
+    const int n = lwip_send(led_stream.client.fd(), &led_stream.out[led_stream.out_pos],
+                       led_stream.out_len - led_stream.out_pos, MSG_DONTWAIT);
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (n == 0) {
+      return true;
+    }
+    led_stream.out_pos += n;
+    led_stream.bytes += n;
+  }
+  return true;
+}
+
+// Queue the frame just shown for the viewer. Key frames are preceded by a
+// "layout" event with the strip lengths; unchanged frames send nothing
+// but a keep-alive comment now and then.
+static void led_stream_poll(unsigned long now_ms) {
+  if (!led_stream.active) {
+    return;
+  }
+  const uint32_t t0 = micros();
+  if (!led_stream.client.connected() || !led_stream_flush()) {
+    led_stream_close();
+    return;
+  }
+  if (static_cast<int32_t>(now_ms - led_stream.next_ms) < 0) {
+    return;
+  }
+  if (led_stream.out_pos < led_stream.out_len) {
+    led_stream.skipped++;
+    return;
+  }
+  const bool key = led_stream.need_key;
+  const uint8_t range = static_cast<uint8_t>(led_stream.range | (led_preview_range != 0 ? 0x80 : 0));
+  const size_t n = led_delta_encode(leds_frame, led_stream_prev, led_pixel_count, key, range, led_stream_bin);
+  size_t len = 0;
+  if (key) {
+    len += snprintf(&led_stream.out[len], 64, "event: layout\ndata: {\"status\":%u,\"strips\":[",
+                    g_cfg.layout.status_count);
+    for (int s = 0; s < g_cfg.layout.strip_count; ++s) {
+      len += snprintf(&led_stream.out[len], 8, s > 0 ? ",%u" : "%u", g_cfg.layout.strip_len[s]);
+    }
+    len += snprintf(&led_stream.out[len], 8, "]}\n\n");
+  }
+  if (key || n > 4 || range != led_stream.sent_range) {
+    led_stream.sent_range = range;
+    len += snprintf(&led_stream.out[len], 16, "data: ");
+    len += base64_encode(led_stream_bin, n, &led_stream.out[len]);
+    len += snprintf(&led_stream.out[len], 4, "\n\n");
+  } else if (now_ms - led_stream.last_send_ms >= LED_STREAM_KEEPALIVE_MS) {
+    len += snprintf(&led_stream.out[len], 4, ":\n\n");
+  }
+  led_stream.need_key = false;
+  if (len > 0) {
+    led_stream.out_len = static_cast<uint16_t>(len);
+    led_stream.out_pos = 0;
+    led_stream.frames++;
+    led_stream.last_send_ms = now_ms;
+    if (!led_stream_flush()) {
+      led_stream_close();
+      return;
+    }
+  }
+  const uint32_t cost_us = static_cast<uint32_t>(micros()) - t0;
+  led_stream.last_us = cost_us;
+  led_stream.max_us = max(led_stream.max_us, cost_us);
+  led_stream.next_ms = now_ms + max<uint32_t>(LED_STREAM_MIN_MS, cost_us / (10 * LED_STREAM_BUDGET_PCT));
+}
+
+static void led_show() {
+  PixelSums sums;
+  led_pack(leds_frame, led_wire, g_cfg.rgbw != 0, sums);
+  power_update(sums);
+  trace_event(TRACE_LED_SHOW, TRACE_BEGIN);
+  FastLED.show();
+  trace_event(TRACE_LED_SHOW, TRACE_END);
+  boot_mark(boot_ms.first_frame_ms, TRACE_BOOT_FIRST_FRAME);
+  if (led_stats.frame_start_us != 0) {
+    const uint32_t frame_us = static_cast<uint32_t>(micros()) - led_stats.frame_start_us;
+    led_stats.max_frame_us = max(led_stats.max_frame_us, frame_us);
+    led_stats.last_frame_us = frame_us;
+    led_stats.frame_start_us = 0;
+  }
+  led_stream_poll(millis());
+}
+
+// Pixel kernels. They treat a CRGB span as raw bytes and process four
+// bytes per 32-bit word (SWAR), with scalar head/tail for unaligned edges.
+// Words go through memcpy (one aligned load/store) so CRGB storage is
+// never accessed through a uint32_t lvalue.
+// Results are bit-exact with FastLED's scale8()/nscale8()/fadeToBlackBy().
+
+// Scale four packed bytes by s1 / 256 (s1 = scale + 1, 1..256). Each byte is
+// widened to a 16-bit lane, so products (<= 255 * 256) never carry across.
+static inline uint32_t swar_scale8(uint32_t v, uint32_t s1) {
+  const uint32_t lo = (((v & 0x00FF00FFu) * s1) >> 8) & 0x00FF00FFu;
+  const uint32_t hi = (((v >> 8) & 0x00FF00FFu) * s1) & 0xFF00FF00u;
+  return lo | hi;
+}
+
+static void px_scale(CRGB *leds, int count, uint8_t scale) {
+  uint8_t *p = reinterpret_cast<uint8_t *>(leds);
+  const size_t n = static_cast<size_t>(count) * sizeof(CRGB);
+  const uint32_t s1 = static_cast<uint32_t>(scale) + 1;
+  const size_t head = min<size_t>(n, (4 - (reinterpret_cast<uintptr_t>(p) & 3u)) & 3u);
+  size_t i = 0;
+  for (; i < head; ++i) {
+    p[i] = static_cast<uint8_t>((p[i] * s1) >> 8);
+  }
+  for (; i + 4 <= n; i += 4) {
+    uint32_t w;
+    memcpy(&w, p + i, sizeof(w));
+    w = swar_scale8(w, s1);
+    memcpy(p + i, &w, sizeof(w));
+  }
+  for (; i < n; ++i) {
+    p[i] = static_cast<uint8_t>((p[i] * s1) >> 8);
+  }
+}
+
+static void px_fade(CRGB *leds, int count, uint8_t amount) {
+  px_scale(leds, count, static_cast<uint8_t>(255 - amount));
+}
+
+// Fill with one color. Four pixels are exactly three words, so once the
+// pixel index is a multiple of four (word-aligned in an aligned frame) the
+// pattern is stored as three precomputed words.
+static void px_fill(CRGB *leds, int count, const CRGB &color) {
+  int i = 0;
+  while (i < count && (reinterpret_cast<uintptr_t>(&leds[i]) & 3u) != 0) {
+    leds[i++] = color;
+  }
+  if (count - i >= 4) {
+    uint32_t pattern[3];
+    uint8_t *pb = reinterpret_cast<uint8_t *>(pattern);
+    for (int k = 0; k < 4; ++k) {
+      pb[k * 3 + 0] = color.raw[0];
+      pb[k * 3 + 1] = color.raw[1];
+      pb[k * 3 + 2] = color.raw[2];
+    }
+    for (; i + 4 <= count; i += 4) {
+      memcpy(&leds[i], pattern, sizeof(pattern));
+    }
+  }
+  for (; i < count; ++i) {
     leds[i] = color;
   }
 }
 
+static void fill_range(CRGB *leds, int start, int count, const CRGB &color) {
+  px_fill(&leds[start], count, color);
+}
+
 static void fade_range(CRGB *leds, int start, int count, uint8_t amount) {
-  for (int i = start; i < start + count; ++i) {
-    leds[i].fadeToBlackBy(amount);
-  }
+  px_fade(&leds[start], count, amount);
 }
 
 static uint8_t step_from_speed(uint8_t speed, uint8_t divisor) {
@@ -542,6 +3615,37 @@ static uint8_t step_from_speed(uint8_t speed, uint8_t divisor) {
   return step < 1 ? 1 : step;
 }
 
+// Q8 advance for `step` units per LED_UPDATE_MS over dt_ms. The remainder
+// is carried, so e.g. 5 x 10 ms and 1 x 50 ms advance exactly the same.
+static uint32_t effect_advance(EffectState &state, uint8_t step, uint32_t dt_ms) {
+  const uint32_t acc = static_cast<uint32_t>(step) * 256u * dt_ms + state.rem;
+  state.rem = static_cast<uint16_t>(acc % LED_UPDATE_MS);
+  return acc / LED_UPDATE_MS;
+}
+
+// Fade amount for a dt_ms frame equivalent to `amount` per LED_UPDATE_MS.
+static uint8_t fade_for_dt(uint8_t amount, uint32_t dt_ms) {
+  if (dt_ms == LED_UPDATE_MS || amount == 0) {
+    return amount;
+  }
+  const float keep = powf((256.0f - amount) / 256.0f,
+                          static_cast<float>(dt_ms) / static_cast<float>(LED_UPDATE_MS));
+  return clamp_u8(static_cast<int>(lroundf(256.0f - 256.0f * keep)));
+}
+
+// Draw color at a Q8 position in leds[start, start + count), split over the
+// two nearest pixels by the fractional part (wrapping at the end).
+static void draw_aa(CRGB *leds, int start, int count, uint32_t pos_q8, const CRGB &color) {
+  const int i = static_cast<int>((pos_q8 >> 8) % count);
+  const uint8_t frac = static_cast<uint8_t>(pos_q8 & 0xFF);
+  CRGB near = color;
+  CRGB far = color;
+  near.nscale8(255 - frac);
+  far.nscale8(frac);
+  leds[start + i] |= near;
+  leds[start + (i + 1) % count] |= far;
+}
+
 static uint8_t speed_range(float kph) {
   if (kph <= g_cfg.ranges[0]) return 1;
   if (kph <= g_cfg.ranges[1]) return 2;
@@ -563,21 +3667,40 @@ static void get_range_config(uint8_t range,
   intensity = g_cfg.effects[idx].intensity;
 }
 
-static CRGB base_color_for_range(uint8_t range) {
-  switch (range) {
-    case 1:
-      return CRGB(0, 0, 60);
-    case 2:
-      return CRGB(20, 0, 60);
-    case 3:
-      return CRGB(40, 0, 60);
-    case 4:
-      return CRGB(60, 0, 40);
-    case 5:
-      return CRGB(60, 0, 20);
-    default:
-      return CRGB(60, 0, 0);
+// Expand a range palette into a 256-entry cyclic LUT: 64 linear steps
+// from each stop to the next, the last stop blending back into the first.
+static void palette_build(const RangePalette &palette, CRGB *lut) {
+  const int span = 256 / PALETTE_STOPS;
+  for (int k = 0; k < PALETTE_STOPS; ++k) {
+    const uint8_t *a = palette.stops[k];
+    const uint8_t *b = palette.stops[(k + 1) % PALETTE_STOPS];
+    for (int j = 0; j < span; ++j) {
+      lut[k * span + j] = CRGB(static_cast<uint8_t>(a[0] + (b[0] - a[0]) * j / span),
+                               static_cast<uint8_t>(a[1] + (b[1] - a[1]) * j / span),
+                               static_cast<uint8_t>(a[2] + (b[2] - a[2]) * j / span));
+    }
+  }
+}
+
+// LUT of the range being rendered; rebuilt only when the range changes or
+// the config is applied. Entry 0 is the range base color.
+static const CRGB *palette_for_range(uint8_t range) {
+  if (palette_lut_range != range) {
+    palette_build(g_cfg.palettes[range - 1], palette_lut);
+    palette_lut_range = range;
+  }
+  return palette_lut;
+}
+
+// fill_rainbow() colors (CHSV(hue, 240, 255)), computed once.
+static const CRGB *rainbow_table() {
+  if (!rainbow_lut_ready) {
+    for (int h = 0; h < 256; ++h) {
+      rainbow_lut[h] = CHSV(static_cast<uint8_t>(h), 240, 255);
+    }
+    rainbow_lut_ready = true;
   }
+  return rainbow_lut;
 }
 
 static void apply_fire(CRGB *leds,
@@ -604,18 +3727,103 @@ static void apply_fire(CRGB *leds,
   (void)speed;
 }
 
+// Trail effects (CHASE..JUGGLE) start each frame by fading the previous one.
+static bool effect_fades(int effect_id) {
+  return effect_id >= 3 && effect_id <= 7;
+}
+
+static uint8_t effect_fade_amount(uint8_t intensity) {
+  return map(255 - intensity, 0, 255, 10, 80);
+}
+
+// Run a user program over leds[start, start + count). Programs are checked
+// by fx_validate() before they are stored, so register fields need no
+// bounds checks here; a/b are masked only because LDI/JZ/JMP reuse them.
+static void fx_run(const FxProgram &prog,
+                   CRGB *leds,
+                   int start,
+                   int count,
+                   const CRGB *palette,
+                   uint8_t speed,
+                   uint8_t intensity,
+                   EffectState &state,
+                   uint32_t dt_ms) {
+  state.pos += dt_ms;
+  int32_t r[FX_REGS] = {0};
+  const CRGB *rainbow = rainbow_table();
+  const int n = prog.op_count;
+  for (int i = 0; i < count; ++i) {
+    CRGB &px = leds[start + i];
+    CRGB out = px;
+    r[0] = i;
+    r[1] = count;
+    r[2] = static_cast<int32_t>(state.pos);
+    r[3] = speed;
+    r[4] = intensity;
+    r[5] = i * 256 / count;
+    r[13] = px.r;
+    r[14] = px.g;
+    r[15] = px.b;
+    for (int pc = 0; pc < n; ++pc) {
+      const uint8_t *ins = &prog.code[pc * 4];
+      int32_t &d = r[ins[1]];
+      // Unsigned so that overflow wraps instead of being undefined.
+      const uint32_t a = static_cast<uint32_t>(r[ins[2] & (FX_REGS - 1)]);
+      const uint32_t b = static_cast<uint32_t>(r[ins[3] & (FX_REGS - 1)]);
+      const int32_t sa = static_cast<int32_t>(a);
+      const int32_t sb = static_cast<int32_t>(b);
+      switch (ins[0]) {
+        case FX_LDI: d = static_cast<int16_t>(ins[2] | (ins[3] << 8)); break;
+        case FX_MOV: d = sa; break;
+        case FX_ADD: d = static_cast<int32_t>(a + b); break;
+        case FX_SUB: d = static_cast<int32_t>(a - b); break;
+        case FX_MUL: d = static_cast<int32_t>(a * b); break;
+        case FX_DIV: d = (sb == 0 || (sb == -1 && sa == INT32_MIN)) ? 0 : sa / sb; break;
+        case FX_MOD: d = (sb == 0 || sb == -1) ? 0 : sa % sb; break;
+        case FX_AND: d = static_cast<int32_t>(a & b); break;
+        case FX_OR: d = static_cast<int32_t>(a | b); break;
+        case FX_XOR: d = static_cast<int32_t>(a ^ b); break;
+        case FX_SHL: d = static_cast<int32_t>(a << (b & 31)); break;
+        case FX_SHR: d = sa >> (b & 31); break;
+        case FX_MIN: d = min(sa, sb); break;
+        case FX_MAX: d = max(sa, sb); break;
+        case FX_SIN: d = sin8(static_cast<uint8_t>(a)); break;
+        case FX_RND: d = random8(); break;
+        case FX_SLT: d = (sa < sb) ? 1 : 0; break;
+        case FX_JZ: pc += (d == 0) ? ins[2] : 0; break;
+        case FX_JMP: pc += ins[2]; break;
+        case FX_RGB: out = CRGB(clamp_u8(d), clamp_u8(sa), clamp_u8(sb)); break;
+        case FX_PAL: out = palette[static_cast<uint8_t>(d)]; break;
+        case FX_HUE: out = rainbow[static_cast<uint8_t>(d)]; break;
+        case FX_SCALE: out.nscale8(clamp_u8(d)); break;
+        default: pc = n; break; // FX_END
+      }
+    }
+    px = out;
+  }
+}
+
+// Render one effect frame dt_ms after the previous one into
+// leds[start, start + count). When prefaded is true the caller already
+// applied the trail fade for dt_ms (shared across strips).
 static void apply_effect(int effect_id,
                          CRGB *leds,
                          uint8_t *heat,
                          int start,
                          int count,
-                         const CRGB &base,
+                         const CRGB *palette,
                          uint8_t speed,
                          uint8_t intensity,
-                         EffectState &state) {
-  const uint8_t fade_amt = map(255 - intensity, 0, 255, 10, 80);
+                         EffectState &state,
+                         uint32_t dt_ms,
+                         bool prefaded) {
   const uint8_t bpm = map(speed, 0, 255, 10, 90);
+  const CRGB &base = palette[0];
 
+  trace_event(TRACE_EFFECT_RENDER, TRACE_BEGIN, static_cast<uint16_t>(effect_id));
+  if (effect_fades(effect_id) && !prefaded) {
+    fade_range(leds, start, count, fade_for_dt(effect_fade_amount(intensity), dt_ms));
+  }
   switch (effect_id) {
     case 0: // SOLID
       fill_range(leds, start, count, base);
@@ -635,64 +3843,126 @@ static void apply_effect(int effect_id,
       break;
     }
     case 3: { // CHASE
-      fade_range(leds, start, count, fade_amt);
-      state.pos = (state.pos + step_from_speed(speed, 32)) % count;
-      leds[start + state.pos] = base;
+      state.pos = (state.pos + effect_advance(state, step_from_speed(speed, 32), dt_ms)) %
+                  (static_cast<uint32_t>(count) << 8);
+      draw_aa(leds, start, count, state.pos, base);
       break;
     }
     case 4: { // COMET
-      fade_range(leds, start, count, fade_amt);
-      state.pos = (state.pos + step_from_speed(speed, 24)) % count;
-      leds[start + state.pos] = base;
+      state.pos = (state.pos + effect_advance(state, step_from_speed(speed, 24), dt_ms)) %
+                  (static_cast<uint32_t>(count) << 8);
+      draw_aa(leds, start, count, state.pos, base);
       break;
     }
     case 5: { // SINELON
-      fade_range(leds, start, count, fade_amt);
-      const int pos = start + beatsin16(bpm, 0, count - 1);
-      leds[pos] = base;
+      draw_aa(leds, start, count, beatsin16(bpm, 0, (count - 1) * 256), base);
       break;
     }
     case 6: { // CONFETTI
-      fade_range(leds, start, count, fade_amt);
-      const int pos = start + random16(count);
-      leds[pos] += base;
+      // One spark per LED_UPDATE_MS of elapsed time, whatever the frame rate.
+      state.tick_ms += dt_ms;
+      while (state.tick_ms >= LED_UPDATE_MS) {
+        state.tick_ms -= LED_UPDATE_MS;
+        leds[start + random16(count)] += palette[random8()];
+      }
       break;
     }
     case 7: { // JUGGLE
-      fade_range(leds, start, count, fade_amt);
       for (uint8_t i = 0; i < 4; ++i) {
-        leds[start + beatsin16(bpm + i * 2, 0, count - 1)] |= base;
+        draw_aa(leds, start, count, beatsin16(bpm + i * 2, 0, (count - 1) * 256), palette[i * 64]);
       }
       break;
     }
     case 8: { // BPM
       const uint8_t beat = beatsin8(bpm, 64, 255);
-      for (int i = start; i < start + count; ++i) {
-        leds[i] = base;
-        leds[i].nscale8(beat);
-      }
+      CRGB c = base;
+      c.nscale8(beat);
+      fill_range(leds, start, count, c);
       break;
     }
     case 9: { // RAINBOW
-      state.hue += step_from_speed(speed, 16);
-      fill_rainbow(&leds[start], count, state.hue, 7);
+      state.hue += effect_advance(state, step_from_speed(speed, 16), dt_ms);
+      const CRGB *rainbow = rainbow_table();
+      for (int i = 0; i < count; ++i) {
+        leds[start + i] = rainbow[static_cast<uint8_t>((state.hue >> 8) + i * 7)];
+      }
       break;
     }
     case 10: // FIRE
-      apply_fire(leds, heat, start, count, intensity, speed);
+      // The heat simulation runs at a fixed LED_UPDATE_MS step.
+      state.tick_ms += dt_ms;
+      while (state.tick_ms >= LED_UPDATE_MS) {
+        state.tick_ms -= LED_UPDATE_MS;
+        apply_fire(leds, heat, start, count, intensity, speed);
+      }
       break;
     case 11: { // GRADIENT_WAVE
-      state.hue += step_from_speed(speed, 24);
+      state.hue += effect_advance(state, step_from_speed(speed, 24), dt_ms);
       for (int i = start; i < start + count; ++i) {
-        const uint8_t offset = (state.hue + (i * 8));
-        leds[i] = CHSV(offset, 200, 255);
+        leds[i] = palette[static_cast<uint8_t>((state.hue >> 8) + (i * 8))];
       }
       break;
     }
     default:
-      fill_range(leds, start, count, base);
+      if (effect_id >= FX_EFFECT_BASE && effect_id <= FX_EFFECT_MAX &&
+          fx_programs[effect_id - FX_EFFECT_BASE].op_count > 0) {
+        fx_run(fx_programs[effect_id - FX_EFFECT_BASE], leds, start, count, palette, speed, intensity,
+               state, dt_ms);
+      } else {
+        fill_range(leds, start, count, base);
+      }
       break;
   }
+  trace_event(TRACE_EFFECT_RENDER, TRACE_END, static_cast<uint16_t>(effect_id));
+}
+
+// Assign every body segment to a render slot for the current effects.
+// Segments with the same effect and length share a slot.
+static void led_plan_renders(int effect_a, int effect_b) {
+  render_slot_count = 0;
+  render_pixel_count = 0;
+  for (int i = 0; i < led_segment_count; ++i) {
+    const LedSegment &seg = led_segments[i];
+    if (seg.role != SEG_BODY) {
+      continue;
+    }
+    const int effect_id = (seg.channel == 0) ? effect_a : effect_b;
+    int slot = 0;
+    while (slot < render_slot_count &&
+           !(render_slots[slot].effect_id == effect_id && render_slots[slot].count == seg.count)) {
+      slot++;
+    }
+    if (slot == render_slot_count) {
+      render_slots[slot] = {static_cast<int8_t>(effect_id), seg.count, static_cast<uint16_t>(render_pixel_count)};
+      render_pixel_count += seg.count;
+      render_slot_count++;
+    }
+    segment_slot[i] = static_cast<uint8_t>(slot);
+  }
+  planned_effect_a = effect_a;
+  planned_effect_b = effect_b;
+}
+
+static void blit_segment(const LedSegment &seg, const CRGB *src) {
+  CRGB *dst = &leds_frame[strip_offset[seg.strip] + seg.start];
+  if (seg.flags & SEG_MIRROR) {
+    for (int i = 0; i < seg.count; ++i) {
+      dst[i] = src[seg.count - 1 - i];
+    }
+  } else {
+    memcpy(dst, src, seg.count * sizeof(CRGB));
+  }
+}
+
+// Next frame period: as fast as LED_FRAME_MIN_MS while the body animates
+// and the last frame took under a quarter of the period, never slower than
+// LED_UPDATE_MS; LED_FRAME_IDLE_MS when only status patterns are shown.
+static unsigned long led_next_frame_ms(bool body_on) {
+  if (!body_on) {
+    return LED_FRAME_IDLE_MS;
+  }
+  const unsigned long budget_ms = (led_stats.last_frame_us * 4) / 1000 + 1;
+  return constrain(budget_ms, LED_FRAME_MIN_MS, LED_UPDATE_MS);
 }
 
 static void update_led_ui() {
@@ -700,14 +3970,24 @@ static void update_led_ui() {
     return;
   }
   const unsigned long now_ms = millis();
-  if (now_ms - last_led_update_ms < LED_UPDATE_MS) {
+  if (now_ms - last_led_update_ms < led_frame_ms) {
     return;
   }
+  const uint32_t gap_ms = static_cast<uint32_t>(now_ms - last_led_update_ms);
+  if (led_stats.frames > 0) {
+    led_stats.max_gap_ms = max(led_stats.max_gap_ms, gap_ms);
+    if (gap_ms > 2 * max(led_frame_ms, LED_UPDATE_MS)) {
+      led_stats.late++;
+    }
+  }
+  const uint32_t dt_ms = (led_stats.frames > 0) ? min<uint32_t>(gap_ms, LED_FRAME_MAX_DT_MS) : LED_UPDATE_MS;
+  led_stats.frames++;
+  led_stats.frame_start_us = max<uint32_t>(1, static_cast<uint32_t>(micros()));
   last_led_update_ms = now_ms;
 
   const bool gps_ok = has_gps_fix;
   const bool sta_ok = (wifi_sta_connected && WiFi.status() == WL_CONNECTED);
-  const bool sta_try = (!sta_ok && wifi_ssid.length() > 0 && WiFi.getMode() == WIFI_STA);
+  const bool sta_try = (!sta_ok && wifi_ssid[0] != '\0' && WiFi.getMode() == WIFI_STA);
   const bool ap_mode = (WiFi.getMode() == WIFI_AP);
 
   if (gps_ok || sta_ok) {
@@ -715,6 +3995,10 @@ static void update_led_ui() {
   }
 
   const bool critical_error = (!gps_ok && !sta_ok && (now_ms - last_ok_ms) > CRITICAL_NO_OK_MS);
+  if (led_preview_range != 0 && static_cast<int32_t>(now_ms - led_preview_until_ms) >= 0) {
+    led_preview_range = 0;
+  }
+  const bool preview = (led_preview_range != 0);
 
   uint8_t r = 0;
   uint8_t g = 0;
@@ -730,19 +4014,17 @@ static void update_led_ui() {
     scale = (now_ms / 200) % 2 ? 1.0f : 0.0f;
     full_override = true;
     full_r = clamp_u8(static_cast<int>(60 * scale));
-  } else if (!sta_ok && wifi_ssid.length() > 0 && ap_mode) {
+  } else if (!sta_ok && wifi_ssid[0] != '\0' && ap_mode) {
     full_override = true;
     full_r = 60;
     full_g = 0;
     full_b = 0;
   }
 
-  if (full_override) {
-    fill_solid(leds_a, LED_STRIP_COUNT, CRGB(full_r, full_g, full_b));
-    if (LED_STRIP_MODE == 2) {
-      fill_solid(leds_b, LED_STRIP_COUNT, CRGB(full_r, full_g, full_b));
-    }
-    FastLED.show();
+  if (full_override && !preview) {
+    px_fill(leds_frame, led_pixel_count, CRGB(full_r, full_g, full_b));
+    led_frame_ms = led_next_frame_ms(false);
+    led_show();
     return;
   }
 
@@ -770,38 +4052,590 @@ static void update_led_ui() {
     b = clamp_u8(static_cast<int>(60 * scale));
   }
 
-  const bool body_on = gps_ok;
-  const int seg_start = LED_STATUS_COUNT;
-  const int seg_count = LED_STRIP_COUNT - LED_STATUS_COUNT;
-  const uint8_t range = speed_range(last_speed_kph);
+  // Geofence alerts blink the status LEDs: magenta on exit, cyan on enter.
+  if (geo_alert_active(now_ms)) {
+    const uint8_t level = ((now_ms / 250) % 2) ? 60 : 0;
+    r = geo_alert_exit ? level : 0;
+    g = geo_alert_exit ? 0 : level;
+    b = level;
+  }
+
+  const bool body_on = gps_ok || preview;
+  const uint8_t range = preview ? led_preview_range : speed_range(led_speed_kph());
+  led_stream.range = range;
   int effect_a = RANGE_1_EFFECT_A;
   int effect_b = RANGE_1_EFFECT_B;
   uint8_t eff_speed = RANGE_1_SPEED;
   uint8_t eff_intensity = RANGE_1_INTENSITY;
   get_range_config(range, effect_a, effect_b, eff_speed, eff_intensity);
-  const CRGB base = base_color_for_range(range);
+  const CRGB *palette = palette_for_range(range);
+
+  if (body_on) {
+    if (effect_a != planned_effect_a || effect_b != planned_effect_b) {
+      led_plan_renders(effect_a, effect_b);
+    }
+    // Render slots are contiguous in render_buf; when every slot runs a
+    // trail effect their fade is done in one pass.
+    bool shared_fade = (render_slot_count > 0);
+    for (int k = 0; k < render_slot_count; ++k) {
+      shared_fade = shared_fade && effect_fades(render_slots[k].effect_id);
+    }
+    if (shared_fade) {
+      px_fade(render_buf, render_pixel_count, fade_for_dt(effect_fade_amount(eff_intensity), dt_ms));
+    }
+    for (int k = 0; k < render_slot_count; ++k) {
+      const RenderSlot &slot = render_slots[k];
+      apply_effect(slot.effect_id, render_buf, render_heat, slot.offset, slot.count, palette, eff_speed,
+                   eff_intensity, render_state[k], dt_ms, shared_fade);
+    }
+  }
+
+  for (int i = 0; i < led_segment_count; ++i) {
+    const LedSegment &seg = led_segments[i];
+    if (seg.role == SEG_STATUS) {
+      px_fill(&leds_frame[strip_offset[seg.strip] + seg.start], seg.count, CRGB(r, g, b));
+    } else if (body_on) {
+      blit_segment(seg, &render_buf[render_slots[segment_slot[i]].offset]);
+    } else {
+      px_fill(&leds_frame[strip_offset[seg.strip] + seg.start], seg.count, CRGB(0, 0, 0));
+    }
+  }
+  led_frame_ms = led_next_frame_ms(body_on);
+  led_show();
+}
+
+struct SimResult {
+  uint32_t crc;
+  uint32_t render_us;
+};
+
+// Preview stream of sim cases (see sim_stream_step()): the cost, and the
+// encoder's previous frame and output buffer, so that only stream runs
+// hold them.
+struct SimStream {
+  uint32_t frames;
+  uint32_t bytes;       // Encoded frames, binary.
+  uint32_t sse_bytes;   // As sent: base64 plus event framing.
+  uint32_t max_bytes;
+  uint32_t encode_us;
+  CRGB prev[SIM_MAX_LEDS];
+  uint8_t bin[4 + SIM_MAX_LEDS * 5];
+};
+
+// Print one frame as a row of ANSI true-color blocks (one per pixel).
+static void print_sim_frame(const CRGB *leds, int length) {
+  for (int i = 0; i < length; ++i) {
+    Serial.printf("\x1b[48;2;%u;%u;%um  ", leds[i].r, leds[i].g, leds[i].b);
+  }
+  Serial.println("\x1b[0m");
+}
+
+// Speed, intensity and palette of a range for the simulator. They come
+// from the compile-time defaults (config.h), not the live config, so CRCs
+// only change when the effect code or the defaults do.
+static const RangeEffect &sim_range_config(uint8_t range, const CRGB *&palette) {
+  static RuntimeConfig cfg;
+  static bool cfg_ready = false;
+  static CRGB lut[256];
+  static uint8_t lut_range = 0;
+  if (!cfg_ready) {
+    default_config(cfg);
+    cfg_ready = true;
+  }
+  if (lut_range != range) {
+    palette_build(cfg.palettes[range - 1], lut);
+    lut_range = range;
+  }
+  palette = lut;
+  return cfg.effects[range - 1];
+}
+
+// Render SIM_FRAMES x LED_UPDATE_MS of one effect/range/strip-length case
+// from a clean state at the given frame period. The status segment is left
+// black; the CRC covers every frame and on_frame, if set, sees each one.
+// When snaps is set, the frame at every SIM_SNAP_MS boundary is copied
+// there (length pixels each) and trail effects draw without their trail,
+// so a snapshot shows only the instant.
+static SimResult sim_run_case(int effect_id, uint8_t range, int length,
+                              void (*on_frame)(const CRGB *leds, int length) = nullptr,
+                              uint32_t frame_ms = LED_UPDATE_MS, CRGB *snaps = nullptr,
+                              SimStream *stream = nullptr) {
+  CRGB leds[SIM_MAX_LEDS];
+  uint8_t heat[SIM_MAX_LEDS];
+  EffectState state;
+  fill_solid(leds, SIM_MAX_LEDS, CRGB(0, 0, 0));
+  memset(heat, 0, sizeof(heat));
+
+  const CRGB *palette = nullptr;
+  const RangeEffect &cfg = sim_range_config(range, palette);
+  const uint8_t speed = cfg.speed;
+  const uint8_t intensity = cfg.intensity;
+  const int start = min(LED_STATUS_COUNT, length - 1);
+  const int count = length - start;
+
+  random16_set_seed(SIM_SEED);
+  sim_clock_ms = 0;
+  SimResult result = {0, 0};
+  const unsigned long frames = SIM_FRAMES * LED_UPDATE_MS / frame_ms;
+  for (unsigned long f = 0; f < frames; ++f) {
+    sim_clock_ms += frame_ms;
+    const bool heads_only = (snaps != nullptr && effect_fades(effect_id));
+    if (heads_only) {
+      fill_solid(leds, length, CRGB(0, 0, 0));
+    }
+    const unsigned long t0 = micros();
+    apply_effect(effect_id, leds, heat, start, count, palette, speed, intensity, state, frame_ms, heads_only);
+    result.render_us += micros() - t0;
+    result.crc = crc32_update(result.crc, reinterpret_cast<const uint8_t *>(leds), length * sizeof(CRGB));
+    if (stream != nullptr) {
+      const unsigned long t1 = micros();
+      const uint32_t n = led_delta_encode(leds, stream->prev, length, f == 0, range, stream->bin);
+      stream->encode_us += micros() - t1;
+      stream->frames++;
+      stream->bytes += n;
+      stream->sse_bytes += (n > 4 || f == 0) ? 8 + (n + 2) / 3 * 4 : 0;
+      stream->max_bytes = max(stream->max_bytes, n);
+    }
+    if (on_frame != nullptr) {
+      on_frame(leds, length);
+    }
+    if (snaps != nullptr && sim_clock_ms % SIM_SNAP_MS == 0) {
+      memcpy(&snaps[(sim_clock_ms / SIM_SNAP_MS - 1) * length], leds, length * sizeof(CRGB));
+    }
+  }
+  result.render_us = result.render_us * SIM_FRAMES / frames; // render_us / SIM_FRAMES = cost per frame.
+  return result;
+}
+
+// Frame-rate independence: render every effect at each SIM_FPS_PERIODS
+// frame period and compare the frames at common SIM_SNAP_MS timestamps
+// against the LED_UPDATE_MS run; motion, hue and sparks must match exactly
+// (CONFETTI is skipped above LED_UPDATE_MS, where one frame holds several
+// sparks). Trail decay is checked separately: the time a full pixel takes
+// to fade below 32 must be within SIM_FPS_TRAIL_TOLERANCE_PCT of the
+// reference; the per-frame 8-bit fade truncates, so fast rates run short.
+static const uint32_t SIM_FPS_PERIODS[] = {10, 25, 100};
+static const uint32_t SIM_FPS_TRAIL_TOLERANCE_PCT = 25;
+
+static uint32_t sim_trail_ms(uint8_t amount, uint32_t frame_ms) {
+  CRGB px(255, 255, 255);
+  uint32_t t = 0;
+  while (px.r >= 32 && t < 10000) {
+    px_fade(&px, 1, fade_for_dt(amount, frame_ms));
+    t += frame_ms;
+  }
+  return t;
+}
+
+// Sim jobs run one step per loop() pass (one case, or one effect for
+// `sim fps` and `sim stream`) so LED frames, the portal and GNSS keep
+// running during a full pass. Each step renders with sim_active set and
+// the live RNG seed put back afterwards.
+enum SimJobKind : uint8_t {
+  SIM_JOB_NONE = 0,
+  SIM_JOB_CHECK = 1,
+  SIM_JOB_RECORD = 2,
+  SIM_JOB_FPS = 3,
+  SIM_JOB_STREAM = 4,
+};
+
+struct SimJob {
+  uint8_t kind;
+  int step;
+  int failures;
+  uint32_t worst_us;
+  bool has_golden;
+  uint32_t golden[SIM_CASES];
+  uint32_t crcs[SIM_CASES];
+};
+
+static SimJob sim_job;
+
+// Stored with the golden CRCs; bump it whenever the effects' output changes
+// on purpose, so CRCs recorded by older firmware are not reported as FAIL.
+static const uint16_t SIM_GOLDEN_VERSION = 2;
+
+// One effect of the frame-rate check; step SIM_EFFECT_COUNT is the trail check.
+static bool sim_fps_step(int step) {
+  static const int len = SIM_MAX_LEDS;
+  static const int snaps = SIM_FRAMES * LED_UPDATE_MS / SIM_SNAP_MS;
+  static CRGB ref[snaps * len];
+  static CRGB run[snaps * len];
+  if (step < SIM_EFFECT_COUNT) {
+    const int effect_id = step;
+    sim_run_case(effect_id, 3, len, nullptr, LED_UPDATE_MS, ref);
+    for (uint32_t period : SIM_FPS_PERIODS) {
+      if (effect_id == 6 && period > LED_UPDATE_MS) {
+        Serial.printf("sim fps effect=%d frame_ms=%lu skip\n", effect_id, static_cast<unsigned long>(period));
+        continue;
+      }
+      const SimResult r = sim_run_case(effect_id, 3, len, nullptr, period, run);
+      int max_delta = 0;
+      for (int i = 0; i < snaps * len; ++i) {
+        for (int ch = 0; ch < 3; ++ch) {
+          max_delta = max(max_delta, abs(static_cast<int>(ref[i].raw[ch]) - static_cast<int>(run[i].raw[ch])));
+        }
+      }
+      const bool ok = (max_delta == 0);
+      sim_job.failures += ok ? 0 : 1;
+      Serial.printf("sim fps effect=%d frame_ms=%lu max_delta=%d us_per_frame=%lu %s\n", effect_id,
+                    static_cast<unsigned long>(period), max_delta,
+                    static_cast<unsigned long>(r.render_us / SIM_FRAMES),
+                    ok ? "ok" : "FAIL");
+    }
+    return false;
+  }
+  for (uint8_t range = 1; range <= 6; ++range) {
+    const CRGB *palette = nullptr;
+    const uint8_t amount = effect_fade_amount(sim_range_config(range, palette).intensity);
+    const uint32_t ref_ms = sim_trail_ms(amount, LED_UPDATE_MS);
+    for (uint32_t period : SIM_FPS_PERIODS) {
+      const uint32_t trail_ms = sim_trail_ms(amount, period);
+      const uint32_t delta_ms = (trail_ms > ref_ms) ? trail_ms - ref_ms : ref_ms - trail_ms;
+      const bool ok = delta_ms * 100 <= ref_ms * SIM_FPS_TRAIL_TOLERANCE_PCT;
+      sim_job.failures += ok ? 0 : 1;
+      Serial.printf("sim fps trail range=%u amount=%u frame_ms=%lu trail_ms=%lu ref_ms=%lu %s\n", range, amount,
+                    static_cast<unsigned long>(period), static_cast<unsigned long>(trail_ms),
+                    static_cast<unsigned long>(ref_ms), ok ? "ok" : "FAIL");
+    }
+  }
+  Serial.printf("sim fps done: failures=%d\n", sim_job.failures);
+  return true;
+}
+
+// One effect x range x strip length case, compared against the golden CRCs
+// stored in NVS (or recorded into them after the last case).
+static bool sim_case_step(int step) {
+  const bool record = (sim_job.kind == SIM_JOB_RECORD);
+  const int effect_id = step / (6 * SIM_LENGTH_COUNT);
+  const uint8_t range = static_cast<uint8_t>(step / SIM_LENGTH_COUNT % 6 + 1);
+  const int length = SIM_STRIP_LENGTHS[step % SIM_LENGTH_COUNT];
+  const SimResult r = sim_run_case(effect_id, range, length);
+  sim_job.crcs[step] = r.crc;
+  const char *status = "none";
+  if (record) {
+    status = "saved";
+  } else if (sim_job.has_golden) {
+    status = (sim_job.golden[step] == r.crc) ? "ok" : "FAIL";
+    if (sim_job.golden[step] != r.crc) {
+      sim_job.failures++;
+    }
+  }
+  const uint32_t frame_us = r.render_us / SIM_FRAMES;
+  sim_job.worst_us = max(sim_job.worst_us, frame_us);
+  Serial.printf("sim effect=%d range=%u len=%d crc=%08lx us_per_frame=%lu %s\n",
+                effect_id, range, length,
+                static_cast<unsigned long>(r.crc),
+                static_cast<unsigned long>(frame_us), status);
+  if (step + 1 < SIM_CASES) {
+    return false;
+  }
+  if (record) {
+    prefs_sim.putBytes("golden", sim_job.crcs, sizeof(sim_job.crcs));
+    prefs_sim.putUShort("golden_v", SIM_GOLDEN_VERSION);
+  }
+  Serial.printf("sim done: cases=%d failures=%d worst_us_per_frame=%lu%s\n",
+                SIM_CASES, sim_job.failures, static_cast<unsigned long>(sim_job.worst_us),
+                (!record && !sim_job.has_golden) ? " (no golden for this firmware, run 'sim golden')" : "");
+  return true;
+}
+
+// Preview stream size of one effect: every range at full strip length, with
+// each frame delta-encoded against the previous one as led_stream_poll()
+// does (first frame is a key frame; unchanged frames send nothing).
+static bool sim_stream_step(int effect_id) {
+  SimStream s = {};
+  for (uint8_t range = 1; range <= 6; ++range) {
+    sim_run_case(effect_id, range, SIM_MAX_LEDS, nullptr, LED_UPDATE_MS, nullptr, &s);
+  }
+  Serial.printf("sim stream effect=%d len=%d raw_bytes=%d avg_bytes=%.1f max_bytes=%lu sse_bytes=%.1f "
+                "encode_us=%.1f\n",
+                effect_id, SIM_MAX_LEDS, SIM_MAX_LEDS * 3, s.bytes / static_cast<float>(s.frames),
+                static_cast<unsigned long>(s.max_bytes), s.sse_bytes / static_cast<float>(s.frames),
+                s.encode_us / static_cast<float>(s.frames));
+  return effect_id + 1 >= SIM_EFFECT_COUNT;
+}
+
+static void sim_start(SimJobKind kind) {
+  if (sim_job.kind != SIM_JOB_NONE) {
+    Serial.println("sim busy");
+    return;
+  }
+  sim_job.kind = kind;
+  sim_job.step = 0;
+  sim_job.failures = 0;
+  sim_job.worst_us = 0;
+  sim_job.has_golden = (kind == SIM_JOB_CHECK) && prefs_sim.getUShort("golden_v", 0) == SIM_GOLDEN_VERSION &&
+                       prefs_sim.getBytes("golden", sim_job.golden, sizeof(sim_job.golden)) == sizeof(sim_job.golden);
+}
+
+static void sim_poll() {
+  if (sim_job.kind == SIM_JOB_NONE) {
+    return;
+  }
+  const uint16_t saved_seed = random16_get_seed();
+  sim_active = true;
+  bool done = true;
+  if (sim_job.kind == SIM_JOB_CHECK || sim_job.kind == SIM_JOB_RECORD) {
+    done = sim_case_step(sim_job.step);
+  } else if (sim_job.kind == SIM_JOB_FPS) {
+    done = sim_fps_step(sim_job.step);
+  } else if (sim_job.kind == SIM_JOB_STREAM) {
+    done = sim_stream_step(sim_job.step);
+  }
+  sim_active = false;
+  random16_set_seed(saved_seed);
+  sim_job.step++;
+  if (done) {
+    sim_job.kind = SIM_JOB_NONE;
+  }
+}
+
+// Print the frames of a single case to the terminal.
+static void sim_show(int effect_id, int range, int length) {
+  if (effect_id < 0 || effect_id >= SIM_EFFECT_COUNT || range < 1 || range > 6 ||
+      length < 2 || length > SIM_MAX_LEDS) {
+    Serial.println("usage: sim show <effect 0-11> <range 1-6> <len 2-50>");
+    return;
+  }
+  const uint16_t saved_seed = random16_get_seed();
+  sim_active = true;
+  const SimResult r = sim_run_case(effect_id, static_cast<uint8_t>(range), length, print_sim_frame);
+  sim_active = false;
+  random16_set_seed(saved_seed);
+  Serial.printf("crc=%08lx us_per_frame=%lu\n", static_cast<unsigned long>(r.crc),
+                static_cast<unsigned long>(r.render_us / SIM_FRAMES));
+}
+
+// Pixel kernel benchmark at 2 x 50 LEDs. Each kernel is checked bit-exact
+// against FastLED's per-pixel operation for every amount (and unaligned
+// starts), and the average cost per frame is reported.
+static const int BENCH_LEDS = 2 * 50;
+
+enum BenchOp : uint8_t {
+  BENCH_FADE = 0,
+  BENCH_SCALE = 1,
+  BENCH_FILL = 2,
+};
+
+static void bench_pixel_op(BenchOp op, const char *name) {
+  alignas(4) static CRGB ref[BENCH_LEDS];
+  alignas(4) static CRGB fast[BENCH_LEDS];
+  uint32_t scalar_cycles = 0;
+  uint32_t kernel_cycles = 0;
+  uint32_t mismatches = 0;
+
+  for (int amount = 0; amount < 256; ++amount) {
+    for (int i = 0; i < BENCH_LEDS; ++i) {
+      ref[i] = CRGB(random8(), random8(), random8());
+      fast[i] = ref[i];
+    }
+    const uint8_t a = static_cast<uint8_t>(amount);
+    const CRGB color(a, static_cast<uint8_t>(255 - a), static_cast<uint8_t>(a * 7));
+    const int offset = amount & 3;
+    const int count = BENCH_LEDS - offset;
+
+    uint32_t t0 = ESP.getCycleCount();
+    for (int i = offset; i < BENCH_LEDS; ++i) {
+      if (op == BENCH_FADE) {
+        ref[i].fadeToBlackBy(a);
+      } else if (op == BENCH_SCALE) {
+        ref[i].nscale8(a);
+      } else {
+        ref[i] = color;
+      }
+    }
+    scalar_cycles += ESP.getCycleCount() - t0;
+
+    t0 = ESP.getCycleCount();
+    if (op == BENCH_FADE) {
+      px_fade(&fast[offset], count, a);
+    } else if (op == BENCH_SCALE) {
+      px_scale(&fast[offset], count, a);
+    } else {
+      px_fill(&fast[offset], count, color);
+    }
+    kernel_cycles += ESP.getCycleCount() - t0;
+
+    if (memcmp(ref, fast, sizeof(ref)) != 0) {
+      mismatches++;
+    }
+  }
+
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  Serial.printf("bench %s leds=%d scalar_us=%.2f kernel_us=%.2f mismatches=%lu\n",
+                name, BENCH_LEDS,
+                scalar_cycles / 256.0f / mhz,
+                kernel_cycles / 256.0f / mhz,
+                static_cast<unsigned long>(mismatches));
+}
+
+// GRADIENT_WAVE per-frame color cost at 2 x 50 LEDs: the former CHSV
+// conversion per pixel against one palette LUT load, plus the LUT rebuild
+// that runs when the range or config changes.
+static void bench_palette() {
+  alignas(4) static CRGB out[BENCH_LEDS];
+  static CRGB lut[256];
+  const int frames = 256;
+  uint32_t hsv_cycles = 0;
+  uint32_t lut_cycles = 0;
+  uint32_t t0 = ESP.getCycleCount();
+  palette_build(g_cfg.palettes[3], lut);
+  const uint32_t build_cycles = ESP.getCycleCount() - t0;
+  uint32_t sink = 0;
+
+  for (int f = 0; f < frames; ++f) {
+    const uint8_t hue = static_cast<uint8_t>(f);
+    t0 = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_LEDS; ++i) {
+      out[i] = CHSV(static_cast<uint8_t>(hue + i * 8), 200, 255);
+    }
+    hsv_cycles += ESP.getCycleCount() - t0;
+    sink += out[BENCH_LEDS - 1].r;
+
+    t0 = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_LEDS; ++i) {
+      out[i] = lut[static_cast<uint8_t>(hue + i * 8)];
+    }
+    lut_cycles += ESP.getCycleCount() - t0;
+    sink += out[BENCH_LEDS - 1].r;
+  }
+
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  Serial.printf("bench palette leds=%d hsv_us=%.2f lut_us=%.2f build_us=%.2f (%lu)\n",
+                BENCH_LEDS,
+                hsv_cycles / static_cast<float>(frames) / mhz,
+                lut_cycles / static_cast<float>(frames) / mhz,
+                build_cycles / static_cast<float>(mhz),
+                static_cast<unsigned long>(sink & 1));
+}
+
+// Sample programs for `fx bench`: a palette gradient moving with speed
+// (like GRADIENT_WAVE) and a hue ramp with a travelling sine brightness.
+static const uint8_t FX_BENCH_WAVE[] = {
+    FX_LDI, 6, 3, 0,         // r6 = 3
+    FX_SHL, 7, 0, 6,         // r7 = i * 8
+    FX_MUL, 8, 2, 3,         // r8 = t * speed
+    FX_LDI, 9, 0xB0, 0x04,   // r9 = 1200
+    FX_DIV, 8, 8, 9,         // r8 = t * speed / 1200
+    FX_ADD, 7, 7, 8,         // r7 += r8
+    FX_PAL, 7, 0, 0,
+    FX_END, 0, 0, 0,
+};
+static const uint8_t FX_BENCH_SINE[] = {
+    FX_LDI, 6, 4, 0,         // r6 = 4
+    FX_SHL, 7, 0, 6,         // r7 = i * 16
+    FX_SHR, 8, 2, 6,         // r8 = t / 16
+    FX_SUB, 7, 7, 8,         // r7 -= r8
+    FX_SIN, 7, 7, 0,         // r7 = sin8(r7)
+    FX_ADD, 9, 5, 8,         // r9 = position + t / 16
+    FX_HUE, 9, 0, 0,
+    FX_SCALE, 7, 0, 0,
+    FX_END, 0, 0, 0,
+};
+
+// Render cost per frame at 2 x 50 LEDs of every built-in effect against the
+// interpreter running the sample programs and a worst-case program of
+// FX_PROGRAM_MAX_OPS ADDs, with the share of a 20 ms (50 fps) frame.
+static void bench_fx() {
+  alignas(4) static CRGB out[BENCH_LEDS];
+  static uint8_t heat[BENCH_LEDS];
+  static FxProgram progs[3];
+  const char *const names[3] = {"fx_wave", "fx_sine", "fx_worst"};
+  memset(progs, 0, sizeof(progs));
+  memcpy(progs[0].code, FX_BENCH_WAVE, sizeof(FX_BENCH_WAVE));
+  progs[0].op_count = sizeof(FX_BENCH_WAVE) / 4;
+  memcpy(progs[1].code, FX_BENCH_SINE, sizeof(FX_BENCH_SINE));
+  progs[1].op_count = sizeof(FX_BENCH_SINE) / 4;
+  for (int pc = 0; pc < FX_PROGRAM_MAX_OPS; ++pc) {
+    uint8_t *ins = &progs[2].code[pc * 4];
+    ins[0] = FX_ADD;
+    ins[1] = 6;
+    ins[2] = 6;
+    ins[3] = 0;
+  }
+  progs[2].op_count = FX_PROGRAM_MAX_OPS;
 
-  if (body_on && seg_count > 0) {
-    apply_effect(effect_a, leds_a, heat_a, seg_start, seg_count, base, eff_speed, eff_intensity, state_a);
-    if (LED_STRIP_MODE == 2) {
-      apply_effect(effect_b, leds_b, heat_b, seg_start, seg_count, base, eff_speed, eff_intensity, state_b);
+  const CRGB *palette = palette_for_range(4);
+  const int frames = 64;
+  const uint32_t dt_ms = 20;
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  for (int k = 0; k < SIM_EFFECT_COUNT + 3; ++k) {
+    EffectState state;
+    fill_solid(out, BENCH_LEDS, CRGB(0, 0, 0));
+    memset(heat, 0, sizeof(heat));
+    uint32_t cycles = 0;
+    for (int f = 0; f < frames; ++f) {
+      const uint32_t t0 = ESP.getCycleCount();
+      if (k < SIM_EFFECT_COUNT) {
+        apply_effect(k, out, heat, 0, BENCH_LEDS, palette, 128, 128, state, dt_ms, false);
+      } else {
+        fx_run(progs[k - SIM_EFFECT_COUNT], out, 0, BENCH_LEDS, palette, 128, 128, state, dt_ms);
+      }
+      cycles += ESP.getCycleCount() - t0;
     }
-  } else if (seg_count > 0) {
-    fill_range(leds_a, seg_start, seg_count, CRGB(0, 0, 0));
-    if (LED_STRIP_MODE == 2) {
-      fill_range(leds_b, seg_start, seg_count, CRGB(0, 0, 0));
+    const float us = cycles / static_cast<float>(frames) / mhz;
+    if (k < SIM_EFFECT_COUNT) {
+      Serial.printf("bench fx effect=%d leds=%d us=%.1f frame_pct=%.2f\n", k, BENCH_LEDS, us, us / 200.0f);
+    } else {
+      const FxProgram &p = progs[k - SIM_EFFECT_COUNT];
+      Serial.printf("bench fx %s ops=%u leds=%d us=%.1f ns_per_op=%.1f frame_pct=%.2f\n",
+                    names[k - SIM_EFFECT_COUNT], p.op_count, BENCH_LEDS, us,
+                    us * 1000.0f / (BENCH_LEDS * p.op_count), us / 200.0f);
     }
   }
+}
 
-  fill_range(leds_a, 0, LED_STATUS_COUNT, CRGB(r, g, b));
-  if (LED_STRIP_MODE == 2) {
-    fill_range(leds_b, 0, LED_STATUS_COUNT, CRGB(r, g, b));
+// RGB against RGBW packing on the live layout: pack time, and full-duty
+// current of the status white, the status yellow and each range palette
+// spread over the strips. Both wire formats are packed from a scratch frame
+// into a scratch wire buffer, so the shown frame and the bytes the
+// controllers send are left alone.
+static void bench_rgbw() {
+  static const char *const names[] = {"white", "yellow", "range1", "range2", "range3", "range4", "range5", "range6"};
+  static CRGB lut[256];
+  alignas(4) static CRGB frame[LED_MAX_PIXELS];
+  alignas(4) static CRGB wire[LED_MAX_STRIPS * LED_WIRE_PER_STRIP];
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  for (int k = 0; k < 8; ++k) {
+    if (k == 0) {
+      fill_solid(frame, led_pixel_count, CRGB(60, 60, 60));
+    } else if (k == 1) {
+      fill_solid(frame, led_pixel_count, CRGB(60, 45, 0));
+    } else {
+      palette_build(g_cfg.palettes[k - 2], lut);
+      for (int i = 0; i < led_pixel_count; ++i) {
+        frame[i] = lut[i * 256 / led_pixel_count];
+      }
+    }
+    PixelSums sums[2];
+    uint32_t cycles[2];
+    for (int mode = 0; mode < 2; ++mode) {
+      const uint32_t t0 = ESP.getCycleCount();
+      led_pack(frame, wire, mode != 0, sums[mode]);
+      cycles[mode] = ESP.getCycleCount() - t0;
+    }
+    const uint32_t rgb_ua = pixel_sums_ua(sums[0]);
+    const uint32_t rgbw_ua = pixel_sums_ua(sums[1]);
+    Serial.printf("bench rgbw %s leds=%d white_k=%u rgb_ma=%lu rgbw_ma=%lu saved_ma=%lu saved_pct=%.0f "
+                  "pack_rgb_us=%.1f pack_rgbw_us=%.1f\n",
+                  names[k], led_pixel_count, g_cfg.white_k,
+                  static_cast<unsigned long>(rgb_ua / 1000), static_cast<unsigned long>(rgbw_ua / 1000),
+                  static_cast<unsigned long>(pixel_sums_saved_ua(sums[1]) / 1000),
+                  rgb_ua > 0 ? 100.0f * (rgb_ua - min(rgb_ua, rgbw_ua)) / rgb_ua : 0.0f,
+                  cycles[0] / static_cast<float>(mhz), cycles[1] / static_cast<float>(mhz));
   }
-  FastLED.show();
 }
 
-static String html_config_page() {
-  return String(
+static void run_benchmarks() {
+  bench_pixel_op(BENCH_FADE, "fade");
+  bench_pixel_op(BENCH_SCALE, "scale");
+  bench_pixel_op(BENCH_FILL, "fill");
+  bench_palette();
+  bench_rgbw();
+}
+
+static const char HTML_CONFIG[] PROGMEM =
       "<!doctype html><html><head><meta charset='utf-8'>"
       "<meta name='viewport' content='width=device-width,initial-scale=1'>"
       "<title>Config</title>"
@@ -809,9 +4643,24 @@ static String html_config_page() {
       "input{width:100%;padding:8px;margin:4px 0}"
       ".row{display:grid;grid-template-columns:1fr 1fr;gap:10px}"
       "button{padding:10px 14px;border:0;border-radius:6px;background:#111;color:#fff}"
+      ".pal input{width:22%;height:28px;padding:0}"
+      "#leds span{display:inline-block;width:10px;height:10px;margin:1px;border-radius:50%;background:#000}"
       "</style></head><body>"
       "<h1>Config</h1>"
+      "<div class='row'>"
       "<div><label>Brightness</label><input id='brightness' type='number' min='1' max='255'></div>"
+      "<div><label>Limite LEDs (mA, 0 = sin limite)</label><input id='power_ma' type='number' min='0' max='5000'></div>"
+      "</div>"
+      "<h3>Tiras LED</h3>"
+      "<div class='row'>"
+      "<div><label>LEDs por tira (ej. 20,20)</label><input id='strips' type='text'></div>"
+      "<div><label>LEDs de estado</label><input id='status_n' type='number' min='0' max='49'></div>"
+      "</div>"
+      "<div><label><input id='mirror' type='checkbox'> Cuerpo en mitades espejo</label></div>"
+      "<div class='row'>"
+      "<div><label><input id='rgbw' type='checkbox'> LEDs RGBW (SK6812 con blanco)</label></div>"
+      "<div><label>Temperatura del blanco (K)</label><input id='white_k' type='number' min='2000' max='10000' step='100'></div>"
+      "</div>"
       "<h3>Speed ranges (kph)</h3>"
       "<div class='row'>"
       "<input id='r1' type='number' step='0.1'><input id='r2' type='number' step='0.1'>"
@@ -820,6 +4669,13 @@ static String html_config_page() {
       "</div>"
       "<h3>Effects (range 1-6)</h3>"
       "<div id='effects'></div>"
+      "<h3>Vista previa LEDs</h3>"
+      "<div class='row'>"
+      "<select id='prev_r'><option value='0'>En vivo</option><option>1</option><option>2</option>"
+      "<option>3</option><option>4</option><option>5</option><option>6</option></select>"
+      "<div><button onclick='prevStart()'>Ver</button> <button onclick='prevStop()'>Parar</button></div>"
+      "</div>"
+      "<div id='leds'></div><p id='prev_info' style='font-size:12px;color:#666'></p>"
       "<h3>Wi-Fi AP</h3>"
       "<div><label>SSID</label><input id='ap_ssid' type='text'></div>"
       "<div><label>Password</label><input id='ap_pass' type='password' placeholder='(sin cambio)'></div>"
@@ -827,21 +4683,33 @@ static String html_config_page() {
       "<div id='ap_hint' style='font-size:12px;color:#666'></div>"
       "<div id='ap_warn' style='font-size:12px;color:#b00'></div>"
       "<div><label>mDNS</label><input id='mdns' type='text'></div>"
+      "<h3>Subida a servidor</h3>"
+      "<div><label>URL</label><input id='upload_url' type='text' placeholder='http://192.168.1.10:8080/dogrgb'></div>"
       "<button onclick='saveCfg()'>Guardar</button> "
       "<button onclick='resetCfg()'>Restaurar defaults</button>"
       "<p id='status'></p>"
       "<p><a href='/'>Volver</a></p>"
-      "<script>"
-      "const effectsDiv=document.getElementById('effects');"
+      "<script>var CFG=";
+
+static const char HTML_CONFIG_SCRIPT[] PROGMEM =
+      ";const effectsDiv=document.getElementById('effects');"
       "for(let i=1;i<=6;i++){"
       "effectsDiv.innerHTML+=`<div class='row'>"
-      "<input id='e${i}a' type='number' min='0' max='11' placeholder='R${i} A'>"
-      "<input id='e${i}b' type='number' min='0' max='11' placeholder='R${i} B'>"
+      "<input id='e${i}a' type='number' min='0' max='15' placeholder='R${i} A'>"
+      "<input id='e${i}b' type='number' min='0' max='15' placeholder='R${i} B'>"
       "<input id='e${i}s' type='number' min='0' max='255' placeholder='R${i} Speed'>"
       "<input id='e${i}i' type='number' min='0' max='255' placeholder='R${i} Intensity'>"
-      "</div>`;}"
-      "fetch('/api/config').then(r=>r.json()).then(c=>{"
+      "</div><div class='pal'>R${i} "
+      "<input id='e${i}p0' type='color'><input id='e${i}p1' type='color'>"
+      "<input id='e${i}p2' type='color'><input id='e${i}p3' type='color'></div>`;}"
+      "(c=>{"
       "document.getElementById('brightness').value=c.led.brightness;"
+      "document.getElementById('power_ma').value=c.led.power_budget_ma;"
+      "document.getElementById('strips').value=c.led.strips.join(',');"
+      "document.getElementById('status_n').value=c.led.status;"
+      "document.getElementById('mirror').checked=c.led.mirror;"
+      "document.getElementById('rgbw').checked=c.led.rgbw;"
+      "document.getElementById('white_k').value=c.led.white_k;"
       "document.getElementById('r1').value=c.speed_ranges_kph[0];"
       "document.getElementById('r2').value=c.speed_ranges_kph[1];"
       "document.getElementById('r3').value=c.speed_ranges_kph[2];"
@@ -853,26 +4721,32 @@ static String html_config_page() {
       "document.getElementById('e'+i+'b').value=e.b;"
       "document.getElementById('e'+i+'s').value=e.speed;"
       "document.getElementById('e'+i+'i').value=e.intensity;"
+      "for(let k=0;k<4;k++){document.getElementById('e'+i+'p'+k).value=e.palette[k];}"
       "}"
       "document.getElementById('ap_ssid').value=c.wifi.ap_ssid;"
       "document.getElementById('mdns').value=c.wifi.mdns;"
+      "document.getElementById('upload_url').value=c.upload.url;"
       "document.getElementById('ap_open').checked=!c.wifi.has_ap_pass;"
       "document.getElementById('ap_hint').innerText=c.wifi.has_ap_pass?'Password configurada':'AP abierto';"
-      "});"
+      "})(CFG);"
       "function saveCfg(){"
       "if(ap_ssid.value!==''||ap_pass.value!==''||mdns.value!==''||ap_open.checked){"
       "ap_warn.innerText='Nota: cambiar AP puede desconectar la sesion.';"
       "if(!confirm('Guardar cambios? El AP puede reiniciarse.')){return;}"
       "}"
-      "const cfg={version:1,led:{brightness:parseInt(brightness.value)},"
+      "const cfg={version:1,led:{brightness:parseInt(brightness.value),power_budget_ma:parseInt(power_ma.value),"
+      "strips:strips.value.split(',').map(v=>parseInt(v)),status:parseInt(status_n.value),mirror:mirror.checked,"
+      "rgbw:rgbw.checked,white_k:parseInt(white_k.value)},"
       "speed_ranges_kph:[parseFloat(r1.value),parseFloat(r2.value),parseFloat(r3.value),parseFloat(r4.value),parseFloat(r5.value)],"
       "effects:{}};"
       "for(let i=1;i<=6;i++){cfg.effects['range'+i]={"
       "a:parseInt(document.getElementById('e'+i+'a').value),"
       "b:parseInt(document.getElementById('e'+i+'b').value),"
       "speed:parseInt(document.getElementById('e'+i+'s').value),"
-      "intensity:parseInt(document.getElementById('e'+i+'i').value)};}"
+      "intensity:parseInt(document.getElementById('e'+i+'i').value),"
+      "palette:[0,1,2,3].map(k=>document.getElementById('e'+i+'p'+k).value)};}"
       "cfg.wifi={ap_ssid:ap_ssid.value,ap_pass:ap_pass.value,ap_open:ap_open.checked,mdns:mdns.value};"
+      "cfg.upload={url:upload_url.value};"
       "fetch('/api/config',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify(cfg)})"
       ".then(r=>r.json()).then(r=>{"
       "status.innerText=r.status+(r.wifi_restart?' (reiniciando AP)':'');"
@@ -883,51 +4757,284 @@ static String html_config_page() {
       "fetch('/api/config/reset',{method:'POST'})"
       ".then(r=>r.json()).then(r=>{status.innerText=r.status;}).catch(()=>{status.innerText='error'});"
       "}"
-      "</script></body></html>");
+      "let es=null,cells=[];"
+      "function prevStop(){if(es){es.close();es=null;}}"
+      "function prevStart(){"
+      "prevStop();"
+      "es=new EventSource('/api/leds/stream'+(prev_r.value>0?'?range='+prev_r.value:''));"
+      "es.addEventListener('layout',e=>{"
+      "const l=JSON.parse(e.data);"
+      "leds.innerHTML=l.strips.map(n=>'<div>'+'<span></span>'.repeat(n)+'</div>').join('');"
+      "cells=[...leds.querySelectorAll('span')];});"
+      "es.onmessage=e=>{"
+      "const b=Uint8Array.from(atob(e.data),c=>c.charCodeAt(0));"
+      "const rgb=p=>`rgb(${b[p]},${b[p+1]},${b[p+2]})`;"
+      "const set=(i,c)=>{if(cells[i])cells[i].style.background=c;};"
+      "if(b[0]&1){cells.forEach(c=>c.style.background='#000');}"
+      "let i=0,p=4;"
+      "while(p<b.length){i+=b[p++];const n=b[p++];"
+      "if(n&128){const c=rgb(p);p+=3;for(let k=0;k<(n&127);k++){set(i++,c);}}"
+      "else{for(let k=0;k<n;k++){set(i++,rgb(p));p+=3;}}}"
+      "prev_info.innerText='Rango '+(b[1]&127)+(b[1]&128?' (forzado)':'')+', '+b.length+' bytes';};"
+      "}"
+      "</script></body></html>";
+
+// Program editor: assembles the source in the browser (same syntax as
+// tools/fxasm.py) and uploads the bytecode to a slot.
+static const char HTML_EFFECTS[] PROGMEM =
+      "<!doctype html><html><head><meta charset='utf-8'>"
+      "<meta name='viewport' content='width=device-width,initial-scale=1'>"
+      "<title>Efectos</title>"
+      "<style>body{font-family:Arial,sans-serif;margin:20px;color:#111}"
+      "input,textarea{width:100%;padding:8px;margin:4px 0;box-sizing:border-box}"
+      "textarea{height:220px;font-family:monospace}"
+      ".row{display:grid;grid-template-columns:1fr 1fr;gap:10px}"
+      "button{padding:10px 14px;border:0;border-radius:6px;background:#111;color:#fff}"
+      "</style></head><body>"
+      "<h1>Efectos de usuario</h1>"
+      "<ul id='slots'></ul>"
+      "<div class='row'>"
+      "<div><label>Slot (0-3)</label><input id='slot' type='number' min='0' max='3' value='0'></div>"
+      "<div><label>Nombre</label><input id='pname' type='text' maxlength='15'></div>"
+      "</div>"
+      "<label>Programa</label>"
+      "<textarea id='src'>; gradiente de paleta\nldi r6, 3\nshl r7, r0, r6\nmul r8, r2, r3\n"
+      "ldi r9, 1200\ndiv r8, r8, r9\nadd r7, r7, r8\npal r7\nend</textarea>"
+      "<button onclick='upload(false)'>Subir</button> "
+      "<button onclick='upload(true)'>Borrar slot</button>"
+      "<p id='msg'></p>"
+      "<p style='font-size:12px;color:#666'>r0 indice, r1 cantidad, r2 tiempo ms, r3 speed, r4 intensity, "
+      "r5 posicion 0-255, r13-r15 color actual. Asignar el slot como efecto 12-15 en Config.</p>"
+      "<p><a href='/'>Volver</a></p>"
+      "<script>"
+      "const OPS=['end','ldi','mov','add','sub','mul','div','mod','and','or','xor','shl','shr',"
+      "'min','max','sin','rnd','slt','jz','jmp','rgb','pal','hue','scale'];"
+      "function asm(text){"
+      "const ins=[],labels={};"
+      "text.split('\\n').forEach((raw,k)=>{let l=raw.replace(/;.*/,'').trim();"
+      "const m=/^(\\w+):\\s*(.*)$/.exec(l);if(m){labels[m[1]]=ins.length;l=m[2];}"
+      "if(l){ins.push([l,k+1]);}});"
+      "const out=[];"
+      "ins.forEach(([l,ln],pc)=>{const t=l.split(/[\\s,]+/),op=OPS.indexOf(t[0].toLowerCase());"
+      "const err=s=>{throw 'linea '+ln+': '+s;};"
+      "const reg=s=>{const m=/^r(\\d+)$/i.exec(s||'');if(!m||+m[1]>15){err('registro '+s);}return +m[1];};"
+      "if(op<0){err(t[0]);}"
+      "let b=[op,0,0,0];"
+      "if(op==1){const v=parseInt(t[2]);if(isNaN(v)||v<-32768||v>32767){err('valor '+t[2]);}"
+      "b=[op,reg(t[1]),v&255,(v>>8)&255];}"
+      "else if(op==18||op==19){const lab=t[op==18?2:1],s=labels[lab]-pc-1;"
+      "if(!(s>=0&&s<256)){err('salto '+lab);}b=[op,op==18?reg(t[1]):0,s,0];}"
+      "else{t.slice(1).forEach((s,i)=>{b[i+1]=reg(s);});}"
+      "out.push(...b);});"
+      "if(out.length>256){throw 'mas de 64 instrucciones';}"
+      "return out.map(v=>v.toString(16).padStart(2,'0')).join('');}"
+      "const $=id=>document.getElementById(id);"
+      "function load(){fetch('/api/effects/programs').then(r=>r.json()).then(p=>{"
+      "const ul=$('slots');ul.replaceChildren();p.slots.forEach(s=>{const li=document.createElement('li');"
+      "li.textContent=`Slot ${s.slot} (efecto ${s.effect}): `+"
+      "(s.ops?`${s.name} - ${s.ops} instrucciones`:'vacio');ul.appendChild(li);});});}"
+      "function upload(clear){let code='';const msg=$('msg');"
+      "try{code=clear?'':asm($('src').value);}catch(e){msg.textContent=e;return;}"
+      "fetch('/api/effects/programs',{method:'POST',headers:{'Content-Type':'application/json'},"
+      "body:JSON.stringify({slot:parseInt($('slot').value),name:$('pname').value,code:code})})"
+      ".then(r=>r.json()).then(r=>{msg.textContent=r.status+(r.reason?': '+r.reason:'');load();})"
+      ".catch(()=>{msg.textContent='error'});}"
+      "load();"
+      "</script></body></html>";
+
+static void handle_wifi_page() {
+  ResponseStream out(200, "text/html");
+  write_wifi_page(out);
 }
 
-static void handle_root() {
-  server.send(200, "text/html", html_page());
+// Content negotiation: clients sending Accept: application/cbor get the
+// same document as CBOR.
+static bool wants_cbor() {
+  return strstr(server.header("Accept").c_str(), "application/cbor") != nullptr;
 }
 
-static void handle_wifi_page() {
-  server.send(200, "text/html", html_wifi_page());
+static void send_negotiated(void (*writer)(Print &)) {
+  if (wants_cbor()) {
+    ResponseStream out(200, "application/cbor");
+    CborStream cbor(out);
+    writer(cbor);
+  } else {
+    ResponseStream out(200, "application/json");
+    writer(out);
+  }
 }
 
 static void handle_summary() {
-  server.send(200, "application/json", build_summary_json());
+  send_negotiated(write_summary_json);
 }
 
-static void handle_config_get() {
-  StaticJsonDocument<1536> doc;
+static void write_status_json(Print &out) {
+  out.printf("{\"uptime_ms\":%lu", static_cast<unsigned long>(millis()));
+  out.printf(",\"boot\":{\"first_frame_ms\":%lu", static_cast<unsigned long>(boot_ms.first_frame_ms));
+  out.printf(",\"first_nmea_ms\":%lu", static_cast<unsigned long>(boot_ms.first_nmea_ms));
+  out.printf(",\"wifi_ms\":%lu", static_cast<unsigned long>(boot_ms.wifi_ms));
+  out.printf(",\"portal_ms\":%lu", static_cast<unsigned long>(boot_ms.portal_ms));
+  out.printf(",\"ble_ms\":%lu", static_cast<unsigned long>(boot_ms.ble_ms));
+  out.printf(",\"first_fix_ms\":%lu}", static_cast<unsigned long>(boot_ms.first_fix_ms));
+  out.printf(",\"gnss\":{\"ttff_ms\":%lu", gnss_ttff_ms);
+  out.printf(",\"aid_flags\":%u", gnss_aid_flags);
+  out.printf(",\"last_fix_unix\":%lu", static_cast<unsigned long>(gnss_aid.unix_s));
+  out.printf(",\"almanac_age_s\":%ld}", gnss_almanac_age_s());
+  out.printf(",\"led\":{\"frames\":%lu", static_cast<unsigned long>(led_stats.frames));
+  out.printf(",\"frame_ms\":%lu", static_cast<unsigned long>(led_frame_ms));
+  out.printf(",\"late\":%lu", static_cast<unsigned long>(led_stats.late));
+  out.printf(",\"max_gap_ms\":%lu", static_cast<unsigned long>(led_stats.max_gap_ms));
+  out.printf(",\"max_frame_us\":%lu", static_cast<unsigned long>(led_stats.max_frame_us));
+  out.printf(",\"preview_range\":%u", led_preview_range);
+  out.printf(",\"stream\":{\"active\":%s", led_stream.active ? "true" : "false");
+  out.printf(",\"viewers\":%lu", static_cast<unsigned long>(led_stream.viewers));
+  out.printf(",\"frames\":%lu", static_cast<unsigned long>(led_stream.frames));
+  out.printf(",\"skipped\":%lu", static_cast<unsigned long>(led_stream.skipped));
+  out.printf(",\"bytes\":%lu", static_cast<unsigned long>(led_stream.bytes));
+  out.printf(",\"last_us\":%lu", static_cast<unsigned long>(led_stream.last_us));
+  out.printf(",\"max_us\":%lu}}", static_cast<unsigned long>(led_stream.max_us));
+  out.printf(",\"replay\":%s", nmea_replay.load(std::memory_order_relaxed) ? "true" : "false");
+  out.printf(",\"power\":{\"est_ma\":%lu", static_cast<unsigned long>(power.est_ma));
+  out.printf(",\"peak_ma\":%lu", static_cast<unsigned long>(power.peak_ma));
+  out.printf(",\"budget_ma\":%u", g_cfg.power_budget_ma);
+  out.printf(",\"brightness\":%u", power.brightness);
+  out.printf(",\"capped_frames\":%lu", static_cast<unsigned long>(power.capped_frames));
+  out.printf(",\"rgbw\":%s", g_cfg.rgbw ? "true" : "false");
+  out.printf(",\"white_saved_ma\":%lu", static_cast<unsigned long>(power.white_saved_ma));
+  out.printf(",\"white_saved_mah\":%.1f", power.white_saved_mams / 3600000.0);
+  out.printf(",\"mah_last_hour\":%.1f", power_last_hour_mah());
+  out.printf(",\"mah_total\":%.1f}", power.total_mams / 3600000.0);
+  out.printf(",\"log\":{\"bytes\":%lu", static_cast<unsigned long>(log_part != nullptr ? log_size() : 0));
+  out.printf(",\"capacity\":%lu", static_cast<unsigned long>(log_part != nullptr ? log_ring : 0));
+  out.printf(",\"errors\":%lu", static_cast<unsigned long>(log_stats.errors));
+  out.printf(",\"downloads\":%lu", static_cast<unsigned long>(log_stats.downloads));
+  out.printf(",\"last_bytes\":%lu", static_cast<unsigned long>(log_stats.last_bytes));
+  out.printf(",\"last_ms\":%lu}", static_cast<unsigned long>(log_stats.last_ms));
+  out.printf(",\"portal\":{\"root_us\":%lu", static_cast<unsigned long>(portal_page_us[0]));
+  out.printf(",\"config_us\":%lu}", static_cast<unsigned long>(portal_page_us[1]));
+  out.printf(",\"upload\":{\"active\":%s", (wifi_sta_connected && g_cfg.upload_url[0] != '\0') ? "true" : "false");
+  out.printf(",\"days\":%lu", static_cast<unsigned long>(upload.days));
+  out.printf(",\"fixes\":%lu", static_cast<unsigned long>(upload.fixes));
+  out.printf(",\"batches\":%lu", static_cast<unsigned long>(upload.batches));
+  out.printf(",\"bytes\":%lu", static_cast<unsigned long>(upload.bytes));
+  out.printf(",\"failures\":%lu", static_cast<unsigned long>(upload.failures));
+  out.printf(",\"last_code\":%d", upload.last_code);
+  out.printf(",\"backoff_ms\":%lu", static_cast<unsigned long>(upload.backoff_ms));
+  out.printf(",\"day_cursor\":%lu", static_cast<unsigned long>(upload.day_cursor));
+  out.printf(",\"fix_gen\":%lu", static_cast<unsigned long>(upload.fix_gen));
+  out.printf(",\"fix_offset\":%lu}", static_cast<unsigned long>(upload.fix_offset));
+  out.printf(",\"heap\":{\"free\":%lu", static_cast<unsigned long>(ESP.getFreeHeap()));
+  out.printf(",\"min_free\":%lu", static_cast<unsigned long>(ESP.getMinFreeHeap()));
+  out.printf(",\"largest_free\":%lu", static_cast<unsigned long>(ESP.getMaxAllocHeap()));
+  out.printf(",\"json_arena_peak\":%lu", static_cast<unsigned long>(json_arena.peak));
+  out.printf(",\"json_arena_fallbacks\":%lu}}", static_cast<unsigned long>(json_arena.fallbacks));
+}
+
+static void handle_status() {
+  send_negotiated(write_status_json);
+}
+
+// Summary and status in one document: inlined in the root page and served
+// as /api/state for the page's refreshes.
+static void write_state_json(Print &out) {
+  out.print("{\"summary\":");
+  write_summary_json(out);
+  out.print(",\"status\":");
+  write_status_json(out);
+  out.print("}");
+}
+
+static void handle_state() {
+  send_negotiated(write_state_json);
+}
+
+// The root page streams with the current state inlined, so the first
+// meaningful paint costs one request instead of page + /api/summary.
+static void handle_root() {
+  const uint32_t start_us = micros();
+  {
+    ResponseStream out(200, "text/html");
+    out.print(HTML_ROOT);
+    ScriptJsonPrint state(out);
+    write_state_json(state);
+    out.print(HTML_ROOT_SCRIPT);
+  }
+  portal_page_us[0] = micros() - start_us;
+}
+
+static void print_boot_milestones() {
+  Serial.printf("boot first_frame_ms=%lu first_nmea_ms=%lu wifi_ms=%lu portal_ms=%lu ble_ms=%lu first_fix_ms=%lu\n",
+                static_cast<unsigned long>(boot_ms.first_frame_ms),
+                static_cast<unsigned long>(boot_ms.first_nmea_ms),
+                static_cast<unsigned long>(boot_ms.wifi_ms),
+                static_cast<unsigned long>(boot_ms.portal_ms),
+                static_cast<unsigned long>(boot_ms.ble_ms),
+                static_cast<unsigned long>(boot_ms.first_fix_ms));
+}
+
+static void write_config_json(Print &out) {
+  JsonDocument doc(&json_arena);
   doc["version"] = CONFIG_VERSION;
   doc["led"]["brightness"] = g_cfg.brightness;
+  doc["led"]["power_budget_ma"] = g_cfg.power_budget_ma;
+  doc["led"]["rgbw"] = (g_cfg.rgbw != 0);
+  doc["led"]["white_k"] = g_cfg.white_k;
+  JsonArray strips = doc["led"].createNestedArray("strips");
+  for (int i = 0; i < g_cfg.layout.strip_count; ++i) {
+    strips.add(g_cfg.layout.strip_len[i]);
+  }
+  doc["led"]["status"] = g_cfg.layout.status_count;
+  doc["led"]["mirror"] = (g_cfg.layout.mirror != 0);
+  doc["led"]["custom_segments"] = (g_cfg.layout.segment_count > 0);
+  JsonArray segments = doc["led"].createNestedArray("segments");
+  for (int i = 0; i < led_segment_count; ++i) {
+    const LedSegment &seg = led_segments[i];
+    JsonObject o = segments.createNestedObject();
+    o["strip"] = seg.strip;
+    o["role"] = (seg.role == SEG_STATUS) ? "status" : "body";
+    o["channel"] = (seg.channel == 0) ? "a" : "b";
+    o["start"] = seg.start;
+    o["count"] = seg.count;
+    o["mirror"] = (seg.flags & SEG_MIRROR) != 0;
+  }
   JsonArray ranges = doc.createNestedArray("speed_ranges_kph");
   for (int i = 0; i < 5; ++i) {
     ranges.add(g_cfg.ranges[i]);
   }
   JsonObject effects = doc.createNestedObject("effects");
   for (int i = 0; i < 6; ++i) {
-    JsonObject r = effects.createNestedObject(String("range") + String(i + 1));
+    char key[8];
+    snprintf(key, sizeof(key), "range%d", i + 1);
+    JsonObject r = effects.createNestedObject(key);
     r["a"] = g_cfg.effects[i].effect_a;
     r["b"] = g_cfg.effects[i].effect_b;
     r["speed"] = g_cfg.effects[i].speed;
     r["intensity"] = g_cfg.effects[i].intensity;
+    JsonArray palette = r.createNestedArray("palette");
+    for (int k = 0; k < PALETTE_STOPS; ++k) {
+      const uint8_t *rgb = g_cfg.palettes[i].stops[k];
+      char hex[8];
+      snprintf(hex, sizeof(hex), "#%02x%02x%02x", rgb[0], rgb[1], rgb[2]);
+      palette.add(hex);
+    }
   }
   doc["wifi"]["ap_ssid"] = g_cfg.ap_ssid;
-  doc["wifi"]["has_ap_pass"] = (g_cfg.ap_pass.length() >= 8);
+  doc["wifi"]["has_ap_pass"] = (strlen(g_cfg.ap_pass) >= 8);
   doc["wifi"]["mdns"] = g_cfg.mdns;
-
-  String out;
+  doc["upload"]["url"] = g_cfg.upload_url;
   serializeJson(doc, out);
-  server.send(200, "application/json", out);
 }
 
-static bool valid_mdns(const String &value) {
-  if (value.length() < 1 || value.length() > 32) {
+static void handle_config_get() {
+  send_negotiated(write_config_json);
+}
+
+static bool valid_mdns(const char *value) {
+  const size_t len = strlen(value);
+  if (len < 1 || len > MDNS_MAX) {
     return false;
   }
-  for (size_t i = 0; i < value.length(); ++i) {
+  for (size_t i = 0; i < len; ++i) {
     const char c = value[i];
     const bool ok = (c >= 'a' && c <= 'z') ||
                     (c >= 'A' && c <= 'Z') ||
@@ -940,121 +5047,824 @@ static bool valid_mdns(const String &value) {
   return true;
 }
 
-static void handle_config_post() {
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"no body\"}");
-    return;
+// Empty (upload off) or a plain http:// URL without spaces.
+static bool valid_upload_url(const char *value) {
+  const size_t len = strlen(value);
+  if (len == 0) {
+    return true;
   }
-  StaticJsonDocument<2048> doc;
-  const DeserializationError err = deserializeJson(doc, server.arg("plain"));
-  if (err) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"bad json\"}");
-    return;
+  if (len > UPLOAD_URL_MAX || len <= 7 || strncmp(value, "http://", 7) != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (value[i] <= ' ' || value[i] > '~') {
+      return false;
+    }
   }
+  return true;
+}
 
-  RuntimeConfig next = g_cfg;
-  const int brightness = doc["led"]["brightness"] | g_cfg.brightness;
+// Validate a /api/config body into next (a copy of the current config).
+// Returns nullptr on success or the error reason reported to the client.
+static const char *parse_config_json(JsonDocument &doc, RuntimeConfig &next) {
+  const int brightness = doc["led"]["brightness"] | next.brightness;
   if (brightness < 1 || brightness > 255) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"brightness\"}");
-    return;
+    return "brightness";
   }
   next.brightness = static_cast<uint8_t>(brightness);
+  const long power_budget_ma = doc["led"]["power_budget_ma"] | static_cast<long>(next.power_budget_ma);
+  if (power_budget_ma != 0 && (power_budget_ma < 100 || power_budget_ma > 5000)) {
+    return "power_budget_ma";
+  }
+  next.power_budget_ma = static_cast<uint16_t>(power_budget_ma);
+  next.rgbw = (doc["led"]["rgbw"] | (next.rgbw != 0)) ? 1 : 0;
+  const long white_k = doc["led"]["white_k"] | static_cast<long>(next.white_k);
+  if (white_k < 2000 || white_k > 10000) {
+    return "white_k";
+  }
+  next.white_k = static_cast<uint16_t>(white_k);
+
+  // Strip layout is optional; omitted fields keep the current layout.
+  // "segments": [] returns to the automatic map.
+  JsonArray strips = doc["led"]["strips"].as<JsonArray>();
+  if (!strips.isNull()) {
+    if (strips.size() < 1 || strips.size() > static_cast<size_t>(LED_MAX_STRIPS)) {
+      return "strips";
+    }
+    next.layout.strip_count = static_cast<uint8_t>(strips.size());
+    for (size_t i = 0; i < strips.size(); ++i) {
+      const int len = strips[i] | 0;
+      if (len < 1 || len > LED_MAX_PER_STRIP) {
+        return "strip length";
+      }
+      next.layout.strip_len[i] = static_cast<uint8_t>(len);
+    }
+  }
+  const int status_count = doc["led"]["status"] | next.layout.status_count;
+  if (status_count < 0 || status_count >= LED_MAX_PER_STRIP) {
+    return "status count";
+  }
+  next.layout.status_count = static_cast<uint8_t>(status_count);
+  next.layout.mirror = (doc["led"]["mirror"] | (next.layout.mirror != 0)) ? 1 : 0;
+  JsonArray segments = doc["led"]["segments"].as<JsonArray>();
+  if (!segments.isNull()) {
+    if (segments.size() > static_cast<size_t>(LED_MAX_SEGMENTS)) {
+      return "segments";
+    }
+    next.layout.segment_count = static_cast<uint8_t>(segments.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+      JsonObject o = segments[i];
+      const int strip = o["strip"] | -1;
+      const int start = o["start"] | -1;
+      const int count = o["count"] | 0;
+      const char *role = o["role"] | "body";
+      const char *channel = o["channel"] | "a";
+      const bool mirror = o["mirror"] | false;
+      if (strip < 0 || strip >= LED_MAX_STRIPS || start < 0 || start >= LED_MAX_PER_STRIP ||
+          count < 1 || count > LED_MAX_PER_STRIP ||
+          (strcmp(role, "status") != 0 && strcmp(role, "body") != 0) ||
+          (strcmp(channel, "a") != 0 && strcmp(channel, "b") != 0)) {
+        return "segment values";
+      }
+      next.layout.segments[i] = {static_cast<uint8_t>(strip),
+                                 static_cast<uint8_t>(strcmp(role, "status") == 0 ? SEG_STATUS : SEG_BODY),
+                                 static_cast<uint8_t>(strcmp(channel, "a") == 0 ? 0 : 1),
+                                 static_cast<uint8_t>(mirror ? SEG_MIRROR : 0),
+                                 static_cast<uint8_t>(start),
+                                 static_cast<uint8_t>(count)};
+    }
+  }
+  if (!validate_layout(next.layout)) {
+    return "layout";
+  }
 
   JsonArray ranges = doc["speed_ranges_kph"].as<JsonArray>();
   if (ranges.size() != 5) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"ranges\"}");
-    return;
+    return "ranges";
   }
   for (int i = 0; i < 5; ++i) {
     next.ranges[i] = ranges[i].as<float>();
     if (next.ranges[i] <= 0.0f) {
-      server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"ranges value\"}");
-      return;
+      return "ranges value";
     }
   }
   if (!validate_ranges(next.ranges)) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"ranges order\"}");
-    return;
+    return "ranges order";
   }
 
   JsonObject effects = doc["effects"].as<JsonObject>();
   for (int i = 0; i < 6; ++i) {
-    JsonObject r = effects[String("range") + String(i + 1)];
+    char key[8];
+    snprintf(key, sizeof(key), "range%d", i + 1);
+    JsonObject r = effects[key];
     if (r.isNull()) {
-      server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"effects\"}");
-      return;
+      return "effects";
     }
     const int eff_a = r["a"] | next.effects[i].effect_a;
     const int eff_b = r["b"] | next.effects[i].effect_b;
     const int eff_speed = r["speed"] | next.effects[i].speed;
     const int eff_intensity = r["intensity"] | next.effects[i].intensity;
-    if (eff_a < 0 || eff_a > 11 || eff_b < 0 || eff_b > 11 ||
+    if (eff_a < 0 || eff_a > FX_EFFECT_MAX || eff_b < 0 || eff_b > FX_EFFECT_MAX ||
         eff_speed < 0 || eff_speed > 255 || eff_intensity < 0 || eff_intensity > 255) {
-      server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"effect values\"}");
-      return;
+      return "effect values";
     }
     next.effects[i].effect_a = static_cast<uint8_t>(eff_a);
     next.effects[i].effect_b = static_cast<uint8_t>(eff_b);
     next.effects[i].speed = static_cast<uint8_t>(eff_speed);
     next.effects[i].intensity = static_cast<uint8_t>(eff_intensity);
+
+    // Optional: 4 colors as "#rrggbb"; keeps the current palette if absent.
+    JsonArray palette = r["palette"].as<JsonArray>();
+    if (!palette.isNull()) {
+      if (palette.size() != PALETTE_STOPS) {
+        return "palette";
+      }
+      for (int k = 0; k < PALETTE_STOPS; ++k) {
+        const char *hex = palette[k] | "";
+        char *end = nullptr;
+        const unsigned long rgb = (hex[0] == '#' && strlen(hex) == 7) ? strtoul(hex + 1, &end, 16) : 0;
+        if (end == nullptr || *end != '\0') {
+          return "palette";
+        }
+        next.palettes[i].stops[k][0] = static_cast<uint8_t>(rgb >> 16);
+        next.palettes[i].stops[k][1] = static_cast<uint8_t>(rgb >> 8);
+        next.palettes[i].stops[k][2] = static_cast<uint8_t>(rgb);
+      }
+    }
   }
   if (!validate_effects(next.effects)) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"effect id\"}");
+    return "effect id";
+  }
+
+  const char *ap_ssid = doc["wifi"]["ap_ssid"] | static_cast<const char *>(next.ap_ssid);
+  const char *ap_pass = doc["wifi"]["ap_pass"] | "";
+  const bool ap_open = doc["wifi"]["ap_open"] | false;
+  const char *mdns = doc["wifi"]["mdns"] | static_cast<const char *>(next.mdns);
+  const size_t ssid_len = strlen(ap_ssid);
+  const size_t pass_len = strlen(ap_pass);
+  if (ssid_len < 1 || ssid_len > SSID_MAX) {
+    return "ssid";
+  }
+  if (!ap_open && pass_len > 0 && (pass_len < 8 || pass_len > PASS_MAX)) {
+    return "pass";
+  }
+  if (!valid_mdns(mdns)) {
+    return "mdns";
+  }
+  set_str(next.ap_ssid, ap_ssid);
+  if (ap_open) {
+    set_str(next.ap_pass, "");
+  } else if (pass_len > 0) {
+    set_str(next.ap_pass, ap_pass);
+  }
+  set_str(next.mdns, mdns);
+
+  const char *upload_url = doc["upload"]["url"] | static_cast<const char *>(next.upload_url);
+  if (!valid_upload_url(upload_url)) {
+    return "upload url";
+  }
+  set_str(next.upload_url, upload_url);
+  return nullptr;
+}
+
+static void print_heap(const char *tag) {
+  Serial.printf("%s free=%lu min_free=%lu largest=%lu arena_peak=%lu arena_fallbacks=%lu\n", tag,
+                static_cast<unsigned long>(ESP.getFreeHeap()),
+                static_cast<unsigned long>(ESP.getMinFreeHeap()),
+                static_cast<unsigned long>(ESP.getMaxAllocHeap()),
+                static_cast<unsigned long>(json_arena.peak),
+                static_cast<unsigned long>(json_arena.fallbacks));
+}
+
+// Soak (serial `soak [n]`, needs `replay on`): each step replays the portal
+// responses and a config POST parse without the network, and feeds one
+// simulated second of RMC through handle_nmea_line(), so the metrics, log
+// and day rollover run as they do from the UART. soak_poll() runs a few
+// steps per loop pass; a steady free heap and largest block across runs
+// means no leaks or fragmentation.
+struct SoakJob {
+  uint32_t total; // 0 = idle.
+  uint32_t done;
+  uint32_t free_before;
+  uint32_t largest_before;
+  size_t config_len;
+  CountingPrint sink;
+};
+
+static const uint32_t SOAK_STEPS_PER_PASS = 4;
+static SoakJob soak_job;
+static char soak_config_body[2048];
+
+static void soak_start(uint32_t iterations) {
+  if (!nmea_replay.load(std::memory_order_relaxed)) {
+    Serial.println("soak needs replay on (it feeds RMC into the day metrics)");
+    return;
+  }
+  if (soak_job.total != 0) {
+    Serial.println("soak busy");
+    return;
+  }
+  BufferPrint body(soak_config_body, sizeof(soak_config_body));
+  write_config_json(body);
+  soak_job.config_len = body.len;
+  soak_job.total = max<uint32_t>(1, iterations);
+  soak_job.done = 0;
+  soak_job.sink.count = 0;
+  soak_job.free_before = ESP.getFreeHeap();
+  soak_job.largest_before = ESP.getMaxAllocHeap();
+  print_heap("soak start");
+}
+
+static void soak_step(uint32_t i) {
+  write_summary_json(soak_job.sink);
+  write_status_json(soak_job.sink);
+  write_config_json(soak_job.sink);
+  write_wifi_page(soak_job.sink);
+  {
+    JsonDocument doc(&json_arena);
+    if (!deserializeJson(doc, soak_config_body, soak_job.config_len)) {
+      RuntimeConfig next = g_cfg;
+      parse_config_json(doc, next);
+    }
+  }
+
+  // One simulated second of GPS input; a new day every 86400 steps.
+  const uint32_t t = i % 86400;
+  char rmc[96];
+  snprintf(rmc, sizeof(rmc), "$GNRMC,%02lu%02lu%02lu.00,A,3436.%04lu,S,05824.0000,W,%lu.0,0.0,%02lu0126,,,A*00",
+           static_cast<unsigned long>(t / 3600), static_cast<unsigned long>((t / 60) % 60),
+           static_cast<unsigned long>(t % 60), static_cast<unsigned long>(i % 10000),
+           static_cast<unsigned long>(i % 12), static_cast<unsigned long>(1 + (i / 86400) % 28));
+  handle_nmea_line(rmc);
+}
+
+static void soak_poll() {
+  if (soak_job.total == 0) {
     return;
   }
+  for (uint32_t n = 0; n < SOAK_STEPS_PER_PASS && soak_job.done < soak_job.total; ++n) {
+    soak_step(soak_job.done++);
+    if (soak_job.done % 1000 == 0) {
+      char tag[24];
+      snprintf(tag, sizeof(tag), "soak %lu", static_cast<unsigned long>(soak_job.done));
+      print_heap(tag);
+    }
+  }
+  if (soak_job.done < soak_job.total) {
+    return;
+  }
+  print_heap("soak end");
+  Serial.printf("soak bytes=%lu free_delta=%ld largest_delta=%ld\n",
+                static_cast<unsigned long>(soak_job.sink.count),
+                static_cast<long>(ESP.getFreeHeap()) - static_cast<long>(soak_job.free_before),
+                static_cast<long>(ESP.getMaxAllocHeap()) - static_cast<long>(soak_job.largest_before));
+  soak_job.total = 0;
+}
+
+// POST /api/config body, captured by the raw hook so CBOR bodies keep
+// their zero bytes (the "plain" argument stops at the first one).
+static uint8_t post_body[PORTAL_BODY_MAX];
+static size_t post_body_len = 0;
+static bool post_body_overflow = false;
+
+static void capture_post_body() {
+  HTTPRaw &raw = server.raw();
+  if (raw.status == RAW_START) {
+    post_body_len = 0;
+    post_body_overflow = false;
+  } else if (raw.status == RAW_WRITE) {
+    if (post_body_len + raw.currentSize > sizeof(post_body)) {
+      post_body_overflow = true;
+    } else {
+      memcpy(&post_body[post_body_len], raw.buf, raw.currentSize);
+      post_body_len += raw.currentSize;
+    }
+  }
+}
+
+static void handle_config_post() {
+  static char cbor_text[PORTAL_BODY_MAX];
+  if (post_body_overflow) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"too large\"}");
+    return;
+  }
+  if (post_body_len == 0) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"no body\"}");
+    return;
+  }
+  const char *text = reinterpret_cast<const char *>(post_body);
+  size_t text_len = post_body_len;
+  if (strstr(server.header("Content-Type").c_str(), "application/cbor") != nullptr) {
+    text = cbor_text;
+    text_len = cbor_to_json(post_body, post_body_len, cbor_text, sizeof(cbor_text));
+    if (text_len == 0) {
+      server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"bad cbor\"}");
+      return;
+    }
+  }
+  JsonDocument doc(&json_arena);
+  const DeserializationError err = deserializeJson(doc, text, text_len);
+  post_body_len = 0;
+  if (err) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"bad json\"}");
+    return;
+  }
+
+  RuntimeConfig next = g_cfg;
+  const char *reason = parse_config_json(doc, next);
+  if (reason != nullptr) {
+    ResponseStream out(400, "application/json");
+    out.printf("{\"status\":\"error\",\"reason\":\"%s\"}", reason);
+    return;
+  }
+
+  RuntimeConfig previous = g_cfg;
+  g_cfg = next;
+  save_config();
+  apply_config(previous);
+  const bool wifi_restart = (strcmp(g_cfg.ap_ssid, previous.ap_ssid) != 0 ||
+                             strcmp(g_cfg.ap_pass, previous.ap_pass) != 0);
+  if (wifi_restart) {
+    pending_ap_restart = true;
+    pending_ap_at_ms = millis();
+  }
+  server.send(200, "application/json", wifi_restart ? "{\"status\":\"ok\",\"wifi_restart\":true}"
+                                                     : "{\"status\":\"ok\",\"wifi_restart\":false}");
+}
+
+static void handle_config_reset() {
+  prefs_cfg.clear();
+  RuntimeConfig previous = g_cfg;
+  set_default_config();
+  save_config();
+  apply_config(previous);
+  if (strcmp(g_cfg.ap_ssid, previous.ap_ssid) != 0 ||
+      strcmp(g_cfg.ap_pass, previous.ap_pass) != 0) {
+    pending_ap_restart = true;
+    pending_ap_at_ms = millis();
+  }
+  server.send(200, "application/json", "{\"status\":\"ok\"}");
+}
+
+static void handle_config_page() {
+  const uint32_t start_us = micros();
+  {
+    ResponseStream out(200, "text/html");
+    out.print(HTML_CONFIG);
+    ScriptJsonPrint config(out);
+    write_config_json(config);
+    out.print(HTML_CONFIG_SCRIPT);
+  }
+  portal_page_us[1] = micros() - start_us;
+}
+
+static void handle_effects_page() {
+  server.send_P(200, "text/html", HTML_EFFECTS);
+}
+
+static void handle_programs_get() {
+  ResponseStream out(200, "application/json");
+  out.printf("{\"base\":%d,\"max_ops\":%d,\"slots\":[", FX_EFFECT_BASE, FX_PROGRAM_MAX_OPS);
+  for (int i = 0; i < FX_PROGRAM_SLOTS; ++i) {
+    const FxProgram &p = fx_programs[i];
+    out.printf("%s{\"slot\":%d,\"effect\":%d,\"name\":\"%s\",\"ops\":%u,\"code\":\"",
+               i ? "," : "", i, FX_EFFECT_BASE + i, p.name, p.op_count);
+    for (int k = 0; k < p.op_count * 4; ++k) {
+      out.printf("%02x", p.code[k]);
+    }
+    out.print("\"}");
+  }
+  out.print("]}");
+}
+
+// Store {"slot":n,"name":"...","code":"<hex>"} in a program slot; empty
+// code clears the slot. Effects set to that slot pick it up next frame.
+static void handle_programs_post() {
+  static FxProgram next;
+  JsonDocument doc(&json_arena);
+  if (!server.hasArg("plain") || deserializeJson(doc, server.arg("plain"))) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"bad json\"}");
+    return;
+  }
+  const int slot = doc["slot"] | -1;
+  const char *name = doc["name"] | "";
+  const char *code = doc["code"] | "";
+  const size_t len = strlen(code);
+  const char *reason = nullptr;
+  memset(&next, 0, sizeof(next));
+  if (slot < 0 || slot >= FX_PROGRAM_SLOTS) {
+    reason = "slot";
+  } else if ((len > 0 || name[0] != '\0') && !valid_name(name, sizeof(next.name))) {
+    reason = "name";
+  } else if (len % 8 != 0 || len / 8 > static_cast<size_t>(FX_PROGRAM_MAX_OPS)) {
+    reason = "code";
+  } else {
+    set_str(next.name, name);
+    next.op_count = static_cast<uint8_t>(len / 8);
+    for (size_t k = 0; k < len / 2 && reason == nullptr; ++k) {
+      char byte[3] = {code[2 * k], code[2 * k + 1], '\0'};
+      char *end = nullptr;
+      next.code[k] = static_cast<uint8_t>(strtoul(byte, &end, 16));
+      if (end != byte + 2) {
+        reason = "code";
+      }
+    }
+    if (reason == nullptr && !fx_validate(next)) {
+      reason = "program";
+    }
+  }
+  if (reason != nullptr) {
+    ResponseStream out(400, "application/json");
+    out.printf("{\"status\":\"error\",\"reason\":\"%s\"}", reason);
+    return;
+  }
+  fx_programs[slot] = next;
+  save_programs();
+  server.send(200, "application/json", "{\"status\":\"ok\"}");
+}
+
+static const char *geo_alert_name(uint8_t alert) {
+  static const char *const names[] = {"none", "enter", "exit", "both"};
+  return names[alert & 3];
+}
+
+static void write_zones_json(Print &out) {
+  out.printf("{\"checks\":%lu", static_cast<unsigned long>(geo_stats.checks));
+  out.printf(",\"tests\":%lu", static_cast<unsigned long>(geo_stats.tests));
+  out.print(",\"zones\":[");
+  for (int i = 0; i < geo.table.count; ++i) {
+    const GeoZone &z = geo.table.zones[i];
+    out.printf("%s{\"name\":\"%s\"", i ? "," : "", z.name);
+    out.printf(",\"alert\":\"%s\"", geo_alert_name(z.alert));
+    if (z.type == GEO_CIRCLE) {
+      out.printf(",\"type\":\"circle\",\"lat\":%.6f", z.lat[0]);
+      out.printf(",\"lon\":%.6f,\"radius_m\":%.1f", z.lon[0], z.radius_m);
+    } else {
+      out.print(",\"type\":\"polygon\",\"points\":[");
+      for (int v = 0; v < z.vertex_count; ++v) {
+        out.printf("%s[%.6f,%.6f]", v ? "," : "", z.lat[v], z.lon[v]);
+      }
+      out.print("]");
+    }
+    out.printf(",\"inside\":%s", (geo_inside & (1u << i)) ? "true" : "false");
+    out.printf(",\"enters\":%u,\"exits\":%u}", geo_stats.enters[i], geo_stats.exits[i]);
+  }
+  out.print("]}");
+}
+
+static void handle_zones_get() {
+  send_negotiated(write_zones_json);
+}
+
+static bool valid_lat_lon(float lat, float lon) {
+  return lat >= -90.0f && lat <= 90.0f && lon >= -180.0f && lon <= 180.0f;
+}
+
+// Parse {"zones":[...]} into t. Returns nullptr or the error reason.
+static const char *parse_zones_json(JsonDocument &doc, GeoZoneTable &t) {
+  JsonArray zones = doc["zones"].as<JsonArray>();
+  if (zones.isNull() || zones.size() > static_cast<size_t>(GEOFENCE_MAX_ZONES)) {
+    return "zones";
+  }
+  memset(&t, 0, sizeof(t));
+  t.count = static_cast<uint8_t>(zones.size());
+  for (size_t i = 0; i < zones.size(); ++i) {
+    JsonObject o = zones[i];
+    GeoZone &z = t.zones[i];
+    const char *name = o["name"] | "";
+    const char *type = o["type"] | "";
+    const char *alert = o["alert"] | "none";
+    if (!valid_name(name, sizeof(z.name))) {
+      return "name";
+    }
+    set_str(z.name, name);
+    z.alert = 0;
+    for (uint8_t a = 0; a < 4; ++a) {
+      if (strcmp(alert, geo_alert_name(a)) == 0) {
+        z.alert = a;
+      }
+    }
+    if (strcmp(type, "circle") == 0) {
+      z.type = GEO_CIRCLE;
+      z.lat[0] = o["lat"] | 1000.0f;
+      z.lon[0] = o["lon"] | 1000.0f;
+      z.radius_m = o["radius_m"] | 0.0f;
+      if (!valid_lat_lon(z.lat[0], z.lon[0]) || z.radius_m < 5.0f || z.radius_m > 100000.0f) {
+        return "circle";
+      }
+    } else if (strcmp(type, "polygon") == 0) {
+      JsonArray points = o["points"].as<JsonArray>();
+      if (points.size() < 3 || points.size() > static_cast<size_t>(GEOFENCE_MAX_VERTICES)) {
+        return "points";
+      }
+      z.type = GEO_POLYGON;
+      z.vertex_count = static_cast<uint8_t>(points.size());
+      for (size_t v = 0; v < points.size(); ++v) {
+        z.lat[v] = points[v][0] | 1000.0f;
+        z.lon[v] = points[v][1] | 1000.0f;
+        if (!valid_lat_lon(z.lat[v], z.lon[v])) {
+          return "point value";
+        }
+      }
+    } else {
+      return "type";
+    }
+  }
+  return nullptr;
+}
+
+// Replace all zones. Counters and inside state restart with the new set.
+static void handle_zones_post() {
+  static GeoZoneTable next;
+  JsonDocument doc(&json_arena);
+  if (!server.hasArg("plain") || deserializeJson(doc, server.arg("plain"))) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"bad json\"}");
+    return;
+  }
+  const char *reason = parse_zones_json(doc, next);
+  if (reason != nullptr) {
+    ResponseStream out(400, "application/json");
+    out.printf("{\"status\":\"error\",\"reason\":\"%s\"}", reason);
+    return;
+  }
+  geo.table = next;
+  geo_build(geo);
+  geo_reset_state();
+  save_zones();
+  server.send(200, "application/json", "{\"status\":\"ok\"}");
+}
+
+// JSON against CBOR for the negotiated endpoints (serial `cbor bench`):
+// bytes and encode time per response, then a config round trip through
+// CBOR that must parse to the same settings as the JSON body.
+static void cbor_bench() {
+  static char json_text[PORTAL_BODY_MAX];
+  static char cbor_body[PORTAL_BODY_MAX];
+  static char back_text[PORTAL_BODY_MAX];
+  struct BenchCase {
+    const char *name;
+    void (*writer)(Print &);
+  };
+  const BenchCase cases[] = {{"summary", write_summary_json}, {"status", write_status_json},
+                             {"config", write_config_json}, {"zones", write_zones_json}};
+  const int runs = 50;
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  for (const BenchCase &c : cases) {
+    CountingPrint json;
+    CountingPrint cbor;
+    uint32_t t0 = ESP.getCycleCount();
+    for (int i = 0; i < runs; ++i) {
+      json.count = 0;
+      c.writer(json);
+    }
+    const uint32_t json_cycles = ESP.getCycleCount() - t0;
+    t0 = ESP.getCycleCount();
+    for (int i = 0; i < runs; ++i) {
+      cbor.count = 0;
+      CborStream stream(cbor);
+      c.writer(stream);
+    }
+    const uint32_t cbor_cycles = ESP.getCycleCount() - t0;
+    Serial.printf("bench cbor %s json_bytes=%lu cbor_bytes=%lu json_us=%.1f cbor_us=%.1f\n", c.name,
+                  static_cast<unsigned long>(json.count), static_cast<unsigned long>(cbor.count),
+                  json_cycles / static_cast<float>(runs) / mhz, cbor_cycles / static_cast<float>(runs) / mhz);
+  }
+
+  BufferPrint json(json_text, sizeof(json_text));
+  write_config_json(json);
+  BufferPrint body(cbor_body, sizeof(cbor_body));
+  {
+    CborStream stream(body);
+    write_config_json(stream);
+  }
+  const size_t back_len =
+      cbor_to_json(reinterpret_cast<const uint8_t *>(cbor_body), body.len, back_text, sizeof(back_text));
+  RuntimeConfig from_json = g_cfg;
+  RuntimeConfig from_cbor = g_cfg;
+  bool ok = (back_len > 0);
+  {
+    JsonDocument doc(&json_arena);
+    ok = ok && !deserializeJson(doc, json_text, json.len) && parse_config_json(doc, from_json) == nullptr;
+  }
+  {
+    JsonDocument doc(&json_arena);
+    ok = ok && !deserializeJson(doc, back_text, back_len) && parse_config_json(doc, from_cbor) == nullptr;
+  }
+  ok = ok && memcmp(&from_json, &from_cbor, sizeof(RuntimeConfig)) == 0;
+  Serial.printf("bench cbor config round_trip=%s\n", ok ? "ok" : "FAIL");
+}
+
+// Per-minute timeline as little-endian binary. Optional from/to (minutes,
+// to exclusive) select a window. Header: date (u32), first minute (u16),
+// bucket count (u16), bucket size (u8), version (u8), reserved (u16).
+static void handle_timeline() {
+  int from = server.hasArg("from") ? server.arg("from").toInt() : 0;
+  int to = server.hasArg("to") ? server.arg("to").toInt() : TIMELINE_MINUTES;
+  from = constrain(from, 0, TIMELINE_MINUTES);
+  to = constrain(to, from, TIMELINE_MINUTES);
+  const uint16_t count = static_cast<uint16_t>(to - from);
+
+  uint8_t header[12];
+  put_u32_le(&header[0], current_date_yyyymmdd);
+  put_u16_le(&header[4], static_cast<uint16_t>(from));
+  put_u16_le(&header[6], count);
+  header[8] = static_cast<uint8_t>(sizeof(TimelineBucket));
+  header[9] = 1;
+  put_u16_le(&header[10], 0);
+
+  server.setContentLength(sizeof(header) + count * sizeof(TimelineBucket));
+  server.send(200, "application/octet-stream", "");
+  server.sendContent(reinterpret_cast<const char *>(header), sizeof(header));
+  if (count > 0) {
+    server.sendContent(reinterpret_cast<const char *>(&timeline[from]), count * sizeof(TimelineBucket));
+  }
+}
+
+// Day track as little-endian binary. Optional from/to (seconds of day, to
+// exclusive) select a window and level (0-3: 1 s, 10 s, 60 s, 10 min
+// steps) the resolution; without level the finest one with at most
+// TRACK_AUTO_MAX_POINTS points is used. Header: date (u32), first slot
+// (u32), point count (u32), step in s (u16), point size (u8), version (u8).
+// Points are lat/lon in 1e-7 degrees (i32 each), sent from the level array.
+static void handle_track() {
+  uint32_t from = server.hasArg("from") ? constrain(server.arg("from").toInt(), 0, 86400) : 0;
+  uint32_t to = server.hasArg("to") ? constrain(server.arg("to").toInt(), 0, 86400) : 86400;
+  to = max(to, from);
+  int level = track_pick_level(from, to);
+  if (server.hasArg("level")) {
+    const String arg = server.arg("level");
+    level = (arg.length() == 1 && isdigit(static_cast<unsigned char>(arg[0]))) ? arg[0] - '0' : -1;
+  }
+  if (level < 0 || level >= TRACK_LEVELS || track_level[level] == nullptr) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"level\"}");
+    return;
+  }
+  const uint16_t step = TRACK_STEP_S[level];
+  const uint32_t first = from / step;
+  // Long windows at fine levels (a day at 1 s is 691 KB) are sent in
+  // slices; the header says where this one ends.
+  const uint32_t count = min((to + step - 1) / step - first, TRACK_MAX_POINTS);
+
+  uint8_t header[16];
+  put_u32_le(&header[0], current_date_yyyymmdd);
+  put_u32_le(&header[4], first);
+  put_u32_le(&header[8], count);
+  put_u16_le(&header[12], step);
+  header[14] = static_cast<uint8_t>(sizeof(TrackPoint));
+  header[15] = 1;
+
+  server.setContentLength(sizeof(header) + count * sizeof(TrackPoint));
+  server.send(200, "application/octet-stream", "");
+  server.sendContent(reinterpret_cast<const char *>(header), sizeof(header));
+  if (count > 0) {
+    server.sendContent(reinterpret_cast<const char *>(&track_level[level][first]), count * sizeof(TrackPoint));
+  }
+}
 
-  const String ap_ssid = doc["wifi"]["ap_ssid"] | next.ap_ssid;
-  const String ap_pass = doc["wifi"]["ap_pass"] | String("");
-  const bool ap_open = doc["wifi"]["ap_open"] | false;
-  const String mdns = doc["wifi"]["mdns"] | next.mdns;
-  if (ap_ssid.length() < 1 || ap_ssid.length() > 32) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"ssid\"}");
+// Live LED preview as server-sent events (see led_stream_poll()). The
+// socket is taken over from the web server, which only drops its handle,
+// so the handler returns at once and frames go out after each led_show().
+// A new viewer replaces the previous one. ?range=1-6 forces that speed
+// range on the body until the viewer leaves (or LED_PREVIEW_MAX_MS).
+static void handle_leds_stream() {
+  const int range = server.hasArg("range") ? server.arg("range").toInt() : 0;
+  if (range < 0 || range > 6) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"range\"}");
     return;
   }
-  if (!ap_open && ap_pass.length() > 0 && ap_pass.length() < 8) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"pass\"}");
+  if (led_stream.active) {
+    led_stream_close();
+  }
+  led_stream.client = server.client();
+  server.client().stop();
+  led_stream.client.setNoDelay(true);
+  led_stream.client.print("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                          "Cache-Control: no-cache\r\nConnection: close\r\n\r\nretry: 2000\n\n");
+  led_stream.active = true;
+  led_stream.need_key = true;
+  led_stream.out_len = 0;
+  led_stream.out_pos = 0;
+  led_stream.next_ms = millis();
+  led_stream.viewers++;
+  if (range > 0) {
+    led_preview_range = static_cast<uint8_t>(range);
+    led_preview_until_ms = millis() + LED_PREVIEW_MAX_MS;
+    led_stream.owns_preview = true;
+  }
+}
+
+// Fix log as the raw LogRecord stream, oldest first. Flash is read
+// LOG_CHUNK_BYTES at a time into one static buffer, so RAM use does not
+// grow with the log. The whole log is sent chunked; a single Range
+// (bytes=a-b, a-, -n) gets 206 with Content-Range for resuming. The ETag
+// is the oldest record's time, so If-Range falls back to the whole log
+// after the ring erased the start of an interrupted download.
+static void handle_log() {
+  if (log_part == nullptr) {
+    server.send(404, "application/json", "{\"status\":\"error\",\"reason\":\"no log partition\"}");
     return;
   }
-  if (!valid_mdns(mdns)) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"reason\":\"mdns\"}");
+  const uint32_t total = log_size();
+  const uint32_t oldest = log_oldest();
+  char etag[12];
+  snprintf(etag, sizeof(etag), "\"%08lx\"", static_cast<unsigned long>(total > 0 ? log_read_u32(oldest) : 0));
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Accept-Ranges", "bytes");
+
+  uint32_t from = 0;
+  uint32_t to = total;
+  const bool partial = server.header("Range").length() > 0 &&
+                       (!server.hasHeader("If-Range") || server.header("If-Range") == etag);
+  char content_range[40];
+  if (partial && !parse_byte_range(server.header("Range").c_str(), total, &from, &to)) {
+    snprintf(content_range, sizeof(content_range), "bytes */%lu", static_cast<unsigned long>(total));
+    server.sendHeader("Content-Range", content_range);
+    server.send(416, "application/json", "{\"status\":\"error\",\"reason\":\"range\"}");
     return;
   }
-  next.ap_ssid = ap_ssid;
-  if (ap_open) {
-    next.ap_pass = "";
-  } else if (ap_pass.length() > 0) {
-    next.ap_pass = ap_pass;
+  if (partial) {
+    snprintf(content_range, sizeof(content_range), "bytes %lu-%lu/%lu", static_cast<unsigned long>(from),
+             static_cast<unsigned long>(to - 1), static_cast<unsigned long>(total));
+    server.sendHeader("Content-Range", content_range);
+    server.setContentLength(to - from);
+    server.send(206, "application/octet-stream", "");
+  } else {
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "application/octet-stream", "");
   }
-  next.mdns = mdns;
 
-  RuntimeConfig previous = g_cfg;
-  g_cfg = next;
-  save_config();
-  apply_config(previous);
-  const bool wifi_restart = (g_cfg.ap_ssid != previous.ap_ssid || g_cfg.ap_pass != previous.ap_pass);
-  if (wifi_restart) {
-    pending_ap_restart = true;
-    pending_ap_at_ms = millis();
+  const uint32_t start_ms = millis();
+  uint32_t pos = from;
+  while (pos < to) {
+    const uint32_t at = (oldest + pos) % log_ring;
+    const uint32_t n = min(min<uint32_t>(to - pos, LOG_CHUNK_BYTES), log_ring - at);
+    if (esp_partition_read(log_part, at, log_chunk, n) != ESP_OK) {
+      ++log_stats.errors;
+      break;
+    }
+    server.sendContent(reinterpret_cast<const char *>(log_chunk), n);
+    pos += n;
   }
-  server.send(200, "application/json", wifi_restart ? "{\"status\":\"ok\",\"wifi_restart\":true}"
-                                                     : "{\"status\":\"ok\",\"wifi_restart\":false}");
+  if (!partial) {
+    server.sendContent("", 0); // Terminating chunk.
+  }
+  ++log_stats.downloads;
+  log_stats.last_bytes = pos - from;
+  log_stats.last_ms = millis() - start_ms;
 }
 
-static void handle_config_reset() {
-  prefs_cfg.clear();
-  RuntimeConfig previous = g_cfg;
-  set_default_config();
-  save_config();
-  apply_config(previous);
-  if (g_cfg.ap_ssid != previous.ap_ssid || g_cfg.ap_pass != previous.ap_pass) {
-    pending_ap_restart = true;
-    pending_ap_at_ms = millis();
+// Log state and the last download's throughput (serial `log`). With bench,
+// also time reading the whole log through the download buffer, which is
+// the flash side of /api/log without Wi-Fi.
+static void print_log(bool bench) {
+  if (log_part == nullptr) {
+    Serial.println("log: no partition");
+    return;
   }
-  server.send(200, "application/json", "{\"status\":\"ok\"}");
+  const uint32_t total = log_size();
+  Serial.printf("log bytes=%lu records=%lu capacity=%lu head=%lu wrapped=%d appends=%lu errors=%lu formatted=%lu\n",
+                static_cast<unsigned long>(total), static_cast<unsigned long>(total / sizeof(LogRecord)),
+                static_cast<unsigned long>(log_ring), static_cast<unsigned long>(log_head), log_wrapped ? 1 : 0,
+                static_cast<unsigned long>(log_stats.appends), static_cast<unsigned long>(log_stats.errors),
+                static_cast<unsigned long>(log_stats.formatted));
+  Serial.printf("log downloads=%lu last_bytes=%lu last_ms=%lu kib_s=%.1f\n",
+                static_cast<unsigned long>(log_stats.downloads), static_cast<unsigned long>(log_stats.last_bytes),
+                static_cast<unsigned long>(log_stats.last_ms),
+                log_stats.last_ms > 0 ? log_stats.last_bytes / 1.024f / log_stats.last_ms : 0.0f);
+  if (!bench) {
+    return;
+  }
+  const uint32_t oldest = log_oldest();
+  const uint32_t heap_before = ESP.getFreeHeap();
+  const uint32_t start_us = micros();
+  for (uint32_t pos = 0; pos < total;) {
+    const uint32_t at = (oldest + pos) % log_ring;
+    const uint32_t n = min(min<uint32_t>(total - pos, LOG_CHUNK_BYTES), log_ring - at);
+    esp_partition_read(log_part, at, log_chunk, n);
+    pos += n;
+  }
+  const uint32_t us = micros() - start_us;
+  Serial.printf("log bench bytes=%lu us=%lu kib_s=%.1f heap_delta=%ld\n", static_cast<unsigned long>(total),
+                static_cast<unsigned long>(us), us > 0 ? total * 1000.0f / 1.024f / us : 0.0f,
+                static_cast<long>(heap_before) - static_cast<long>(ESP.getFreeHeap()));
 }
 
-static void handle_config_page() {
-  server.send(200, "text/html", html_config_page());
+// Download the trace ring as a binary dump (see tools/trace2chrome.py).
+static void handle_trace() {
+  uint8_t header[TRACE_HEADER_SIZE];
+  uint32_t first = 0;
+  const uint32_t count = trace_fill_header(header, &first);
+  server.setContentLength(TRACE_HEADER_SIZE + count * sizeof(TraceEvent));
+  server.send(200, "application/octet-stream", "");
+  server.sendContent(reinterpret_cast<const char *>(header), sizeof(header));
+
+  // Oldest events run to the end of the ring, the rest wrap to index 0.
+  const uint32_t start = first & (TRACE_RING_EVENTS - 1);
+  const uint32_t tail = min(count, TRACE_RING_EVENTS - start);
+  server.sendContent(reinterpret_cast<const char *>(&trace_ring[start]), tail * sizeof(TraceEvent));
+  if (count > tail) {
+    server.sendContent(reinterpret_cast<const char *>(trace_ring), (count - tail) * sizeof(TraceEvent));
+  }
 }
 
 static void handle_wifi_save() {
@@ -1064,22 +5874,28 @@ static void handle_wifi_save() {
   }
   const String ssid = server.arg("ssid");
   const String pass = server.arg("pass");
-  save_wifi_creds(ssid, pass);
+  if (ssid.length() > SSID_MAX || pass.length() > PASS_MAX) {
+    server.send(400, "text/plain", "ssid/pass too long");
+    return;
+  }
+  save_wifi_creds(ssid.c_str(), pass.c_str());
   start_sta_mode();
   server.send(200, "text/plain", "saved, connecting");
 }
 
 static void start_ap_mode() {
+  trace_event(TRACE_WIFI, TRACE_INSTANT, TRACE_WIFI_AP);
   WiFi.mode(WIFI_AP);
-  WiFi.softAP(g_cfg.ap_ssid.c_str(), g_cfg.ap_pass.c_str());
+  WiFi.softAP(g_cfg.ap_ssid, g_cfg.ap_pass);
   wifi_sta_connected = false;
   wifi_sta_connecting = false;
 }
 
 static void start_sta_mode() {
+  trace_event(TRACE_WIFI, TRACE_INSTANT, TRACE_WIFI_STA_START);
   WiFi.mode(WIFI_AP_STA);
-  WiFi.softAP(g_cfg.ap_ssid.c_str(), g_cfg.ap_pass.c_str());
-  WiFi.begin(wifi_ssid.c_str(), wifi_pass.c_str());
+  WiFi.softAP(g_cfg.ap_ssid, g_cfg.ap_pass);
+  WiFi.begin(wifi_ssid, wifi_pass);
   wifi_sta_connected = false;
   wifi_sta_connecting = true;
   wifi_sta_start_ms = millis();
@@ -1087,26 +5903,375 @@ static void start_sta_mode() {
 
 static void setup_wifi() {
   load_wifi_creds();
-  if (wifi_ssid.length() > 0) {
+  if (wifi_ssid[0] != '\0') {
     start_sta_mode();
   } else {
     start_ap_mode();
   }
 }
 
+// Register a route whose handler is bracketed by TRACE_HTTP events.
+// The event arg is the route index in registration order.
+// Register a traced route. With body set, the request body is passed
+// raw to it (see capture_post_body()) before the handler runs.
+static void http_on(const char *uri, HTTPMethod method, void (*handler)(), void (*body)() = nullptr) {
+  static uint16_t next_route = 0;
+  const uint16_t route = next_route++;
+  auto traced = [handler, route]() {
+    trace_event(TRACE_HTTP, TRACE_BEGIN, route);
+    handler();
+    trace_event(TRACE_HTTP, TRACE_END, route);
+  };
+  if (body != nullptr) {
+    server.on(uri, method, traced, body);
+  } else {
+    server.on(uri, method, traced);
+  }
+}
+
 static void setup_http() {
-  server.on("/", HTTP_GET, handle_root);
-  server.on("/api/summary", HTTP_GET, handle_summary);
-  server.on("/api/config", HTTP_GET, handle_config_get);
-  server.on("/api/config", HTTP_POST, handle_config_post);
-  server.on("/api/config/reset", HTTP_POST, handle_config_reset);
-  server.on("/config", HTTP_GET, handle_config_page);
-  server.on("/wifi", HTTP_GET, handle_wifi_page);
-  server.on("/api/wifi", HTTP_POST, handle_wifi_save);
+  static const char *headers[] = {"Accept", "Content-Type", "Range", "If-Range"};
+  server.collectHeaders(headers, 4);
+  http_on("/", HTTP_GET, handle_root);
+  http_on("/api/summary", HTTP_GET, handle_summary);
+  http_on("/api/status", HTTP_GET, handle_status);
+  http_on("/api/state", HTTP_GET, handle_state);
+  http_on("/api/config", HTTP_GET, handle_config_get);
+  http_on("/api/config", HTTP_POST, handle_config_post, capture_post_body);
+  http_on("/api/config/reset", HTTP_POST, handle_config_reset);
+  http_on("/config", HTTP_GET, handle_config_page);
+  http_on("/wifi", HTTP_GET, handle_wifi_page);
+  http_on("/api/wifi", HTTP_POST, handle_wifi_save);
+  http_on("/api/trace", HTTP_GET, handle_trace);
+  http_on("/api/timeline", HTTP_GET, handle_timeline);
+  http_on("/api/track", HTTP_GET, handle_track);
+  http_on("/api/log", HTTP_GET, handle_log);
+  http_on("/api/leds/stream", HTTP_GET, handle_leds_stream);
+  http_on("/api/zones", HTTP_GET, handle_zones_get);
+  http_on("/api/zones", HTTP_POST, handle_zones_post);
+  http_on("/effects", HTTP_GET, handle_effects_page);
+  http_on("/api/effects/programs", HTTP_GET, handle_programs_get);
+  http_on("/api/effects/programs", HTTP_POST, handle_programs_post);
   server.begin();
 }
 
-// Expose the daily summary via BLE (read-only).
+// BLE bulk transfer. The app writes a request to the control point and the
+// object is streamed as notifications on the data characteristic:
+//   [offset u32][payload][crc32 u32 over offset + payload]
+// A request with a non-zero offset resumes an interrupted transfer.
+enum BulkObject : uint8_t {
+  BULK_OBJ_HISTORY = 0,
+  BULK_OBJ_TIMELINE = 1,
+};
+
+enum BulkOp : uint8_t {
+  BULK_OP_START = 1,
+  BULK_OP_ABORT = 2,
+  BULK_OP_DONE = 3,
+};
+
+enum BulkStatus : uint8_t {
+  BULK_OK = 0,
+  BULK_BAD_REQUEST = 1,
+  BULK_BAD_OFFSET = 2,
+  BULK_ABORTED = 3,
+};
+
+static const size_t BULK_REQUEST_LEN = 14; // op, object, from, to, offset.
+static const size_t BULK_CHUNK_OVERHEAD = 8; // offset + crc32.
+
+struct BulkTransfer {
+  bool active;
+  uint8_t object;
+  uint32_t date; // Day the object belongs to; a day change aborts.
+  const uint8_t *data;
+  uint32_t total;
+  uint32_t offset;
+  uint32_t sent;
+  uint32_t start_ms;
+  uint32_t waits; // Loop passes with no credit or a congested link.
+};
+
+typedef void (*BulkSink)(const uint8_t *data, size_t len);
+
+static BulkTransfer bulk = {};
+static uint8_t bulk_history_buf[HISTORY_DAYS * 16];
+static uint8_t bulk_chunk[BLE_MTU - 3];
+static std::atomic<uint16_t> bulk_mtu{23};
+static std::atomic<bool> bulk_disconnected{false};
+
+// Control point writes arrive on the BLE task. The request is handed to
+// loop() through a one-slot mailbox; writes while it is full are dropped.
+// The release store of pending publishes the request bytes to loop().
+static uint8_t bulk_request[BULK_REQUEST_LEN];
+static std::atomic<bool> bulk_request_pending{false};
+
+// Notification flow control. notify() only queues the packet in the
+// controller; a burst beyond its buffers fails (GATT_CONGESTED) and the
+// chunk is lost. Every notification takes a credit, given back by its
+// ESP_GATTS_CONF_EVT or by a failed notify, and nothing is sent while the
+// stack reports the link congested (ESP_GATTS_CONGEST_EVT).
+static std::atomic<int> bulk_credits{BLE_BULK_CREDITS};
+static std::atomic<bool> bulk_congested{false};
+static std::atomic<uint32_t> bulk_lost{0}; // Refused or unconfirmed notifications.
+
+// Resolve an object and date range (to = 0 means open-ended) to a byte range.
+// History records are copied oldest first; the timeline is served in place
+// and only up to the current minute, whose bucket is still changing.
+static bool bulk_prepare(BulkTransfer &t, uint8_t object, uint32_t from, uint32_t to) {
+  if (to == 0) {
+    to = 0xFFFFFFFFu;
+  }
+  t.object = object;
+  t.date = current_date_yyyymmdd;
+  if (object == BULK_OBJ_HISTORY) {
+    uint32_t len = 0;
+    for (int i = 0; i < history.count; ++i) {
+      const int slot = (history.head - history.count + i + HISTORY_DAYS) % HISTORY_DAYS;
+      const uint32_t date = get_u32_le(history.records[slot]);
+      if (date >= from && date <= to) {
+        memcpy(&bulk_history_buf[len], history.records[slot], 16);
+        len += 16;
+      }
+    }
+    t.data = bulk_history_buf;
+    t.total = len;
+    return true;
+  }
+  if (object == BULK_OBJ_TIMELINE) {
+    const bool in_range = current_date_yyyymmdd >= from && current_date_yyyymmdd <= to;
+    t.data = reinterpret_cast<const uint8_t *>(timeline);
+    t.total = in_range ? last_update_min * sizeof(TimelineBucket) : 0;
+    return true;
+  }
+  return false;
+}
+
+// Build the next chunk into out; returns its length (0 when done).
+static size_t bulk_next_chunk(BulkTransfer &t, uint8_t *out, uint16_t mtu) {
+  if (t.offset >= t.total) {
+    return 0;
+  }
+  const size_t max_payload = min<size_t>(mtu - 3, sizeof(bulk_chunk)) - BULK_CHUNK_OVERHEAD;
+  const size_t n = min<size_t>(max_payload, t.total - t.offset);
+  put_u32_le(out, t.offset);
+  memcpy(out + 4, t.data + t.offset, n);
+  put_u32_le(out + 4 + n, crc32_update(0, out, 4 + n));
+  t.offset += n;
+  t.sent += n;
+  return 4 + n + 4;
+}
+
+// Send up to max_chunks chunks; returns true when the transfer finished.
+static bool bulk_pump(BulkTransfer &t, BulkSink sink, uint16_t mtu, int max_chunks) {
+  for (int i = 0; i < max_chunks; ++i) {
+    const size_t len = bulk_next_chunk(t, bulk_chunk, mtu);
+    if (len == 0) {
+      return true;
+    }
+    sink(bulk_chunk, len);
+  }
+  return t.offset >= t.total;
+}
+
+static void bulk_credit_return() {
+  int c = bulk_credits.load(std::memory_order_relaxed);
+  while (c < BLE_BULK_CREDITS && !bulk_credits.compare_exchange_weak(c, c + 1, std::memory_order_relaxed)) {
+  }
+}
+
+static void bulk_notify(BLECharacteristic *characteristic, const uint8_t *data, size_t len) {
+  bulk_credits.fetch_sub(1, std::memory_order_relaxed);
+  characteristic->setValue(data, len);
+  characteristic->notify();
+}
+
+static void bulk_notify_sink(const uint8_t *data, size_t len) {
+  bulk_notify(bulk_data_char, data, len);
+}
+
+// GATTS events on the BLE task (BLEDevice::setCustomGattsHandler()).
+static void bulk_gatts_event(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) {
+  if (event == ESP_GATTS_CONF_EVT) {
+    if (param->conf.status != ESP_GATT_OK) {
+      bulk_lost.fetch_add(1, std::memory_order_relaxed);
+    }
+    bulk_credit_return();
+  } else if (event == ESP_GATTS_CONGEST_EVT) {
+    bulk_congested.store(param->congest.congested, std::memory_order_relaxed);
+  }
+}
+
+// Control point response: [op | 0x80][status][object][u32][u32]. START
+// answers with total length and CRC-32 of the whole object, DONE with the
+// bytes sent and elapsed milliseconds.
+static void bulk_respond(uint8_t op, uint8_t status, uint8_t object, uint32_t a, uint32_t b) {
+  uint8_t out[11];
+  out[0] = static_cast<uint8_t>(op | 0x80);
+  out[1] = status;
+  out[2] = object;
+  put_u32_le(&out[3], a);
+  put_u32_le(&out[7], b);
+  bulk_notify(bulk_control_char, out, sizeof(out));
+}
+
+static void bulk_finish(uint8_t status) {
+  const uint32_t elapsed_ms = millis() - bulk.start_ms;
+  bulk_respond(BULK_OP_DONE, status, bulk.object, bulk.sent, elapsed_ms);
+  Serial.printf("bulk done object=%u status=%u bytes=%lu ms=%lu kBps=%.1f waits=%lu lost=%lu\n",
+                bulk.object, status, static_cast<unsigned long>(bulk.sent),
+                static_cast<unsigned long>(elapsed_ms),
+                elapsed_ms > 0 ? bulk.sent / static_cast<float>(elapsed_ms) : 0.0f,
+                static_cast<unsigned long>(bulk.waits),
+                static_cast<unsigned long>(bulk_lost.exchange(0, std::memory_order_relaxed)));
+  bulk.active = false;
+}
+
+static void bulk_handle_request(const uint8_t *req) {
+  const uint8_t op = req[0];
+  const uint8_t object = req[1];
+  if (op == BULK_OP_ABORT) {
+    if (bulk.active) {
+      bulk_finish(BULK_ABORTED);
+    }
+    return;
+  }
+  BulkTransfer t = {};
+  if (op != BULK_OP_START || !bulk_prepare(t, object, get_u32_le(&req[2]), get_u32_le(&req[6]))) {
+    bulk_respond(op, BULK_BAD_REQUEST, object, 0, 0);
+    return;
+  }
+  t.offset = get_u32_le(&req[10]);
+  if (t.offset > t.total) {
+    bulk_respond(op, BULK_BAD_OFFSET, object, t.total, 0);
+    return;
+  }
+  t.active = true;
+  t.start_ms = millis();
+  bulk = t;
+  bulk_lost.store(0, std::memory_order_relaxed);
+  bulk_respond(op, BULK_OK, object, t.total, crc32_update(0, t.data, t.total));
+}
+
+// Whether the link takes another notification now.
+static bool bulk_can_notify() {
+  return !bulk_congested.load(std::memory_order_relaxed) && bulk_credits.load(std::memory_order_relaxed) > 0;
+}
+
+// Called from loop(): take a pending request, then stream as many chunks
+// as there are credits, at most BLE_BULK_CHUNKS_PER_LOOP. Responses wait
+// for a credit like the chunks do.
+static void bulk_poll() {
+  if (bulk_disconnected.exchange(false, std::memory_order_relaxed)) {
+    if (bulk.active) {
+      Serial.println("bulk aborted: disconnected");
+      bulk.active = false;
+    }
+  }
+  if (!bulk_can_notify()) {
+    bulk.waits += bulk.active ? 1 : 0;
+    return;
+  }
+  if (bulk_request_pending.load(std::memory_order_acquire)) {
+    uint8_t req[BULK_REQUEST_LEN];
+    memcpy(req, bulk_request, sizeof(req));
+    bulk_request_pending.store(false, std::memory_order_release);
+    bulk_handle_request(req);
+  }
+  if (!bulk.active) {
+    return;
+  }
+  if (bulk.date != current_date_yyyymmdd) {
+    bulk_finish(BULK_ABORTED);
+    return;
+  }
+  // One chunk at a time: a CONGEST_EVT raised by the last notify stops the
+  // next one.
+  for (int i = 0; i < BLE_BULK_CHUNKS_PER_LOOP; ++i) {
+    if (!bulk_can_notify()) {
+      bulk.waits++;
+      return;
+    }
+    if (bulk.offset >= bulk.total) {
+      bulk_finish(BULK_OK);
+      return;
+    }
+    bulk_pump(bulk, bulk_notify_sink, bulk_mtu.load(std::memory_order_relaxed), 1);
+  }
+}
+
+class BulkServerCallbacks : public BLEServerCallbacks {
+  void onConnect(BLEServer *server, esp_ble_gatts_cb_param_t *param) override {
+    // Ask for 251-byte link-layer packets so a full chunk needs fewer PDUs.
+    esp_ble_gap_set_pkt_data_len(param->connect.remote_bda, 251);
+  }
+
+  void onDisconnect(BLEServer *server) override {
+    // Queued notifications die with the link; their CONF_EVTs may not come.
+    bulk_mtu.store(23, std::memory_order_relaxed);
+    bulk_credits.store(BLE_BULK_CREDITS, std::memory_order_relaxed);
+    bulk_congested.store(false, std::memory_order_relaxed);
+    bulk_disconnected.store(true, std::memory_order_relaxed);
+    BLEDevice::startAdvertising();
+  }
+
+  void onMtuChanged(BLEServer *server, esp_ble_gatts_cb_param_t *param) override {
+    bulk_mtu.store(param->mtu.mtu, std::memory_order_relaxed);
+  }
+};
+
+// A notify the stack refused never gets a CONF_EVT: give its credit back.
+class BulkNotifyCallbacks : public BLECharacteristicCallbacks {
+  void onStatus(BLECharacteristic *characteristic, Status s, uint32_t code) override {
+    if (s != SUCCESS_NOTIFY && s != SUCCESS_INDICATE) {
+      bulk_lost.fetch_add(1, std::memory_order_relaxed);
+      bulk_credit_return();
+    }
+  }
+};
+
+class BulkControlCallbacks : public BulkNotifyCallbacks {
+  void onWrite(BLECharacteristic *characteristic) override {
+    if (bulk_request_pending.load(std::memory_order_acquire) || characteristic->getLength() != BULK_REQUEST_LEN) {
+      return;
+    }
+    memcpy(bulk_request, characteristic->getData(), BULK_REQUEST_LEN);
+    bulk_request_pending.store(true, std::memory_order_release);
+  }
+};
+
+static uint32_t bulk_bench_bytes = 0;
+
+static void bulk_bench_sink(const uint8_t *data, size_t len) {
+  bulk_bench_bytes += len;
+}
+
+// Chunk a full-day timeline into a counting sink instead of the radio, to
+// measure the framing + CRC cost per MTU (serial `bulk bench`).
+static void bulk_bench() {
+  static const uint16_t mtus[] = {23, 185, 247, 517};
+  const uint32_t mhz = ESP.getCpuFreqMHz();
+  for (uint16_t mtu : mtus) {
+    BulkTransfer t = {};
+    t.data = reinterpret_cast<const uint8_t *>(timeline);
+    t.total = sizeof(timeline);
+    bulk_bench_bytes = 0;
+    uint32_t chunks = 0;
+    const uint32_t start = ESP.getCycleCount();
+    while (!bulk_pump(t, bulk_bench_sink, mtu, 1)) {
+      chunks++;
+    }
+    const uint32_t cycles = ESP.getCycleCount() - start;
+    const float us = cycles / static_cast<float>(mhz);
+    Serial.printf("bench bulk mtu=%u chunks=%lu wire_bytes=%lu payload_pct=%.1f cpu_kBps=%.0f\n",
+                  mtu, static_cast<unsigned long>(chunks + 1),
+                  static_cast<unsigned long>(bulk_bench_bytes),
+                  100.0f * t.total / bulk_bench_bytes,
+                  us > 0 ? t.total * 1000.0f / us : 0.0f);
+  }
+}
+
+// Expose the daily summary (read-only) and the bulk transfer service via BLE.
 static void setup_ble() {
   BLEDevice::init(BLE_DEVICE_NAME);
   BLEServer *server = BLEDevice::createServer();
@@ -1114,13 +6279,281 @@ static void setup_ble() {
   summary_char = service->createCharacteristic(
       BLE_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
   summary_char->setValue("init");
+  activity_char = service->createCharacteristic(
+      BLE_ACTIVITY_UUID, BLECharacteristic::PROPERTY_READ);
+  activity_char->setValue("init");
   service->start();
+
+  BLEDevice::setMTU(BLE_MTU);
+  BLEDevice::setCustomGattsHandler(bulk_gatts_event);
+  server->setCallbacks(new BulkServerCallbacks());
+  BLEService *bulk_service = server->createService(BLE_BULK_SERVICE_UUID);
+  bulk_control_char = bulk_service->createCharacteristic(
+      BLE_BULK_CONTROL_UUID, BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
+  bulk_control_char->addDescriptor(new BLE2902());
+  bulk_control_char->setCallbacks(new BulkControlCallbacks());
+  bulk_data_char = bulk_service->createCharacteristic(
+      BLE_BULK_DATA_UUID, BLECharacteristic::PROPERTY_NOTIFY);
+  bulk_data_char->addDescriptor(new BLE2902());
+  bulk_data_char->setCallbacks(new BulkNotifyCallbacks());
+  bulk_service->start();
+
   BLEAdvertising *adv = BLEDevice::getAdvertising();
   adv->addServiceUUID(BLE_SERVICE_UUID);
   adv->setScanResponse(true);
   adv->start();
 }
 
+// IMU. A task on core 0 drains the ICM-42688 FIFO every IMU_POLL_MS in
+// I2C bursts (8-byte accel packets at IMU_ODR_HZ) and turns the samples
+// into an activity intensity: the low-passed deviation of |a| from its
+// slow (gravity) average, in mg, all in Q8 fixed point. The task is the
+// only writer of its filter and publishes it through a Seqlock after each
+// poll; with replay on, loop() feeds recorded bursts into a filter of its
+// own instead. GNSS speed anchors the LED speed between fixes.
+static const uint8_t ICM_DEVICE_CONFIG = 0x11;
+static const uint8_t ICM_FIFO_CONFIG = 0x16;
+static const uint8_t ICM_FIFO_COUNTH = 0x2E;
+static const uint8_t ICM_FIFO_DATA = 0x30;
+static const uint8_t ICM_SIGNAL_PATH_RESET = 0x4B;
+static const uint8_t ICM_PWR_MGMT0 = 0x4E;
+static const uint8_t ICM_ACCEL_CONFIG0 = 0x50;
+static const uint8_t ICM_FIFO_CONFIG1 = 0x5F;
+static const uint8_t ICM_WHO_AM_I = 0x75;
+static const uint8_t ICM_WHO_AM_I_VALUE = 0x47;
+static const size_t IMU_PACKET = 8; // Header, accel XYZ (big-endian), temp.
+static const size_t IMU_BURST_BYTES = 15 * IMU_PACKET; // Fits the 128-byte Wire buffer.
+static const int32_t IMU_LSB_PER_G = 8192; // +-4 g full scale.
+static const int IMU_GRAVITY_SHIFT = 7; // ~0.64 s at 200 Hz.
+static const int IMU_INTENSITY_SHIFT = 4; // ~80 ms at 200 Hz.
+
+struct ImuState {
+  int32_t gravity_q8;       // Slow average of |a|, mg Q8.
+  int32_t intensity_q8;     // Low-passed ||a| - gravity|, mg Q8.
+  uint32_t samples;
+  uint32_t active_samples;  // Samples with intensity above IMU_ACTIVE_MG.
+  uint32_t bad_packets;
+  uint32_t i2c_errors;
+  uint32_t bursts;
+  uint32_t max_burst;       // Bytes in the largest drain.
+};
+static const ImuState IMU_CLEAN = {1000 << 8, 0, 0, 0, 0, 0, 0, 0};
+static ImuState imu = IMU_CLEAN; // IMU task only.
+static Seqlock<ImuState> imu_pub; // imu as of the last poll.
+static ImuState imu_replay = IMU_CLEAN; // loop() only; fed by `IMU <hex>`.
+static std::atomic<bool> imu_ready{false};
+static std::atomic<uint16_t> imu_record_bursts{0}; // `imu rec`: bursts left to capture.
+
+// `imu rec` capture ring: the IMU task copies each drained burst in and
+// loop() prints it (imu_rec_poll()), so the hex lines never land in the
+// middle of other console output. Single producer, single consumer.
+static const uint32_t IMU_REC_RING = 2048; // Power of two, bytes.
+static uint8_t imu_rec_ring[IMU_REC_RING];
+static std::atomic<uint32_t> imu_rec_head{0}; // Written by the IMU task.
+static std::atomic<uint32_t> imu_rec_tail{0}; // Written by loop().
+static std::atomic<uint32_t> imu_rec_dropped{0}; // Bursts that did not fit.
+static float imu_kph_per_mg = IMU_KPH_PER_MG;
+static float imu_kph_at_fix = 0.0f;
+static uint32_t imu_active_at_sample = 0;
+
+static uint32_t isqrt32(uint32_t v) {
+  uint32_t root = 0;
+  uint32_t bit = 1u << 30;
+  while (bit > v) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+// Fold raw FIFO bytes into the intensity filter. Pure (no I/O), so recorded
+// dumps replay exactly; stops at the empty-FIFO marker.
+static void imu_ingest(ImuState &s, const uint8_t *fifo, size_t len) {
+  for (size_t i = 0; i + IMU_PACKET <= len; i += IMU_PACKET) {
+    const uint8_t header = fifo[i];
+    if (header & 0x80) {
+      break;
+    }
+    if ((header & 0x40) == 0) {
+      s.bad_packets++;
+      continue;
+    }
+    const int32_t ax = static_cast<int16_t>((fifo[i + 1] << 8) | fifo[i + 2]);
+    const int32_t ay = static_cast<int16_t>((fifo[i + 3] << 8) | fifo[i + 4]);
+    const int32_t az = static_cast<int16_t>((fifo[i + 5] << 8) | fifo[i + 6]);
+    const uint32_t sq = static_cast<uint32_t>(ax * ax) + static_cast<uint32_t>(ay * ay) +
+                        static_cast<uint32_t>(az * az);
+    const int32_t mag_q8 = static_cast<int32_t>((static_cast<uint64_t>(isqrt32(sq)) * 1000u << 8) / IMU_LSB_PER_G);
+    s.gravity_q8 += (mag_q8 - s.gravity_q8) >> IMU_GRAVITY_SHIFT;
+    const int32_t dev_q8 = abs(mag_q8 - s.gravity_q8);
+    s.intensity_q8 += (dev_q8 - s.intensity_q8) >> IMU_INTENSITY_SHIFT;
+    if ((s.intensity_q8 >> 8) > IMU_ACTIVE_MG) {
+      s.active_samples++;
+    }
+    s.samples++;
+  }
+}
+
+// The filter loop() acts on: the replay one while replay is on.
+static ImuState imu_filter() {
+  return nmea_replay.load(std::memory_order_relaxed) ? imu_replay : imu_pub.read();
+}
+
+static uint32_t imu_intensity_mg() {
+  return static_cast<uint32_t>(imu_filter().intensity_q8) >> 8;
+}
+
+static uint32_t imu_active_ms() {
+  return static_cast<uint32_t>(static_cast<uint64_t>(imu_filter().active_samples) * 1000 / IMU_ODR_HZ);
+}
+
+static bool imu_write(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(IMU_I2C_ADDR);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static bool imu_read(uint8_t reg, uint8_t *out, size_t len) {
+  Wire.beginTransmission(IMU_I2C_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0 || Wire.requestFrom(IMU_I2C_ADDR, len) != len) {
+    return false;
+  }
+  return Wire.readBytes(out, len) == len;
+}
+
+static void imu_task(void *arg) {
+  uint8_t buf[IMU_BURST_BYTES];
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(IMU_POLL_MS));
+    uint8_t count_be[2];
+    if (!imu_read(ICM_FIFO_COUNTH, count_be, sizeof(count_be))) {
+      imu.i2c_errors++;
+      imu_pub.publish(imu);
+      continue;
+    }
+    size_t pending = (static_cast<size_t>(count_be[0]) << 8) | count_be[1];
+    imu.max_burst = max<uint32_t>(imu.max_burst, pending);
+    while (pending >= IMU_PACKET) {
+      const size_t n = min(pending, IMU_BURST_BYTES) / IMU_PACKET * IMU_PACKET;
+      if (!imu_read(ICM_FIFO_DATA, buf, n)) {
+        imu.i2c_errors++;
+        break;
+      }
+      // In replay mode the samples come from the console instead.
+      if (!nmea_replay.load(std::memory_order_relaxed)) {
+        imu_ingest(imu, buf, n);
+      }
+      if (imu_record_bursts.load(std::memory_order_relaxed) > 0) {
+        const uint32_t head = imu_rec_head.load(std::memory_order_relaxed);
+        if (IMU_REC_RING - (head - imu_rec_tail.load(std::memory_order_acquire)) >= n) {
+          for (size_t i = 0; i < n; ++i) {
+            imu_rec_ring[(head + i) & (IMU_REC_RING - 1)] = buf[i];
+          }
+          imu_rec_head.store(head + n, std::memory_order_release);
+        } else {
+          imu_rec_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+      pending -= n;
+      imu.bursts++;
+    }
+    if (imu_record_bursts.load(std::memory_order_relaxed) > 0) {
+      imu_record_bursts.fetch_sub(1, std::memory_order_relaxed);
+    }
+    imu_pub.publish(imu);
+  }
+}
+
+// Print captured FIFO bytes as `IMU <hex>` lines of four packets, a few
+// lines per loop pass.
+static void imu_rec_poll() {
+  uint32_t tail = imu_rec_tail.load(std::memory_order_relaxed);
+  const uint32_t head = imu_rec_head.load(std::memory_order_acquire);
+  for (int lines = 0; lines < 8 && tail != head; ++lines) {
+    uint8_t chunk[4 * IMU_PACKET];
+    const uint32_t n = min<uint32_t>(head - tail, sizeof(chunk));
+    for (uint32_t i = 0; i < n; ++i) {
+      chunk[i] = imu_rec_ring[(tail + i) & (IMU_REC_RING - 1)];
+    }
+    tail += n;
+    imu_rec_tail.store(tail, std::memory_order_release);
+    print_hex_line("IMU ", chunk, n);
+  }
+}
+
+// Probe and configure the sensor: accel low-noise mode at IMU_ODR_HZ,
+// +-4 g, accel-only FIFO in stream mode. Leaves imu_ready false if absent.
+static void imu_begin() {
+  if (!IMU_ENABLED) {
+    return;
+  }
+  Wire.begin(PIN_IMU_SDA, PIN_IMU_SCL, IMU_I2C_HZ);
+  uint8_t who = 0;
+  if (!imu_read(ICM_WHO_AM_I, &who, 1) || who != ICM_WHO_AM_I_VALUE) {
+    Serial.println("imu: not found");
+    return;
+  }
+  imu_write(ICM_DEVICE_CONFIG, 0x01); // Soft reset.
+  delay(2);
+  const uint8_t odr = (IMU_ODR_HZ >= 500) ? 0x0F : (IMU_ODR_HZ >= 200) ? 0x07 : 0x08;
+  const bool ok = imu_write(ICM_ACCEL_CONFIG0, static_cast<uint8_t>((2 << 5) | odr)) &&
+                  imu_write(ICM_FIFO_CONFIG1, 0x01) &&
+                  imu_write(ICM_FIFO_CONFIG, 0x40) &&
+                  imu_write(ICM_SIGNAL_PATH_RESET, 0x02) && // Flush FIFO.
+                  imu_write(ICM_PWR_MGMT0, 0x03);
+  if (!ok) {
+    Serial.println("imu: config failed");
+    return;
+  }
+  imu_pub.publish(imu);
+  imu_ready.store(true, std::memory_order_release);
+  xTaskCreatePinnedToCore(imu_task, "imu", 3072, nullptr, 2, nullptr, 0);
+}
+
+// Speed that drives the LED range: the last GNSS speed plus the IMU change
+// in estimated speed since that fix, so starts and stops show within a few
+// IMU polls instead of at the next 1 Hz fix.
+static float led_speed_kph() {
+  if (!imu_ready.load(std::memory_order_acquire) && !nmea_replay.load(std::memory_order_relaxed)) {
+    return last_speed_kph;
+  }
+  const float imu_kph = imu_intensity_mg() * imu_kph_per_mg;
+  return max(0.0f, last_speed_kph + (imu_kph - imu_kph_at_fix));
+}
+
+// On each fix: learn the intensity-to-speed ratio while moving and re-anchor.
+static void imu_note_fix(float speed_kph) {
+  const uint32_t mg = imu_intensity_mg();
+  if (speed_kph > SPEED_ACTIVE_KPH && mg > IMU_ACTIVE_MG) {
+    imu_kph_per_mg += (speed_kph / mg - imu_kph_per_mg) * 0.05f;
+    imu_kph_per_mg = constrain(imu_kph_per_mg, IMU_KPH_PER_MG / 4, IMU_KPH_PER_MG * 4);
+  }
+  imu_kph_at_fix = mg * imu_kph_per_mg;
+}
+
+// Feed a recorded "IMU <hex>" line (console replay).
+static void imu_feed_hex(const char *hex) {
+  uint8_t buf[IMU_BURST_BYTES];
+  size_t n = 0;
+  while (n < sizeof(buf) && isxdigit(static_cast<unsigned char>(hex[0])) &&
+         isxdigit(static_cast<unsigned char>(hex[1]))) {
+    char byte[3] = {hex[0], hex[1], '\0'};
+    buf[n++] = static_cast<uint8_t>(strtoul(byte, nullptr, 16));
+    hex += 2;
+  }
+  imu_ingest(imu_replay, buf, n);
+}
+
 // Handle a single NMEA line and update rolling metrics.
 static void handle_nmea_line(const char *line) {
   float speed_kph = 0.0f;
@@ -1129,44 +6562,243 @@ static void handle_nmea_line(const char *line) {
   bool valid_fix = false;
   uint32_t date_yyyymmdd = 0;
   uint16_t time_min = 0;
+  uint32_t time_s = 0;
 
-  if (parse_rmc(line, &lat_deg, &lon_deg, &speed_kph, &valid_fix, &date_yyyymmdd, &time_min)) {
+  trace_event(TRACE_GPS_PARSE, TRACE_BEGIN);
+  if (parse_rmc(line, &lat_deg, &lon_deg, &speed_kph, &valid_fix, &date_yyyymmdd, &time_min, &time_s)) {
     has_gps_fix = valid_fix;
+    if (valid_fix) {
+      boot_mark(boot_ms.first_fix_ms, TRACE_BOOT_FIRST_FIX);
+      gnss_note_fix(lat_deg, lon_deg, date_yyyymmdd, time_s);
+      geo_update(lat_deg, lon_deg);
+    }
     last_speed_kph = speed_kph;
     last_gps_ms = millis();
-    last_update_min = time_min;
+    imu_note_fix(speed_kph);
 
     if (date_yyyymmdd != 0 && date_yyyymmdd != current_date_yyyymmdd) {
+      history_append_day();
       current_date_yyyymmdd = date_yyyymmdd;
       total_distance_m = 0.0f;
       active_time_ms = 0;
       max_speed_kph = 0.0f;
+      memset(&activity, 0, sizeof(activity));
+      timeline_reset();
+      track_reset();
       has_last_point = false;
       save_metrics();
     }
+    last_update_min = time_min;
 
     if (has_gps_fix && speed_kph <= SPEED_MAX_VALID_KPH) {
-      const unsigned long now_ms = millis();
-      if (now_ms - last_sample_ms >= GPS_SAMPLE_MS) {
-        last_sample_ms = now_ms;
+      // Fix time in whole seconds (NMEA times have no useful fraction at
+      // 1 Hz); millis() seconds while the receiver has no date yet. The
+      // difference is widened before scaling so a long gap cannot wrap.
+      const uint32_t now_s = (date_yyyymmdd != 0) ? unix_from_utc(date_yyyymmdd, time_s)
+                                                  : static_cast<uint32_t>(millis() / 1000);
+      if (static_cast<uint64_t>(now_s - last_sample_s) * 1000u >= GPS_SAMPLE_MS) {
+        last_sample_s = now_s;
 
+        float segment_m = 0.0f;
         if (has_last_point) {
-          const float segment_m = haversine_m(last_lat_deg, last_lon_deg, lat_deg, lon_deg);
+          segment_m = haversine_m(last_lat_deg, last_lon_deg, lat_deg, lon_deg);
           if (segment_m < 50.0f) {
             total_distance_m += segment_m;
+          } else {
+            segment_m = 0.0f;
           }
         }
 
         last_lat_deg = lat_deg;
         last_lon_deg = lon_deg;
         has_last_point = true;
-
-        if (speed_kph > SPEED_ACTIVE_KPH) {
-          active_time_ms += GPS_SAMPLE_MS;
+        track_add(time_s, lat_deg, lon_deg);
+        if (date_yyyymmdd != 0) {
+          log_append(unix_from_utc(date_yyyymmdd, time_s), lat_deg, lon_deg, speed_kph);
         }
+
+        // Active credit: the whole sample above the GNSS threshold, else the
+        // time the IMU saw activity since the previous sample.
+        const uint32_t imu_active = imu_active_ms();
+        const uint32_t active_ms = (speed_kph > SPEED_ACTIVE_KPH)
+                                       ? GPS_SAMPLE_MS
+                                       : min<uint32_t>(imu_active - imu_active_at_sample, GPS_SAMPLE_MS);
+        imu_active_at_sample = imu_active;
+        active_time_ms += active_ms;
         if (speed_kph > max_speed_kph) {
           max_speed_kph = speed_kph;
         }
+
+        const uint8_t range_idx = static_cast<uint8_t>(speed_range(speed_kph) - 1);
+        activity.range_time_ms[range_idx] += GPS_SAMPLE_MS;
+        activity.range_distance_m[range_idx] += segment_m;
+        timeline_add_sample(time_min, segment_m, active_ms >= GPS_SAMPLE_MS / 2, speed_kph);
+
+        const uint16_t hour = time_min / 60;
+        if (hour < 24) {
+          activity.hour_active_ms[hour] += active_ms;
+          activity.hour_distance_m[hour] += segment_m;
+        }
+      }
+    }
+    metrics_publish();
+  }
+  trace_event(TRACE_GPS_PARSE, TRACE_END);
+}
+
+// Diagnostic commands typed on the USB serial console.
+static void handle_serial_command(const char *line) {
+  if (strcmp(line, "trace") == 0) {
+    dump_trace_serial();
+  } else if (strcmp(line, "trace clear") == 0) {
+    trace_head = 0;
+    Serial.println("trace cleared");
+  } else if (strcmp(line, "bench") == 0) {
+    run_benchmarks();
+  } else if (strcmp(line, "boot") == 0) {
+    print_boot_milestones();
+  } else if (strcmp(line, "ble") == 0) {
+    ble_start_requested = true;
+    Serial.printf("ble %s\n", ble_ready.load(std::memory_order_acquire) ? "ready" : "starting");
+  } else if (strcmp(line, "heap") == 0) {
+    print_heap("heap");
+  } else if (strncmp(line, "metrics stress", 14) == 0) {
+    unsigned long n = 100000;
+    sscanf(line + 14, "%lu", &n);
+    metrics_stress(n);
+  } else if (strcmp(line, "metrics") == 0) {
+    uint32_t version = 0;
+    const MetricsSnapshot s = metrics_pub.read(&version);
+    Serial.printf("metrics version=%lu date=%lu distance_m=%lu active_ms=%lu avg_cmps=%u max_cmps=%u "
+                  "last_update_min=%u gps_fix=%d summary_cache=%u@%lu\n",
+                  static_cast<unsigned long>(version), static_cast<unsigned long>(s.date_yyyymmdd),
+                  static_cast<unsigned long>(s.distance_m), static_cast<unsigned long>(s.active_time_ms),
+                  s.avg_speed_cmps, s.max_speed_cmps, s.last_update_min, s.gps_fix ? 1 : 0,
+                  static_cast<unsigned>(summary_cache_len), static_cast<unsigned long>(summary_cache_version));
+  } else if (strncmp(line, "soak", 4) == 0) {
+    unsigned long iterations = 10000;
+    sscanf(line + 4, "%lu", &iterations);
+    soak_start(iterations);
+  } else if (strcmp(line, "gnss") == 0) {
+    uint8_t frame[CASIC_AID_INI_FRAME];
+    uint8_t flags = 0;
+    const size_t len = gnss_prepare_aid(frame, &flags);
+    Serial.printf("gnss ttff_ms=%lu sent_flags=0x%02x last_fix_unix=%lu now_unix=%lu almanac_age_s=%ld\n",
+                  gnss_ttff_ms, gnss_aid_flags, static_cast<unsigned long>(gnss_aid.unix_s),
+                  static_cast<unsigned long>(time(nullptr)), gnss_almanac_age_s());
+    if (len > 0) {
+      print_hex_line("AID-INI ", frame, len);
+    }
+  } else if (strcmp(line, "replay on") == 0 || strcmp(line, "replay off") == 0) {
+    const bool on = (line[8] == 'n');
+    if (on && !nmea_replay.load(std::memory_order_relaxed)) {
+      imu_replay = IMU_CLEAN; // Replays start from a clean filter.
+    }
+    nmea_replay.store(on, std::memory_order_relaxed);
+    Serial.printf("replay %s\n", on ? "on" : "off");
+  } else if (strncmp(line, "nmea ", 5) == 0) {
+    handle_nmea_line(line + 5);
+  } else if (strncmp(line, "IMU ", 4) == 0) {
+    // Outside replay the sensor drives the LEDs; replay has its own filter.
+    if (nmea_replay.load(std::memory_order_relaxed)) {
+      imu_feed_hex(line + 4);
+    } else {
+      Serial.println("IMU lines need replay on");
+    }
+  } else if (strncmp(line, "imu rec", 7) == 0) {
+    unsigned bursts = 50;
+    sscanf(line + 7, "%u", &bursts);
+    imu_record_bursts.store(static_cast<uint16_t>(bursts), std::memory_order_relaxed);
+  } else if (strcmp(line, "imu") == 0) {
+    const ImuState f = imu_filter();
+    const ImuState task = imu_pub.read();
+    Serial.printf("imu ready=%d samples=%lu intensity_mg=%lu active_ms=%lu kph_per_mg=%.4f led_kph=%.2f "
+                  "bursts=%lu max_burst=%lu bad=%lu i2c_errors=%lu rec_dropped=%lu\n",
+                  imu_ready.load(std::memory_order_acquire) ? 1 : 0, static_cast<unsigned long>(f.samples),
+                  static_cast<unsigned long>(imu_intensity_mg()), static_cast<unsigned long>(imu_active_ms()),
+                  imu_kph_per_mg, led_speed_kph(), static_cast<unsigned long>(task.bursts),
+                  static_cast<unsigned long>(task.max_burst), static_cast<unsigned long>(f.bad_packets),
+                  static_cast<unsigned long>(task.i2c_errors),
+                  static_cast<unsigned long>(imu_rec_dropped.load(std::memory_order_relaxed)));
+  } else if (strcmp(line, "cbor bench") == 0) {
+    cbor_bench();
+  } else if (strcmp(line, "upload") == 0) {
+    Serial.printf("upload url=%s sta=%d pending=%d days=%lu fixes=%lu batches=%lu bytes=%lu failures=%lu "
+                  "last_code=%d backoff_ms=%lu day_cursor=%lu fix_gen=%lu fix_offset=%lu\n",
+                  g_cfg.upload_url, wifi_sta_connected ? 1 : 0, upload_pending.load(std::memory_order_relaxed) ? 1 : 0,
+                  static_cast<unsigned long>(upload.days), static_cast<unsigned long>(upload.fixes),
+                  static_cast<unsigned long>(upload.batches), static_cast<unsigned long>(upload.bytes),
+                  static_cast<unsigned long>(upload.failures), upload.last_code,
+                  static_cast<unsigned long>(upload.backoff_ms), static_cast<unsigned long>(upload.day_cursor),
+                  static_cast<unsigned long>(upload.fix_gen), static_cast<unsigned long>(upload.fix_offset));
+  } else if (strcmp(line, "upload now") == 0) {
+    upload.next_ms = millis();
+  } else if (strcmp(line, "upload reset") == 0) {
+    upload.day_cursor = 0;
+    upload.fix_gen = 0;
+    upload.fix_offset = 0;
+    upload.next_ms = millis();
+    save_upload_cursors();
+    Serial.println("upload cursors cleared");
+  } else if (strcmp(line, "log") == 0 || strcmp(line, "log bench") == 0) {
+    print_log(strcmp(line, "log bench") == 0);
+  } else if (strcmp(line, "fx bench") == 0) {
+    bench_fx();
+  } else if (strcmp(line, "fx") == 0) {
+    for (int i = 0; i < FX_PROGRAM_SLOTS; ++i) {
+      Serial.printf("fx slot=%d effect=%d name=%s ops=%u\n", i, FX_EFFECT_BASE + i, fx_programs[i].name,
+                    fx_programs[i].op_count);
+    }
+  } else if (strcmp(line, "geo bench") == 0) {
+    geo_bench();
+  } else if (strcmp(line, "bulk bench") == 0) {
+    bulk_bench();
+  } else if (strcmp(line, "leds") == 0) {
+    Serial.printf("leds preview_range=%u stream=%d viewers=%lu frames=%lu skipped=%lu bytes=%lu last_us=%lu max_us=%lu\n",
+                  led_preview_range, led_stream.active ? 1 : 0, static_cast<unsigned long>(led_stream.viewers),
+                  static_cast<unsigned long>(led_stream.frames), static_cast<unsigned long>(led_stream.skipped),
+                  static_cast<unsigned long>(led_stream.bytes), static_cast<unsigned long>(led_stream.last_us),
+                  static_cast<unsigned long>(led_stream.max_us));
+  } else if (strncmp(line, "leds preview", 12) == 0) {
+    int range = 0;
+    sscanf(line + 12, "%d", &range);
+    led_preview_range = static_cast<uint8_t>(constrain(range, 0, 6));
+    led_preview_until_ms = millis() + LED_PREVIEW_MAX_MS;
+    led_stream.owns_preview = false;
+    Serial.printf("leds preview_range=%u\n", led_preview_range);
+  } else if (strcmp(line, "sim") == 0) {
+    sim_start(SIM_JOB_CHECK);
+  } else if (strcmp(line, "sim golden") == 0) {
+    sim_start(SIM_JOB_RECORD);
+  } else if (strcmp(line, "sim stream") == 0) {
+    sim_start(SIM_JOB_STREAM);
+  } else if (strcmp(line, "sim fps") == 0) {
+    sim_start(SIM_JOB_FPS);
+  } else if (strncmp(line, "sim show", 8) == 0) {
+    int effect_id = -1;
+    int range = 0;
+    int length = LED_STRIP_COUNT;
+    sscanf(line + 8, "%d %d %d", &effect_id, &range, &length);
+    sim_show(effect_id, range, length);
+  } else {
+    Serial.println("commands: boot | heap | metrics | metrics stress [n] | soak [n] | gnss | replay on|off | nmea <sentence> | imu | imu rec [n] | IMU <hex> | trace | trace clear | bench | cbor bench | log | log bench | upload [now|reset] | fx | fx bench | geo bench | bulk bench | leds | leds preview <1-6|off> | sim | sim golden | sim fps | sim stream | sim show <effect> <range> [len]");
+  }
+}
+
+static void read_serial_commands() {
+  while (Serial.available() > 0) {
+    const char c = static_cast<char>(Serial.read());
+    if (c == '\n') {
+      serial_line[serial_len] = '\0';
+      if (serial_len > 0) {
+        handle_serial_command(serial_line);
+      }
+      serial_len = 0;
+    } else if (c != '\r') {
+      if (serial_len + 1 < sizeof(serial_line)) {
+        serial_line[serial_len++] = c;
+      } else {
+        serial_len = 0;
       }
     }
   }
@@ -1176,9 +6808,16 @@ static void handle_nmea_line(const char *line) {
 static void read_gps() {
   while (GPS.available() > 0) {
     const char c = static_cast<char>(GPS.read());
+    if (nmea_replay.load(std::memory_order_relaxed)) {
+      continue;
+    }
     if (c == '\n') {
       nmea_line[nmea_len] = '\0';
       if (nmea_len > 6) {
+        if (boot_ms.first_nmea_ms == 0) {
+          boot_mark(boot_ms.first_nmea_ms, TRACE_BOOT_FIRST_NMEA);
+          gnss_send_aid();
+        }
         handle_nmea_line(nmea_line);
       }
       nmea_len = 0;
@@ -1192,29 +6831,92 @@ static void read_gps() {
   }
 }
 
+// BLE init takes several hundred ms; run it off the loop() core.
+static void ble_start_task(void *arg) {
+  setup_ble();
+  ble_ready.store(true, std::memory_order_release);
+  vTaskDelete(nullptr);
+}
+
+// Why BLE should start now, or nullptr to keep waiting.
+static const char *ble_start_reason() {
+  if (ble_start_requested) {
+    return "requested";
+  }
+  if (boot_ms.first_fix_ms != 0) {
+    return "first_fix";
+  }
+  if (millis() >= BLE_START_DELAY_MS) {
+    return "delay";
+  }
+  return nullptr;
+}
+
+// Advance the staged boot by at most one stage per loop() pass.
+static void boot_step() {
+  switch (boot_stage) {
+    case BOOT_WIFI:
+      setup_wifi();
+      boot_mark(boot_ms.wifi_ms, TRACE_BOOT_WIFI);
+      boot_stage = BOOT_HTTP;
+      break;
+    case BOOT_HTTP:
+      setup_http();
+      boot_mark(boot_ms.portal_ms, TRACE_BOOT_PORTAL);
+      boot_stage = BOOT_BLE;
+      break;
+    case BOOT_BLE: {
+      const char *reason = ble_start_reason();
+      if (reason == nullptr) {
+        break;
+      }
+      Serial.printf("ble start: %s\n", reason);
+      xTaskCreatePinnedToCore(ble_start_task, "ble_init", 4096, nullptr, 1, nullptr, 0);
+      boot_stage = BOOT_DONE;
+      break;
+    }
+    case BOOT_DONE:
+      if (ble_ready.load(std::memory_order_acquire) && boot_ms.ble_ms == 0) {
+        boot_mark(boot_ms.ble_ms, TRACE_BOOT_BLE);
+        print_boot_milestones();
+      }
+      break;
+  }
+}
+
 void setup() {
   Serial.begin(115200);
-  // GPS on UART1 with selected RX/TX pins.
+  // GPS on UART1 with selected RX/TX pins. The larger RX buffer absorbs
+  // NMEA bursts while the radios come up.
+  GPS.setRxBufferSize(GPS_RX_BUFFER);
   GPS.begin(GPS_BAUD, SERIAL_8N1, PIN_GPS_RX, PIN_GPS_TX);
+  gnss_start_ms = millis();
   pinMode(PIN_STATUS_LED, OUTPUT);
   digitalWrite(PIN_STATUS_LED, LOW);
   // Open NVS namespace and restore last known metrics.
   prefs.begin("dogrgb", false);
   prefs_cfg.begin("dogrgb_cfg", false);
+  prefs_sim.begin("dogrgb_sim", false);
+  prefs_geo.begin("dogrgb_geo", false);
   load_metrics();
+  metrics_publish();
   load_config();
+  load_programs();
+  load_zones();
+  track_begin();
+  log_begin();
+  imu_begin();
   if (LED_UI_ENABLED) {
     led_begin();
+    update_led_ui();
   }
-  setup_wifi();
-  setup_http();
-  setup_ble();
   Serial.println("Dog-RGB ESP32-S3 GPS-first base firmware");
 }
 
 void loop() {
   const unsigned long now_ms = millis();
   read_gps();
+  boot_step();
 
   // Periodic persistence to avoid flash wear.
   if (now_ms - last_save_ms >= SAVE_INTERVAL_MS) {
@@ -1227,65 +6929,89 @@ void loop() {
     led_state = !led_state;
     digitalWrite(PIN_STATUS_LED, led_state ? HIGH : LOW);
 
-    const float avg_speed_kph = (active_time_ms > 0)
-                                    ? (total_distance_m / (active_time_ms / 1000.0f)) * 3.6f
-                                    : 0.0f;
+    const MetricsSnapshot s = metrics_pub.read();
     // Serial log for quick field diagnostics.
     Serial.print("heartbeat | gps_fix=");
-    Serial.print(has_gps_fix ? "1" : "0");
+    Serial.print(s.gps_fix ? "1" : "0");
     Serial.print(" | speed_kph=");
-    Serial.println(last_speed_kph, 2);
+    Serial.println(s.speed_kph, 2);
 
     Serial.print("distance_m=");
-    Serial.print(total_distance_m, 1);
+    Serial.print(s.distance_exact_m, 1);
     Serial.print(" avg_kph=");
-    Serial.print(avg_speed_kph, 2);
+    Serial.print(s.avg_speed_kph, 2);
     Serial.print(" max_kph=");
-    Serial.println(max_speed_kph, 2);
+    Serial.println(s.max_speed_kph, 2);
+
+    // The histogram changes at most once per GPS sample.
+    static uint32_t activity_version = 0;
+    if (ble_ready.load(std::memory_order_acquire) && metrics_pub.version() != activity_version) {
+      activity_version = metrics_pub.version();
+      uint8_t activity_payload[BLE_ACTIVITY_LEN];
+      build_activity_payload(activity_payload, sizeof(activity_payload));
+      activity_char->setValue(activity_payload, sizeof(activity_payload));
+    }
   }
 
-  if (summary_char != nullptr) {
-    uint8_t payload[16];
-    build_summary_payload(payload, sizeof(payload));
-    summary_char->setValue(payload, sizeof(payload));
+  // The summary characteristic is re-encoded only for a new metrics version.
+  static uint32_t summary_version = 0;
+  if (ble_ready.load(std::memory_order_acquire)) {
+    bulk_poll();
+    if (metrics_pub.version() != summary_version) {
+      summary_version = metrics_pub.version();
+      uint8_t payload[16];
+      build_summary_payload(payload, sizeof(payload));
+      summary_char->setValue(payload, sizeof(payload));
+    }
   }
 
-  if (now_ms - last_wifi_check_ms >= WIFI_RETRY_INTERVAL_MS) {
+  if (boot_stage > BOOT_WIFI && now_ms - last_wifi_check_ms >= WIFI_RETRY_INTERVAL_MS) {
     last_wifi_check_ms = now_ms;
     if (wifi_sta_connected && WiFi.status() != WL_CONNECTED) {
+      trace_event(TRACE_WIFI, TRACE_INSTANT, TRACE_WIFI_STA_LOST);
       wifi_sta_connected = false;
-      if (wifi_ssid.length() > 0) {
+      if (wifi_ssid[0] != '\0') {
         start_sta_mode();
       } else {
         start_ap_mode();
       }
     } else if (wifi_sta_connecting) {
       if (WiFi.status() == WL_CONNECTED) {
+        trace_event(TRACE_WIFI, TRACE_INSTANT, TRACE_WIFI_STA_UP);
         wifi_sta_connected = true;
         wifi_sta_connecting = false;
-        MDNS.begin(g_cfg.mdns.c_str());
+        MDNS.begin(g_cfg.mdns);
         WiFi.softAPdisconnect(true);
       } else if ((now_ms - wifi_sta_start_ms) >= STA_CONNECT_TIMEOUT_MS) {
+        trace_event(TRACE_WIFI, TRACE_INSTANT, TRACE_WIFI_STA_TIMEOUT);
         wifi_sta_connecting = false;
         start_ap_mode();
       }
-    } else if (!wifi_sta_connected && wifi_ssid.length() > 0) {
+    } else if (!wifi_sta_connected && wifi_ssid[0] != '\0') {
       start_sta_mode();
     }
   }
 
   if (pending_ap_restart && (now_ms - pending_ap_at_ms) >= AP_RESTART_DELAY_MS) {
     pending_ap_restart = false;
+    trace_event(TRACE_WIFI, TRACE_INSTANT, TRACE_WIFI_AP_RESTART);
     if (wifi_sta_connected) {
       WiFi.mode(WIFI_AP_STA);
     } else {
       WiFi.mode(WIFI_AP);
     }
-    WiFi.softAP(g_cfg.ap_ssid.c_str(), g_cfg.ap_pass.c_str());
+    WiFi.softAP(g_cfg.ap_ssid, g_cfg.ap_pass);
   }
 
+  upload_poll(now_ms);
+  sim_poll();
+  soak_poll();
+  imu_rec_poll();
   update_led_ui();
-  server.handleClient();
+  if (boot_ms.portal_ms != 0) {
+    server.handleClient();
+  }
+  read_serial_commands();
 
   // Placeholder for GPS-based LED mapping and patterns.
 }
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Assemble a Dog-RGB user effect program and optionally upload it.
+
+One instruction per line, `;` starts a comment, `name:` defines a label.
+Registers are r0-r15; on entry to every pixel r0 = index, r1 = count,
+r2 = effect time (ms), r3 = speed, r4 = intensity, r5 = index * 256 / count
+and r13-r15 = the pixel's current r/g/b. r6-r12 carry from pixel to pixel.
+
+  ldi d, imm16        mov d, a            add/sub/mul/div/mod d, a, b
+  and/or/xor d, a, b  shl/shr d, a, b     min/max/slt d, a, b
+  sin d, a            rnd d               jz r, label   jmp label
+  rgb r, g, b         pal i               hue i         scale v      end
+
+Jumps go forward only. The opcode table matches FxOp in src/main.cpp and
+the assembler on the /effects page.
+
+Usage:
+  python3 tools/fxasm.py wave.fxa
+  python3 tools/fxasm.py wave.fxa --upload http://192.168.4.1 --slot 0 --name wave
+"""
+
+import argparse
+import json
+import re
+import sys
+import urllib.request
+
+OPS = [
+    "end", "ldi", "mov", "add", "sub", "mul", "div", "mod", "and", "or",
+    "xor", "shl", "shr", "min", "max", "sin", "rnd", "slt", "jz", "jmp",
+    "rgb", "pal", "hue", "scale",
+]
+
+MAX_OPS = 64
+
+
+def assemble(text):
+    lines = []
+    labels = {}
+    for number, raw in enumerate(text.splitlines(), 1):
+        line = raw.split(";", 1)[0].strip()
+        m = re.match(r"^(\w+):\s*(.*)$", line)
+        if m:
+            labels[m.group(1)] = len(lines)
+            line = m.group(2)
+        if line:
+            lines.append((number, line))
+
+    out = bytearray()
+    for pc, (number, line) in enumerate(lines):
+        def fail(what):
+            sys.exit("line %d: %s" % (number, what))
+
+        def reg(s):
+            m = re.match(r"^r(\d+)$", s or "", re.I)
+            if not m or int(m.group(1)) > 15:
+                fail("bad register %r" % s)
+            return int(m.group(1))
+
+        tokens = re.split(r"[\s,]+", line)
+        name = tokens[0].lower()
+        if name not in OPS:
+            fail("unknown op %r" % tokens[0])
+        op = OPS.index(name)
+        args = tokens[1:]
+        if name == "ldi":
+            if len(args) != 2:
+                fail("ldi needs a register and a value")
+            value = int(args[1], 0)
+            if not -32768 <= value <= 32767:
+                fail("value out of range")
+            ins = [op, reg(args[0]), value & 0xFF, (value >> 8) & 0xFF]
+        elif name in ("jz", "jmp"):
+            label = args[-1] if args else None
+            if label not in labels:
+                fail("unknown label %r" % label)
+            skip = labels[label] - pc - 1
+            if not 0 <= skip <= 255:
+                fail("jumps must go forward")
+            ins = [op, reg(args[0]) if name == "jz" else 0, skip, 0]
+        else:
+            ins = [op, 0, 0, 0]
+            for i, s in enumerate(args[:3]):
+                ins[i + 1] = reg(s)
+        out += bytes(ins)
+    if len(out) > MAX_OPS * 4:
+        sys.exit("more than %d instructions" % MAX_OPS)
+    return bytes(out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("source", help="program source file")
+    ap.add_argument("--upload", metavar="URL", help="portal base URL, e.g. http://192.168.4.1")
+    ap.add_argument("--slot", type=int, default=0, help="program slot 0-3 (effect id 12 + slot)")
+    ap.add_argument("--name", default="")
+    args = ap.parse_args()
+
+    with open(args.source) as f:
+        code = assemble(f.read()).hex()
+    print(code)
+    if args.upload:
+        body = json.dumps({"slot": args.slot, "name": args.name, "code": code}).encode()
+        req = urllib.request.Request(args.upload.rstrip("/") + "/api/effects/programs", data=body,
+                                     headers={"Content-Type": "application/json"})
+        try:
+            with urllib.request.urlopen(req, timeout=5) as r:
+                print(r.read().decode())
+        except urllib.error.HTTPError as e:
+            sys.exit(e.read().decode())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Download the Dog-RGB fix log (GET /api/log), resuming a partial file.
+
+If the output file already exists, only the missing bytes are requested
+with a Range header. The ETag of the first download is kept next to the
+file (<out>.etag) and sent as If-Range, so if the ring has erased the
+start of the log since then the device sends the whole log again and the
+file is rewritten. Prints bytes, time and throughput.
+
+Records are 16 bytes, little-endian: unix time (u32), lat and lon in 1e-7
+degrees (i32 each), speed in cm/s (u16), flags (u8, bit 0 = moving) and
+the XOR of the first 15 bytes. --csv decodes the file after the download.
+
+Usage:
+  python3 tools/log_fetch.py http://192.168.4.1 fixes.bin
+  python3 tools/log_fetch.py http://192.168.4.1 fixes.bin --csv > fixes.csv
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+import urllib.error
+import urllib.request
+
+RECORD = struct.Struct("<IiiHBB")
+
+
+def fetch(base, path):
+    etag_path = path + ".etag"
+    have = os.path.getsize(path) if os.path.exists(path) else 0
+    headers = {}
+    if have > 0 and os.path.exists(etag_path):
+        with open(etag_path) as f:
+            headers["Range"] = "bytes=%d-" % have
+            headers["If-Range"] = f.read().strip()
+    req = urllib.request.Request(base.rstrip("/") + "/api/log", headers=headers)
+    start = time.time()
+    try:
+        r = urllib.request.urlopen(req, timeout=10)
+    except urllib.error.HTTPError as e:
+        if e.code == 416:
+            print("up to date (%d bytes)" % have, file=sys.stderr)
+            return
+        sys.exit("HTTP %d: %s" % (e.code, e.read().decode(errors="replace")))
+    mode = "ab" if r.status == 206 else "wb"
+    got = 0
+    with r, open(path, mode) as f:
+        while True:
+            chunk = r.read(16384)
+            if not chunk:
+                break
+            f.write(chunk)
+            got += len(chunk)
+    with open(etag_path, "w") as f:
+        f.write(r.headers.get("ETag", ""))
+    secs = max(time.time() - start, 1e-6)
+    print("%s %d bytes in %.2f s, %.1f KiB/s" % ("resumed" if mode == "ab" else "full", got, secs,
+                                                 got / 1024.0 / secs), file=sys.stderr)
+
+
+def dump_csv(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    print("unix_s,lat,lon,speed_kph,moving")
+    bad = 0
+    for off in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        rec = data[off:off + RECORD.size]
+        check = 0
+        for b in rec[:15]:
+            check ^= b
+        unix_s, lat, lon, speed, flags, stored = RECORD.unpack(rec)
+        if check != stored:
+            bad += 1
+            continue
+        print("%d,%.7f,%.7f,%.2f,%d" % (unix_s, lat / 1e7, lon / 1e7, speed * 0.036, flags & 1))
+    if bad:
+        print("%d records failed the check byte" % bad, file=sys.stderr)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("url", help="portal base URL, e.g. http://192.168.4.1")
+    ap.add_argument("out", help="output file (resumed if it exists)")
+    ap.add_argument("--csv", action="store_true", help="print the records as CSV")
+    args = ap.parse_args()
+    fetch(args.url, args.out)
+    if args.csv:
+        dump_csv(args.out)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Replay NMEA into a running Dog-RGB board faster than real time.
+
+The board switches to replay mode (`replay on`), drops its own GNSS UART
+bytes and takes RMC sentences from the serial console (`nmea <sentence>`).
+Metrics are sampled on the fix timestamps, so an hour of track replays in
+seconds and still adds up to an hour of activity.
+
+Input is an NMEA log, or --synth N to generate N days of 1 Hz fixes
+walking/running around a point. A serial capture that also holds IMU FIFO
+lines (from `imu rec`) replays both streams in their recorded order.
+
+Usage:
+  python3 tools/nmea_replay.py /dev/ttyACM0 track.nmea
+  python3 tools/nmea_replay.py /dev/ttyACM0 --synth 2 --rate 2000
+
+Requires pyserial. Run tools/portal_load.py at the same time to measure
+the portal and LED frame deadline under GNSS load.
+"""
+
+import argparse
+import datetime
+import math
+import sys
+import time
+
+import serial  # pyserial
+
+
+def checksum(body):
+    c = 0
+    for ch in body.encode("ascii"):
+        c ^= ch
+    return "%02X" % c
+
+
+def rmc(t, lat, lon, knots):
+    def dm(v, width):
+        v = abs(v)
+        deg = int(v)
+        return "%0*d%07.4f" % (width, deg, (v - deg) * 60.0)
+
+    body = "GNRMC,%s.00,A,%s,%s,%s,%s,%.1f,0.0,%s,,,A" % (
+        t.strftime("%H%M%S"),
+        dm(lat, 2), "S" if lat < 0 else "N",
+        dm(lon, 3), "W" if lon < 0 else "E",
+        knots, t.strftime("%d%m%y"))
+    return "$%s*%s" % (body, checksum(body))
+
+
+def synth(days, start):
+    # Mostly resting, with a walk and a run every few hours.
+    lat, lon = -34.6, -58.4
+    heading = 0.0
+    for s in range(days * 86400):
+        t = start + datetime.timedelta(seconds=s)
+        phase = (s // 600) % 18
+        kph = 0.0 if phase > 3 else (5.0 if phase < 3 else 14.0)
+        heading += 0.02
+        step = kph / 3.6 / 111320.0
+        lat += step * math.cos(heading)
+        lon += step * math.sin(heading) / math.cos(math.radians(lat))
+        yield rmc(t, lat, lon, kph / 1.852)
+
+
+def from_file(path):
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if line[3:6] == "RMC" or line.startswith("IMU "):
+                yield line
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("port")
+    ap.add_argument("nmea", nargs="?")
+    ap.add_argument("--synth", type=int, metavar="DAYS")
+    ap.add_argument("--rate", type=float, default=500.0, help="sentences per second (default 500)")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+    if bool(args.nmea) == bool(args.synth):
+        sys.exit("give an NMEA file or --synth DAYS")
+
+    lines = synth(args.synth, datetime.datetime(2026, 1, 1)) if args.synth else from_file(args.nmea)
+    port = serial.Serial(args.port, args.baud, timeout=0)
+    port.write(b"replay on\n")
+    period = 1.0 / args.rate
+    sent = 0
+    t0 = time.monotonic()
+    try:
+        for line in lines:
+            cmd = line if line.startswith("IMU ") else "nmea " + line
+            port.write((cmd + "\n").encode("ascii"))
+            port.read(port.in_waiting or 1)
+            sent += 1
+            lag = t0 + sent * period - time.monotonic()
+            if lag > 0:
+                time.sleep(lag)
+            if sent % 3600 == 0:
+                rate = sent / (time.monotonic() - t0)
+                sys.stderr.write("%d sentences (%.0f/s, %.0fx real time)\n" % (sent, rate, rate))
+    finally:
+        port.write(b"replay off\n")
+        port.close()
+    print("sent %d sentences in %.1f s" % (sent, time.monotonic() - t0))
+
+
+if __name__ == "__main__":
+    main()
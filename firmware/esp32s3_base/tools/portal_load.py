@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Load-test the Dog-RGB portal and report latency and LED frame deadline.
+
+Issues GET /api/summary and GET /api/config back to back for --duration
+seconds, then prints p50/p95/p99/max latency per endpoint and the LED
+frame counters from GET /api/status (frames started more than two
+LED_UPDATE_MS periods apart count as late). Exits non-zero when any
+request failed or --max-late is exceeded, so it can gate a bench run.
+
+--bootstrap N instead times a cold page load N times: the root page with
+its inlined state (one request) against the page plus a separate
+GET /api/summary (two connections, the old flow), each on a new TCP
+connection, and fails if the p95 one-request load is over 2 s.
+
+Usage:
+  python3 tools/portal_load.py http://192.168.4.1 --duration 60
+  python3 tools/portal_load.py http://192.168.4.1 --bootstrap 50
+"""
+
+import argparse
+import json
+import sys
+import time
+import urllib.request
+
+ENDPOINTS = ["/api/summary", "/api/config"]
+
+
+def get(url, timeout):
+    t0 = time.perf_counter()
+    with urllib.request.urlopen(url, timeout=timeout) as r:
+        body = r.read()
+    return (time.perf_counter() - t0) * 1000.0, body
+
+
+def pct(sorted_ms, p):
+    if not sorted_ms:
+        return 0.0
+    return sorted_ms[min(len(sorted_ms) - 1, int(len(sorted_ms) * p / 100.0))]
+
+
+def bootstrap(base, n, timeout):
+    one, two = [], []
+    for _ in range(n):
+        ms, page = get(base + "/", timeout)
+        if b"var S={" not in page:
+            sys.exit("root page has no inlined state")
+        one.append(ms)
+        ms, _ = get(base + "/", timeout)
+        extra, body = get(base + "/api/summary", timeout)
+        json.loads(body)
+        two.append(ms + extra)
+    _, body = get(base + "/api/status", timeout)
+    portal = json.loads(body)["portal"]
+    print("%-22s %6s %8s %8s %8s" % ("first paint", "n", "p50", "p95", "max"))
+    for name, s in (("inline (1 request)", sorted(one)), ("page + summary (2)", sorted(two))):
+        print("%-22s %6d %8.1f %8.1f %8.1f" % (name, len(s), pct(s, 50), pct(s, 95), s[-1]))
+    print("server root_us=%d config_us=%d" % (portal["root_us"], portal["config_us"]))
+    if pct(sorted(one), 95) > 2000.0:
+        sys.exit(1)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("base", help="portal base URL, e.g. http://192.168.4.1")
+    ap.add_argument("--duration", type=float, default=30.0)
+    ap.add_argument("--timeout", type=float, default=5.0)
+    ap.add_argument("--max-late", type=int, default=0, help="allowed late LED frames")
+    ap.add_argument("--bootstrap", type=int, metavar="N", help="time N cold root page loads instead")
+    args = ap.parse_args()
+    base = args.base.rstrip("/")
+    if args.bootstrap:
+        bootstrap(base, args.bootstrap, args.timeout)
+        return
+
+    _, body = get(base + "/api/status", args.timeout)
+    led0 = json.loads(body)["led"]
+    samples = {e: [] for e in ENDPOINTS}
+    errors = 0
+    end = time.monotonic() + args.duration
+    while time.monotonic() < end:
+        for e in ENDPOINTS:
+            try:
+                ms, body = get(base + e, args.timeout)
+                json.loads(body)
+                samples[e].append(ms)
+            except Exception as exc:  # timeout, reset, truncated JSON
+                errors += 1
+                sys.stderr.write("%s: %s\n" % (e, exc))
+    _, body = get(base + "/api/status", args.timeout)
+    led = json.loads(body)["led"]
+
+    print("%-14s %6s %8s %8s %8s %8s" % ("endpoint", "n", "p50", "p95", "p99", "max"))
+    for e in ENDPOINTS:
+        s = sorted(samples[e])
+        print("%-14s %6d %8.1f %8.1f %8.1f %8.1f" % (
+            e, len(s), pct(s, 50), pct(s, 95), pct(s, 99), s[-1] if s else 0.0))
+    late = led["late"] - led0["late"]
+    print("led frames=%d late=%d max_gap_ms=%d max_frame_us=%d errors=%d" % (
+        led["frames"] - led0["frames"], late, led["max_gap_ms"], led["max_frame_us"], errors))
+    if errors or late > args.max_late:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Convert a Dog-RGB trace dump to Chrome/Perfetto trace JSON.
+
+Input is either the binary body of GET /api/trace or a serial log that
+contains the output of the `trace` console command (TRACE BEGIN/END block).
+
+Usage:
+  curl -o trace.bin http://192.168.4.1/api/trace
+  python3 tools/trace2chrome.py trace.bin > trace.json
+  python3 tools/trace2chrome.py serial.log > trace.json
+
+Open the JSON in https://ui.perfetto.dev or chrome://tracing.
+"""
+
+import json
+import struct
+import sys
+
+HEADER = struct.Struct("<4sBBHII")
+EVENT = struct.Struct("<IBBH")
+
+NAMES = {
+    1: "gps_parse",
+    2: "effect_render",
+    3: "led_show",
+    4: "http",
+    5: "nvs_commit",
+    6: "wifi",
+    7: "boot",
+}
+
+# Effect ids match apply_effect() in src/main.cpp.
+EFFECTS = [
+    "SOLID", "PULSE", "BREATH", "CHASE", "COMET", "SINELON",
+    "CONFETTI", "JUGGLE", "BPM", "RAINBOW", "FIRE", "GRADIENT_WAVE",
+]
+
+WIFI = ["ap", "sta_start", "sta_up", "sta_lost", "sta_timeout", "ap_restart"]
+
+NVS = ["metrics", "wifi_creds", "config", "zones", "programs", "upload", "log"]
+
+BOOT = ["first_frame", "first_nmea", "wifi", "portal", "ble", "first_fix"]
+
+PHASES = {0: "B", 1: "E", 2: "i"}
+
+
+def read_dump(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] == b"DTRC":
+        return data
+    # Serial capture: concatenate the hex lines of the last TRACE block.
+    out = None
+    for raw in data.decode("utf-8", "replace").splitlines():
+        line = raw.strip()
+        if line == "TRACE BEGIN":
+            out = bytearray()
+        elif line == "TRACE END":
+            if out is not None:
+                return bytes(out)
+        elif out is not None and line.startswith("TRACE "):
+            out += bytes.fromhex(line[6:])
+    sys.exit("no trace dump found in %s" % path)
+
+
+def label(event_id, arg):
+    name = NAMES.get(event_id, "event_%d" % event_id)
+    if event_id == 2 and arg < len(EFFECTS):
+        return "%s:%s" % (name, EFFECTS[arg])
+    if event_id == 2:
+        # User programs: effect id 12 + slot.
+        return "%s:FX%d" % (name, arg - len(EFFECTS))
+    if event_id == 6 and arg < len(WIFI):
+        return "%s:%s" % (name, WIFI[arg])
+    if event_id == 7 and arg < len(BOOT):
+        return "%s:%s" % (name, BOOT[arg])
+    if event_id == 5 and arg < len(NVS):
+        return "%s:%s" % (name, NVS[arg])
+    if event_id == 4:
+        # Route index in setup_http() registration order.
+        return "%s:route%d" % (name, arg)
+    return name
+
+
+def convert(data):
+    magic, version, event_size, cpu_mhz, count, dropped = HEADER.unpack_from(data, 0)
+    if magic != b"DTRC" or version != 1 or event_size != EVENT.size:
+        sys.exit("unsupported trace dump (version %d, event size %d)" % (version, event_size))
+    events = []
+    # The cycle counter wraps every 2^32 cycles (~17.9 s at 240 MHz); unwrap
+    # assuming consecutive events are closer than one wrap period.
+    prev = None
+    elapsed = 0
+    for i in range(count):
+        cycles, event_id, phase, arg = EVENT.unpack_from(data, HEADER.size + i * EVENT.size)
+        if prev is not None:
+            elapsed += (cycles - prev) & 0xFFFFFFFF
+        prev = cycles
+        name = label(event_id, arg)
+        ev = {
+            "name": name,
+            "cat": NAMES.get(event_id, "event"),
+            "ph": PHASES.get(phase, "i"),
+            "ts": elapsed / float(cpu_mhz),
+            "pid": 1,
+            "tid": 1,
+        }
+        if ev["ph"] == "i":
+            ev["s"] = "t"
+        else:
+            ev["args"] = {"arg": arg}
+        events.append(ev)
+    return {
+        "traceEvents": events,
+        "displayTimeUnit": "ms",
+        "otherData": {"cpu_mhz": cpu_mhz, "events": count, "dropped": dropped},
+    }
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: trace2chrome.py <trace.bin|serial.log>")
+    json.dump(convert(read_dump(sys.argv[1])), sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Stand-in home server for the Dog-RGB upload (upload.url in /api/config).
+
+Accepts the batches the collar POSTs, decodes them and appends days and
+fixes as CSV lines to <out>-days.csv / <out>-fixes.csv. Days at or before
+the last date stored, and fixes at or before the last record number
+stored (a batch repeated after a lost reply), are counted as duplicates
+and dropped. A fix batch's cursor is the record number of its first fix
+since the collar's log was formatted, so fixes are matched by position,
+not by time, which can step back. --fail-rate and --delay make it answer
+503 or reply slowly, to exercise the retry backoff and to check that LED
+frames stay on time (GET /api/status "led").
+
+Usage:
+  python3 tools/upload_server.py --port 8080 --out dog
+  # on the collar: upload.url = http://<pc-ip>:8080/dogrgb
+"""
+
+import argparse
+import http.server
+import random
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("<4sBBHI")
+DAY = struct.Struct("<IIHHHB")
+FIX = struct.Struct("<IiiHBB")
+
+
+def varint(data, pos):
+    value = shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if b < 0x80:
+            return value, pos
+
+
+def zigzag(data, pos):
+    value, pos = varint(data, pos)
+    return (value >> 1) ^ -(value & 1), pos
+
+
+def decode(body):
+    """Return (kind, previous cursor, records) of one batch."""
+    magic, version, kind, count, cursor = HEADER.unpack_from(body, 0)
+    if magic != b"DRUP" or version != 2:
+        raise ValueError("not a batch")
+    pos = HEADER.size
+    records = []
+    if kind == 1:
+        for _ in range(count):
+            date, dist_m, avg, mx, upd, flags = DAY.unpack_from(body, pos)
+            records.append((date, dist_m, avg * 0.036, mx * 0.036, upd, flags))
+            pos += 16
+    elif kind == 2:
+        if count:
+            t, lat, lon, speed, flags, _ = FIX.unpack_from(body, pos)
+            pos += FIX.size
+            records.append((t, lat, lon, speed, flags))
+        for _ in range(count - 1):
+            dt, pos = zigzag(body, pos)
+            dlat, pos = zigzag(body, pos)
+            dlon, pos = zigzag(body, pos)
+            dspeed, pos = zigzag(body, pos)
+            flags = body[pos]
+            pos += 1
+            t, lat, lon, speed = t + dt, lat + dlat, lon + dlon, speed + dspeed
+            records.append((t, lat, lon, speed, flags))
+    else:
+        raise ValueError("unknown kind %d" % kind)
+    if pos != len(body):
+        raise ValueError("%d trailing bytes" % (len(body) - pos))
+    return kind, cursor, records
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    last = {1: 0, 2: -1}
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        if self.server.delay:
+            time.sleep(self.server.delay)
+        if random.random() < self.server.fail_rate:
+            self.send_response(503)
+            self.end_headers()
+            print("503 (simulated), %d bytes dropped" % len(body))
+            return
+        try:
+            kind, cursor, records = decode(body)
+        except (ValueError, IndexError, struct.error) as e:
+            self.send_response(400)
+            self.end_headers()
+            print("bad batch: %s" % e)
+            return
+        # Days are keyed by date, fixes by record number (cursor + index).
+        keys = [r[0] for r in records] if kind == 1 else list(range(cursor, cursor + len(records)))
+        fresh = [r for k, r in zip(keys, records) if k > Handler.last[kind]]
+        name = "days" if kind == 1 else "fixes"
+        with open("%s-%s.csv" % (self.server.out, name), "a") as f:
+            for r in fresh:
+                if kind == 1:
+                    f.write("%d,%d,%.2f,%.2f,%d,%d\n" % r)
+                else:
+                    f.write("%d,%.7f,%.7f,%.2f,%d\n" % (r[0], r[1] / 1e7, r[2] / 1e7, r[3] * 0.036, r[4] & 1))
+        if fresh:
+            Handler.last[kind] = keys[-1]
+        print("%s %s: %d bytes, %d records (%.1f B/record), %d duplicates, cursor %d" % (
+            self.headers.get("X-Device", "?"), name, len(body), len(records),
+            (len(body) - HEADER.size) / max(len(records), 1), len(records) - len(fresh), cursor))
+        self.send_response(200)
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--port", type=int, default=8080)
+    ap.add_argument("--out", default="dog", help="CSV file prefix")
+    ap.add_argument("--fail-rate", type=float, default=0.0, help="fraction of batches answered 503")
+    ap.add_argument("--delay", type=float, default=0.0, help="seconds to wait before replying")
+    args = ap.parse_args()
+    server = http.server.HTTPServer(("", args.port), Handler)
+    server.out = args.out
+    server.fail_rate = args.fail_rate
+    server.delay = args.delay
+    print("listening on :%d" % args.port, file=sys.stderr)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()